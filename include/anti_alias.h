@@ -0,0 +1,53 @@
+#ifndef ANTI_ALIAS_H
+#define ANTI_ALIAS_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "colour.h"
+#include "parameters.h"
+
+
+/* Subsamples plotted for the edge pixels of a batch at a time */
+#define ANTI_ALIAS_BATCH_LEN 256
+
+
+/* Pixels of a block whose colour differs sharply from a neighbour's, found once
+ * the block is plotted. Each is plotted again at jittered points on a grid
+ * across its area, and given the mean colour of the points. The first and last
+ * rows are compared with the rows either side of the block as plotted, so the
+ * edges found do not depend on where the image is split into blocks
+ */
+typedef struct AntiAlias
+{
+    unsigned int grid;          /* Points taken along each side of an edge pixel */
+    size_t width;               /* Pixels in a row */
+    size_t rows;                /* Rows the map has room for */
+    size_t stride;              /* Bytes of each row of the map */
+    unsigned char *edges;       /* Bit map of the edge pixels of the block */
+    size_t rowSize;             /* Bytes of each row of the image */
+    unsigned char *halo;        /* Last row of the block before, then first row of the block after */
+    size_t kept;                /* Image row following the last row kept, or 0 if none is kept */
+    const unsigned char *above; /* Row before the block compared with (if any) */
+    const unsigned char *below; /* Row after the block compared with (if any) */
+} AntiAlias;
+
+
+extern const unsigned int ANTI_ALIAS_GRID_MIN;
+extern const unsigned int ANTI_ALIAS_GRID_MAX;
+extern const unsigned int ANTI_ALIAS_GRID_DEFAULT;
+
+
+AntiAlias * createAntiAlias(void);
+int initialiseAntiAlias(AntiAlias *aa, const PlotCTX *p, unsigned int grid, size_t rows);
+void * findEdges(void *threadInfo);
+void keepRow(AntiAlias *aa, const char *row, size_t next);
+bool isEdgePixel(const AntiAlias *aa, size_t x, size_t y);
+unsigned int getSampleCount(const AntiAlias *aa);
+void getSampleOffset(double *dx, double *dy, const AntiAlias *aa, size_t x, size_t y, unsigned int sample);
+void blendSamples(char *px, const RGB *samples, const AntiAlias *aa, BitDepth depth);
+void freeAntiAlias(AntiAlias *aa);
+
+
+#endif
\ No newline at end of file
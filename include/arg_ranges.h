@@ -35,6 +35,9 @@ extern const long double MAGNIFICATION_MAX_EXT;
 extern const unsigned long ITERATIONS_MIN;
 extern const unsigned long ITERATIONS_MAX;
 
+extern const unsigned int DEGREE_MIN;
+extern const unsigned int DEGREE_MAX;
+
 extern const size_t WIDTH_MIN;
 extern const size_t WIDTH_MAX;
 extern const size_t HEIGHT_MIN;
@@ -46,10 +49,23 @@ extern const uint16_t PORT_MAX;
 extern const int WORKERS_MIN;
 extern const int WORKERS_MAX;
 
+extern const unsigned int IO_THREADS_MIN;
+extern const unsigned int IO_THREADS_MAX;
+
+extern const unsigned int HEARTBEAT_MIN;
+extern const unsigned int HEARTBEAT_MAX;
+extern const unsigned int RETRY_MIN;
+extern const unsigned int RETRY_MAX;
+
+extern const size_t UNIT_ROWS_MIN;
+extern const size_t UNIT_ROWS_MAX;
+extern const unsigned int UNIT_DEPTH_MIN;
+extern const unsigned int UNIT_DEPTH_MAX;
+
 #ifdef MP_PREC
-const mpfr_prec_t MP_BITS_DEFAULT;
-const mpfr_prec_t MP_BITS_MIN;
-const mpfr_prec_t MP_BITS_MAX;
+extern const mpfr_prec_t MP_BITS_DEFAULT;
+extern const mpfr_prec_t MP_BITS_MIN;
+extern const mpfr_prec_t MP_BITS_MAX;
 
 
 void initialiseArgRangesMP(void);
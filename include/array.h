@@ -7,13 +7,19 @@
 
 #include <pthread.h>
 
+#include "anti_alias.h"
+#include "frame_reuse.h"
+#include "gpu.h"
+#include "numa.h"
 #include "parameters.h"
+#include "perturbation.h"
+#include "stats.h"
 
 
 typedef struct Block
 {
     size_t id;                 /* ID of block (also used as row number) */
-    unsigned int bCount;       /* Number of blocks in image */
+    size_t bCount;             /* Number of blocks in image */
     PlotCTX *parameters;       /* Image parameters */
     size_t rows;               /* Number of rows in each block */
     size_t remainderRows;      /* Number of rows in the remainder block */
@@ -22,15 +28,66 @@ typedef struct Block
     size_t rowSize;            /* Size of each row */
     size_t blockSize;          /* Size of full-size block */
     size_t remainderBlockSize; /* Size of remainder block */
+    size_t tileWidth;          /* Number of columns in each unit of work */
+    size_t tileHeight;         /* Number of rows in each unit of work */
+    bool subdivide;            /* Whether tiles are plotted by subdivision */
+    size_t mirrorStart;        /* Rows [mirrorStart, mirrorEnd) are copied from their image, not plotted */
+    size_t mirrorEnd;
+    ReferenceOrbit *orbit;     /* Orbit pixels are perturbed from (if any) */
+    FrameReuse *reuse;         /* Pixels kept of the last frame of a sequence (if any) */
+    AntiAlias *antiAlias;      /* Edge pixels to be supersampled once plotted (if any) */
     char *array;               /* Full-size block array */
+    char *map;                 /* Mapping of the image file the array lies in (if any) */
+    size_t mapSize;            /* Length of the mapping */
+    bool hugePages;            /* Whether the array is to be backed by huge pages */
+    size_t arrayMapSize;       /* Length of the array's anonymous mapping (0 if on the heap) */
 } Block;
 
+typedef struct WorkItem
+{
+    void * (*function)(void *);     /* Function each thread runs on the block */
+    Block *block;                   /* Block to work on */
+    unsigned int remaining;         /* Number of threads yet to finish the item */
+    size_t claimed[NUMA_NODES_MAX]; /* Next tile of each node's share of the block to be claimed */
+    size_t end[NUMA_NODES_MAX];     /* End of each node's share of the tiles */
+} WorkItem;
+
+#define THREAD_POOL_QUEUE_LEN 4
+
+typedef struct ThreadPool
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t queued;                    /* Signalled when an item is queued */
+    pthread_cond_t completed;                 /* Signalled when an item completes */
+    WorkItem queue[THREAD_POOL_QUEUE_LEN];    /* Circular queue of work items */
+    size_t head;                              /* Sequence number of next item queued */
+    size_t tail;                              /* Sequence number of oldest uncompleted item */
+    unsigned int running;                     /* Number of pool threads started */
+    bool shutdown;                            /* Whether threads should exit */
+    unsigned int nodes;                       /* Number of NUMA nodes the threads are pinned across */
+    unsigned int nodeThreads[NUMA_NODES_MAX]; /* Number of threads on each node */
+} ThreadPool;
+
 typedef struct Thread
 {
     pthread_t pid;
     unsigned int tid;
     unsigned int tCount;
     Block *block;
+    ThreadPool *pool;          /* Pool shared by every thread in the list */
+    size_t item;               /* Sequence number of next work item to run */
+    ThreadStats stats;         /* Work done by the thread */
+    unsigned int node;         /* NUMA node the thread is pinned to (0 if not pinned) */
+    unsigned int nodeRank;     /* Index of the thread among those on its node */
+
+    #ifdef MP_PREC
+    ScratchMP *scratch;        /* Multiple-precision variables (created on first use) */
+    #endif
+
+    #ifdef OPENCL
+    GPU *gpu;                  /* Device the thread plots on, rather than the processor (if any) */
+    #endif
+
 } Thread;
 
 
@@ -38,11 +95,29 @@ extern const unsigned int FREE_MEMORY_ALLOCATION;
 
 
 Block * createBlock(void);
-int initialiseBlock(Block *block, PlotCTX *p, size_t mem);
+int initialiseBlock(Block *block, PlotCTX *p, size_t mem, unsigned int buffers, size_t reserve);
 int initialiseBlockAsRow(Block *block, PlotCTX *p);
+int initialiseBlockAsMap(Block *block, PlotCTX *p);
+int initialiseBlockBuffer(Block *block, const Block *src);
+void setBlockTiles(Block *block, size_t width, size_t height);
+size_t getBlockTileCount(const Block *block);
 Thread * createThreads(Block *block, unsigned int n);
 
+#ifdef OPENCL
+Thread * createThreadsGPU(Block *block, unsigned int n, GPU *gpu);
+#endif
+
+int pinThreads(Thread *threads, AffinityPolicy policy);
+void resetThreadStats(Thread *threads);
+
+int queueThreads(Thread *threads, void * (*function)(void *), Block *block);
+void waitThreads(Thread *threads);
+int runThreads(Thread *threads, void * (*function)(void *), Block *block);
+int claimTile(Thread *t, size_t *tile);
+int touchBlock(Thread *threads, Block *block);
+
 void freeBlock(Block *block);
+void freeBlockBuffer(Block *block);
 void freeThreads(Thread *threads);
 
 
@@ -0,0 +1,45 @@
+#ifndef BLOCK_WRITER_H
+#define BLOCK_WRITER_H
+
+
+#include <stdbool.h>
+
+#include <pthread.h>
+
+#include "array.h"
+#include "checkpoint.h"
+#include "png.h"
+#include "pyramid.h"
+
+
+/* Number of block arrays needed to compute one block while writing another */
+#define BLOCK_WRITER_BUFFERS 2
+
+
+/* Thread that writes finished blocks to the image file, so that the next
+ * block can be filled in the meantime
+ */
+typedef struct BlockWriter
+{
+    pthread_t pid;
+    pthread_mutex_t mutex;
+    pthread_cond_t queued;  /* Signalled when a block is queued */
+    pthread_cond_t written; /* Signalled when the queued block has been written */
+    const Block *block;     /* Block queued or being written (if any) */
+    Checkpoint *checkpoint; /* Checkpoint updated as each block is written (if any) */
+    PNGEncoder *png;        /* Encoder the rows of a PNG image are written through */
+    Pyramid *pyramid;       /* Tile pyramid the rows are cut into */
+    bool running;           /* Whether the writer thread has been started */
+    bool shutdown;          /* Whether the writer thread should exit */
+    int error;              /* Set once any write has failed */
+} BlockWriter;
+
+
+BlockWriter * createBlockWriter(void);
+int initialiseBlockWriter(BlockWriter *writer, Checkpoint *checkpoint, PNGEncoder *png, Pyramid *pyramid);
+int queueBlockWrite(BlockWriter *writer, const Block *block);
+int waitBlockWriter(BlockWriter *writer);
+void freeBlockWriter(BlockWriter *writer);
+
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+
+#include "array.h"
+#include "parameters.h"
+
+
+/* Appended to the image's path to give the path of its checkpoint */
+#define CHECKPOINT_EXTENSION ".checkpoint"
+
+#define CHECKPOINT_FILEPATH_LEN_MAX (PLOT_FILEPATH_LEN_MAX + sizeof(CHECKPOINT_EXTENSION))
+
+
+/* Progress of a plot through its image file, kept in a file beside the image
+ * so an interrupted plot can be resumed. Blocks are written in order, so the
+ * rows written are always those from the top of the image
+ */
+typedef struct Checkpoint
+{
+    char filepath[CHECKPOINT_FILEPATH_LEN_MAX]; /* Path of the checkpoint file */
+    uint64_t hash;                              /* Hash of the plot parameters */
+    off_t offset;                               /* Position of the first row in the image file */
+    size_t rows;                                /* Rows wholly written to the image file */
+} Checkpoint;
+
+
+Checkpoint * createCheckpoint(void);
+int initialiseCheckpoint(Checkpoint *c, const PlotCTX *p);
+int readCheckpoint(Checkpoint *c);
+int updateCheckpoint(Checkpoint *c, const Block *block);
+int removeCheckpoint(const Checkpoint *c);
+void freeCheckpoint(Checkpoint *c);
+
+
+#endif
\ No newline at end of file
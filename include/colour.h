@@ -37,7 +37,8 @@ typedef enum BitDepth
     BIT_DEPTH_ASCII = 0,
     BIT_DEPTH_1 = 1,
     BIT_DEPTH_8 = 8,
-    BIT_DEPTH_24 = 24
+    BIT_DEPTH_24 = 24,
+    BIT_DEPTH_ITERATIONS = 32 /* Smoothed iteration values, coloured later by mapIterationRow() */
 } BitDepth;
 
 typedef struct ColourRGB
@@ -50,6 +51,22 @@ typedef struct ColourHSV
     double h, s, v;
 } HSV;
 
+/* Number of colours in a palette lookup table, covering one period of the
+ * scheme. Must be a power of two
+ */
+#define COLOUR_PALETTE_LEN 4096
+
+/* Colours of a scheme precomputed over one period of smoothed iteration
+ * values, so pixels are coloured by table lookup. Greyscale palettes hold
+ * their shade in every channel
+ */
+typedef struct ColourPalette
+{
+    double scale;                       /* Palette entries per smoothed iteration */
+    RGB unescaped;                      /* Colour of points inside the set */
+    RGB colours[COLOUR_PALETTE_LEN];    /* Colours of escaped points */
+} ColourPalette;
+
 typedef union ColourMapFunction
 {
     char (*ascii) (double n, EscapeStatus status);
@@ -63,6 +80,8 @@ typedef struct ColourScheme
     ColourSchemeType scheme;
     BitDepth depth;
     ColourMapFunction mapColour;
+    ColourPalette palette;
+    double smoothing;   /* Reciprocal of log2 of the degree of the formula, as escaped values grow as z^d */
 } ColourScheme;
 
 
@@ -71,15 +90,25 @@ extern const ColourSchemeType COLOUR_SCHEME_MAX;
 
 
 int initialiseColourScheme(ColourScheme *scheme, ColourSchemeType colour);
+void setColourDegree(ColourScheme *scheme, unsigned int degree);
 
 void mapColour(void *pixel, unsigned long n, complex z, int offset, unsigned long max, const ColourScheme *scheme);
 void mapColourExt(void *pixel, unsigned long n, long double complex z, int offset, unsigned long max,
                   const ColourScheme *scheme);
 
 #ifdef MP_PREC
-void mapColourMP(void *pixel, unsigned long n, mpfr_t norm, int offset, unsigned long max, const ColourScheme *scheme);
+void mapColourMP(void *pixel, unsigned long n, const mpfr_t norm, int offset, unsigned long max,
+                 const ColourScheme *scheme);
 #endif
 
+void mapColourBatch(char *const *pixels, const int *offsets, const unsigned long *n, const complex *z, size_t count,
+                    unsigned long max, const ColourScheme *scheme);
+void mapColourBatchExt(char *const *pixels, const int *offsets, const unsigned long *n, const long double complex *z,
+                       size_t count, unsigned long max, const ColourScheme *scheme);
+
+void mapIterationRow(void *row, const unsigned char *values, size_t width, const ColourScheme *scheme);
+unsigned long getIterationCount(const unsigned char *value, unsigned long max);
+
 int getColourString(char *dest, ColourSchemeType colour, size_t n);
 
 
@@ -7,15 +7,46 @@
 
 #include <netinet/in.h>
 
+#include "protocol.h"
+#include "stats.h"
 
+
+/* Maximum number of units of work a worker may have outstanding */
+#define CONNECTION_UNITS_MAX 16
+
+
+/* A unit of work outstanding at a worker */
+typedef struct ConnectionUnit
+{
+    size_t row;    /* First row of the unit */
+    size_t rows;   /* Number of rows */
+    double issued; /* Time the unit was sent, in seconds */
+} ConnectionUnit;
+
+/* A master receives each message from a worker in two parts: the header into
+ * `header`, then the body to wherever the header says it belongs (`body`)
+ */
 typedef struct Connection
 {
-    struct sockaddr_in addr; /* Address */
-    bool rowAllocated;       /* True if the worker has been allocated a row */
-    size_t row;              /* Row number allocated to the worker */
-    size_t n;                /* Receive buffer allocated size */
-    size_t read;             /* Bytes of data present in the buffer */
-    char *buffer;            /* Receive buffer */
+    struct sockaddr_in addr;                    /* Address */
+    ConnectionUnit units[CONNECTION_UNITS_MAX]; /* Units allocated to the worker, oldest first */
+    unsigned int unitCount;                     /* Number of units allocated to the worker */
+    size_t unitDone;                            /* Rows of the oldest unit received so far */
+    double rate;                                /* Rows per second the worker plots at (0 until known) */
+    double lastDone;                            /* Time the worker last completed a unit */
+    double lastHeard;                           /* Time anything was last received from the worker */
+    unsigned int thread;                        /* I/O thread of the master serving the worker */
+    ConnectionStats stats;                      /* Traffic of the worker */
+    unsigned char header[MESSAGE_HEADER_SIZE];  /* Header of the next message */
+    size_t headerRead;                          /* Bytes of the next header received so far */
+    MessageHeader message;                      /* Header of the message whose body is being received */
+    unsigned char *body;                        /* Where the body is being received to (NULL between bodies) */
+    size_t bodyRead;                            /* Bytes of the body received so far */
+    bool discard;                               /* Whether the body is received only to be thrown away */
+    size_t n;                                   /* Receive buffer allocated size */
+    size_t head;                                /* Start of the first message in the buffer not yet taken */
+    size_t read;                                /* Bytes of data present in the buffer */
+    unsigned char *buffer;                      /* Receive buffer */
 } Connection;
 
 
@@ -23,6 +54,7 @@ Connection createConnection(void);
 
 int createClientReceiveBuffer(Connection *c, size_t n);
 void clearClientReceiveBuffer(Connection *c);
+void compactClientReceiveBuffer(Connection *c);
 void freeClientReceiveBuffer(Connection *c);
 
 
@@ -6,18 +6,50 @@
 
 #include "array.h"
 #include "network_ctx.h"
+#include "report.h"
+
+
+/* Number of blocks the listener hands out units of at once, so that workers
+ * move on to the next block while the last rows of one are still to come
+ */
+#define LISTENER_WINDOW 2
+
+
+/* The master's own share of the plot - units are taken from the same stack as
+ * the workers', and their rows plotted by the thread pool straight into the
+ * block
+ */
+typedef struct LocalWorker
+{
+    Thread *threads;                 /* Thread pool of the master */
+    void * (*genFractalRow)(void *); /* Row function of the plot's precision */
+    Block *row;                      /* Row handed to the thread pool */
+} LocalWorker;
+
+typedef struct Listener Listener;
 
 
 int initialiseNetworkConnection(NetworkCTX *network, PlotCTX **p);
 
 int initialiseAsMaster(NetworkCTX *network);
 int initialiseAsWorker(NetworkCTX *network, PlotCTX **p);
+int rejoinMaster(NetworkCTX *network);
+int joinNextFrame(NetworkCTX *network, PlotCTX **p);
+int joinNextPlot(NetworkCTX *network, PlotCTX **p);
 
 int acceptConnection(NetworkCTX *network);
 void closeConnection(NetworkCTX *network, int i);
 void closeAllConnections(NetworkCTX *network);
-
-int listener(NetworkCTX *network, const Block *block);
+void nextFrameConnections(NetworkCTX *network);
+void keepConnections(NetworkCTX *network);
+void tendConnections(NetworkCTX *network);
+
+Listener * createListener(NetworkCTX *network, const Block *block, LocalWorker *local);
+int initialiseListener(Listener *l);
+int queueListenerBlock(Listener *l, const Block *block);
+int waitListenerBlock(Listener *l, const Block *block);
+int reportListener(Listener *l, RunReport *r);
+void freeListener(Listener *l);
 
 
 #endif
\ No newline at end of file
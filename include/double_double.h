@@ -0,0 +1,54 @@
+#ifndef DOUBLE_DOUBLE_H
+#define DOUBLE_DOUBLE_H
+
+
+#include <complex.h>
+#include <float.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mandelbrot_parameters.h"
+
+
+/* Significand bits of a double-double value */
+#define DD_MANT_DIG (2 * DBL_MANT_DIG)
+
+/* Number of pixels a kernel call may be given at once */
+#define DD_BATCH_LEN 256
+
+
+/* Unevaluated sum of two doubles, where `lo` is no more than half an ulp of
+ * `hi`. Gives twice the significand of double with no more range
+ */
+typedef struct DoubleDouble
+{
+    double hi, lo;
+} DoubleDouble;
+
+typedef struct ComplexDD
+{
+    DoubleDouble re, im;
+} ComplexDD;
+
+
+DoubleDouble doubleToDD(double x);
+DoubleDouble longDoubleToDD(long double x);
+long double ddToLongDouble(DoubleDouble x);
+
+DoubleDouble ddAdd(DoubleDouble a, DoubleDouble b);
+DoubleDouble ddSub(DoubleDouble a, DoubleDouble b);
+DoubleDouble ddMul(DoubleDouble a, DoubleDouble b);
+DoubleDouble ddMulD(DoubleDouble a, double b);
+DoubleDouble ddDiv(DoubleDouble a, DoubleDouble b);
+DoubleDouble ddDivD(DoubleDouble a, double b);
+int ddCmp(DoubleDouble a, DoubleDouble b);
+
+int stringToDD(DoubleDouble *x, char *nptr, char **endptr);
+
+void mandelbrotDD(unsigned long *n, complex *z, const ComplexDD *c, size_t count, Formula formula,
+                  unsigned int degree, unsigned long max, uintmax_t *iterations);
+void juliaDD(unsigned long *n, complex *z, const ComplexDD *c, size_t count, ComplexDD constant, Formula formula,
+             unsigned int degree, unsigned long max, uintmax_t *iterations);
+
+
+#endif
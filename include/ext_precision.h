@@ -5,6 +5,8 @@
 #include <complex.h>
 #include <stddef.h>
 
+#include "double_double.h"
+
 #ifdef MP_PREC
 #include <mpfr.h>
 #include <mpc.h>
@@ -15,6 +17,7 @@ typedef enum PrecisionMode
 {
     STD_PRECISION,
     EXT_PRECISION,
+    DD_PRECISION,
 
     #ifdef MP_PREC
     MUL_PRECISION
@@ -26,6 +29,7 @@ typedef union ExtComplex
 {
     complex c;
     long double complex lc;
+    ComplexDD dd;
 
     #ifdef MP_PREC
     mpc_t mpc;
@@ -33,6 +37,26 @@ typedef union ExtComplex
 
 } ExtComplex;
 
+#ifdef MP_PREC
+/* Multiple-precision variables used by a thread to plot pixels. Created once
+ * per thread and reused for every block, so the hot loops never allocate
+ */
+typedef struct ScratchMP
+{
+    mpfr_prec_t precision;          /* Significand size of every variable */
+    mpfr_t reMin, imMax;            /* Values at top-left of plot */
+    mpfr_t pxWidth, pxHeight;       /* Pixel dimensions */
+    mpfr_t constantRe, constantIm;  /* Julia set constant */
+    mpfr_t real, imag;              /* Values at the start of a row */
+    mpfr_t cRe, cIm;                /* Value of the current pixel */
+    mpfr_t zRe, zIm;                /* Function value */
+    mpfr_t zReSqr, zImSqr;          /* Squares of the function value components */
+    mpfr_t norm;                    /* Squared magnitude of the function value */
+    mpfr_t savedRe, savedIm;        /* Value saved for periodicity checking */
+    mpfr_t powRe, powIm;            /* Power of the function value (Multibrot sets) */
+} ScratchMP;
+#endif
+
 
 extern const PrecisionMode PREC_MODE_MIN;
 extern const PrecisionMode PREC_MODE_MAX;
@@ -49,6 +73,11 @@ extern mpfr_prec_t mpSignificandSize;
 #endif
 
 
+#ifdef MP_PREC
+ScratchMP * createScratchMP(mpfr_prec_t precision);
+void freeScratchMP(ScratchMP *s);
+#endif
+
 int getPrecisionString(char *dest, PrecisionMode prec, size_t n);
 
 
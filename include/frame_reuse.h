@@ -0,0 +1,43 @@
+#ifndef FRAME_REUSE_H
+#define FRAME_REUSE_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "parameters.h"
+
+
+/* Pixels of the last frame of a sequence, kept for a frame that is a 2x zoom
+ * of it. Frames of odd dimensions have a pixel on the centre, so pixel (x, y)
+ * of the frame with x + xCentre and y + yCentre even lies on pixel
+ * ((x + xCentre) / 2, (y + yCentre) / 2) of the last - a quarter of the
+ * frame's pixels, taken from the middle half of the last frame's rows
+ */
+typedef struct FrameReuse
+{
+    size_t xCentre, yCentre;   /* Pixel coordinates of the centre */
+    size_t rowStart, rowEnd;   /* Rows [rowStart, rowEnd) of a frame are kept */
+    size_t width;              /* Pixels in a row */
+    size_t rowSize;            /* Bytes in a row */
+    size_t pixelSize;          /* Bytes in a pixel */
+    char *last;                /* Rows kept of the last frame */
+    char *next;                /* Rows kept of the frame being plotted */
+    unsigned char *lastStatus; /* Escape status of each pixel kept, for subdivision (if any) */
+    unsigned char *nextStatus;
+    bool ready;                /* Whether the last frame has been kept */
+} FrameReuse;
+
+
+FrameReuse * createFrameReuse(void);
+int initialiseFrameReuse(FrameReuse *r, const PlotCTX *p, size_t rowSize, bool status);
+size_t getFrameReuseSize(const PlotCTX *p, bool status);
+bool isReusedRow(const FrameReuse *r, size_t row);
+const char * getReusedPixel(const FrameReuse *r, size_t x, size_t y, unsigned char *status);
+void keepFrameRows(FrameReuse *r, const char *rows, size_t row, size_t n);
+void keepFrameStatus(FrameReuse *r, const unsigned char *status, size_t x, size_t y, size_t width, size_t height);
+void swapFrameReuse(FrameReuse *r);
+void freeFrameReuse(FrameReuse *r);
+
+
+#endif
\ No newline at end of file
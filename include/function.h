@@ -2,13 +2,17 @@
 #define FUNCTION_H
 
 
-void * generateFractalRow(void *threadInfo);
-void * generateFractalRowExt(void *threadInfo);
-void * generateFractalRowMP(void *threadInfo);
+#include <stdbool.h>
 
-void * generateFractal(void *threadInfo);
-void * generateFractalExt(void *threadInfo);
-void * generateFractalMP(void *threadInfo);
+#include "parameters.h"
+
+
+/* Thread function plotting the thread's block */
+typedef void * (*PlotFunction)(void *threadInfo);
+
+
+PlotFunction getPlotFunction(const PlotCTX *p, bool perturbation);
+PlotFunction getAntiAliasFunction(const PlotCTX *p);
 
 
 #endif
\ No newline at end of file
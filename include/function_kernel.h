@@ -0,0 +1,518 @@
+/* Plotting kernel template, included by function.c once per plot type.
+ * FUNCTION_KERNEL(name) names the functions generated for the type, and the
+ * FUNCTION_KERNEL_* macros run the type's function on pixels at each
+ * precision. The type is then fixed when the kernels are compiled, rather than
+ * tested for every pixel, and the thread functions are gathered into the
+ * table FUNCTION_KERNEL(plotKernels) that getPlotFunction() and
+ * getAntiAliasFunction() select from
+ */
+#if !defined(FUNCTION_KERNEL) || !defined(FUNCTION_KERNEL_SIMD) || !defined(FUNCTION_KERNEL_EXT) \
+    || !defined(FUNCTION_KERNEL_DD) || !defined(FUNCTION_KERNEL_MP)
+    #error "FUNCTION_KERNEL and FUNCTION_KERNEL_SIMD/EXT/DD/MP must be defined"
+#endif
+
+
+static void * FUNCTION_KERNEL(generateFractal)(void *threadInfo);
+static void * FUNCTION_KERNEL(generateFractalExt)(void *threadInfo);
+static void * FUNCTION_KERNEL(generateFractalDD)(void *threadInfo);
+
+static int FUNCTION_KERNEL(plotRectangle)(void *data, size_t x, size_t y, size_t width, size_t height,
+                                          unsigned char *status, size_t stride);
+static void FUNCTION_KERNEL(plotBatch)(TileCTX *ctx, PixelBatch *batch);
+
+static int FUNCTION_KERNEL(plotRectangleExt)(void *data, size_t x, size_t y, size_t width, size_t height,
+                                             unsigned char *status, size_t stride);
+static void FUNCTION_KERNEL(plotBatchExt)(TileCTXExt *ctx, PixelBatchExt *batch);
+
+static int FUNCTION_KERNEL(plotRectangleDD)(void *data, size_t x, size_t y, size_t width, size_t height,
+                                            unsigned char *status, size_t stride);
+static void FUNCTION_KERNEL(plotBatchDD)(TileCTXDD *ctx, PixelBatchDD *batch);
+
+static void * FUNCTION_KERNEL(antiAlias)(void *threadInfo);
+static void * FUNCTION_KERNEL(antiAliasExt)(void *threadInfo);
+static void * FUNCTION_KERNEL(antiAliasDD)(void *threadInfo);
+
+static void FUNCTION_KERNEL(plotSamples)(void *data, SampleBatch *samples);
+static void FUNCTION_KERNEL(plotSamplesExt)(void *data, SampleBatch *samples);
+static void FUNCTION_KERNEL(plotSamplesDD)(void *data, SampleBatch *samples);
+
+#ifdef MP_PREC
+static void * FUNCTION_KERNEL(generateFractalMP)(void *threadInfo);
+static int FUNCTION_KERNEL(plotRectangleMP)(void *data, size_t x, size_t y, size_t width, size_t height,
+                                            unsigned char *status, size_t stride);
+#endif
+
+
+static const PlotKernels FUNCTION_KERNEL(plotKernels) =
+{
+    .std = FUNCTION_KERNEL(generateFractal),
+    .ext = FUNCTION_KERNEL(generateFractalExt),
+    .dd = FUNCTION_KERNEL(generateFractalDD),
+
+    #ifdef MP_PREC
+    .mp = FUNCTION_KERNEL(generateFractalMP),
+    #endif
+
+    .antiAlias = FUNCTION_KERNEL(antiAlias),
+    .antiAliasExt = FUNCTION_KERNEL(antiAliasExt),
+    .antiAliasDD = FUNCTION_KERNEL(antiAliasDD)
+};
+
+
+static void * FUNCTION_KERNEL(generateFractal)(void *threadInfo)
+{
+    Thread *t = threadInfo;
+    TileCTX ctx;
+
+    #ifdef OPENCL
+    if (t->gpu)
+        return plotTilesGPU(t);
+    #endif
+
+    initialiseTileCTX(&ctx, t);
+    plotTiles(t, FUNCTION_KERNEL(plotRectangle), fillRectangle, &ctx);
+
+    return NULL;
+}
+
+
+static void * FUNCTION_KERNEL(generateFractalExt)(void *threadInfo)
+{
+    Thread *t = threadInfo;
+    TileCTXExt ctx;
+
+    initialiseTileCTXExt(&ctx, t);
+    plotTiles(t, FUNCTION_KERNEL(plotRectangleExt), fillRectangleExt, &ctx);
+
+    return NULL;
+}
+
+
+static void * FUNCTION_KERNEL(generateFractalDD)(void *threadInfo)
+{
+    Thread *t = threadInfo;
+    TileCTXDD ctx;
+
+    #ifdef OPENCL
+    if (t->gpu)
+        return plotTilesGPU(t);
+    #endif
+
+    initialiseTileCTXDD(&ctx, t);
+    plotTiles(t, FUNCTION_KERNEL(plotRectangleDD), fillRectangleDD, &ctx);
+
+    return NULL;
+}
+
+
+#ifdef MP_PREC
+static void * FUNCTION_KERNEL(generateFractalMP)(void *threadInfo)
+{
+    Thread *t = threadInfo;
+    TileCTXMP ctx;
+
+    if (initialiseTileCTXMP(&ctx, t))
+        return NULL;
+
+    plotTiles(t, FUNCTION_KERNEL(plotRectangleMP), fillRectangleMP, &ctx);
+
+    return NULL;
+}
+#endif
+
+
+/* Plot a rectangle of pixels of the block. Pixels are collected into batches
+ * for the vectorised functions, so narrow rectangles still fill every lane
+ */
+static int FUNCTION_KERNEL(plotRectangle)(void *data, size_t x, size_t y, size_t width, size_t height,
+                                          unsigned char *status, size_t stride)
+{
+    TileCTX *ctx = data;
+    Block *block = ctx->block;
+
+    PixelBatch batch;
+    batch.count = 0;
+
+    for (size_t row = y; row < y + height; ++row)
+    {
+        char *px = block->array + row * block->rowSize + getColumnOffset(x, block);
+        int bitOffset = getBitOffset(x, block);
+
+        double im = ctx->imMax - (ctx->blockOffset + row) * ctx->pxHeight;
+
+        size_t imageRow = block->id * block->rows + row;
+        bool reused = isReusedRow(block->reuse, imageRow);
+
+        for (size_t column = x; column < x + width; ++column)
+        {
+            unsigned char *pxStatus = (status) ? &status[(row - y) * stride + (column - x)] : NULL;
+
+            if (reused && takeReusedPixel(block, column, imageRow, px, pxStatus, ctx->stats))
+            {
+                nextPixel(&px, &bitOffset, block);
+                continue;
+            }
+
+            size_t i = (batch.count)++;
+
+            batch.c[i] = ctx->reMin + ctx->pxWidth * column + im * I;
+            batch.px[i] = px;
+            batch.bitOffset[i] = bitOffset;
+            batch.status[i] = pxStatus;
+
+            nextPixel(&px, &bitOffset, block);
+
+            if (batch.count == SIMD_BATCH_LEN)
+            {
+                FUNCTION_KERNEL(plotBatch)(ctx, &batch);
+                batch.count = 0;
+            }
+        }
+    }
+
+    if (batch.count > 0)
+        FUNCTION_KERNEL(plotBatch)(ctx, &batch);
+
+    return 0;
+}
+
+
+/* Run the fractal function on a batch of pixels and colour them */
+static void FUNCTION_KERNEL(plotBatch)(TileCTX *ctx, PixelBatch *batch)
+{
+    FUNCTION_KERNEL_SIMD(batch, ctx);
+
+    /* Map iteration counts to RGB colour values */
+    mapColourBatch(batch->px, batch->bitOffset, batch->n, batch->z, batch->count, ctx->nMax, ctx->colour);
+    countBatch(ctx->stats, batch->n, batch->status, batch->count, ctx->nMax);
+}
+
+
+/* Plot a rectangle of pixels of the block (extended-precision). Pixels are
+ * iterated one at a time, but coloured in batches
+ */
+static int FUNCTION_KERNEL(plotRectangleExt)(void *data, size_t x, size_t y, size_t width, size_t height,
+                                             unsigned char *status, size_t stride)
+{
+    TileCTXExt *ctx = data;
+    Block *block = ctx->block;
+
+    PixelBatchExt batch;
+    batch.count = 0;
+
+    for (size_t row = y; row < y + height; ++row)
+    {
+        char *px = block->array + row * block->rowSize + getColumnOffset(x, block);
+        int bitOffset = getBitOffset(x, block);
+
+        /* Set complex value to start of the row */
+        long double complex c = ctx->reMin + ctx->pxWidth * x
+                                + (ctx->imMax - (ctx->blockOffset + row) * ctx->pxHeight) * I;
+
+        size_t imageRow = block->id * block->rows + row;
+        bool reused = isReusedRow(block->reuse, imageRow);
+
+        for (size_t column = x; column < x + width; ++column, c += ctx->pxWidth)
+        {
+            unsigned char *pxStatus = (status) ? &status[(row - y) * stride + (column - x)] : NULL;
+
+            if (reused && takeReusedPixel(block, column, imageRow, px, pxStatus, ctx->stats))
+            {
+                nextPixel(&px, &bitOffset, block);
+                continue;
+            }
+
+            size_t i = (batch.count)++;
+
+            batch.c[i] = c;
+            batch.px[i] = px;
+            batch.bitOffset[i] = bitOffset;
+            batch.status[i] = pxStatus;
+
+            nextPixel(&px, &bitOffset, block);
+
+            if (batch.count == EXT_BATCH_LEN)
+            {
+                FUNCTION_KERNEL(plotBatchExt)(ctx, &batch);
+                batch.count = 0;
+            }
+        }
+    }
+
+    if (batch.count > 0)
+        FUNCTION_KERNEL(plotBatchExt)(ctx, &batch);
+
+    return 0;
+}
+
+
+/* Run the fractal function on a batch of pixels and colour them
+ * (extended-precision)
+ */
+static void FUNCTION_KERNEL(plotBatchExt)(TileCTXExt *ctx, PixelBatchExt *batch)
+{
+    for (size_t i = 0; i < batch->count; ++i)
+        batch->z[i] = FUNCTION_KERNEL_EXT(&(batch->n[i]), batch->c[i], ctx);
+
+    /* Map iteration counts to RGB colour values */
+    mapColourBatchExt(batch->px, batch->bitOffset, batch->n, batch->z, batch->count, ctx->nMax, ctx->colour);
+    countBatch(ctx->stats, batch->n, batch->status, batch->count, ctx->nMax);
+}
+
+
+/* Plot a rectangle of pixels of the block (double-double) */
+static int FUNCTION_KERNEL(plotRectangleDD)(void *data, size_t x, size_t y, size_t width, size_t height,
+                                            unsigned char *status, size_t stride)
+{
+    TileCTXDD *ctx = data;
+    Block *block = ctx->block;
+
+    PixelBatchDD batch;
+    batch.count = 0;
+
+    for (size_t row = y; row < y + height; ++row)
+    {
+        char *px = block->array + row * block->rowSize + getColumnOffset(x, block);
+        int bitOffset = getBitOffset(x, block);
+
+        DoubleDouble im = ddSub(ctx->imMax, ddMulD(ctx->pxHeight, (double) (ctx->blockOffset + row)));
+
+        size_t imageRow = block->id * block->rows + row;
+        bool reused = isReusedRow(block->reuse, imageRow);
+
+        for (size_t column = x; column < x + width; ++column)
+        {
+            unsigned char *pxStatus = (status) ? &status[(row - y) * stride + (column - x)] : NULL;
+
+            if (reused && takeReusedPixel(block, column, imageRow, px, pxStatus, ctx->stats))
+            {
+                nextPixel(&px, &bitOffset, block);
+                continue;
+            }
+
+            size_t i = (batch.count)++;
+
+            batch.c[i].re = ddAdd(ctx->reMin, ddMulD(ctx->pxWidth, (double) column));
+            batch.c[i].im = im;
+            batch.px[i] = px;
+            batch.bitOffset[i] = bitOffset;
+            batch.status[i] = pxStatus;
+
+            nextPixel(&px, &bitOffset, block);
+
+            if (batch.count == DD_BATCH_LEN)
+            {
+                FUNCTION_KERNEL(plotBatchDD)(ctx, &batch);
+                batch.count = 0;
+            }
+        }
+    }
+
+    if (batch.count > 0)
+        FUNCTION_KERNEL(plotBatchDD)(ctx, &batch);
+
+    return 0;
+}
+
+
+/* Run the fractal function on a batch of pixels and colour them (double-double).
+ * Final values only feed the smooth colouring, so are returned as double
+ */
+static void FUNCTION_KERNEL(plotBatchDD)(TileCTXDD *ctx, PixelBatchDD *batch)
+{
+    FUNCTION_KERNEL_DD(batch, ctx);
+
+    /* Map iteration counts to RGB colour values */
+    mapColourBatch(batch->px, batch->bitOffset, batch->n, batch->z, batch->count, ctx->nMax, ctx->colour);
+    countBatch(ctx->stats, batch->n, batch->status, batch->count, ctx->nMax);
+}
+
+
+/* Supersample the edge pixels of the thread's block */
+static void * FUNCTION_KERNEL(antiAlias)(void *threadInfo)
+{
+    Thread *t = threadInfo;
+    TileCTX ctx;
+
+    initialiseTileCTX(&ctx, t);
+    antiAliasTiles(t, FUNCTION_KERNEL(plotSamples), &ctx);
+
+    return NULL;
+}
+
+
+static void * FUNCTION_KERNEL(antiAliasExt)(void *threadInfo)
+{
+    Thread *t = threadInfo;
+    TileCTXExt ctx;
+
+    initialiseTileCTXExt(&ctx, t);
+    antiAliasTiles(t, FUNCTION_KERNEL(plotSamplesExt), &ctx);
+
+    return NULL;
+}
+
+
+static void * FUNCTION_KERNEL(antiAliasDD)(void *threadInfo)
+{
+    Thread *t = threadInfo;
+    TileCTXDD ctx;
+
+    initialiseTileCTXDD(&ctx, t);
+    antiAliasTiles(t, FUNCTION_KERNEL(plotSamplesDD), &ctx);
+
+    return NULL;
+}
+
+
+/* Run the fractal function on points within pixels of the block and colour
+ * them, through the same vectorised functions as whole pixels
+ */
+static void FUNCTION_KERNEL(plotSamples)(void *data, SampleBatch *samples)
+{
+    TileCTX *ctx = data;
+    PixelBatch batch;
+
+    for (size_t start = 0; start < samples->count; start += batch.count)
+    {
+        batch.count = (samples->count - start < SIMD_BATCH_LEN) ? samples->count - start : SIMD_BATCH_LEN;
+
+        for (size_t i = 0; i < batch.count; ++i)
+        {
+            double im = ctx->imMax - (ctx->blockOffset + samples->y[start + i]) * ctx->pxHeight;
+
+            batch.c[i] = ctx->reMin + ctx->pxWidth * samples->x[start + i] + im * I;
+            batch.px[i] = samples->px[start + i];
+            batch.bitOffset[i] = 0;
+        }
+
+        FUNCTION_KERNEL_SIMD(&batch, ctx);
+
+        mapColourBatch(batch.px, batch.bitOffset, batch.n, batch.z, batch.count, ctx->nMax, ctx->colour);
+        ctx->stats->samples += batch.count;
+    }
+}
+
+
+/* Run the fractal function on points within pixels of the block and colour
+ * them (extended-precision)
+ */
+static void FUNCTION_KERNEL(plotSamplesExt)(void *data, SampleBatch *samples)
+{
+    TileCTXExt *ctx = data;
+    PixelBatchExt batch;
+
+    for (size_t start = 0; start < samples->count; start += batch.count)
+    {
+        batch.count = (samples->count - start < EXT_BATCH_LEN) ? samples->count - start : EXT_BATCH_LEN;
+
+        for (size_t i = 0; i < batch.count; ++i)
+        {
+            long double im = ctx->imMax - (ctx->blockOffset + samples->y[start + i]) * ctx->pxHeight;
+
+            batch.c[i] = ctx->reMin + ctx->pxWidth * samples->x[start + i] + im * I;
+            batch.px[i] = samples->px[start + i];
+            batch.bitOffset[i] = 0;
+            batch.z[i] = FUNCTION_KERNEL_EXT(&(batch.n[i]), batch.c[i], ctx);
+        }
+
+        mapColourBatchExt(batch.px, batch.bitOffset, batch.n, batch.z, batch.count, ctx->nMax, ctx->colour);
+        ctx->stats->samples += batch.count;
+    }
+}
+
+
+/* Run the fractal function on points within pixels of the block and colour
+ * them (double-double)
+ */
+static void FUNCTION_KERNEL(plotSamplesDD)(void *data, SampleBatch *samples)
+{
+    TileCTXDD *ctx = data;
+    PixelBatchDD batch;
+
+    for (size_t start = 0; start < samples->count; start += batch.count)
+    {
+        batch.count = (samples->count - start < DD_BATCH_LEN) ? samples->count - start : DD_BATCH_LEN;
+
+        for (size_t i = 0; i < batch.count; ++i)
+        {
+            batch.c[i].re = ddAdd(ctx->reMin, ddMulD(ctx->pxWidth, samples->x[start + i]));
+            batch.c[i].im = ddSub(ctx->imMax, ddMulD(ctx->pxHeight, ctx->blockOffset + samples->y[start + i]));
+            batch.px[i] = samples->px[start + i];
+            batch.bitOffset[i] = 0;
+        }
+
+        FUNCTION_KERNEL_DD(&batch, ctx);
+
+        mapColourBatch(batch.px, batch.bitOffset, batch.n, batch.z, batch.count, ctx->nMax, ctx->colour);
+        ctx->stats->samples += batch.count;
+    }
+}
+
+
+#ifdef MP_PREC
+/* Plot a rectangle of pixels of the block (multiple-precision). The cost of
+ * each pixel dwarfs that of colouring it, so pixels are not batched
+ */
+static int FUNCTION_KERNEL(plotRectangleMP)(void *data, size_t x, size_t y, size_t width, size_t height,
+                                            unsigned char *status, size_t stride)
+{
+    TileCTXMP *ctx = data;
+    Block *block = ctx->block;
+    ScratchMP *s = ctx->mp;
+
+    unsigned long nMax = ctx->nMax;
+
+    /* Real value at the start of each row */
+    mpfr_mul_ui(s->real, s->pxWidth, (unsigned long) x, MP_REAL_RND);
+    mpfr_add(s->real, s->reMin, s->real, MP_REAL_RND);
+
+    for (size_t row = y; row < y + height; ++row)
+    {
+        char *px = block->array + row * block->rowSize + getColumnOffset(x, block);
+        int bitOffset = getBitOffset(x, block);
+
+        /* Set complex value to start of the row */
+        mpfr_set_uj(s->cIm, (uintmax_t) (ctx->blockOffset + row), MP_IMAG_RND);
+        mpfr_mul(s->cIm, s->cIm, s->pxHeight, MP_IMAG_RND);
+        mpfr_sub(s->cIm, s->imMax, s->cIm, MP_IMAG_RND);
+
+        mpfr_set(s->cRe, s->real, MP_REAL_RND);
+
+        bool reused = isReusedRow(block->reuse, ctx->blockOffset + row);
+
+        for (size_t column = x; column < x + width; ++column, mpfr_add(s->cRe, s->cRe, s->pxWidth, MP_REAL_RND))
+        {
+            unsigned long n;
+
+            if (reused && takeReusedPixel(block, column, ctx->blockOffset + row, px,
+                                          (status) ? &status[(row - y) * stride + (column - x)] : NULL, ctx->stats))
+            {
+                nextPixel(&px, &bitOffset, block);
+                continue;
+            }
+
+            /* Run fractal function on c */
+            FUNCTION_KERNEL_MP(&n, ctx);
+
+            /* Map iteration count to RGB colour value */
+            mapColourMP(px, n, s->norm, bitOffset, nMax, ctx->colour);
+            countPixel(ctx->stats, n, nMax);
+
+            if (status)
+                status[(row - y) * stride + (column - x)] = (n < nMax) ? SUBDIVISION_ESCAPED : SUBDIVISION_UNESCAPED;
+
+            nextPixel(&px, &bitOffset, block);
+        }
+    }
+
+    return 0;
+}
+#endif
+
+
+#undef FUNCTION_KERNEL
+#undef FUNCTION_KERNEL_SIMD
+#undef FUNCTION_KERNEL_EXT
+#undef FUNCTION_KERNEL_DD
+#undef FUNCTION_KERNEL_MP
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef GPU_H
+#define GPU_H
+
+
+#include <complex.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parameters.h"
+
+#ifdef OPENCL
+#define CL_TARGET_OPENCL_VERSION 120
+#include <CL/cl.h>
+#endif
+
+
+/* Pixels each launch may hold */
+#define GPU_BATCH_LEN ((size_t) 1 << 18)
+
+/* Length of a device name kept for the log */
+#define GPU_NAME_LEN_MAX 128
+
+
+extern const unsigned int GPU_DEVICE_MIN;
+extern const unsigned int GPU_DEVICE_MAX;
+
+
+#ifdef OPENCL
+/* OpenCL device running the escape-time kernels of a plot. Pixel values are
+ * written into, and results read out of, buffers in pinned host memory, so
+ * no copy of the block is made on the way in or out
+ */
+typedef struct GPU
+{
+    cl_context context;
+    cl_command_queue queue;
+    cl_device_id device;
+    cl_program program;
+    cl_kernel kernel;
+    cl_mem c;                     /* Values of the pixels (complex or ComplexDD) */
+    cl_mem n;                     /* Iteration counts */
+    cl_mem z;                     /* Final function values */
+    cl_mem run;                   /* Iterations run by each pixel */
+    void *cMap;                   /* Host address of each buffer while mapped */
+    void *nMap;
+    void *zMap;
+    PrecisionMode precision;      /* Plot the program was built for */
+    PlotType type;
+    Formula formula;
+    unsigned int degree;
+    double rate;                  /* Pixels per second measured over the last launches */
+    char name[GPU_NAME_LEN_MAX];
+} GPU;
+
+
+GPU * createGPU(void);
+int initialiseGPU(GPU *gpu, unsigned int device);
+GPU * openGPU(const PlotCTX *p, unsigned int device);
+int setGPUPlot(GPU *gpu, const PlotCTX *p);
+void * mapGPUPixels(GPU *gpu);
+int runGPU(GPU *gpu, size_t count, const unsigned long **n, const complex **z, uintmax_t *iterations);
+int unmapGPUResults(GPU *gpu);
+void freeGPU(GPU *gpu);
+#endif
+
+
+#endif
\ No newline at end of file
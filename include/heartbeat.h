@@ -0,0 +1,31 @@
+#ifndef HEARTBEAT_H
+#define HEARTBEAT_H
+
+
+#include <stdbool.h>
+
+#include <pthread.h>
+
+#include "network_ctx.h"
+
+
+/* Thread of a worker that sends the master a heartbeat at its interval, so
+ * that the worker is heard from while it plots a slow row
+ */
+typedef struct Heartbeat
+{
+    pthread_t pid;
+    pthread_mutex_t mutex;
+    pthread_cond_t stopped; /* Signalled when the thread is to exit */
+    NetworkCTX *network;    /* Network of the worker */
+    bool running;           /* Whether the heartbeat thread has been started */
+    bool shutdown;          /* Whether the heartbeat thread should exit */
+} Heartbeat;
+
+
+Heartbeat * createHeartbeat(void);
+int initialiseHeartbeat(Heartbeat *heartbeat, NetworkCTX *network);
+void freeHeartbeat(Heartbeat *heartbeat);
+
+
+#endif
@@ -2,11 +2,14 @@
 #define IMAGE_H
 
 
+#include <stdbool.h>
 #include <stddef.h>
 
+#include "array.h"
 #include "network_ctx.h"
 #include "parameters.h"
 #include "program_ctx.h"
+#include "sequence.h"
 
 
 extern const size_t MEMORY_MIN;
@@ -15,11 +18,18 @@ extern const size_t MEMORY_MAX;
 extern const unsigned int THREAD_COUNT_MIN;
 extern const unsigned int THREAD_COUNT_MAX;
 
+extern const size_t TILE_WIDTH_MIN;
+extern const size_t TILE_WIDTH_MAX;
+extern const size_t TILE_HEIGHT_MIN;
+extern const size_t TILE_HEIGHT_MAX;
 
-int initialiseImage(PlotCTX *p);
-int imageOutput(PlotCTX *p, ProgramCTX *ctx);
-int imageOutputMaster(PlotCTX *p, NetworkCTX *network, ProgramCTX *ctx);
-int imageRowOutput(PlotCTX *p, NetworkCTX *network, ProgramCTX *ctx);
+
+int initialiseImage(PlotCTX *p, bool resume);
+Thread * createImageThreads(const PlotCTX *p, const ProgramCTX *ctx);
+int imageOutput(PlotCTX *p, ProgramCTX *ctx, Sequence *sequence, Thread *threads);
+int imageOutputMaster(PlotCTX *p, NetworkCTX *network, ProgramCTX *ctx, Sequence *sequence, Thread *threads);
+int imageRowOutput(PlotCTX **p, NetworkCTX *network, ProgramCTX *ctx);
+int imageRecolour(PlotCTX *p, const ProgramCTX *ctx);
 int closeImage(PlotCTX *p);
 
 
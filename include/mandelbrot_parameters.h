@@ -2,9 +2,24 @@
 #define MANDELBROT_PARAMETERS_H
 
 
+/* Function iterated to plot the set. A Julia set of each is plotted by
+ * iterating z from the pixel with c fixed, rather than from 0 with c the pixel
+ */
+typedef enum Formula
+{
+    FORMULA_MANDELBROT,     /* z^2 + c */
+    FORMULA_MULTIBROT,      /* z^d + c, for an integer degree d */
+    FORMULA_BURNING_SHIP,   /* (|Re(z)| + |Im(z)|i)^2 + c */
+    FORMULA_TRICORN         /* conj(z)^2 + c */
+} Formula;
+
+
 extern const double ESCAPE_RADIUS;
 extern const long double ESCAPE_RADIUS_EXT;
 
+extern const double ESCAPE_RADIUS_SQR;
+extern const long double ESCAPE_RADIUS_SQR_EXT;
+
 #ifdef MP_PREC
 extern const double ESCAPE_RADIUS_MP;
 #endif
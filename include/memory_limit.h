@@ -0,0 +1,11 @@
+#ifndef MEMORY_LIMIT_H
+#define MEMORY_LIMIT_H
+
+
+#include <stddef.h>
+
+
+size_t getAvailableMemory(void);
+
+
+#endif
\ No newline at end of file
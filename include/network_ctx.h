@@ -2,14 +2,21 @@
 #define NETWORK_CTX_H
 
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <netinet/in.h>
 #include <poll.h>
+#include <pthread.h>
 
 #include "connection.h"
 
 
 #define GENERAL_NETWORK_BUFFER_SIZE 4096
 
+/* Number of heartbeats a peer may miss before it is taken to be lost */
+#define HEARTBEAT_MISSES 3
+
 
 typedef enum LANStatus
 {
@@ -25,6 +32,21 @@ typedef struct NetworkCTX
     int n;                   /* Number of current connections (inc. master) */
     Connection *connections; /* Array of workers (0 is self for LAN_MASTER) */
     struct pollfd *fds;      /* Socket file descriptor set for polling */
+    size_t unitRows;         /* Number of rows in each unit of work given to a worker */
+    unsigned int unitDepth;  /* Number of units each worker may have outstanding */
+    uint64_t job;            /* Identifier of the plot, carried by every message */
+    bool compress;           /* Whether workers may run-length encode rows */
+    bool iterations;         /* Whether workers send iteration values, coloured by the master */
+    unsigned int ioThreads;  /* Number of threads the master receives from workers on */
+    bool local;              /* Whether the master plots rows alongside the workers */
+    double rateTotal;        /* Sum of the rates of the workers whose rate is known */
+    unsigned int rated;      /* Number of workers whose rate is known */
+    unsigned int heartbeat;  /* Seconds between heartbeats (the master's, on a worker) */
+    unsigned int retry;      /* Seconds a worker keeps trying to reach its master */
+    pthread_mutex_t send;    /* Keeps messages a worker sends from several threads whole */
+    int *epoll;              /* Event set of each I/O thread (LAN_MASTER only) */
+    ConnectionStats past;    /* Traffic of the workers released so far, summed (LAN_MASTER only) */
+    unsigned int pastCount;  /* Number of workers released */
 } NetworkCTX;
 
 
@@ -0,0 +1,48 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+
+#include <stddef.h>
+
+#include <pthread.h>
+
+
+/* Most NUMA nodes threads are spread across */
+#define NUMA_NODES_MAX 64
+
+
+/* How pool threads are pinned to CPUs. Compact fills the CPUs of one node
+ * before the next, and scatter deals threads out to the nodes in turn
+ */
+typedef enum AffinityPolicy
+{
+    AFFINITY_NONE,
+    AFFINITY_COMPACT,
+    AFFINITY_SCATTER
+} AffinityPolicy;
+
+/* CPUs the process may run on, ordered by node then ID. Nodes are numbered
+ * from 0 in order, counting only those with a CPU the process may use
+ */
+typedef struct Topology
+{
+    unsigned int cpuCount;                  /* Number of CPUs */
+    int *cpus;                              /* ID of each CPU */
+    unsigned int *nodes;                    /* Node of each CPU */
+    unsigned int nodeCount;                 /* Number of nodes */
+    unsigned int nodeCPUs[NUMA_NODES_MAX];  /* Number of CPUs on each node */
+    unsigned int nodeFirst[NUMA_NODES_MAX]; /* Index of the first CPU of each node */
+} Topology;
+
+
+Topology * createTopology(void);
+int initialiseTopology(Topology *t);
+unsigned int getAffinityCPU(const Topology *t, AffinityPolicy policy, unsigned int i);
+int pinThread(pthread_t pid, int cpu);
+void freeTopology(Topology *t);
+
+char * mapHugeArray(size_t *size);
+void unmapArray(char *array, size_t size);
+
+
+#endif
\ No newline at end of file
@@ -9,12 +9,19 @@
 
 #include "colour.h"
 #include "ext_precision.h"
+#include "mandelbrot_parameters.h"
 
 
 #define PLOT_FILEPATH_LEN_MAX 4096
 #define PLOT_FILEPATH_DEFAULT "var/mandelbrot.pnm"
+#define RAW_FILEPATH_DEFAULT "var/mandelbrot.raw"
+#define PNG_FILEPATH_DEFAULT "var/mandelbrot.png"
+#define TILES_FILEPATH_DEFAULT "var/mandelbrot.dzi"
 
 
+/* Whether the pixels are values of c (a Mandelbrot set of the formula) or of
+ * the starting value of z (a Julia set)
+ */
 typedef enum PlotType
 {
     PLOT_NONE,
@@ -26,19 +33,25 @@ typedef enum OutputType
 {
     OUTPUT_NONE,
     OUTPUT_PNM,
-    OUTPUT_TERMINAL
+    OUTPUT_TERMINAL,
+    OUTPUT_RAW,
+    OUTPUT_PNG,
+    OUTPUT_TILES
 } OutputType;
 
 typedef struct PlotCTX
 {
     PrecisionMode precision;
     PlotType type;
+    Formula formula;
+    unsigned int degree;  /* Degree of the formula in z */
     ExtComplex minimum, maximum, c;
     unsigned long iterations;
     OutputType output;
     char plotFilepath[PLOT_FILEPATH_LEN_MAX];
     FILE *file;
     size_t width, height;
+    size_t tileSize;      /* Pixels along each side of a tile (if output as a tile pyramid) */
     ColourScheme colour;
 } PlotCTX;
 
@@ -50,8 +63,11 @@ extern const size_t MANDELBROT_TERMINAL_HEIGHT_DEFAULT;
 
 extern const ColourSchemeType COLOUR_SCHEME_DEFAULT;
 
+extern const unsigned int MULTIBROT_DEGREE_DEFAULT;
+
 extern const PlotCTX JULIA_PARAMETERS_DEFAULT;
 extern const PlotCTX JULIA_PARAMETERS_DEFAULT_EXT;
+extern const PlotCTX JULIA_PARAMETERS_DEFAULT_DD;
 
 #ifdef MP_PREC
 extern const PlotCTX JULIA_PARAMETERS_DEFAULT_MP;
@@ -59,6 +75,7 @@ extern const PlotCTX JULIA_PARAMETERS_DEFAULT_MP;
 
 extern const PlotCTX MANDELBROT_PARAMETERS_DEFAULT;
 extern const PlotCTX MANDELBROT_PARAMETERS_DEFAULT_EXT;
+extern const PlotCTX MANDELBROT_PARAMETERS_DEFAULT_DD;
 
 #ifdef MP_PREC
 extern const PlotCTX MANDELBROT_PARAMETERS_DEFAULT_MP;
@@ -66,11 +83,13 @@ extern const PlotCTX MANDELBROT_PARAMETERS_DEFAULT_MP;
 
 
 PlotCTX * createPlotCTX(PrecisionMode precision);
-int initialisePlotCTX(PlotCTX *p, PlotType plot, OutputType output);
+int initialisePlotCTX(PlotCTX *p, PlotType plot, Formula formula, OutputType output);
 void freePlotCTX(PlotCTX *p);
 
+long getResolutionBits(const PlotCTX *p);
+
 int getOutputString(char *dest, const PlotCTX *p, size_t n);
-int getPlotString(char *dest, PlotType plot, size_t n);
+int getPlotString(char *dest, const PlotCTX *p, size_t n);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef PERTURBATION_H
+#define PERTURBATION_H
+
+
+#include <complex.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parameters.h"
+
+
+/* Orbit of a single point of the plot, computed at full precision, that every
+ * other pixel is iterated relative to
+ */
+typedef struct ReferenceOrbit
+{
+    PlotType type;
+    long double complex *z;      /* Reference values, from the starting value to the last iteration */
+    complex *zStd;               /* Reference values rounded to double (if not extended) */
+    size_t length;               /* Index of the last reference value */
+    bool extended;               /* Whether pixel offsets need the range of long double */
+    long double pxWidth;         /* Pixel dimensions */
+    long double pxHeight;
+    long double xCentre;         /* Pixel coordinates of the reference point */
+    long double yCentre;
+    long double radius;          /* Distance from the reference point to the furthest pixel */
+    unsigned long skip;          /* Iterations skipped by the series approximation */
+    long double complex a, b, c; /* Series coefficients after `skip` iterations, scaled by `radius` */
+} ReferenceOrbit;
+
+
+#ifdef MP_PREC
+ReferenceOrbit * createReferenceOrbit(const PlotCTX *p);
+int rescaleReferenceOrbit(ReferenceOrbit *orbit, const PlotCTX *p);
+#endif
+
+long double complex perturbation(unsigned long *n, const ReferenceOrbit *orbit, long double complex delta,
+                                 unsigned long max, uintmax_t *iterations);
+void freeReferenceOrbit(ReferenceOrbit *orbit);
+
+
+#endif
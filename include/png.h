@@ -0,0 +1,69 @@
+#ifndef PNG_H
+#define PNG_H
+
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <pthread.h>
+#include <zlib.h>
+
+#include "parameters.h"
+
+
+/* Signature, IHDR chunk and the IDAT chunk holding the zlib stream header */
+#define PNG_HEADER_LEN 47
+
+
+/* Rows compressed by one thread as an independent deflate segment */
+typedef struct PNGSegment
+{
+    unsigned char *filtered; /* Rows with their filter type bytes */
+    unsigned char *out;      /* Compressed segment */
+    size_t outSize;          /* Space for the compressed segment */
+    size_t outLen;           /* Length of the compressed segment */
+    size_t len;              /* Length of the filtered rows */
+    uLong adler;             /* Adler-32 of the filtered rows */
+    const char *rows;        /* First row of the segment */
+    const char *prior;       /* Row above the first */
+    size_t count;            /* Rows in the segment */
+    int error;
+} PNGSegment;
+
+/* Streaming PNG encoder. Rows are handed over as they are plotted, and split
+ * into segments filtered and deflated across threads (as pigz does). Each
+ * segment ends on a sync flush, so their output follows one another as a
+ * single zlib stream without the image ever being held whole
+ */
+typedef struct PNGEncoder
+{
+    FILE *file;
+    BitDepth depth;
+    size_t width;            /* Pixels in the widest row the encoder was set up for */
+    size_t rowSize;          /* Bytes in a row of the image */
+    size_t bpp;              /* Bytes a filter looks back by (at least 1) */
+    int invert;              /* Whether bits are flipped (PBM has 1 as black) */
+    unsigned int threads;    /* Threads compressing segments at once */
+    size_t segmentRows;      /* Rows in a full segment */
+    PNGSegment *segments;    /* A round of segments, compressed at once */
+    size_t segmentCount;
+    char *prior;             /* Last row written (zeroes at first), above the next rows */
+    uLong adler;             /* Adler-32 of the filtered rows written */
+    pthread_mutex_t mutex;
+    size_t next;             /* Next segment of the round to be claimed */
+    size_t roundCount;       /* Segments in the current round */
+} PNGEncoder;
+
+
+size_t getPNGHeader(unsigned char *dest, const PlotCTX *p);
+PNGEncoder * createPNGEncoder(void);
+int initialisePNGEncoder(PNGEncoder *png, const PlotCTX *p, unsigned int threads);
+size_t getPNGEncoderSize(const PlotCTX *p, unsigned int threads);
+int writePNGRows(PNGEncoder *png, const char *rows, size_t n);
+int finishPNG(PNGEncoder *png);
+void restartPNG(PNGEncoder *png, FILE *file);
+int startPNGImage(PNGEncoder *png, FILE *file, size_t width, size_t height);
+void freePNGEncoder(PNGEncoder *png);
+
+
+#endif
\ No newline at end of file
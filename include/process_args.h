@@ -7,6 +7,7 @@
 
 #include "percy/include/parser.h"
 
+#include "double_double.h"
 #include "parameters.h"
 
 #ifdef MP_PREC
@@ -25,9 +26,11 @@ ParseErr floatArgExt(long double *x, char *arg, long double min, long double max
 
 ParseErr complexArg(complex *z, char *arg, complex min, complex max);
 ParseErr complexArgExt(long double complex *z, char *arg, long double complex min, long double complex max);
+ParseErr complexArgDD(ComplexDD *z, char *arg, long double complex min, long double complex max);
 
 ParseErr magArg(PlotCTX *p, char *arg, complex cMin, complex cMax, double mMin, double mMax);
 ParseErr magArgExt(PlotCTX *p, char *arg, long double complex cMin, long double complex cMax, double mMin, double mMax);
+ParseErr magArgDD(PlotCTX *p, char *arg, long double complex cMin, long double complex cMax, double mMin, double mMax);
 
 #ifdef MP_PREC
 ParseErr complexArgMP(mpc_t z, char *arg, mpc_t min, mpc_t max);
@@ -9,12 +9,19 @@
 
 
 extern const uint16_t PORT_DEFAULT;
+extern const size_t UNIT_ROWS_DEFAULT;
+extern const unsigned int UNIT_DEPTH_DEFAULT;
+extern const unsigned int IO_THREADS_DEFAULT;
+extern const unsigned int HEARTBEAT_DEFAULT;
+extern const unsigned int RETRY_DEFAULT;
 
 
 int validateOptions(int argc, char **argv);
+int validateJobOptions(int argc, char **argv);
 
 int processProgramOptions(ProgramCTX *ctx, NetworkCTX **network, int argc, char **argv);
-PlotCTX * processPlotOptions(int argc, char **argv);
+PlotCTX * processPlotOptions(ProgramCTX *ctx, int argc, char **argv);
+PlotCTX * processRecolourOptions(ProgramCTX *ctx, int argc, char **argv);
 
 
 #endif
\ No newline at end of file
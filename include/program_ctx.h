@@ -5,10 +5,18 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "numa.h"
+
 
 #define LOG_FILEPATH_LEN_MAX 4096
 #define LOG_FILEPATH_DEFAULT "var/mandelbrot.log"
 
+#define RECOLOUR_FILEPATH_LEN_MAX 4096
+
+#define STATS_FILEPATH_LEN_MAX 4096
+
+#define SERVE_FILEPATH_LEN_MAX 4096
+
 
 typedef struct ProgramCTX
 {
@@ -16,6 +24,30 @@ typedef struct ProgramCTX
     bool logToFile;
     size_t mem;
     unsigned int threads;
+    bool gpu;
+    unsigned int gpuDevice;
+    size_t tileWidth;
+    size_t tileHeight;
+    bool subdivide;
+    bool symmetry;
+    unsigned int antiAlias;
+    bool perturbation;
+    bool checkpoint;
+    bool resume;
+    bool map;
+    bool recolour;
+    char recolourFilepath[RECOLOUR_FILEPATH_LEN_MAX];
+    bool stats;
+    char statsFilepath[STATS_FILEPATH_LEN_MAX];
+    double statsInterval;
+    AffinityPolicy affinity;
+    bool firstTouch;
+    bool hugePages;
+    size_t frames;
+    long double zoomTo;
+    char *centre;
+    bool serve;
+    char serveFilepath[SERVE_FILEPATH_LEN_MAX];
 } ProgramCTX;
 
 
@@ -0,0 +1,90 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Version of the wire protocol. Peers drop messages of any other version */
+#define PROTOCOL_VERSION 5
+
+/* Encoded size of a message header */
+#define MESSAGE_HEADER_SIZE 24
+
+/* Header flag - on MESSAGE_PARAMETERS, the master accepts run-length encoded
+ * rows; on MESSAGE_ROWS, the body is a single run-length encoded row
+ */
+#define MESSAGE_FLAG_RUN_LENGTH 0x0001
+
+/* Header flag on MESSAGE_PARAMETERS - workers send rows of smoothed iteration
+ * values (BIT_DEPTH_ITERATIONS) for the master to colour, rather than pixels
+ */
+#define MESSAGE_FLAG_ITERATIONS 0x0002
+
+/* Header flag on MESSAGE_NEXT - the connection is kept, and the parameters of
+ * the next plot (of a master serving render jobs) follow on it
+ */
+#define MESSAGE_FLAG_KEEP 0x0004
+
+
+typedef enum MessageType
+{
+    MESSAGE_PARAMETERS = 1, /* Master to worker: precision mode and plot parameters */
+    MESSAGE_UNIT,           /* Master to worker: a unit of work of `rows` rows from `row` */
+    MESSAGE_ROWS,           /* Worker to master: image data of one or more whole rows from `row` */
+    MESSAGE_HEARTBEAT,      /* Either way: the sender is still there (no body) */
+    MESSAGE_DONE,           /* Master to worker: the plot is finished, so is not to be rejoined (no body) */
+    MESSAGE_NEXT            /* Master to worker: the frame is finished, and the next of the sequence is to be
+                             * joined (no body) */
+} MessageType;
+
+/* Every message is a header followed by `length` bytes of body. Multi-byte
+ * fields are little-endian on the wire
+ */
+typedef struct MessageHeader
+{
+    uint8_t version; /* Protocol version */
+    uint8_t type;    /* MessageType */
+    uint16_t flags;  /* MESSAGE_FLAG_* bits */
+    uint32_t length; /* Size of the body */
+    uint64_t job;    /* Identifier of the plot the message belongs to */
+    uint64_t row;    /* First row of the image the message refers to (0 if none) */
+} MessageHeader;
+
+/* Cursor over a message body being encoded or decoded. Fields that would run
+ * past `size` are not written (or read as 0) and set `error`, so a sequence of
+ * fields need only be checked once at the end
+ */
+typedef struct WireBuffer
+{
+    unsigned char *data; /* Start of the body */
+    size_t size;         /* Space in (or length of) the body */
+    size_t pos;          /* Bytes encoded or decoded so far */
+    bool error;          /* Whether any field overran the body */
+} WireBuffer;
+
+
+MessageHeader createMessageHeader(MessageType type, uint64_t job, uint64_t row, size_t length);
+void encodeMessageHeader(unsigned char *dest, const MessageHeader *h);
+int decodeMessageHeader(MessageHeader *h, const unsigned char *src);
+
+WireBuffer createWireBuffer(unsigned char *data, size_t size);
+
+void putU8(WireBuffer *w, uint8_t x);
+void putU32(WireBuffer *w, uint32_t x);
+void putU64(WireBuffer *w, uint64_t x);
+void putDouble(WireBuffer *w, double x);
+void putLongDouble(WireBuffer *w, long double x);
+void putBytes(WireBuffer *w, const void *src, size_t n);
+
+uint8_t getU8(WireBuffer *w);
+uint32_t getU32(WireBuffer *w);
+uint64_t getU64(WireBuffer *w);
+double getDouble(WireBuffer *w);
+long double getLongDouble(WireBuffer *w);
+const unsigned char * getBytes(WireBuffer *w, size_t n);
+
+
+#endif
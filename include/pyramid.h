@@ -0,0 +1,74 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+
+#include <stddef.h>
+
+#include <pthread.h>
+
+#include "parameters.h"
+#include "png.h"
+
+
+/* Directory of the tiles, beside the descriptor - its path less the extension */
+#define PYRAMID_DIRECTORY_SUFFIX "_files"
+
+
+/* One level of the pyramid, halving the dimensions of the level above. Only
+ * the row of tiles being filled is held
+ */
+typedef struct PyramidLevel
+{
+    size_t width, height;   /* Pixels of the image at this level */
+    size_t rowSize;         /* Bytes in a row of the image */
+    char *rows;             /* Rows of the tile row being filled */
+    size_t filled;          /* Rows of the tile row filled so far */
+    size_t received;        /* Rows of the level filled so far */
+    size_t tileRow;         /* Index of the tile row being filled */
+} PyramidLevel;
+
+/* Encoder and buffers of a thread writing tiles */
+typedef struct PyramidWorker
+{
+    struct Pyramid *pyramid;
+    PNGEncoder *png;
+    char *tile;             /* Rows of the tile, one after another */
+    char *path;             /* Path of the tile's file */
+    int error;
+} PyramidWorker;
+
+/* Deep Zoom tile pyramid, written as the rows of the plot come in. Each row
+ * of tiles is written once filled, then scaled down by half into the level
+ * below, so the lower levels are built alongside the full-size image without
+ * the image ever being held whole
+ */
+typedef struct Pyramid
+{
+    size_t tileSize;        /* Pixels along each side of a full tile */
+    size_t pixelSize;       /* Bytes in a pixel */
+    char directory[PLOT_FILEPATH_LEN_MAX];
+    PyramidLevel *levels;   /* Levels from the 1x1 image (level 0) up to the plot */
+    size_t levelCount;
+    PyramidWorker *workers;
+    unsigned int threads;   /* Threads writing the tiles of a row at once */
+    pthread_mutex_t mutex;
+    size_t level;           /* Level whose tiles are being written */
+    size_t next;            /* Next tile of the row to be claimed */
+    size_t columns;         /* Tiles in the row */
+} Pyramid;
+
+
+extern const size_t PYRAMID_TILE_SIZE_MIN;
+extern const size_t PYRAMID_TILE_SIZE_MAX;
+extern const size_t PYRAMID_TILE_SIZE_DEFAULT;
+
+
+size_t getPyramidHeader(char *dest, const PlotCTX *p, size_t n);
+Pyramid * createPyramid(void);
+int initialisePyramid(Pyramid *pyramid, const PlotCTX *p, unsigned int threads);
+size_t getPyramidSize(const PlotCTX *p, unsigned int threads);
+int writePyramidRows(Pyramid *pyramid, const char *rows, size_t n);
+void freePyramid(Pyramid *pyramid);
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef RAW_H
+#define RAW_H
+
+
+#include <stdio.h>
+
+#include "parameters.h"
+
+
+/* Names the format, at the start of the header */
+#define RAW_MAGIC "ROLYMOIT"
+#define RAW_MAGIC_LEN (sizeof(RAW_MAGIC) - 1)
+
+/* The header is padded to a whole page, so the pixels can be mapped straight
+ * into memory
+ */
+#define RAW_HEADER_LEN 4096
+
+
+/* A raw image is the header - the magic, version, length of the parameters
+ * and the plot parameters as sent to a worker - followed by every row of the
+ * image as smoothed iteration values (BIT_DEPTH_ITERATIONS), so it can be
+ * coloured again without plotting it again
+ */
+int getRawHeader(unsigned char *dest, const PlotCTX *p);
+PlotCTX * readRawHeader(FILE *f);
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "array.h"
+#include "network_ctx.h"
+
+
+/* Minimum/maximum seconds between interim reports (0 for the final report only) */
+extern const double REPORT_INTERVAL_MIN;
+extern const double REPORT_INTERVAL_MAX;
+
+
+/* Statistics of a run, written as one JSON object per line: interim reports
+ * every `interval` seconds while plotting, and a final report at the end
+ */
+typedef struct RunReport
+{
+    FILE *file;          /* Report file (stdout if given as "-") */
+    double start;        /* Time the run started */
+    double interval;     /* Seconds between interim reports */
+    double last;         /* Time of the last report */
+    size_t blocks;       /* Blocks plotted */
+    double blockTime;    /* Seconds spent plotting blocks, summed */
+    double blockTimeMax; /* Seconds spent plotting the slowest block */
+    double writeWait;    /* Seconds spent waiting for the block writer */
+} RunReport;
+
+
+RunReport * createRunReport(void);
+int initialiseRunReport(RunReport *r, const char *filepath, double interval);
+void addBlockTime(RunReport *r, double seconds);
+void addWriteWait(RunReport *r, double seconds);
+bool isReportDue(const RunReport *r);
+int writeRunReport(RunReport *r, const Thread *threads, const NetworkCTX *network, bool final);
+void freeRunReport(RunReport *r);
+
+
+#endif
\ No newline at end of file
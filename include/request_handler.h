@@ -2,25 +2,34 @@
 #define REQUEST_HANDLER_H
 
 
+#include <stdbool.h>
 #include <stddef.h>
 
-#include <sys/types.h>
-
 #include "array.h"
+#include "connection.h"
 #include "network_ctx.h"
 #include "parameters.h"
+#include "protocol.h"
+
 
+int sendMessage(int s, const MessageHeader *h, void *body);
+int readMessage(NetworkCTX *network, int i, MessageHeader *h, unsigned char **body);
+int takeMessage(Connection *c, MessageHeader *h, unsigned char **body);
+int receiveMessageData(NetworkCTX *network, int i);
+int takeMessageHeader(Connection *c);
+int takePlotDone(NetworkCTX *network, int i);
 
-ssize_t writeSocket(const void *src, int s, size_t n);
-int blockingRead(NetworkCTX *network, int i, size_t n);
-int getRowNumber(Block *block, NetworkCTX *network, const PlotCTX *p);
-int nonblockingRead(NetworkCTX *network, int i);
-ssize_t readSocket(void *dest, int s, size_t n);
+int getWorkUnit(size_t *row, size_t *rows, NetworkCTX *network, const PlotCTX *p);
+int sendWorkUnit(const NetworkCTX *network, int i, size_t row, size_t rows);
+int sendHeartbeat(const NetworkCTX *network, int i);
+int sendPlotDone(const NetworkCTX *network, int i);
+int sendPlotNext(const NetworkCTX *network, int i, bool keep);
 
 int readParameters(NetworkCTX *network, PlotCTX **p);
+int readNextParameters(NetworkCTX *network, PlotCTX **p);
 int sendParameters(NetworkCTX *network, int i, const PlotCTX *p);
 
-int sendRowData(const NetworkCTX *network, Block *block);
+int sendRowData(NetworkCTX *network, Block *block, unsigned char *packed);
 
 
-#endif
\ No newline at end of file
+#endif
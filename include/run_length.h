@@ -0,0 +1,16 @@
+#ifndef RUN_LENGTH_H
+#define RUN_LENGTH_H
+
+
+#include <stddef.h>
+
+#include "colour.h"
+
+
+size_t getRunLengthUnit(BitDepth depth);
+
+size_t encodeRunLength(unsigned char *dest, size_t n, const unsigned char *src, size_t length, size_t unit);
+int decodeRunLength(unsigned char *dest, size_t length, const unsigned char *src, size_t n, size_t unit);
+
+
+#endif
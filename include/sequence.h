@@ -0,0 +1,38 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "parameters.h"
+#include "program_ctx.h"
+
+
+extern const size_t FRAME_COUNT_MIN;
+extern const size_t FRAME_COUNT_MAX;
+
+
+/* Frames of a zoom into a fixed centre, plotted one after another by one
+ * process. Each frame is the last magnified by the same amount, through the
+ * parsing of `-x`, and is written to the image filepath numbered by frame
+ */
+typedef struct Sequence
+{
+    size_t frames;                        /* Number of frames */
+    size_t frame;                         /* Frame being plotted */
+    char *step;                           /* `-x` argument magnifying a frame into the next */
+    bool doubling;                        /* Whether each frame is a 2x zoom of the last */
+    char filepath[PLOT_FILEPATH_LEN_MAX]; /* Image filepath the frame numbers are put into */
+} Sequence;
+
+
+Sequence * createSequence(void);
+int initialiseSequence(Sequence *s, const ProgramCTX *ctx, PlotCTX *p);
+int nextFrame(Sequence *s, PlotCTX *p);
+bool isLastFrame(const Sequence *s);
+int magnifyToLastFrame(PlotCTX *p, const ProgramCTX *ctx);
+void freeSequence(Sequence *s);
+
+
+#endif
\ No newline at end of file
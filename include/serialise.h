@@ -6,6 +6,7 @@
 
 #include "ext_precision.h"
 #include "parameters.h"
+#include "protocol.h"
 
 #ifdef MP_PREC
 #include <mpfr.h>
@@ -13,30 +14,35 @@
 
 
 #ifndef MP_PREC
-int serialisePrecision(char *dest, size_t n, PrecisionMode prec);
+int serialisePrecision(WireBuffer *w, PrecisionMode prec);
 #else
-int serialisePrecision(char *dest, size_t n, PrecisionMode prec, mpfr_prec_t bits);
+int serialisePrecision(WireBuffer *w, PrecisionMode prec, mpfr_prec_t bits);
 #endif
 
 #ifndef MP_PREC
-int deserialisePrecision(PrecisionMode *prec, char *src);
+int deserialisePrecision(PrecisionMode *prec, WireBuffer *w);
 #else
-int deserialisePrecision(PrecisionMode *prec, mpfr_prec_t *bits, char *src);
+int deserialisePrecision(PrecisionMode *prec, mpfr_prec_t *bits, WireBuffer *w);
 #endif
 
-int serialisePlotCTX(char *dest, size_t n, const PlotCTX *p);
-int serialisePlotCTXExt(char *dest, size_t n, const PlotCTX *p);
+int serialisePlot(WireBuffer *w, const PlotCTX *p);
+int deserialisePlot(PlotCTX **p, WireBuffer *w);
+
+int serialisePlotCTX(WireBuffer *w, const PlotCTX *p);
+int serialisePlotCTXExt(WireBuffer *w, const PlotCTX *p);
+int serialisePlotCTXDD(WireBuffer *w, const PlotCTX *p);
 
 #ifdef MP_PREC
-int serialisePlotCTXMP(char *dest, size_t n, const PlotCTX *p);
+int serialisePlotCTXMP(WireBuffer *w, const PlotCTX *p);
 #endif
 
-int deserialisePlotCTX(PlotCTX *p, char *src);
-int deserialisePlotCTXExt(PlotCTX *p, char *src);
+int deserialisePlotCTX(PlotCTX *p, WireBuffer *w);
+int deserialisePlotCTXExt(PlotCTX *p, WireBuffer *w);
+int deserialisePlotCTXDD(PlotCTX *p, WireBuffer *w);
 
 #ifdef MP_PREC
-int deserialisePlotCTXMP(PlotCTX *p, char *src);
+int deserialisePlotCTXMP(PlotCTX *p, WireBuffer *w);
 #endif
 
 
-#endif
\ No newline at end of file
+#endif
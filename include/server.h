@@ -0,0 +1,77 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <pthread.h>
+
+
+/* Limits of the control socket: clients connected at a time, jobs each may
+ * have queued, and the length and number of options of a request
+ */
+#define SERVER_CLIENTS_MAX 32
+#define SERVER_CLIENT_JOBS_MAX 64
+#define SERVER_LINE_LEN_MAX 4096
+#define SERVER_ARGS_MAX 64
+
+/* Length of the path of the socket, including the terminator (that of
+ * `sun_path`)
+ */
+#define SERVER_PATH_LEN_MAX 108
+
+
+/* Render job queued by a client - the options of a plot, split from the line
+ * of its request in place
+ */
+typedef struct ServerJob
+{
+    uint64_t id;                       /* Number the job was queued as */
+    int client;                        /* Client that queued the job (-1 once it has gone) */
+    int argc;
+    char *argv[SERVER_ARGS_MAX + 2];   /* Program name, then the options of the plot */
+    char line[SERVER_LINE_LEN_MAX];
+    struct ServerJob *next;            /* Next job of the same client */
+} ServerJob;
+
+typedef struct ServerClient
+{
+    int fd;                            /* Connection of the client (-1 if the slot is free) */
+    char line[SERVER_LINE_LEN_MAX];    /* Request read so far */
+    size_t read;
+    ServerJob *head;                   /* Jobs queued, oldest first */
+    ServerJob *tail;
+    size_t jobs;
+} ServerClient;
+
+/* Control socket of a render daemon, and the thread reading requests from its
+ * clients. Jobs are taken in turn from each client with any queued, so one
+ * client's queue does not hold up the others
+ */
+typedef struct Server
+{
+    pthread_t pid;
+    pthread_mutex_t mutex;
+    pthread_cond_t queued;             /* Signalled when a job is queued, or shutdown asked for */
+    int fd;                            /* Listening socket (-1 if not open) */
+    int wake;                          /* Event waking the control thread to exit */
+    char path[SERVER_PATH_LEN_MAX];    /* Path of the socket */
+    ServerClient clients[SERVER_CLIENTS_MAX];
+    ServerJob *current;                /* Job being rendered (if any) */
+    int turn;                          /* Client the next job is first looked for from */
+    uint64_t next;                     /* Number the next job is queued as */
+    bool running;                      /* Whether the control thread has been started */
+    bool shutdown;                     /* Whether shutdown has been asked for */
+} Server;
+
+
+Server * createServer(void);
+int initialiseServer(Server *s, const char *path);
+int waitServerJob(Server *s, ServerJob **job, unsigned int timeout);
+void finishServerJob(Server *s, ServerJob *job, int ret);
+void freeServer(Server *s);
+
+
+#endif
\ No newline at end of file
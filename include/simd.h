@@ -0,0 +1,37 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+
+#include <complex.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mandelbrot_parameters.h"
+
+
+/* Widest vector, in doubles, of any kernel */
+#define SIMD_LANES 8
+
+/* Number of pixels a kernel call may be given at once */
+#define SIMD_BATCH_LEN 256
+
+
+typedef enum SIMDExtension
+{
+    SIMD_GENERIC,
+    SIMD_AVX2,
+    SIMD_AVX512
+} SIMDExtension;
+
+
+SIMDExtension initialiseSIMD(void);
+
+void mandelbrotSIMD(unsigned long *n, complex *z, const complex *c, size_t count, Formula formula,
+                    unsigned int degree, unsigned long max, uintmax_t *iterations);
+void juliaSIMD(unsigned long *n, complex *z, const complex *c, size_t count, complex constant, Formula formula,
+               unsigned int degree, unsigned long max, uintmax_t *iterations);
+
+int getSIMDString(char *dest, SIMDExtension ext, size_t n);
+
+
+#endif
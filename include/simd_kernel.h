@@ -0,0 +1,181 @@
+/* Escape-time kernel template, included by simd.c once per instruction set.
+ * SIMD_KERNEL names the function, SIMD_KERNEL_FORMULA the loop it runs for
+ * each formula, and SIMD_KERNEL_LANES gives its vector width, which must be
+ * the native width of the enclosing target so that vector comparisons are not
+ * split into scalar ones
+ */
+#if !defined(SIMD_KERNEL) || !defined(SIMD_KERNEL_FORMULA) || !defined(SIMD_KERNEL_LANES)
+    #error "SIMD_KERNEL, SIMD_KERNEL_FORMULA and SIMD_KERNEL_LANES must be defined"
+#endif
+
+/* Select lanes of `a` where the mask is set, otherwise lanes of `b` */
+#define BLEND(mask, a, b) ((VectorDouble) (((VectorMask) (a) & (mask)) | ((VectorMask) (b) & ~(mask))))
+
+/* Clear the sign bit of every lane */
+#define ABS(a) ((VectorDouble) ((VectorMask) (a) & absMask))
+
+
+/* Iterate pixels SIMD_KERNEL_LANES at a time. Each lane holds one pixel; once
+ * it escapes or reaches the maximum its value is frozen, and every
+ * LANE_CHECK_INTERVAL iterations frozen lanes are retired and refilled with the
+ * next pixel, so lanes are never left idle waiting for slower neighbours.
+ *
+ * Always inlined with a constant formula, so each formula gets its own loop
+ * with no branch in the step
+ */
+static inline __attribute__ ((always_inline)) void SIMD_KERNEL_FORMULA(Lanes *s, Formula formula)
+{
+    typedef double VectorDouble __attribute__ ((vector_size (SIMD_KERNEL_LANES * sizeof(double))));
+    typedef int64_t VectorMask __attribute__ ((vector_size (SIMD_KERNEL_LANES * sizeof(int64_t))));
+
+    const size_t size = sizeof(VectorDouble);
+
+    double maxCount = (double) s->max;
+    double escapeRadiusSqr = ESCAPE_RADIUS_SQR;
+    unsigned int degree = s->degree;
+
+    VectorDouble stopCounts = {0.0};
+    stopCounts += maxCount + 1.0;
+
+    VectorMask absMask = {0};
+    absMask += INT64_MAX;
+
+    s->width = SIMD_KERNEL_LANES;
+
+    for (unsigned int l = 0; l < s->width; ++l)
+        fillLane(s, l);
+
+    while (s->active > 0)
+    {
+        VectorDouble zr, zi, cr, ci, nv, sr, si, checks, limit;
+        VectorMask done, periodic, save;
+
+        int64_t doneLanes[SIMD_KERNEL_LANES];
+        int64_t any = 0;
+
+        memcpy(&zr, s->zr, size);
+        memcpy(&zi, s->zi, size);
+        memcpy(&cr, s->cr, size);
+        memcpy(&ci, s->ci, size);
+        memcpy(&nv, s->nv, size);
+        memcpy(&sr, s->sr, size);
+        memcpy(&si, s->si, size);
+        memcpy(&checks, s->checks, size);
+        memcpy(&limit, s->limit, size);
+
+        for (int k = 0; k < LANE_CHECK_INTERVAL; ++k)
+        {
+            VectorDouble zr2 = zr * zr;
+            VectorDouble zi2 = zi * zi;
+            VectorDouble re, im;
+
+            /* Escape test on the squared magnitude to avoid a square root */
+            done = (zr2 + zi2 >= escapeRadiusSqr) | (nv >= maxCount);
+
+            switch (formula)
+            {
+                case FORMULA_MULTIBROT:
+                    /* z^d by repeated multiplication from z^2 */
+                    re = zr2 - zi2;
+                    im = 2.0 * zr * zi;
+
+                    for (unsigned int d = 2; d < degree; ++d)
+                    {
+                        VectorDouble t = re * zr - im * zi;
+                        im = re * zi + im * zr;
+                        re = t;
+                    }
+
+                    im += ci;
+                    re += cr;
+                    break;
+                case FORMULA_BURNING_SHIP:
+                    im = ABS(2.0 * zr * zi) + ci;
+                    re = zr2 - zi2 + cr;
+                    break;
+                case FORMULA_TRICORN:
+                    im = ci - 2.0 * zr * zi;
+                    re = zr2 - zi2 + cr;
+                    break;
+                default:
+                    im = 2.0 * zr * zi + ci;
+                    re = zr2 - zi2 + cr;
+                    break;
+            }
+
+            /* Frozen lanes keep their value */
+            zi = BLEND(done, zi, im);
+            zr = BLEND(done, zr, re);
+            nv = BLEND(done, nv, nv + 1.0);
+        }
+
+        done = (zr * zr + zi * zi >= escapeRadiusSqr) | (nv >= maxCount);
+
+        /* A lane returning exactly to its saved value is periodic, so never
+         * escapes. The saved value is replaced after a doubling number of
+         * checks (Brent's method), so cycles of any length are eventually found.
+         * Its count is moved past the maximum, keeping the iterations it ran
+         */
+        periodic = (zr == sr) & (zi == si) & ~done;
+        nv = BLEND(periodic, stopCounts + nv, nv);
+        done |= periodic;
+
+        checks += 1.0;
+        save = (checks >= limit);
+
+        sr = BLEND(save, zr, sr);
+        si = BLEND(save, zi, si);
+        limit = BLEND(save, 2.0 * limit, limit);
+        checks = BLEND(save, checks - checks, checks);
+
+        memcpy(s->zr, &zr, size);
+        memcpy(s->zi, &zi, size);
+        memcpy(s->nv, &nv, size);
+        memcpy(s->sr, &sr, size);
+        memcpy(s->si, &si, size);
+        memcpy(s->checks, &checks, size);
+        memcpy(s->limit, &limit, size);
+        memcpy(doneLanes, &done, size);
+
+        for (unsigned int l = 0; l < SIMD_KERNEL_LANES; ++l)
+            any |= doneLanes[l];
+
+        if (!any)
+            continue;
+
+        /* Retire finished lanes and refill them */
+        for (unsigned int l = 0; l < SIMD_KERNEL_LANES; ++l)
+        {
+            if (doneLanes[l] && s->lane[l] != LANE_EMPTY)
+                retireLane(s, l);
+        }
+    }
+}
+
+
+/* Run the loop of the batch's formula */
+static void SIMD_KERNEL(Lanes *s)
+{
+    switch (s->formula)
+    {
+        case FORMULA_MULTIBROT:
+            SIMD_KERNEL_FORMULA(s, FORMULA_MULTIBROT);
+            break;
+        case FORMULA_BURNING_SHIP:
+            SIMD_KERNEL_FORMULA(s, FORMULA_BURNING_SHIP);
+            break;
+        case FORMULA_TRICORN:
+            SIMD_KERNEL_FORMULA(s, FORMULA_TRICORN);
+            break;
+        default:
+            SIMD_KERNEL_FORMULA(s, FORMULA_MANDELBROT);
+            break;
+    }
+}
+
+
+#undef ABS
+#undef BLEND
+#undef SIMD_KERNEL
+#undef SIMD_KERNEL_FORMULA
+#undef SIMD_KERNEL_LANES
@@ -0,0 +1,44 @@
+#ifndef STATS_H
+#define STATS_H
+
+
+#include <stdint.h>
+
+
+/* Work done by a plotting thread, counted as it plots. Each thread only
+ * touches its own, so they are read once the thread is idle
+ */
+typedef struct ThreadStats
+{
+    uintmax_t pixels;     /* Pixels iterated */
+    uintmax_t iterations; /* Iterations actually run on those pixels (and on any subsamples) */
+    uintmax_t escaped;    /* Pixels iterated that escaped (the rest are interior) */
+    uintmax_t filled;     /* Interior pixels filled by subdivision without being iterated */
+    uintmax_t reused;     /* Pixels taken from the last frame of a sequence without being iterated */
+    uintmax_t samples;    /* Subsamples of edge pixels iterated to anti-alias them */
+    uintmax_t tiles;      /* Tiles (or rows) plotted */
+    double busy;          /* Seconds spent plotting */
+} ThreadStats;
+
+/* Traffic of a worker's connection, as seen by the master. Kept under the
+ * listener's lock
+ */
+typedef struct ConnectionStats
+{
+    uintmax_t rows;       /* Rows received and taken into the image */
+    uintmax_t bytes;      /* Bytes of rows received, including rows thrown away */
+    uintmax_t units;      /* Units of work completed */
+    double turnaround;    /* Seconds from sending each unit to receiving its last row, summed */
+    double idle;          /* Seconds with no unit outstanding */
+    double idleSince;     /* Time the worker ran out of units (negative while it has some) */
+} ConnectionStats;
+
+
+ThreadStats createThreadStats(void);
+ConnectionStats createConnectionStats(void);
+void addConnectionStats(ConnectionStats *total, const ConnectionStats *s, double now);
+
+double getMonotonicTime(void);
+
+
+#endif
\ No newline at end of file
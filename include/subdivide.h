@@ -0,0 +1,47 @@
+#ifndef SUBDIVIDE_H
+#define SUBDIVIDE_H
+
+
+#include <stddef.h>
+
+
+/* Side length of the tiles used when subdividing and no tile size is set */
+#define SUBDIVIDE_TILE_LEN 64
+
+
+/* Escape status of each pixel of a tile */
+typedef enum SubdivisionStatus
+{
+    SUBDIVISION_UNKNOWN,
+    SUBDIVISION_ESCAPED,
+    SUBDIVISION_UNESCAPED
+} SubdivisionStatus;
+
+/* Plot the rectangle of pixels from (x, y), storing each pixel's status in
+ * rows of `stride` elements (if `status` is not NULL)
+ */
+typedef int (*PlotRectangle)(void *data, size_t x, size_t y, size_t width, size_t height, unsigned char *status,
+                             size_t stride);
+
+/* Colour the rectangle of pixels from (x, y) as unescaped */
+typedef int (*FillRectangle)(void *data, size_t x, size_t y, size_t width, size_t height);
+
+typedef struct Subdivision
+{
+    PlotRectangle plot;    /* Computes pixels */
+    FillRectangle fill;    /* Fills pixels without computing them */
+    void *data;            /* Passed to the plot and fill functions */
+    size_t capacity;       /* Maximum number of pixels in a tile */
+    size_t xStart, yStart; /* Position of the current tile in the block */
+    size_t width;          /* Number of columns in the current tile */
+    unsigned char *status; /* Status of each pixel of the current tile */
+} Subdivision;
+
+
+Subdivision * createSubdivision(size_t width, size_t height);
+void initialiseSubdivision(Subdivision *s, PlotRectangle plot, FillRectangle fill, void *data);
+int subdivideTile(Subdivision *s, size_t xStart, size_t xEnd, size_t yStart, size_t yEnd);
+void freeSubdivision(Subdivision *s);
+
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef SYMMETRY_H
+#define SYMMETRY_H
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <sys/types.h>
+
+#include "array.h"
+#include "parameters.h"
+
+
+/* Rows of a plot that are the image of earlier rows. A Mandelbrot set is
+ * mirrored in the real axis, so row y is row `axis` - y. A Julia set is
+ * unchanged by a half turn about the origin, so row y is row `axis` - y
+ * reversed - provided the columns are centred on the origin too. The other
+ * formulas share these symmetries, except where getSymmetry() finds otherwise
+ */
+typedef struct Symmetry
+{
+    bool rotate;  /* Whether rows are reversed as well as mirrored */
+    size_t axis;  /* Sum of the indices of a row and its image */
+    size_t first; /* First row that is the image of an earlier row */
+    size_t last;  /* Last row that is the image of an earlier row */
+} Symmetry;
+
+
+int getSymmetry(Symmetry *s, const PlotCTX *p);
+void setBlockMirror(Block *block, const Symmetry *s, bool readable);
+bool isMirroredImageRow(const Symmetry *s, size_t y, size_t rows, bool readable);
+int mirrorBlock(Block *block, const Symmetry *s, FILE *f, off_t offset);
+
+
+#endif
\ No newline at end of file
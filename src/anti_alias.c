@@ -0,0 +1,275 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libgroot/include/log.h"
+
+#include "anti_alias.h"
+
+#include "array.h"
+#include "colour.h"
+#include "parameters.h"
+#include "stats.h"
+
+
+/* Difference in any channel between neighbouring pixels that marks them as an
+ * edge. Smooth bands of colour change by less than this from pixel to pixel
+ */
+#define ANTI_ALIAS_THRESHOLD 24
+
+
+const unsigned int ANTI_ALIAS_GRID_MIN = 2;
+const unsigned int ANTI_ALIAS_GRID_MAX = 16;
+const unsigned int ANTI_ALIAS_GRID_DEFAULT = 3;
+
+
+static bool isMirroredRow(const Block *block, size_t y);
+static bool isColourEdge(const unsigned char *a, const unsigned char *b, size_t size);
+static uint64_t hashSample(size_t x, size_t y, unsigned int sample);
+
+
+AntiAlias * createAntiAlias(void)
+{
+    AntiAlias *aa = malloc(sizeof(*aa));
+
+    if (aa)
+    {
+        aa->edges = NULL;
+        aa->halo = NULL;
+    }
+
+    return aa;
+}
+
+
+/* Allocate the map of edge pixels for blocks of up to `rows` rows. Returns 1
+ * if the image has too few colours to blend, or the map could not be allocated
+ */
+int initialiseAntiAlias(AntiAlias *aa, const PlotCTX *p, unsigned int grid, size_t rows)
+{
+    if (!aa)
+        return 1;
+
+    if (p->colour.depth != BIT_DEPTH_8 && p->colour.depth != BIT_DEPTH_24)
+    {
+        logMessage(WARNING, "Only 8-bit and 24-bit images can be anti-aliased - plotting without it");
+        return 1;
+    }
+
+    aa->grid = grid;
+    aa->width = p->width;
+    aa->rows = rows;
+    aa->stride = (p->width + CHAR_BIT - 1) / CHAR_BIT;
+    aa->rowSize = p->width * (p->colour.depth / CHAR_BIT);
+    aa->kept = 0;
+    aa->above = NULL;
+    aa->below = NULL;
+
+    if (rows > SIZE_MAX / aa->stride || !(aa->edges = malloc(rows * aa->stride))
+        || !(aa->halo = malloc(2 * aa->rowSize)))
+    {
+        logMessage(WARNING, "Could not allocate memory to find edges - plotting without anti-aliasing");
+        return 1;
+    }
+
+    logMessage(INFO, "Anti-aliasing edges with %u points to a pixel", grid * grid);
+
+    return 0;
+}
+
+
+/* Thread function marking the pixels of the thread's block that differ sharply
+ * from a neighbour. Each thread takes a share of whole rows, so no byte of the
+ * map is written by two. Mirrored rows are copied once the block is blended,
+ * so are neither marked nor compared with. The rows either side of the block
+ * are those set in `above` and `below`
+ */
+void * findEdges(void *threadInfo)
+{
+    Thread *t = threadInfo;
+    const Block *block = t->block;
+    AntiAlias *aa = block->antiAlias;
+
+    size_t rows = (block->remainder) ? block->remainderRows : block->rows;
+    size_t first = rows * t->tid / t->tCount;
+    size_t last = rows * (t->tid + 1) / t->tCount;
+    size_t size = block->memSize;
+
+    double start = getMonotonicTime();
+
+    for (size_t y = first; y < last; ++y)
+    {
+        unsigned char *edges = aa->edges + y * aa->stride;
+        const unsigned char *row = (const unsigned char *) block->array + y * block->rowSize;
+        const unsigned char *above, *below;
+
+        memset(edges, 0, aa->stride);
+
+        if (isMirroredRow(block, y))
+            continue;
+
+        above = (y == 0) ? aa->above : (!isMirroredRow(block, y - 1)) ? row - block->rowSize : NULL;
+        below = (y + 1 == rows) ? aa->below : (!isMirroredRow(block, y + 1)) ? row + block->rowSize : NULL;
+
+        for (size_t x = 0; x < aa->width; ++x)
+        {
+            const unsigned char *px = row + x * size;
+
+            if ((x > 0 && isColourEdge(px, px - size, size))
+                || (x + 1 < aa->width && isColourEdge(px, px + size, size))
+                || (above && isColourEdge(px, above + x * size, size))
+                || (below && isColourEdge(px, below + x * size, size)))
+            {
+                edges[x / CHAR_BIT] |= (unsigned char) (1u << (x % CHAR_BIT));
+            }
+        }
+    }
+
+    t->stats.busy += getMonotonicTime() - start;
+
+    return NULL;
+}
+
+
+/* Keep the last row of a plotted block before it is blended, to be compared
+ * with image row `next` at the start of the next block
+ */
+void keepRow(AntiAlias *aa, const char *row, size_t next)
+{
+    memcpy(aa->halo, row, aa->rowSize);
+    aa->kept = next;
+}
+
+
+/* Whether pixel (x, y) of the block is to be supersampled */
+bool isEdgePixel(const AntiAlias *aa, size_t x, size_t y)
+{
+    return (aa->edges[y * aa->stride + x / CHAR_BIT] >> (x % CHAR_BIT)) & 1u;
+}
+
+
+/* Number of points plotted again for each edge pixel. With an odd grid, the
+ * middle point is the pixel's own, which is already plotted
+ */
+unsigned int getSampleCount(const AntiAlias *aa)
+{
+    return aa->grid * aa->grid - aa->grid % 2;
+}
+
+
+/* Get the offset, in pixels from its centre, of point `sample` of pixel (x, y)
+ * of the image. Each point is jittered within its own cell of the grid, by a
+ * hash of the pixel, so plots are repeatable and no pattern shows
+ */
+void getSampleOffset(double *dx, double *dy, const AntiAlias *aa, size_t x, size_t y, unsigned int sample)
+{
+    unsigned int cell = (aa->grid % 2 && sample >= aa->grid * aa->grid / 2) ? sample + 1 : sample;
+    uint64_t h = hashSample(x, y, sample);
+
+    /* 24 bits of the hash each, as fractions of a cell */
+    double u = (double) (h >> 40) / (double) (UINT64_C(1) << 24);
+    double v = (double) ((h >> 8) & 0xFFFFFF) / (double) (UINT64_C(1) << 24);
+
+    *dx = ((cell % aa->grid) + u) / aa->grid - 0.5;
+    *dy = ((cell / aa->grid) + v) / aa->grid - 0.5;
+}
+
+
+/* Set an edge pixel to the mean colour of its points, including its own if it
+ * lies in the grid. 8-bit points only hold their shade in the red channel
+ */
+void blendSamples(char *px, const RGB *samples, const AntiAlias *aa, BitDepth depth)
+{
+    unsigned int count = getSampleCount(aa);
+    unsigned int n = count;
+    unsigned int r = 0, g = 0, b = 0;
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        r += samples[i].r;
+        g += samples[i].g;
+        b += samples[i].b;
+    }
+
+    if (depth == BIT_DEPTH_8)
+    {
+        if (aa->grid % 2)
+        {
+            r += *((uint8_t *) px);
+            ++n;
+        }
+
+        *((uint8_t *) px) = (uint8_t) ((r + n / 2) / n);
+        return;
+    }
+
+    if (aa->grid % 2)
+    {
+        const RGB *own = (const RGB *) px;
+
+        r += own->r;
+        g += own->g;
+        b += own->b;
+        ++n;
+    }
+
+    ((RGB *) px)->r = (uint8_t) ((r + n / 2) / n);
+    ((RGB *) px)->g = (uint8_t) ((g + n / 2) / n);
+    ((RGB *) px)->b = (uint8_t) ((b + n / 2) / n);
+}
+
+
+void freeAntiAlias(AntiAlias *aa)
+{
+    if (aa)
+    {
+        free(aa->edges);
+        free(aa->halo);
+    }
+
+    free(aa);
+}
+
+
+/* Whether row `y` of the block is left to be copied from its image */
+static bool isMirroredRow(const Block *block, size_t y)
+{
+    return (y >= block->mirrorStart && y < block->mirrorEnd);
+}
+
+
+/* Whether two pixels of `size` bytes differ by more than the threshold in any
+ * channel
+ */
+static bool isColourEdge(const unsigned char *a, const unsigned char *b, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (abs((int) a[i] - (int) b[i]) > ANTI_ALIAS_THRESHOLD)
+            return true;
+    }
+
+    return false;
+}
+
+
+/* Mix the coordinates of a point into 64 well-spread bits (the finaliser of
+ * SplitMix64)
+ */
+static uint64_t hashSample(size_t x, size_t y, unsigned int sample)
+{
+    uint64_t h = (uint64_t) x * UINT64_C(0x9E3779B97F4A7C15)
+                 ^ (uint64_t) y * UINT64_C(0xC2B2AE3D27D4EB4F)
+                 ^ (uint64_t) sample * UINT64_C(0x165667B19E3779F9);
+
+    h ^= h >> 30;
+    h *= UINT64_C(0xBF58476D1CE4E5B9);
+    h ^= h >> 27;
+    h *= UINT64_C(0x94D049BB133111EB);
+    h ^= h >> 31;
+
+    return h;
+}
\ No newline at end of file
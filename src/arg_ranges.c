@@ -6,6 +6,8 @@
 
 #include "arg_ranges.h"
 
+#include "connection.h"
+
 #ifdef MP_PREC
 #include "ext_precision.h"
 
@@ -50,6 +52,12 @@ const long double MAGNIFICATION_MAX_EXT = LDBL_MAX;
 const unsigned long ITERATIONS_MIN = 0UL;
 const unsigned long ITERATIONS_MAX = ULONG_MAX;
 
+/* Range of permissible Multibrot degrees. An escaped value is at most
+ * ESCAPE_RADIUS^d, so its squared magnitude stays well within double
+ */
+const unsigned int DEGREE_MIN = 2;
+const unsigned int DEGREE_MAX = 32;
+
 /* Range of permissible dimensions */
 const size_t WIDTH_MIN = 1;
 const size_t WIDTH_MAX = SIZE_MAX;
@@ -60,7 +68,25 @@ const uint16_t PORT_MIN = 1024;
 const uint16_t PORT_MAX = 65534;
 
 const int WORKERS_MIN = 1;
-const int WORKERS_MAX = 32;
+const int WORKERS_MAX = 4096;
+
+/* Range of permissible I/O threads on a master */
+const unsigned int IO_THREADS_MIN = 1;
+const unsigned int IO_THREADS_MAX = 64;
+
+/* Range of permissible seconds between heartbeats, and seconds a worker keeps
+ * trying to reach its master
+ */
+const unsigned int HEARTBEAT_MIN = 1;
+const unsigned int HEARTBEAT_MAX = 3600;
+const unsigned int RETRY_MIN = 0;
+const unsigned int RETRY_MAX = 86400;
+
+/* Range of permissible units of work given to each worker */
+const size_t UNIT_ROWS_MIN = 1;
+const size_t UNIT_ROWS_MAX = 65536;
+const unsigned int UNIT_DEPTH_MIN = 1;
+const unsigned int UNIT_DEPTH_MAX = CONNECTION_UNITS_MAX;
 
 #ifdef MP_PREC
 /* Range of permissible precisions (multiple-precision) */
@@ -1,24 +1,50 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/types.h>
 #include <unistd.h>
 
 #include "libgroot/include/log.h"
 
 #include "array.h"
 
+#include "ext_precision.h"
+#include "memory_limit.h"
+#include "numa.h"
 #include "parameters.h"
+#include "perturbation.h"
+#include "subdivide.h"
 
 
-/* Percentage of free physical memory that can be allocated by the program */
+/* Percentage of available physical memory that can be allocated by the program */
 const unsigned int FREE_MEMORY_ALLOCATION = 80;
 
+/* Size in bytes of a cache line, to which the spans of a row are aligned */
+#define CACHE_LINE_SIZE 64
 
-static int allocateImageBlock(Block *block, size_t mem);
+/* Rows of a block are a multiple of this (unless fewer), as tiles are */
+#define BLOCK_ROW_ALIGN SUBDIVIDE_TILE_LEN
+
+
+static int allocateImageBlock(Block *block, size_t mem, unsigned int buffers, size_t reserve);
+static size_t alignBlockRows(size_t rows, size_t height);
+static int allocateArray(Block *block, size_t size);
+static void freeArray(Block *block);
+
+static ThreadPool * createThreadPool(void);
+static void freeThreadPool(ThreadPool *pool);
+static void * poolThread(void *threadInfo);
+static int queueWorkItem(Thread *threads, void * (*function)(void *), Block *block, size_t *sequence);
+static void shareTiles(WorkItem *item, const ThreadPool *pool, size_t tiles);
+static void * touchRows(void *threadInfo);
 
-static size_t getFreeMemory(void);
 static unsigned int getThreadCount(void);
 
 
@@ -28,13 +54,27 @@ Block * createBlock(void)
     Block *block = malloc(sizeof(Block));
 
     if (block)
+    {
         block->array = NULL;
+        block->map = NULL;
+        block->orbit = NULL;
+        block->reuse = NULL;
+        block->antiAlias = NULL;
+        block->subdivide = false;
+        block->mirrorStart = 0;
+        block->mirrorEnd = 0;
+        block->hugePages = false;
+        block->arrayMapSize = 0;
+    }
     
     return block;
 }
 
 
-int initialiseBlock(Block *block, PlotCTX *p, size_t mem)
+/* Set values of a block and allocate its array, leaving memory for `buffers`
+ * arrays of the same size and `reserve` bytes besides in total
+ */
+int initialiseBlock(Block *block, PlotCTX *p, size_t mem, unsigned int buffers, size_t reserve)
 {
     if (!block || !p)
         return 1;
@@ -43,6 +83,9 @@ int initialiseBlock(Block *block, PlotCTX *p, size_t mem)
     block->parameters = p;
     block->remainder = false;
 
+    block->tileWidth = p->width;
+    block->tileHeight = 1;
+
     block->memSize = (block->parameters->colour.depth <= CHAR_BIT || block->parameters->colour.depth == BIT_DEPTH_ASCII)
                      ? sizeof(char)
                      : block->parameters->colour.depth / CHAR_BIT;
@@ -52,13 +95,30 @@ int initialiseBlock(Block *block, PlotCTX *p, size_t mem)
                      : (block->parameters->width * block->parameters->colour.depth) / CHAR_BIT;
 
     /* Allocate memory to the block */
-    if (allocateImageBlock(block, mem))
+    if (allocateImageBlock(block, mem, buffers, reserve))
         return 1;
 
     return 0;
 }
 
 
+/* Initialise a block as another array for the same image as `src`, so one
+ * can be filled while the other is written. The reference orbit is shared,
+ * and remains owned by `src`
+ */
+int initialiseBlockBuffer(Block *block, const Block *src)
+{
+    if (!block || !src)
+        return 1;
+
+    *block = *src;
+
+    block->map = NULL;
+
+    return allocateArray(block, block->blockSize);
+}
+
+
 int initialiseBlockAsRow(Block *block, PlotCTX *p)
 {
     if (!block || !p)
@@ -81,16 +141,145 @@ int initialiseBlockAsRow(Block *block, PlotCTX *p)
     block->blockSize = block->rowSize;
     block->remainderBlockSize = 0;
 
-    block->array = malloc(block->blockSize);
+    /* Threads claim contiguous spans of the row, each a whole number of cache
+     * lines. A sub-byte pixel depth packs CHAR_BIT pixels per byte, so its
+     * spans are wider and start on a byte
+     */
+    if (p->colour.depth < CHAR_BIT && p->colour.depth != BIT_DEPTH_ASCII)
+        setBlockTiles(block, CACHE_LINE_SIZE * CHAR_BIT, 1);
+    else
+        setBlockTiles(block, CACHE_LINE_SIZE, 1);
 
-    return (block->array) ? 0 : 1;
+    /* Align the row so spans do not share a cache line */
+    if (posix_memalign((void **) &(block->array), CACHE_LINE_SIZE, block->blockSize))
+    {
+        block->array = NULL;
+        return 1;
+    }
+
+    return 0;
 }
 
 
-/* Generate a list of threads */
+/* Initialise a block as the whole image, in place in the image file. The file
+ * is extended to its full length and mapped into memory, so threads write
+ * each pixel straight to where it lies in the file, in any order, and the
+ * page cache writes it back. The file must be open, and at the position of
+ * its first row
+ */
+int initialiseBlockAsMap(Block *block, PlotCTX *p)
+{
+    off_t offset;
+
+    if (!block || !p || !p->file)
+        return 1;
+
+    block->id = 0;
+    block->bCount = 1;
+    block->parameters = p;
+    block->rows = p->height;
+    block->remainderRows = 0;
+    block->remainder = false;
+
+    block->tileWidth = p->width;
+    block->tileHeight = 1;
+
+    block->memSize = (block->parameters->colour.depth <= CHAR_BIT || block->parameters->colour.depth == BIT_DEPTH_ASCII)
+                     ? sizeof(char)
+                     : block->parameters->colour.depth / CHAR_BIT;
+
+    block->rowSize = (block->parameters->colour.depth == BIT_DEPTH_ASCII)
+                     ? block->parameters->width
+                     : (block->parameters->width * block->parameters->colour.depth) / CHAR_BIT;
+
+    block->blockSize = block->rows * block->rowSize;
+    block->remainderBlockSize = 0;
+
+    if (fflush(p->file) || (offset = ftello(p->file)) < 0)
+    {
+        logMessage(ERROR, "Could not find position of image data");
+        return 1;
+    }
+
+    if (block->blockSize == 0 || block->blockSize > SIZE_MAX - (size_t) offset)
+    {
+        logMessage(ERROR, "Image is too large to be mapped");
+        return 1;
+    }
+
+    block->mapSize = (size_t) offset + block->blockSize;
+
+    logMessage(DEBUG, "Mapping image file (%zu bytes)", block->mapSize);
+
+    if (ftruncate(fileno(p->file), (off_t) block->mapSize))
+    {
+        logMessage(ERROR, "Image file could not be extended to %zu bytes", block->mapSize);
+        return 1;
+    }
+
+    block->map = mmap(NULL, block->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(p->file), 0);
+
+    if (block->map == MAP_FAILED)
+    {
+        logMessage(ERROR, "Image file could not be mapped into memory");
+        block->map = NULL;
+        return 1;
+    }
+
+    block->array = block->map + offset;
+
+    return 0;
+}
+
+
+/* Set the dimensions of the tiles that threads claim from the block. A width
+ * of 0 spans the whole row
+ */
+void setBlockTiles(Block *block, size_t width, size_t height)
+{
+    size_t columns = block->parameters->width;
+
+    if (width == 0 || width > columns)
+        width = columns;
+
+    /* Sub-byte pixels must not share a byte between two tiles */
+    if (block->parameters->colour.depth < CHAR_BIT && block->parameters->colour.depth != BIT_DEPTH_ASCII
+        && width % CHAR_BIT != 0)
+    {
+        width += CHAR_BIT - (width % CHAR_BIT);
+
+        if (width > columns)
+            width = columns;
+    }
+
+    block->tileWidth = width;
+    block->tileHeight = (height > 0) ? height : 1;
+
+    logMessage(DEBUG, "Work divided into tiles of %zu px * %zu px", block->tileWidth, block->tileHeight);
+}
+
+
+/* Number of tiles in the current block */
+size_t getBlockTileCount(const Block *block)
+{
+    size_t rows = (block->remainder) ? block->remainderRows : block->rows;
+    size_t columns = block->parameters->width;
+
+    size_t tilesPerRow = (columns + block->tileWidth - 1) / block->tileWidth;
+    size_t tilesPerColumn = (rows + block->tileHeight - 1) / block->tileHeight;
+
+    return tilesPerRow * tilesPerColumn;
+}
+
+
+/* Generate a list of threads and start them as a persistent pool. The
+ * threads sleep until work is queued with queueThreads() or runThreads(), and
+ * are only harvested by freeThreads()
+ */
 Thread * createThreads(Block *block, unsigned int n)
 {
     Thread *threads;
+    ThreadPool *pool;
 
     /* Get number of processors if user has not set a thread count limit */
     if (n < 1)
@@ -113,6 +302,15 @@ Thread * createThreads(Block *block, unsigned int n)
         logMessage(ERROR, "Memory allocation failed");
         return NULL;
     }
+
+    pool = createThreadPool();
+
+    if (!pool)
+    {
+        logMessage(ERROR, "Thread pool could not be created");
+        free(threads);
+        return NULL;
+    }
     
     for (unsigned int i = 0; i < n; ++i)
     {
@@ -120,21 +318,282 @@ Thread * createThreads(Block *block, unsigned int n)
         threads[i].tid = i;
         threads[i].tCount = n;
         threads[i].block = block;
+        threads[i].pool = pool;
+        threads[i].item = 0;
+        threads[i].stats = createThreadStats();
+        threads[i].node = 0;
+        threads[i].nodeRank = i;
+
+        #ifdef MP_PREC
+        threads[i].scratch = NULL;
+        #endif
+
+        #ifdef OPENCL
+        threads[i].gpu = NULL;
+        #endif
     }
 
+    /* Until pinned, the threads are taken to share a node */
+    pool->nodes = 1;
+    pool->nodeThreads[0] = n;
+
     logMessage(DEBUG, "Thread array generated");
 
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        logMessage(DEBUG, "Spawning thread %u", i);
+
+        if (pthread_create(&(threads[i].pid), NULL, poolThread, &(threads[i])))
+        {
+            logMessage(ERROR, "Thread could not be created");
+            freeThreads(threads);
+            return NULL;
+        }
+
+        ++(pool->running);
+    }
+
+    logMessage(DEBUG, "All %u threads successfully created", n);
+
     return threads;
 }
 
 
+#ifdef OPENCL
+/* Generate the pool of createThreads() with one more thread, which plots on
+ * the GPU (if any) and frees it with the pool. The GPU thread mostly waits on
+ * the device, so is added to the processor threads rather than taking the
+ * place of one
+ */
+Thread * createThreadsGPU(Block *block, unsigned int n, GPU *gpu)
+{
+    Thread *threads;
+
+    if (!gpu)
+        return createThreads(block, n);
+
+    if (n < 1)
+        n = getThreadCount();
+
+    if (n < 1)
+        n = 1;
+
+    threads = createThreads(block, n + 1);
+
+    if (!threads)
+    {
+        freeGPU(gpu);
+        return NULL;
+    }
+
+    /* The threads only read the GPU once work is queued to them */
+    threads[n].gpu = gpu;
+
+    return threads;
+}
+#endif
+
+
+/* Pin each thread of the pool to a CPU, and have the threads of each NUMA
+ * node claim tiles from their own share of each block. Must be called before
+ * any work is queued
+ */
+int pinThreads(Thread *threads, AffinityPolicy policy)
+{
+    ThreadPool *pool = threads->pool;
+    unsigned int nodeThreads[NUMA_NODES_MAX] = {0};
+    Topology *topology;
+
+    if (policy == AFFINITY_NONE)
+        return 0;
+
+    topology = createTopology();
+
+    if (!topology || initialiseTopology(topology))
+    {
+        logMessage(ERROR, "Could not find the CPUs threads may be pinned to");
+        freeTopology(topology);
+        return 1;
+    }
+
+    for (unsigned int i = 0; i < threads->tCount; ++i)
+    {
+        unsigned int cpu = getAffinityCPU(topology, policy, i);
+
+        if (pinThread(threads[i].pid, topology->cpus[cpu]))
+        {
+            logMessage(ERROR, "Thread %u could not be pinned to CPU %d", i, topology->cpus[cpu]);
+            freeTopology(topology);
+            return 1;
+        }
+
+        threads[i].node = topology->nodes[cpu];
+        threads[i].nodeRank = nodeThreads[threads[i].node]++;
+
+        logMessage(DEBUG, "Thread %u pinned to CPU %d (node %u)", i, topology->cpus[cpu], threads[i].node);
+    }
+
+    pthread_mutex_lock(&(pool->mutex));
+    pool->nodes = topology->nodeCount;
+    memcpy(pool->nodeThreads, nodeThreads, sizeof(pool->nodeThreads));
+    pthread_mutex_unlock(&(pool->mutex));
+
+    logMessage(INFO, "%u threads pinned across %u NUMA node(s)", threads->tCount, topology->nodeCount);
+
+    freeTopology(topology);
+
+    return 0;
+}
+
+
+/* Clear the work done by an idle pool, so a pool kept across plots reports
+ * each plot's work alone
+ */
+void resetThreadStats(Thread *threads)
+{
+    if (!threads)
+        return;
+
+    for (unsigned int i = 0; i < threads->tCount; ++i)
+        threads[i].stats = createThreadStats();
+}
+
+
+/* Queue a function for every thread in the pool to run on a block. Returns
+ * once the item is queued (waiting for space in the queue if it is full)
+ */
+int queueThreads(Thread *threads, void * (*function)(void *), Block *block)
+{
+    size_t sequence;
+
+    return queueWorkItem(threads, function, block, &sequence);
+}
+
+
+/* Wait for every queued work item to be completed by all threads */
+void waitThreads(Thread *threads)
+{
+    ThreadPool *pool;
+
+    if (!threads)
+        return;
+
+    pool = threads->pool;
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    while (pool->tail != pool->head)
+        pthread_cond_wait(&(pool->completed), &(pool->mutex));
+
+    pthread_mutex_unlock(&(pool->mutex));
+}
+
+
+/* Have every thread run a function on a block and wait for them to finish.
+ * Only this item is waited for, so a pool shared by two callers (the master's
+ * local worker and its anti-aliasing) does not hold either up on the other
+ */
+int runThreads(Thread *threads, void * (*function)(void *), Block *block)
+{
+    ThreadPool *pool;
+    size_t sequence;
+
+    if (queueWorkItem(threads, function, block, &sequence))
+        return 1;
+
+    pool = threads->pool;
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    while (pool->tail <= sequence)
+        pthread_cond_wait(&(pool->completed), &(pool->mutex));
+
+    pthread_mutex_unlock(&(pool->mutex));
+
+    return 0;
+}
+
+
+/* Claim the next unprocessed tile of the thread's current work item. Threads
+ * keep claiming until every tile is gone, so cheap tiles do not leave threads
+ * idle while others finish the expensive ones. Threads pinned across NUMA
+ * nodes claim from their own node's share of the block first, then help the
+ * other nodes. Returns 1 when none are left
+ */
+int claimTile(Thread *t, size_t *tile)
+{
+    int ret = 1;
+
+    ThreadPool *pool = t->pool;
+    WorkItem *item = &(pool->queue[t->item % THREAD_POOL_QUEUE_LEN]);
+    const Block *block = t->block;
+    size_t rows = (block->remainder) ? block->remainderRows : block->rows;
+    size_t tilesPerRow = (block->parameters->width + block->tileWidth - 1) / block->tileWidth;
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    for (unsigned int k = 0; k < pool->nodes && ret; ++k)
+    {
+        unsigned int node = (t->node + k) % pool->nodes;
+
+        while (item->claimed[node] < item->end[node])
+        {
+            size_t yStart = (item->claimed[node] / tilesPerRow) * block->tileHeight;
+            size_t yEnd = (yStart + block->tileHeight < rows) ? yStart + block->tileHeight : rows;
+
+            *tile = (item->claimed[node])++;
+
+            /* Tiles wholly within the mirrored rows are left to be copied */
+            if (yStart >= block->mirrorStart && yEnd <= block->mirrorEnd)
+                continue;
+
+            ret = 0;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&(pool->mutex));
+
+    return ret;
+}
+
+
+/* Place the pages of a block array on the NUMA nodes of the threads that will
+ * plot them. Each page is placed on the node of the thread that first writes
+ * it, so rather than the first block placing its pages wherever its tiles
+ * happened to be claimed, each thread writes to the pages of its share of its
+ * node's tiles. The array must not yet have been written
+ */
+int touchBlock(Thread *threads, Block *block)
+{
+    if (!block || block->map)
+        return 0;
+
+    return runThreads(threads, touchRows, block);
+}
+
+
 /* Free Block object */
 void freeBlock(Block *block)
 {
     if (block)
     {
-        free(block->array);
+        if (block->map)
+        {
+            if (munmap(block->map, block->mapSize))
+                logMessage(WARNING, "Image file could not be unmapped");
+
+            block->map = NULL;
+        }
+        else
+        {
+            freeArray(block);
+        }
+
         block->array = NULL;
+
+        freeReferenceOrbit(block->orbit);
+        block->orbit = NULL;
     }
 
     free(block);
@@ -142,112 +601,383 @@ void freeBlock(Block *block)
 }
 
 
-/* Free thread list */
+/* Free a Block object initialised by initialiseBlockBuffer() */
+void freeBlockBuffer(Block *block)
+{
+    if (block)
+        freeArray(block);
+
+    free(block);
+}
+
+
+/* Stop and harvest the thread pool, then free the thread list */
 void freeThreads(Thread *threads)
 {
+    if (threads)
+    {
+        ThreadPool *pool = threads->pool;
+
+        pthread_mutex_lock(&(pool->mutex));
+        pool->shutdown = true;
+        pthread_cond_broadcast(&(pool->queued));
+        pthread_mutex_unlock(&(pool->mutex));
+
+        for (unsigned int i = 0; i < pool->running; ++i)
+        {
+            if (pthread_join(threads[i].pid, NULL))
+                logMessage(WARNING, "Thread %u could not be harvested", threads[i].tid);
+            else
+                logMessage(DEBUG, "Thread %u joined", threads[i].tid);
+        }
+
+        #ifdef MP_PREC
+        for (unsigned int i = 0; i < threads->tCount; ++i)
+            freeScratchMP(threads[i].scratch);
+        #endif
+
+        #ifdef OPENCL
+        for (unsigned int i = 0; i < threads->tCount; ++i)
+            freeGPU(threads[i].gpu);
+        #endif
+
+        freeThreadPool(pool);
+    }
+
     free(threads);
     logMessage(DEBUG, "Thread array freed");
 }
 
 
-/* To prevent memory overcommitment, the array must be divided into blocks */
-static int allocateImageBlock(Block *block, size_t mem)
+/* To prevent memory overcommitment, the array is divided into blocks. The
+ * budget is the memory available (or the caller's maximum) less `reserve`,
+ * shared between `buffers` arrays. Blocks are sized to fit it, with as many
+ * as the image needs
+ */
+static int allocateImageBlock(Block *block, size_t mem, unsigned int buffers, size_t reserve)
 {
-    /* Maximum number of blocks the array should be divided into */
-    const unsigned int BLOCK_COUNT_MAX = 64;
-
-    size_t freeMemory;
+    size_t availableMemory, budget;
 
-    logMessage(DEBUG, "Getting amount of free memory");
+    logMessage(DEBUG, "Getting amount of available memory");
 
-    freeMemory = getFreeMemory();
+    availableMemory = getAvailableMemory();
 
-    if (!freeMemory)
+    if (!availableMemory)
     {
-        logMessage(ERROR, "Failed to calculate amount of free memory");
+        logMessage(ERROR, "Failed to calculate amount of available memory");
         return 1;
     }
 
-    logMessage(DEBUG, "%zu bytes of physical memory is free", freeMemory);
+    logMessage(DEBUG, "%zu bytes of physical memory is available", availableMemory);
 
     /* If caller has specified max memory usage */
     if (mem > 0)
     {
-        if (mem > freeMemory)
+        if (mem > availableMemory)
         {
-            logMessage(WARNING, "Memory maximum of %zu bytes is greater than the amount of free physical memory (%zu"
-                       " bytes). It is recommended to only allow allocation of physical memory for efficiency",
-                       mem, freeMemory);
+            logMessage(WARNING, "Memory maximum of %zu bytes is greater than the amount of available physical memory"
+                       " (%zu bytes). It is recommended to only allow allocation of physical memory for efficiency",
+                       mem, availableMemory);
         }
 
-        freeMemory = mem;
-        logMessage(DEBUG, "Memory allocation will be limited to %zu bytes", freeMemory);
+        budget = mem;
+        logMessage(DEBUG, "Memory allocation will be limited to %zu bytes", budget);
     }
     else
     {
-        freeMemory = freeMemory * (FREE_MEMORY_ALLOCATION / 100.0);
-        logMessage(DEBUG, "Memory allocation will be limited to %u%% of free physical memory (%zu bytes)",
-                   FREE_MEMORY_ALLOCATION, freeMemory);
+        budget = availableMemory * (FREE_MEMORY_ALLOCATION / 100.0);
+        logMessage(DEBUG, "Memory allocation will be limited to %u%% of available physical memory (%zu bytes)",
+                   FREE_MEMORY_ALLOCATION, budget);
     }
 
-    block->blockSize = block->parameters->height * block->rowSize;
+    /* Memory taken alongside the blocks, such as compression buffers */
+    if (reserve > 0)
+    {
+        budget = (budget > reserve) ? budget - reserve : 0;
+        logMessage(DEBUG, "%zu bytes of the limit reserved for output buffers", reserve);
+    }
 
-    logMessage(DEBUG, "Full image is %zu bytes", block->blockSize);
+    /* The limit is shared between every array of the image */
+    if (buffers > 1)
+    {
+        budget /= buffers;
+        logMessage(DEBUG, "Memory allocation will be split between %u block arrays (%zu bytes each)", buffers,
+                   budget);
+    }
+
+    logMessage(DEBUG, "Full image is %zu bytes", block->parameters->height * block->rowSize);
+
+    block->rows = budget / block->rowSize;
 
-    /* Try to malloc the array, with each iteration decreasing the array size */
-    for (block->bCount = 1; block->bCount <= BLOCK_COUNT_MAX; ++(block->bCount))
+    if (block->rows < 1)
     {
-        block->rows = block->parameters->height / block->bCount;
-        block->remainderRows = block->parameters->height % block->bCount;
+        logMessage(WARNING, "Not even one row fits in the memory limit - plotting a row at a time");
+        block->rows = 1;
+    }
 
-        /* To fix the issue where the remainder block may be larger than the
-         * regular ones
-         */
-        if (block->remainderRows > block->rows)
-            continue;
+    block->rows = alignBlockRows(block->rows, block->parameters->height);
 
+    /* Should the allocation fail, halve the blocks and try again */
+    while (1)
+    {
+        block->bCount = block->parameters->height / block->rows;
+        block->remainderRows = block->parameters->height % block->rows;
         block->blockSize = block->rows * block->rowSize;
         block->remainderBlockSize = block->remainderRows * block->rowSize;
 
-        if (block->blockSize <= freeMemory)
-        {
-            logMessage(DEBUG, "Splitting array into %u blocks (%zu bytes each)", block->bCount, block->blockSize);
+        logMessage(DEBUG, "Splitting array into %zu blocks (%zu bytes each)", block->bCount, block->blockSize);
 
-            block->array = malloc(block->blockSize);
+        if (!allocateArray(block, block->blockSize))
+            break;
 
-            if (block->array)
-                break;
-            
-            if (block->bCount != BLOCK_COUNT_MAX)
-                logMessage(DEBUG, "Memory allocation attempt failed. Retrying...");
+        if (block->rows == 1)
+        {
+            logMessage(ERROR, "Memory allocation failed");
+            freeArray(block);
+            return 1;
         }
+
+        logMessage(DEBUG, "Memory allocation attempt failed. Retrying...");
+        block->rows = alignBlockRows(block->rows / 2, block->parameters->height);
     }
 
-    if (!block->array || block->blockSize == 0)
+    logMessage(DEBUG, "Image array split into %zu blocks (%zu bytes - block: %zu rows, remainder block: %zu rows)",
+               block->bCount, block->blockSize, block->rows, block->remainderRows);
+    
+    return 0;
+}
+
+
+/* Round rows of a block down to a whole number of tile rows, so the tiles
+ * of a block (as when subdividing) are not cut short at its bottom edge
+ */
+static size_t alignBlockRows(size_t rows, size_t height)
+{
+    if (rows >= height)
+        return height;
+
+    return (rows > BLOCK_ROW_ALIGN) ? rows - rows % BLOCK_ROW_ALIGN : rows;
+}
+
+
+/* Allocate the array of a block, on huge pages if asked for. Huge pages fall
+ * back to the heap if they cannot be mapped
+ */
+static int allocateArray(Block *block, size_t size)
+{
+    block->arrayMapSize = 0;
+
+    if (block->hugePages)
     {
-        /* If too many malloc() calls have failed */
-        logMessage(ERROR, "Memory allocation failed");
+        size_t mapSize = size;
+
+        block->array = mapHugeArray(&mapSize);
+
+        if (block->array)
+        {
+            block->arrayMapSize = mapSize;
+            return 0;
+        }
+
+        logMessage(WARNING, "Block array could not be mapped on huge pages - allocating it on the heap");
+    }
+
+    block->array = malloc(size);
+
+    return (block->array) ? 0 : 1;
+}
+
+
+static void freeArray(Block *block)
+{
+    if (block->arrayMapSize)
+        unmapArray(block->array, block->arrayMapSize);
+    else
         free(block->array);
-        return 1;
+
+    block->array = NULL;
+    block->arrayMapSize = 0;
+}
+
+
+/* Create the synchronisation state shared by a list of threads */
+static ThreadPool * createThreadPool(void)
+{
+    ThreadPool *pool = malloc(sizeof(*pool));
+
+    if (!pool)
+        return NULL;
+
+    if (pthread_mutex_init(&(pool->mutex), NULL))
+    {
+        free(pool);
+        return NULL;
     }
 
-    logMessage(DEBUG, "Image array split into %u blocks (%zu bytes - block: %zu rows, remainder block: %zu rows)",
-               block->bCount, block->blockSize, block->rows, block->remainderRows);
-    
+    if (pthread_cond_init(&(pool->queued), NULL))
+    {
+        pthread_mutex_destroy(&(pool->mutex));
+        free(pool);
+        return NULL;
+    }
+
+    if (pthread_cond_init(&(pool->completed), NULL))
+    {
+        pthread_cond_destroy(&(pool->queued));
+        pthread_mutex_destroy(&(pool->mutex));
+        free(pool);
+        return NULL;
+    }
+
+    pool->head = 0;
+    pool->tail = 0;
+    pool->running = 0;
+    pool->shutdown = false;
+
+    return pool;
+}
+
+
+static void freeThreadPool(ThreadPool *pool)
+{
+    if (pool)
+    {
+        pthread_cond_destroy(&(pool->completed));
+        pthread_cond_destroy(&(pool->queued));
+        pthread_mutex_destroy(&(pool->mutex));
+    }
+
+    free(pool);
+}
+
+
+/* Body of each pool thread - run queued work items in order until shutdown */
+static void * poolThread(void *threadInfo)
+{
+    Thread *t = threadInfo;
+    ThreadPool *pool = t->pool;
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    while (1)
+    {
+        WorkItem *item;
+
+        while (t->item == pool->head && !pool->shutdown)
+            pthread_cond_wait(&(pool->queued), &(pool->mutex));
+
+        /* Queued work is always finished before shutting down */
+        if (t->item == pool->head)
+            break;
+
+        item = &(pool->queue[t->item % THREAD_POOL_QUEUE_LEN]);
+        t->block = item->block;
+
+        pthread_mutex_unlock(&(pool->mutex));
+        item->function(t);
+        pthread_mutex_lock(&(pool->mutex));
+
+        ++(t->item);
+
+        /* Items may finish out of order, but are only retired from the front
+         * of the queue so that their slots are reused in sequence
+         */
+        if (--(item->remaining) == 0)
+        {
+            while (pool->tail != pool->head && pool->queue[pool->tail % THREAD_POOL_QUEUE_LEN].remaining == 0)
+                ++(pool->tail);
+
+            pthread_cond_broadcast(&(pool->completed));
+        }
+    }
+
+    pthread_mutex_unlock(&(pool->mutex));
+
+    return NULL;
+}
+
+
+/* Queue a work item, giving its sequence number. Items are retired in order, so
+ * the item is complete once the tail of the queue has passed it
+ */
+static int queueWorkItem(Thread *threads, void * (*function)(void *), Block *block, size_t *sequence)
+{
+    ThreadPool *pool;
+    WorkItem *item;
+
+    if (!threads || !function)
+        return 1;
+
+    pool = threads->pool;
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    while (pool->head - pool->tail >= THREAD_POOL_QUEUE_LEN)
+        pthread_cond_wait(&(pool->completed), &(pool->mutex));
+
+    item = &(pool->queue[pool->head % THREAD_POOL_QUEUE_LEN]);
+
+    item->function = function;
+    item->block = block;
+    item->remaining = pool->running;
+    shareTiles(item, pool, getBlockTileCount(block));
+
+    *sequence = (pool->head)++;
+
+    pthread_cond_broadcast(&(pool->queued));
+    pthread_mutex_unlock(&(pool->mutex));
+
     return 0;
 }
 
 
-/* Calculate amount of free physical memory on the system */
-static size_t getFreeMemory(void)
+/* Share the tiles of a work item between the NUMA nodes of the pool, in
+ * proportion to their threads. Each share is a run of whole tiles, in order
+ */
+static void shareTiles(WorkItem *item, const ThreadPool *pool, size_t tiles)
+{
+    unsigned int total = 0, before = 0;
+
+    for (unsigned int node = 0; node < pool->nodes; ++node)
+        total += pool->nodeThreads[node];
+
+    for (unsigned int node = 0; node < pool->nodes; ++node)
+    {
+        item->claimed[node] = tiles * before / total;
+        before += pool->nodeThreads[node];
+        item->end[node] = tiles * before / total;
+    }
+}
+
+
+/* Write to each page of the thread's share of the rows of its node's tiles */
+static void * touchRows(void *threadInfo)
 {
-    long availablePages = sysconf(_SC_AVPHYS_PAGES);
-    long pageSize = sysconf(_SC_PAGE_SIZE);
+    Thread *t = threadInfo;
+    const WorkItem *item = &(t->pool->queue[t->item % THREAD_POOL_QUEUE_LEN]);
+    const Block *block = t->block;
+    size_t tilesPerRow = (block->parameters->width + block->tileWidth - 1) / block->tileWidth;
+    size_t nodeThreads = t->pool->nodeThreads[t->node];
+    size_t pageSize = (size_t) sysconf(_SC_PAGE_SIZE);
+
+    /* Rows of the node's share of the tiles, then the thread's share of those */
+    size_t start = item->claimed[t->node] / tilesPerRow * block->tileHeight;
+    size_t end = (item->end[t->node] + tilesPerRow - 1) / tilesPerRow * block->tileHeight;
+    size_t first, last;
+
+    if (end > block->rows)
+        end = block->rows;
+
+    if (end <= start || !nodeThreads)
+        return NULL;
 
-    if (availablePages < 1 || pageSize < 1)
-        return 0;
+    first = start + (end - start) * t->nodeRank / nodeThreads;
+    last = start + (end - start) * (t->nodeRank + 1) / nodeThreads;
+
+    for (size_t offset = first * block->rowSize; offset < last * block->rowSize; offset += pageSize)
+        block->array[offset] = 0;
 
-    return (size_t) pageSize * (size_t) availablePages;
+    return NULL;
 }
 
 
@@ -0,0 +1,606 @@
+#include <float.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include "libgroot/include/log.h"
+#include "percy/include/parser.h"
+
+#include "arg_ranges.h"
+#include "array.h"
+#include "colour.h"
+#include "ext_precision.h"
+#include "function.h"
+#include "getopt_error.h"
+#include "image.h"
+#include "parameters.h"
+#include "process_args.h"
+#include "simd.h"
+#include "stats.h"
+#include "subdivide.h"
+
+#ifdef MP_PREC
+#include <mpfr.h>
+#include <mpc.h>
+#endif
+
+
+/* Image plotted for each scene (divided by the scale of the precision) */
+#define BENCH_WIDTH_DEFAULT 960
+#define BENCH_HEIGHT_DEFAULT 720
+
+/* Times each measurement is taken, keeping the fastest */
+#define BENCH_REPEATS_DEFAULT 3
+
+#define BENCH_ARG_LEN_MAX 64
+
+
+/* A fixed view of the plot, so results can be compared between builds */
+typedef struct BenchScene
+{
+    const char *name;
+    PlotType type;
+    Formula formula;
+    const char *centre;       /* Centre and magnification, as for `-x` (NULL for the default view) */
+    const char *c;            /* Julia set constant, as for `-j` */
+    unsigned long iterations;
+} BenchScene;
+
+typedef struct BenchPrecision
+{
+    const char *name;
+    PrecisionMode precision;
+    size_t scale;             /* Divisor of the image dimensions, for slow precisions */
+} BenchPrecision;
+
+typedef struct BenchDepth
+{
+    BitDepth depth;
+    ColourSchemeType colour;
+} BenchDepth;
+
+/* Time to plot the scene at each thread count */
+typedef struct BenchResult
+{
+    unsigned int threads;
+    double plot;
+} BenchResult;
+
+
+static const BenchScene SCENES[] =
+{
+    {"full-set", PLOT_MANDELBROT, FORMULA_MANDELBROT, NULL, NULL, 1000},
+    {"seahorse-deep", PLOT_MANDELBROT, FORMULA_MANDELBROT, "-0.743643887037151 + 0.131825904205330i,200", NULL, 5000},
+    {"julia-dendrite", PLOT_JULIA, FORMULA_MANDELBROT, NULL, "0 + 1i", 1000},
+    {"interior", PLOT_MANDELBROT, FORMULA_MANDELBROT, "-0.1 + 0i,10", NULL, 5000},
+    {"burning-ship", PLOT_MANDELBROT, FORMULA_BURNING_SHIP, NULL, NULL, 1000}
+};
+
+static const BenchPrecision PRECISIONS[] =
+{
+    {"std", STD_PRECISION, 1},
+    {"ext", EXT_PRECISION, 1},
+    {"dd", DD_PRECISION, 2},
+
+    #ifdef MP_PREC
+    {"mp", MUL_PRECISION, 8},
+    #endif
+};
+
+/* Depths plotted pixels are coloured into, with raw iteration values last */
+static const BenchDepth DEPTHS[] =
+{
+    {BIT_DEPTH_1, COLOUR_SCHEME_TYPE_BLACK_WHITE},
+    {BIT_DEPTH_8, COLOUR_SCHEME_TYPE_GREYSCALE},
+    {BIT_DEPTH_24, COLOUR_SCHEME_TYPE_RAINBOW},
+    {BIT_DEPTH_ITERATIONS, COLOUR_SCHEME_TYPE_RAINBOW}
+};
+
+
+static int usage(void);
+
+static int benchScene(FILE *results, const BenchScene *scene, const BenchPrecision *precision, size_t width,
+                      size_t height, unsigned int maxThreads, unsigned int repeats, bool subdivide);
+static PlotCTX * createScenePlot(const BenchScene *scene, const BenchPrecision *precision, size_t width,
+                                 size_t height);
+static int plotScene(double *seconds, Block *block, unsigned int threadCount, unsigned int repeats, char *raw);
+static int colourScene(double *colour, double *output, const PlotCTX *p, const BenchDepth *depth, const char *raw,
+                       unsigned int repeats);
+static double countIterations(const char *raw, const PlotCTX *p);
+
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    int option;
+
+    const struct option LONG_OPTIONS[] =
+    {
+        {"help", no_argument, NULL, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    unsigned long width = BENCH_WIDTH_DEFAULT, height = BENCH_HEIGHT_DEFAULT;
+    unsigned long repeats = BENCH_REPEATS_DEFAULT;
+    unsigned long maxThreads = 0;
+    bool subdivide = true;
+
+    FILE *results = stdout;
+    const char *resultsFilepath = NULL;
+
+    programName = argv[0];
+
+    setLogLevel(WARNING);
+    setLogVerbosity(true);
+    setLogTimeFormat(LOG_TIME_RELATIVE);
+    setLogReferenceTime();
+
+    while ((option = getopt_long(argc, argv, ":hn:o:r:s:ST:v", LONG_OPTIONS, NULL)) != -1)
+    {
+        ParseErr argError = PARSE_SUCCESS;
+
+        opt = (char) option;
+
+        switch (option)
+        {
+            case 'h':
+                return usage();
+            case 'n': /* Times each measurement is taken */
+                argError = uLongArg(&repeats, optarg, 1, UINT_MAX);
+                break;
+            case 'o': /* File results are written to */
+                resultsFilepath = optarg;
+                break;
+            case 'r': /* Width of each scene */
+                argError = uLongArg(&width, optarg, WIDTH_MIN, WIDTH_MAX);
+                break;
+            case 's': /* Height of each scene */
+                argError = uLongArg(&height, optarg, HEIGHT_MIN, HEIGHT_MAX);
+                break;
+            case 'S': /* Compute every pixel of each tile */
+                subdivide = false;
+                break;
+            case 'T': /* Largest thread count measured */
+                argError = uLongArg(&maxThreads, optarg, THREAD_COUNT_MIN, THREAD_COUNT_MAX);
+                break;
+            case 'v': /* Log the progress of the benchmark */
+                setLogLevel(INFO);
+                break;
+            case ':':
+                opt = (char) optopt;
+                getoptErrorMessage(OPT_ENOARG, NULL);
+                return EXIT_FAILURE;
+            default:
+                opt = (char) optopt;
+                getoptErrorMessage(OPT_EOPT, NULL);
+                return EXIT_FAILURE;
+        }
+
+        if (argError == PARSE_ERANGE)
+        {
+            getoptErrorMessage(OPT_NONE, NULL);
+            return EXIT_FAILURE;
+        }
+        else if (argError != PARSE_SUCCESS)
+        {
+            getoptErrorMessage(OPT_EARG, NULL);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind < argc)
+    {
+        getoptErrorMessage(OPT_EARGC_HIGH, NULL);
+        return EXIT_FAILURE;
+    }
+
+    if (maxThreads == 0)
+    {
+        long procs = sysconf(_SC_NPROCESSORS_ONLN);
+
+        maxThreads = (procs < 1) ? 1 : (procs > (long) THREAD_COUNT_MAX) ? THREAD_COUNT_MAX : (unsigned long) procs;
+    }
+
+    if (resultsFilepath && !(results = fopen(resultsFilepath, "w")))
+    {
+        fprintf(stderr, "%s: -o: File \'%s\' could not be opened\n", programName, resultsFilepath);
+        return EXIT_FAILURE;
+    }
+
+    initialiseSIMD();
+
+    #ifdef MP_PREC
+    initialiseArgRangesMP();
+    #endif
+
+    fprintf(results, "scene,precision,width,height,iterations,threads,depth,plot_s,mpixels_per_s,iterations_per_s,"
+                     "efficiency,colour_s,output_s\n");
+
+    for (size_t i = 0; i < sizeof(SCENES) / sizeof(SCENES[0]) && !ret; ++i)
+    {
+        for (size_t j = 0; j < sizeof(PRECISIONS) / sizeof(PRECISIONS[0]) && !ret; ++j)
+        {
+            ret = benchScene(results, &SCENES[i], &PRECISIONS[j], width, height, (unsigned int) maxThreads,
+                             (unsigned int) repeats, subdivide);
+        }
+    }
+
+    #ifdef MP_PREC
+    freeArgRangesMP();
+    #endif
+
+    if (resultsFilepath && fclose(results))
+        ret = 1;
+
+    return (ret) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+/* `-h` output */
+static int usage(void)
+{
+    printf("Usage: %s [OPTION]...\n\n", programName);
+    printf("Plot a fixed catalogue of scenes at every precision and a range of thread counts, writing the\n"
+           "throughput of each as CSV.\n\n");
+    printf("  -n REPEATS   Time each measurement REPEATS times, keeping the fastest (default = %d)\n",
+           BENCH_REPEATS_DEFAULT);
+    printf("  -o FILE      Write results to FILE (default = stdout)\n");
+    printf("  -r WIDTH     Width of each scene in pixels, a multiple of %d (default = %d)\n", CHAR_BIT,
+           BENCH_WIDTH_DEFAULT);
+    printf("  -s HEIGHT    Height of each scene in pixels (default = %d)\n", BENCH_HEIGHT_DEFAULT);
+    printf("  -S           Compute every pixel, rather than filling areas enclosed by unescaped pixels\n");
+    printf("  -T COUNT     Measure up to COUNT threads (default = processor count)\n");
+    printf("  -v           Log progress to stderr\n");
+    printf("  -h, --help   Display this help message and exit\n");
+
+    return EXIT_SUCCESS;
+}
+
+
+/* Plot a scene at one precision on 1, 2, 4... threads up to `maxThreads`, then
+ * colour and output the plot at each bit depth. A row of results is written for
+ * each thread count and depth - colouring and output are done on one thread,
+ * so their times are the same on each row of a depth
+ */
+static int benchScene(FILE *results, const BenchScene *scene, const BenchPrecision *precision, size_t width,
+                      size_t height, unsigned int maxThreads, unsigned int repeats, bool subdivide)
+{
+    int ret = 0;
+    char *raw;
+    double iterations;
+
+    BenchResult runs[sizeof(unsigned int) * CHAR_BIT + 1];
+    size_t runCount = 0;
+
+    Block *block;
+    PlotCTX *p = createScenePlot(scene, precision, width, height);
+
+    if (!p)
+        return 1;
+
+    logMessage(INFO, "Benchmarking scene \'%s\' at %s precision (%zux%zu)", scene->name, precision->name,
+               p->width, p->height);
+
+    block = createBlock();
+
+    if (!block || initialiseBlock(block, p, 0, 1, 0))
+    {
+        logMessage(ERROR, "Could not allocate block for scene \'%s\'", scene->name);
+        freeBlock(block);
+        freePlotCTX(p);
+        return 1;
+    }
+
+    /* As in the program, the Burning Ship is never subdivided */
+    subdivide = subdivide && scene->formula != FORMULA_BURNING_SHIP;
+
+    if (subdivide)
+        setBlockTiles(block, SUBDIVIDE_TILE_LEN, SUBDIVIDE_TILE_LEN);
+
+    block->subdivide = subdivide;
+
+    raw = malloc(p->height * block->rowSize);
+
+    if (!raw)
+    {
+        logMessage(ERROR, "Memory allocation failed");
+        freeBlock(block);
+        freePlotCTX(p);
+        return 1;
+    }
+
+    /* Thread counts double up to the largest, which is always measured */
+    for (unsigned int n = 1; ; n = (n > maxThreads / 2) ? maxThreads : n * 2)
+    {
+        runs[runCount].threads = n;
+
+        if (plotScene(&(runs[runCount].plot), block, n, repeats, raw))
+        {
+            ret = 1;
+            break;
+        }
+
+        ++runCount;
+
+        if (n == maxThreads)
+            break;
+    }
+
+    iterations = countIterations(raw, p);
+
+    for (size_t i = 0; i < sizeof(DEPTHS) / sizeof(DEPTHS[0]) && !ret; ++i)
+    {
+        double colour, output;
+        double pixels = (double) p->width * (double) p->height;
+
+        if (colourScene(&colour, &output, p, &DEPTHS[i], raw, repeats))
+        {
+            ret = 1;
+            break;
+        }
+
+        for (size_t j = 0; j < runCount; ++j)
+        {
+            fprintf(results, "%s,%s,%zu,%zu,%lu,%u,%d,%.6f,%.3f,%.6g,%.3f,%.6f,%.6f\n",
+                    scene->name, precision->name, p->width, p->height, p->iterations, runs[j].threads,
+                    (int) DEPTHS[i].depth, runs[j].plot, pixels / runs[j].plot / 1e6, iterations / runs[j].plot,
+                    runs[0].plot / (runs[j].plot * runs[j].threads), colour, output);
+        }
+    }
+
+    fflush(results);
+
+    free(raw);
+    freeBlock(block);
+    freePlotCTX(p);
+
+    return ret;
+}
+
+
+/* Create the plot of a scene, as raw iteration values. Returns NULL if the
+ * scene could not be set at the precision
+ */
+static PlotCTX * createScenePlot(const BenchScene *scene, const BenchPrecision *precision, size_t width,
+                                 size_t height)
+{
+    char arg[BENCH_ARG_LEN_MAX];
+    ParseErr argError = PARSE_SUCCESS;
+
+    PlotCTX *p = createPlotCTX(precision->precision);
+
+    if (!p || initialisePlotCTX(p, scene->type, scene->formula, OUTPUT_RAW))
+    {
+        logMessage(ERROR, "Could not create plot of scene \'%s\'", scene->name);
+        free(p);
+        return NULL;
+    }
+
+    /* Rows of 1-bit pixels must fill whole bytes */
+    p->width = (width / precision->scale) / CHAR_BIT * CHAR_BIT;
+    p->height = height / precision->scale;
+    p->iterations = scene->iterations;
+
+    if (p->width < CHAR_BIT || p->height < 1)
+    {
+        logMessage(ERROR, "Scene \'%s\' is too small to plot at %s precision", scene->name, precision->name);
+        freePlotCTX(p);
+        return NULL;
+    }
+
+    if (scene->c)
+    {
+        strncpy(arg, scene->c, sizeof(arg));
+        arg[sizeof(arg) - 1] = '\0';
+
+        switch (p->precision)
+        {
+            case STD_PRECISION:
+                argError = complexArg(&(p->c.c), arg, C_MIN, C_MAX);
+                break;
+            case EXT_PRECISION:
+                argError = complexArgExt(&(p->c.lc), arg, C_MIN_EXT, C_MAX_EXT);
+                break;
+            case DD_PRECISION:
+                argError = complexArgDD(&(p->c.dd), arg, C_MIN_EXT, C_MAX_EXT);
+                break;
+
+            #ifdef MP_PREC
+            case MUL_PRECISION:
+                argError = complexArgMP(p->c.mpc, arg, C_MIN_MP, C_MAX_MP);
+                break;
+            #endif
+
+            default:
+                argError = PARSE_EERR;
+                break;
+        }
+    }
+
+    if (scene->centre && argError == PARSE_SUCCESS)
+    {
+        strncpy(arg, scene->centre, sizeof(arg));
+        arg[sizeof(arg) - 1] = '\0';
+
+        switch (p->precision)
+        {
+            case STD_PRECISION:
+                argError = magArg(p, arg, COMPLEX_MIN, COMPLEX_MAX, MAGNIFICATION_MIN, MAGNIFICATION_MAX);
+                break;
+            case EXT_PRECISION:
+                argError = magArgExt(p, arg, COMPLEX_MIN_EXT, COMPLEX_MAX_EXT, MAGNIFICATION_MIN, MAGNIFICATION_MAX);
+                break;
+            case DD_PRECISION:
+                argError = magArgDD(p, arg, COMPLEX_MIN_EXT, COMPLEX_MAX_EXT, MAGNIFICATION_MIN, MAGNIFICATION_MAX);
+                break;
+
+            #ifdef MP_PREC
+            case MUL_PRECISION:
+                argError = magArgMP(p, arg, NULL, NULL, MAGNIFICATION_MIN_EXT, MAGNIFICATION_MAX_EXT);
+                break;
+            #endif
+
+            default:
+                argError = PARSE_EERR;
+                break;
+        }
+    }
+
+    if (argError != PARSE_SUCCESS)
+    {
+        logMessage(ERROR, "Could not set view of scene \'%s\'", scene->name);
+        freePlotCTX(p);
+        return NULL;
+    }
+
+    return p;
+}
+
+
+/* Plot the scene block by block into `raw`, the fastest of `repeats` times.
+ * Only the plotting itself is timed
+ */
+static int plotScene(double *seconds, Block *block, unsigned int threadCount, unsigned int repeats, char *raw)
+{
+    PlotFunction plot = getPlotFunction(block->parameters, false);
+    Thread *threads;
+
+    if (!plot || !(threads = createThreads(block, threadCount)))
+        return 1;
+
+    *seconds = DBL_MAX;
+
+    for (unsigned int i = 0; i < repeats; ++i)
+    {
+        double elapsed = 0.0;
+
+        for (size_t id = 0; id < block->bCount || (id == block->bCount && block->remainderRows); ++id)
+        {
+            double start;
+            size_t rows;
+
+            block->id = id;
+            block->remainder = (id == block->bCount);
+            rows = (block->remainder) ? block->remainderRows : block->rows;
+
+            start = getMonotonicTime();
+
+            if (runThreads(threads, plot, block))
+            {
+                logMessage(ERROR, "Work could not be queued to threads");
+                freeThreads(threads);
+                return 1;
+            }
+
+            elapsed += getMonotonicTime() - start;
+
+            memcpy(raw + id * block->rows * block->rowSize, block->array, rows * block->rowSize);
+        }
+
+        if (elapsed < *seconds)
+            *seconds = elapsed;
+    }
+
+    logMessage(INFO, "Plotted on %u thread(s) in %.3f s", threadCount, *seconds);
+
+    freeThreads(threads);
+
+    return 0;
+}
+
+
+/* Colour the raw iteration values of a scene into a depth, then write the
+ * image to a temporary file, each the fastest of `repeats` times
+ */
+static int colourScene(double *colour, double *output, const PlotCTX *p, const BenchDepth *depth, const char *raw,
+                       unsigned int repeats)
+{
+    ColourScheme scheme;
+    FILE *f;
+    char *image;
+
+    size_t valueSize = BIT_DEPTH_ITERATIONS / CHAR_BIT;
+    size_t rowSize = (p->width * depth->depth) / CHAR_BIT;
+
+    if (initialiseColourScheme(&scheme, depth->colour))
+        return 1;
+
+    scheme.depth = depth->depth;
+
+    image = malloc(p->height * rowSize);
+
+    if (!image)
+    {
+        logMessage(ERROR, "Memory allocation failed");
+        return 1;
+    }
+
+    f = tmpfile();
+
+    if (!f)
+    {
+        logMessage(ERROR, "Could not open temporary file for output");
+        free(image);
+        return 1;
+    }
+
+    *colour = DBL_MAX;
+    *output = DBL_MAX;
+
+    for (unsigned int i = 0; i < repeats; ++i)
+    {
+        double start = getMonotonicTime(), elapsed;
+
+        for (size_t y = 0; y < p->height; ++y)
+            mapIterationRow(image + y * rowSize, (const unsigned char *) raw + y * p->width * valueSize, p->width,
+                            &scheme);
+
+        elapsed = getMonotonicTime() - start;
+
+        if (elapsed < *colour)
+            *colour = elapsed;
+
+        rewind(f);
+        start = getMonotonicTime();
+
+        if (fwrite(image, rowSize, p->height, f) != p->height || fflush(f))
+        {
+            logMessage(ERROR, "Could not write image to temporary file");
+            fclose(f);
+            free(image);
+            return 1;
+        }
+
+        elapsed = getMonotonicTime() - start;
+
+        if (elapsed < *output)
+            *output = elapsed;
+    }
+
+    fclose(f);
+    free(image);
+
+    return 0;
+}
+
+
+/* Total iterations of every pixel of the scene. Pixels filled by subdivision
+ * are counted as though iterated, so this is the work a plain plot would do
+ */
+static double countIterations(const char *raw, const PlotCTX *p)
+{
+    double total = 0.0;
+    size_t valueSize = BIT_DEPTH_ITERATIONS / CHAR_BIT;
+    size_t pixels = p->width * p->height;
+
+    for (size_t i = 0; i < pixels; ++i)
+        total += (double) getIterationCount((const unsigned char *) raw + i * valueSize, p->iterations);
+
+    return total;
+}
@@ -0,0 +1,262 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "libgroot/include/log.h"
+
+#include "block_writer.h"
+
+#include "array.h"
+#include "checkpoint.h"
+#include "parameters.h"
+#include "png.h"
+#include "pyramid.h"
+
+
+static void * writerThread(void *writerInfo);
+static int writeBlock(const Block *block, PNGEncoder *png, Pyramid *pyramid);
+
+
+/* Create a block writer. The thread is started by initialiseBlockWriter() */
+BlockWriter * createBlockWriter(void)
+{
+    BlockWriter *writer = malloc(sizeof(*writer));
+
+    if (!writer)
+        return NULL;
+
+    if (pthread_mutex_init(&(writer->mutex), NULL))
+    {
+        free(writer);
+        return NULL;
+    }
+
+    if (pthread_cond_init(&(writer->queued), NULL))
+    {
+        pthread_mutex_destroy(&(writer->mutex));
+        free(writer);
+        return NULL;
+    }
+
+    if (pthread_cond_init(&(writer->written), NULL))
+    {
+        pthread_cond_destroy(&(writer->queued));
+        pthread_mutex_destroy(&(writer->mutex));
+        free(writer);
+        return NULL;
+    }
+
+    writer->block = NULL;
+    writer->checkpoint = NULL;
+    writer->png = NULL;
+    writer->pyramid = NULL;
+    writer->running = false;
+    writer->shutdown = false;
+    writer->error = 0;
+
+    return writer;
+}
+
+
+/* Start the writer thread. With `checkpoint`, it is updated once each block
+ * is written. With `png`, blocks are encoded as rows of a PNG image, and with
+ * `pyramid`, cut into the tiles of a tile pyramid
+ */
+int initialiseBlockWriter(BlockWriter *writer, Checkpoint *checkpoint, PNGEncoder *png, Pyramid *pyramid)
+{
+    if (!writer)
+        return 1;
+
+    writer->checkpoint = checkpoint;
+    writer->png = png;
+    writer->pyramid = pyramid;
+
+    if (pthread_create(&(writer->pid), NULL, writerThread, writer))
+    {
+        logMessage(ERROR, "Writer thread could not be created");
+        return 1;
+    }
+
+    writer->running = true;
+
+    return 0;
+}
+
+
+/* Hand a finished block to the writer thread. Only one block is held at a
+ * time, so this waits for the previous block to be written first. The block
+ * must not be modified until it has been written
+ */
+int queueBlockWrite(BlockWriter *writer, const Block *block)
+{
+    int ret;
+
+    pthread_mutex_lock(&(writer->mutex));
+
+    while (writer->block)
+        pthread_cond_wait(&(writer->written), &(writer->mutex));
+
+    ret = writer->error;
+
+    if (!ret)
+    {
+        writer->block = block;
+        pthread_cond_signal(&(writer->queued));
+    }
+
+    pthread_mutex_unlock(&(writer->mutex));
+
+    return ret;
+}
+
+
+/* Wait for the queued block (if any) to be written. Returns 1 if any write
+ * has failed
+ */
+int waitBlockWriter(BlockWriter *writer)
+{
+    int ret;
+
+    pthread_mutex_lock(&(writer->mutex));
+
+    while (writer->block)
+        pthread_cond_wait(&(writer->written), &(writer->mutex));
+
+    ret = writer->error;
+
+    pthread_mutex_unlock(&(writer->mutex));
+
+    return ret;
+}
+
+
+/* Write any queued block, then stop the writer thread and free it */
+void freeBlockWriter(BlockWriter *writer)
+{
+    if (writer)
+    {
+        if (writer->running)
+        {
+            pthread_mutex_lock(&(writer->mutex));
+            writer->shutdown = true;
+            pthread_cond_signal(&(writer->queued));
+            pthread_mutex_unlock(&(writer->mutex));
+
+            if (pthread_join(writer->pid, NULL))
+                logMessage(WARNING, "Writer thread could not be harvested");
+        }
+
+        pthread_cond_destroy(&(writer->written));
+        pthread_cond_destroy(&(writer->queued));
+        pthread_mutex_destroy(&(writer->mutex));
+    }
+
+    free(writer);
+}
+
+
+/* Body of the writer thread - write each block as it is queued until shutdown */
+static void * writerThread(void *writerInfo)
+{
+    BlockWriter *writer = writerInfo;
+
+    pthread_mutex_lock(&(writer->mutex));
+
+    while (1)
+    {
+        int ret;
+
+        while (!writer->block && !writer->shutdown)
+            pthread_cond_wait(&(writer->queued), &(writer->mutex));
+
+        /* A queued block is always written before shutting down */
+        if (!writer->block)
+            break;
+
+        pthread_mutex_unlock(&(writer->mutex));
+        ret = writeBlock(writer->block, writer->png, writer->pyramid);
+
+        if (!ret && writer->checkpoint)
+            ret = updateCheckpoint(writer->checkpoint, writer->block);
+
+        pthread_mutex_lock(&(writer->mutex));
+
+        if (ret)
+            writer->error = 1;
+
+        writer->block = NULL;
+        pthread_cond_broadcast(&(writer->written));
+    }
+
+    pthread_mutex_unlock(&(writer->mutex));
+
+    return NULL;
+}
+
+
+/* Write block to image file */
+static int writeBlock(const Block *block, PNGEncoder *png, Pyramid *pyramid)
+{
+    FILE *f = block->parameters->file;
+    size_t n = (block->remainder) ? block->remainderBlockSize : block->blockSize;
+
+    logMessage(INFO, "Writing %zu bytes to image file", n);
+
+    if (block->map)
+    {
+        /* The rows are already in place - only start their writeback */
+        if (msync(block->map, block->mapSize, MS_ASYNC))
+        {
+            logMessage(ERROR, "Block %zu could not be written to file", block->id);
+            return 1;
+        }
+    }
+    else if (png)
+    {
+        if (writePNGRows(png, block->array, (block->remainder) ? block->remainderRows : block->rows))
+        {
+            logMessage(ERROR, "Block %zu could not be written to file", block->id);
+            return 1;
+        }
+    }
+    else if (pyramid)
+    {
+        if (writePyramidRows(pyramid, block->array, (block->remainder) ? block->remainderRows : block->rows))
+        {
+            logMessage(ERROR, "Block %zu could not be written to tiles", block->id);
+            return 1;
+        }
+    }
+    else if (block->parameters->colour.depth != BIT_DEPTH_ASCII)
+    {
+        if (fwrite(block->array, sizeof(char), n, f) != n)
+        {
+            logMessage(ERROR, "Block %zu could not be written to file", block->id);
+            return 1;
+        }
+    }
+    else
+    {
+        size_t rows = (block->remainder) ? block->remainderRows : block->rows;
+        char *array = block->array;
+
+        for (size_t i = 0; i < rows; ++i, array += block->rowSize)
+        {
+            const char ASCII_EOL = '\n';
+
+            if (fwrite(array, sizeof(char), block->rowSize, f) != block->rowSize || fputc(ASCII_EOL, f) == EOF)
+            {
+                logMessage(ERROR, "Block %zu could not be written to terminal", block->id);
+                return 1;
+            }
+        }
+    }
+
+    logMessage(INFO, "Block successfully wrote to file");
+
+    return 0;
+}
@@ -0,0 +1,229 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "libgroot/include/log.h"
+
+#include "checkpoint.h"
+
+#include "array.h"
+#include "parameters.h"
+#include "protocol.h"
+#include "serialise.h"
+
+
+/* First line of a checkpoint file, naming its format */
+#define CHECKPOINT_MAGIC "rolymo-checkpoint"
+#define CHECKPOINT_VERSION 1
+
+/* Space the plot parameters are serialised into to be hashed - as for the
+ * parameters sent to a worker
+ */
+#define CHECKPOINT_PARAMETERS_SIZE 4096
+
+/* Appended to the checkpoint's path while a new one is written */
+#define CHECKPOINT_TMP_EXTENSION ".tmp"
+
+/* 64-bit FNV-1a */
+#define FNV_OFFSET_BASIS UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME UINT64_C(0x00000100000001b3)
+
+
+static int hashParameters(uint64_t *hash, const PlotCTX *p);
+static uint64_t hashBytes(uint64_t hash, const unsigned char *data, size_t n);
+
+
+Checkpoint * createCheckpoint(void)
+{
+    return malloc(sizeof(Checkpoint));
+}
+
+
+/* Set up the checkpoint of a plot. The image file must be open, and at the
+ * position of its first row
+ */
+int initialiseCheckpoint(Checkpoint *c, const PlotCTX *p)
+{
+    if (!c)
+        return 1;
+
+    snprintf(c->filepath, sizeof(c->filepath), "%s%s", p->plotFilepath, CHECKPOINT_EXTENSION);
+
+    if (hashParameters(&(c->hash), p))
+    {
+        logMessage(ERROR, "Could not hash plot parameters for checkpoint");
+        return 1;
+    }
+
+    c->offset = ftello(p->file);
+    c->rows = 0;
+
+    if (c->offset < 0)
+    {
+        logMessage(ERROR, "Could not find position of image data");
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/* Read the rows written by an earlier run of the plot. Returns 1 if there is
+ * no checkpoint, or it is of another plot
+ */
+int readCheckpoint(Checkpoint *c)
+{
+    FILE *f;
+    unsigned int version;
+    uint64_t hash;
+    uintmax_t rows;
+    int fields;
+
+    logMessage(DEBUG, "Reading checkpoint \'%s\'", c->filepath);
+
+    f = fopen(c->filepath, "r");
+
+    if (!f)
+    {
+        logMessage(ERROR, "Checkpoint \'%s\' could not be opened", c->filepath);
+        return 1;
+    }
+
+    fields = fscanf(f, CHECKPOINT_MAGIC " %u hash %" SCNx64 " rows %" SCNuMAX, &version, &hash, &rows);
+    fclose(f);
+
+    if (fields != 3 || version != CHECKPOINT_VERSION)
+    {
+        logMessage(ERROR, "Checkpoint \'%s\' could not be read", c->filepath);
+        return 1;
+    }
+
+    if (hash != c->hash)
+    {
+        logMessage(ERROR, "Checkpoint \'%s\' is of a plot with other parameters", c->filepath);
+        return 1;
+    }
+
+    c->rows = (size_t) rows;
+
+    logMessage(INFO, "Checkpoint has %zu rows written", c->rows);
+
+    return 0;
+}
+
+
+/* Record a block as written, once it is safely in the image file. The new
+ * checkpoint is written beside the old and renamed over it, so a crash leaves
+ * one or the other whole. Called by the block writer thread
+ */
+int updateCheckpoint(Checkpoint *c, const Block *block)
+{
+    char tmpFilepath[CHECKPOINT_FILEPATH_LEN_MAX + sizeof(CHECKPOINT_TMP_EXTENSION)];
+    FILE *image = block->parameters->file;
+    FILE *f;
+    size_t rows = (block->remainder) ? block->remainderRows : block->rows;
+
+    if (fflush(image) || fsync(fileno(image)))
+    {
+        logMessage(ERROR, "Block %zu could not be flushed to image file", block->id);
+        return 1;
+    }
+
+    snprintf(tmpFilepath, sizeof(tmpFilepath), "%s%s", c->filepath, CHECKPOINT_TMP_EXTENSION);
+
+    f = fopen(tmpFilepath, "w");
+
+    if (!f)
+    {
+        logMessage(ERROR, "Checkpoint \'%s\' could not be opened", tmpFilepath);
+        return 1;
+    }
+
+    c->rows = block->id * block->rows + rows;
+
+    fprintf(f, CHECKPOINT_MAGIC " %u\nhash %016" PRIx64 "\nrows %zu\n", CHECKPOINT_VERSION, c->hash, c->rows);
+
+    if (fflush(f) || fsync(fileno(f)))
+    {
+        logMessage(ERROR, "Checkpoint \'%s\' could not be written", tmpFilepath);
+        fclose(f);
+        remove(tmpFilepath);
+        return 1;
+    }
+
+    if (fclose(f) || rename(tmpFilepath, c->filepath))
+    {
+        logMessage(ERROR, "Checkpoint \'%s\' could not be written", c->filepath);
+        remove(tmpFilepath);
+        return 1;
+    }
+
+    logMessage(DEBUG, "Checkpoint updated to %zu rows", c->rows);
+
+    return 0;
+}
+
+
+/* Remove the checkpoint of a finished plot */
+int removeCheckpoint(const Checkpoint *c)
+{
+    errno = 0;
+
+    if (remove(c->filepath) && errno != ENOENT)
+    {
+        logMessage(WARNING, "Checkpoint \'%s\' could not be removed", c->filepath);
+        return 1;
+    }
+
+    logMessage(DEBUG, "Checkpoint removed");
+
+    return 0;
+}
+
+
+void freeCheckpoint(Checkpoint *c)
+{
+    free(c);
+}
+
+
+/* Hash the parameters that decide the contents of the image: the plot in its
+ * precision (as sent to a worker), and the output and bit depth
+ */
+static int hashParameters(uint64_t *hash, const PlotCTX *p)
+{
+    unsigned char data[CHECKPOINT_PARAMETERS_SIZE];
+    WireBuffer w = createWireBuffer(data, sizeof(data));
+
+    if (serialisePlot(&w, p))
+        return 1;
+
+    putU8(&w, (uint8_t) p->output);
+    putU8(&w, (uint8_t) p->colour.depth);
+
+    if (w.error)
+        return 1;
+
+    *hash = hashBytes(FNV_OFFSET_BASIS, data, w.pos);
+
+    return 0;
+}
+
+
+static uint64_t hashBytes(uint64_t hash, const unsigned char *data, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
\ No newline at end of file
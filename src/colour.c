@@ -1,6 +1,8 @@
 #include <complex.h>
+#include <float.h>
 #include <limits.h>
 #include <math.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
@@ -30,13 +32,37 @@ const ColourSchemeType COLOUR_SCHEME_MAX = COLOUR_SCHEME_TYPE_MATRIX;
 static const char *OUTPUT_TERMINAL_CHARSET = OUTPUT_TERMINAL_CHARSET_;
 static const size_t OUTPUT_TERMINAL_CHARSET_LENGTH = (sizeof(OUTPUT_TERMINAL_CHARSET_) - 1) / sizeof(char);
 
+/* Smoothed iteration values are stored as little-endian IEEE 754 floats of
+ * ITERATION_BYTES bytes, so that rows of them can be sent as they are. Unescaped
+ * points are stored as ITERATION_UNESCAPED, below any smoothed value
+ */
+#define ITERATION_BYTES (BIT_DEPTH_ITERATIONS / CHAR_BIT)
+static const float ITERATION_UNESCAPED = -FLT_MAX;
+
 /* Multiplier values to normalise the smoothed iteration values */
 static const double COLOUR_SCALE_MULTIPLIER = 30.0;
 static const double CHAR_SCALE_MULTIPLIER = 0.3;
 
+/* Smoothed iteration values are coloured in runs of up to COLOUR_BATCH_LEN,
+ * smoothing all of a run before any is looked up in the palette
+ */
+#define COLOUR_BATCH_LEN 64
+
+
+static void initialisePalette(ColourScheme *scheme, double period);
+static const RGB * getPaletteColour(const ColourPalette *palette, double n, EscapeStatus status);
+
+static void mapSmoothedColour(void *pixel, double n, EscapeStatus status, int offset, const ColourScheme *scheme);
+static void mapSmoothedBatch(char *const *pixels, const int *offsets, const double *n, const EscapeStatus *status,
+                             size_t count, const ColourScheme *scheme);
+static void mapSmoothedRow(char *row, const double *n, const EscapeStatus *status, size_t count,
+                           const ColourScheme *scheme);
 
 static void hsvToRGB(RGB *rgb, HSV *hsv);
 
+static void encodeIteration(unsigned char *dest, double n, EscapeStatus status);
+static float decodeIteration(const unsigned char *src);
+
 static char mapColourSchemeASCII(double n, EscapeStatus status);
 
 static void mapColourSchemeBlackWhite(char *byte, int offset, EscapeStatus status);
@@ -52,10 +78,14 @@ static void mapColourSchemeRedHot(RGB *rgb, double n, EscapeStatus status);
 static void mapColourSchemeMatrix(RGB *rgb, double n, EscapeStatus status);
 
 
-/* Initialise ColourScheme struct */
+/* Initialise ColourScheme struct, and precompute its palette */
 int initialiseColourScheme(ColourScheme *scheme, ColourSchemeType colour)
 {
+    /* Smoothed iterations after which the scheme's colours repeat */
+    double period = 0.0;
+
     scheme->scheme = colour;
+    scheme->smoothing = 1.0;
 
     switch (colour)
     {
@@ -74,39 +104,59 @@ int initialiseColourScheme(ColourScheme *scheme, ColourSchemeType colour)
         case COLOUR_SCHEME_TYPE_GREYSCALE:
             scheme->depth = BIT_DEPTH_8;
             scheme->mapColour.greyscale = mapColourSchemeGreyscale;
+            period = 60.0;
             break;
         case COLOUR_SCHEME_TYPE_RAINBOW:
             scheme->depth = BIT_DEPTH_24;
             scheme->mapColour.trueColour = mapColourSchemeRainbow;
+            period = 12.0;
             break;
         case COLOUR_SCHEME_TYPE_RAINBOW_VIBRANT:
             scheme->depth = BIT_DEPTH_24;
             scheme->mapColour.trueColour = mapColourSchemeRainbowVibrant;
+            period = 12.0;
             break;
         case COLOUR_SCHEME_TYPE_RED_WHITE:
             scheme->depth = BIT_DEPTH_24;
             scheme->mapColour.trueColour = mapColourSchemeRedWhite;
+            period = 28.0;
             break;
         case COLOUR_SCHEME_TYPE_FIRE:
             scheme->depth = BIT_DEPTH_24;
             scheme->mapColour.trueColour = mapColourSchemeFire;
+            period = 50.0;
             break;
         case COLOUR_SCHEME_TYPE_RED_HOT:
             scheme->depth = BIT_DEPTH_24;
             scheme->mapColour.trueColour = mapColourSchemeRedHot;
+            period = 90.0;
             break;
         case COLOUR_SCHEME_TYPE_MATRIX:
             scheme->depth = BIT_DEPTH_24;
             scheme->mapColour.trueColour = mapColourSchemeMatrix;
+            period = 90.0;
             break;
         default:
             return 1;
     }
 
+    if (scheme->depth == BIT_DEPTH_8 || scheme->depth == BIT_DEPTH_24)
+        initialisePalette(scheme, period);
+
     return 0;
 }
 
 
+/* Smooth iteration counts of a formula of the given degree. An escaped value
+ * is raised to the power d each iteration, so the fraction of an iteration is
+ * taken in log base d. Must be set again after the scheme is initialised
+ */
+void setColourDegree(ColourScheme *scheme, unsigned int degree)
+{
+    scheme->smoothing = 1.0 / log2((double) degree);
+}
+
+
 /* Smooth the iteration count then map it to an RGB value */
 void mapColour(void *pixel, unsigned long n, complex z, int offset, unsigned long max, const ColourScheme *scheme)
 {
@@ -115,26 +165,9 @@ void mapColour(void *pixel, unsigned long n, complex z, int offset, unsigned lon
 
     /* Makes discrete iteration count a continuous value */
     if (status == ESCAPED && scheme->depth != BIT_DEPTH_1)
-        nSmooth = n + 1.0 - log2(log2(cabs(z)));
+        nSmooth = n + 1.0 - scheme->smoothing * log2(log2(cabs(z)));
 
-    switch (scheme->depth)
-    {
-        case BIT_DEPTH_ASCII:
-            *((char *) pixel) = scheme->mapColour.ascii(nSmooth, status);
-            break;
-        case BIT_DEPTH_1:
-            /* Only write every byte */
-            scheme->mapColour.monochrome(pixel, offset, status);
-            break;
-        case BIT_DEPTH_8:
-            *((uint8_t *) pixel) = scheme->mapColour.greyscale(nSmooth, status);
-            break;
-        case BIT_DEPTH_24:
-            scheme->mapColour.trueColour(pixel, nSmooth, status);
-            break;
-        default:
-            return;
-    }
+    mapSmoothedColour(pixel, nSmooth, status, offset, scheme);
 }
 
 
@@ -147,63 +180,139 @@ void mapColourExt(void *pixel, unsigned long n, long double complex z, int offse
 
     /* Makes discrete iteration count a continuous value */
     if (status == ESCAPED && scheme->depth != BIT_DEPTH_1)
-        nSmooth = n + 1.0L - log2l(log2l(cabsl(z)));
+        nSmooth = n + 1.0L - scheme->smoothing * log2l(log2l(cabsl(z)));
 
-    switch (scheme->depth)
-    {
-        case BIT_DEPTH_ASCII:
-            *((char *) pixel) = scheme->mapColour.ascii(nSmooth, status);
-            break;
-        case BIT_DEPTH_1:
-            /* Only write every byte */
-            scheme->mapColour.monochrome(pixel, offset, status);
-            break;
-        case BIT_DEPTH_8:
-            *((uint8_t *) pixel) = scheme->mapColour.greyscale(nSmooth, status);
-            break;
-        case BIT_DEPTH_24:
-            scheme->mapColour.trueColour(pixel, nSmooth, status);
-            break;
-        default:
-            return;
-    }
+    mapSmoothedColour(pixel, nSmooth, status, offset, scheme);
 }
 
 
 #ifdef MP_PREC
 /* Smooth the iteration count then map it to an RGB value (multiple-precision) */
-void mapColourMP(void *pixel, unsigned long n, mpfr_t norm, int offset, unsigned long max, const ColourScheme *scheme)
+void mapColourMP(void *pixel, unsigned long n, const mpfr_t norm, int offset, unsigned long max,
+                 const ColourScheme *scheme)
 {
     EscapeStatus status = (n < max) ? ESCAPED : UNESCAPED;
     double nSmooth = 0.0;
 
-    /* Makes discrete iteration count a continuous value */
+    /* Makes discrete iteration count a continuous value. The logarithm is
+     * taken from the exponent and significand, so `norm` is left unchanged
+     */
     if (status == ESCAPED && scheme->depth != BIT_DEPTH_1)
     {
-        mpfr_log2(norm, norm, MP_REAL_RND);
-        nSmooth = n + 2.0 - log2(mpfr_get_d(norm, MP_REAL_RND));
+        long exponent;
+        double significand = mpfr_get_d_2exp(&exponent, norm, MP_REAL_RND);
+
+        nSmooth = n + (1.0 + scheme->smoothing) - scheme->smoothing * log2((double) exponent + log2(significand));
     }
 
-    switch (scheme->depth)
+    mapSmoothedColour(pixel, nSmooth, status, offset, scheme);
+}
+#endif
+
+
+/* Smooth and colour a batch of pixels, as by mapColour(). Every value of a
+ * run is smoothed before any is coloured, so the logarithms are not held up
+ * by the table lookups
+ */
+void mapColourBatch(char *const *pixels, const int *offsets, const unsigned long *n, const complex *z, size_t count,
+                    unsigned long max, const ColourScheme *scheme)
+{
+    double nSmooth[COLOUR_BATCH_LEN];
+    EscapeStatus status[COLOUR_BATCH_LEN];
+    double k = scheme->smoothing;
+
+    for (size_t start = 0; start < count; start += COLOUR_BATCH_LEN)
     {
-        case BIT_DEPTH_ASCII:
-            *((char *) pixel) = scheme->mapColour.ascii(nSmooth, status);
-            break;
-        case BIT_DEPTH_1:
-            /* Only write every byte */
-            scheme->mapColour.monochrome(pixel, offset, status);
-            break;
-        case BIT_DEPTH_8:
-            *((uint8_t *) pixel) = scheme->mapColour.greyscale(nSmooth, status);
-            break;
-        case BIT_DEPTH_24:
-            scheme->mapColour.trueColour(pixel, nSmooth, status);
-            break;
-        default:
-            return;
+        size_t len = (count - start < COLOUR_BATCH_LEN) ? count - start : COLOUR_BATCH_LEN;
+
+        for (size_t i = 0; i < len; ++i)
+        {
+            complex zi = z[start + i];
+            double dot = creal(zi) * creal(zi) + cimag(zi) * cimag(zi);
+
+            status[i] = (n[start + i] < max) ? ESCAPED : UNESCAPED;
+
+            /* log2(log2(|z|)) = log2(log2(|z|^2)) - 1 */
+            nSmooth[i] = (status[i] == ESCAPED) ? n[start + i] + (1.0 + k) - k * log2(log2(dot)) : 0.0;
+        }
+
+        mapSmoothedBatch(pixels + start, offsets + start, nSmooth, status, len, scheme);
     }
 }
-#endif
+
+
+/* Smooth and colour a batch of pixels, as by mapColourExt() */
+void mapColourBatchExt(char *const *pixels, const int *offsets, const unsigned long *n, const long double complex *z,
+                       size_t count, unsigned long max, const ColourScheme *scheme)
+{
+    double nSmooth[COLOUR_BATCH_LEN];
+    EscapeStatus status[COLOUR_BATCH_LEN];
+    bool smooth = (scheme->depth != BIT_DEPTH_1);
+    long double k = scheme->smoothing;
+
+    for (size_t start = 0; start < count; start += COLOUR_BATCH_LEN)
+    {
+        size_t len = (count - start < COLOUR_BATCH_LEN) ? count - start : COLOUR_BATCH_LEN;
+
+        for (size_t i = 0; i < len; ++i)
+        {
+            status[i] = (n[start + i] < max) ? ESCAPED : UNESCAPED;
+            nSmooth[i] = (smooth && status[i] == ESCAPED)
+                         ? n[start + i] + 1.0L - k * log2l(log2l(cabsl(z[start + i]))) : 0.0;
+        }
+
+        mapSmoothedBatch(pixels + start, offsets + start, nSmooth, status, len, scheme);
+    }
+}
+
+
+/* Colour a row of `width` smoothed iteration values, as written by the
+ * mapColour functions at BIT_DEPTH_ITERATIONS, into `row` with the scheme
+ */
+void mapIterationRow(void *row, const unsigned char *values, size_t width, const ColourScheme *scheme)
+{
+    double nSmooth[COLOUR_BATCH_LEN];
+    EscapeStatus status[COLOUR_BATCH_LEN];
+
+    /* Rows of a raw image are kept as they are */
+    if (scheme->depth == BIT_DEPTH_ITERATIONS)
+    {
+        memcpy(row, values, width * ITERATION_BYTES);
+        return;
+    }
+
+    /* Runs are a multiple of CHAR_BIT long, so every run starts on a byte */
+    for (size_t start = 0; start < width; start += COLOUR_BATCH_LEN)
+    {
+        size_t len = (width - start < COLOUR_BATCH_LEN) ? width - start : COLOUR_BATCH_LEN;
+        size_t offset = (scheme->depth == BIT_DEPTH_1) ? start / CHAR_BIT
+                                                         : start * ((scheme->depth == BIT_DEPTH_24) ? sizeof(RGB) : 1);
+
+        for (size_t i = 0; i < len; ++i, values += ITERATION_BYTES)
+        {
+            float n = decodeIteration(values);
+
+            status[i] = (n > ITERATION_UNESCAPED) ? ESCAPED : UNESCAPED;
+            nSmooth[i] = (status[i] == ESCAPED) ? n : 0.0;
+        }
+
+        mapSmoothedRow((char *) row + offset, nSmooth, status, len, scheme);
+    }
+}
+
+
+/* Get the number of iterations a pixel took from its stored smoothed
+ * iteration value. Unescaped pixels took every one of `max`
+ */
+unsigned long getIterationCount(const unsigned char *value, unsigned long max)
+{
+    float n = decodeIteration(value);
+
+    if (!(n > ITERATION_UNESCAPED) || n >= (float) max)
+        return max;
+
+    return (n > 0.0f) ? (unsigned long) n + 1 : 1;
+}
 
 
 /* Convert colour scheme enum to a string */
@@ -254,6 +363,137 @@ int getColourString(char *dest, ColourSchemeType colour, size_t n)
 }
 
 
+/* Fill the palette of a scheme with a period of its colours */
+static void initialisePalette(ColourScheme *scheme, double period)
+{
+    ColourPalette *palette = &(scheme->palette);
+
+    palette->scale = COLOUR_PALETTE_LEN / period;
+
+    for (size_t i = 0; i <= COLOUR_PALETTE_LEN; ++i)
+    {
+        /* The last pass fills the colour of unescaped points */
+        RGB *rgb = (i < COLOUR_PALETTE_LEN) ? &(palette->colours[i]) : &(palette->unescaped);
+        EscapeStatus status = (i < COLOUR_PALETTE_LEN) ? ESCAPED : UNESCAPED;
+        double n = i / palette->scale;
+
+        if (scheme->depth == BIT_DEPTH_8)
+            rgb->r = rgb->g = rgb->b = scheme->mapColour.greyscale(n, status);
+        else
+            scheme->mapColour.trueColour(rgb, n, status);
+    }
+}
+
+
+/* Look up the colour of a smoothed iteration value in a palette */
+static const RGB * getPaletteColour(const ColourPalette *palette, double n, EscapeStatus status)
+{
+    if (status == UNESCAPED)
+        return &(palette->unescaped);
+
+    /* The palette is one period long, so the index wraps around it */
+    return &(palette->colours[(size_t) ((long long) (n * palette->scale)) & (COLOUR_PALETTE_LEN - 1)]);
+}
+
+
+/* Map a smoothed iteration value to the pixel's colour */
+static void mapSmoothedColour(void *pixel, double n, EscapeStatus status, int offset, const ColourScheme *scheme)
+{
+    switch (scheme->depth)
+    {
+        case BIT_DEPTH_ASCII:
+            *((char *) pixel) = scheme->mapColour.ascii(n, status);
+            break;
+        case BIT_DEPTH_1:
+            /* Only write every byte */
+            scheme->mapColour.monochrome(pixel, offset, status);
+            break;
+        case BIT_DEPTH_8:
+            *((uint8_t *) pixel) = getPaletteColour(&(scheme->palette), n, status)->r;
+            break;
+        case BIT_DEPTH_24:
+            *((RGB *) pixel) = *getPaletteColour(&(scheme->palette), n, status);
+            break;
+        case BIT_DEPTH_ITERATIONS:
+            encodeIteration(pixel, n, status);
+            break;
+        default:
+            return;
+    }
+}
+
+
+/* Colour a batch of pixels, each with its own pointer. The depth is tested
+ * once for the batch, so the loop colouring it has no branches of its own
+ */
+static void mapSmoothedBatch(char *const *pixels, const int *offsets, const double *n, const EscapeStatus *status,
+                             size_t count, const ColourScheme *scheme)
+{
+    switch (scheme->depth)
+    {
+        case BIT_DEPTH_ASCII:
+            for (size_t i = 0; i < count; ++i)
+                *(pixels[i]) = scheme->mapColour.ascii(n[i], status[i]);
+
+            break;
+        case BIT_DEPTH_1:
+            for (size_t i = 0; i < count; ++i)
+                scheme->mapColour.monochrome(pixels[i], offsets[i], status[i]);
+
+            break;
+        case BIT_DEPTH_8:
+            for (size_t i = 0; i < count; ++i)
+                *((uint8_t *) pixels[i]) = getPaletteColour(&(scheme->palette), n[i], status[i])->r;
+
+            break;
+        case BIT_DEPTH_24:
+            for (size_t i = 0; i < count; ++i)
+                *((RGB *) pixels[i]) = *getPaletteColour(&(scheme->palette), n[i], status[i]);
+
+            break;
+        case BIT_DEPTH_ITERATIONS:
+            for (size_t i = 0; i < count; ++i)
+                encodeIteration((unsigned char *) pixels[i], n[i], status[i]);
+
+            break;
+        default:
+            return;
+    }
+}
+
+
+/* Colour `count` consecutive pixels of a row, starting on a byte */
+static void mapSmoothedRow(char *row, const double *n, const EscapeStatus *status, size_t count,
+                           const ColourScheme *scheme)
+{
+    switch (scheme->depth)
+    {
+        case BIT_DEPTH_ASCII:
+            for (size_t i = 0; i < count; ++i)
+                row[i] = scheme->mapColour.ascii(n[i], status[i]);
+
+            break;
+        case BIT_DEPTH_1:
+            for (size_t i = 0; i < count; ++i)
+                scheme->mapColour.monochrome(&row[i / CHAR_BIT], (int) (i % CHAR_BIT), status[i]);
+
+            break;
+        case BIT_DEPTH_8:
+            for (size_t i = 0; i < count; ++i)
+                row[i] = (char) getPaletteColour(&(scheme->palette), n[i], status[i])->r;
+
+            break;
+        case BIT_DEPTH_24:
+            for (size_t i = 0; i < count; ++i)
+                ((RGB *) row)[i] = *getPaletteColour(&(scheme->palette), n[i], status[i]);
+
+            break;
+        default:
+            return;
+    }
+}
+
+
 /* Map HSV colour values to RGB */
 static void hsvToRGB(RGB *rgb, HSV *hsv)
 {
@@ -506,4 +746,31 @@ static void mapColourSchemeMatrix(RGB *rgb, double n, EscapeStatus status)
         hsv.v = (90.0 - fabs(fmod(n * 2.0, 180.0) - 90.0)) / 90.0;
 
     hsvToRGB(rgb, &hsv);
+}
+
+
+/* Store a smoothed iteration value (byte by byte, so `dest` needs no alignment) */
+static void encodeIteration(unsigned char *dest, double n, EscapeStatus status)
+{
+    float value = (status == ESCAPED) ? (float) n : ITERATION_UNESCAPED;
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+
+    for (int i = 0; i < ITERATION_BYTES; ++i, bits >>= CHAR_BIT)
+        dest[i] = (unsigned char) (bits & UCHAR_MAX);
+}
+
+
+static float decodeIteration(const unsigned char *src)
+{
+    float value;
+    uint32_t bits = 0;
+
+    for (int i = ITERATION_BYTES; i > 0; --i)
+        bits = (bits << CHAR_BIT) | src[i - 1];
+
+    memcpy(&value, &bits, sizeof(value));
+
+    return value;
 }
\ No newline at end of file
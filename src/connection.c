@@ -10,9 +10,19 @@ Connection createConnection(void)
 {
     Connection c =
     {
-        .rowAllocated = false,
-        .row = 0,
+        .unitCount = 0,
+        .unitDone = 0,
+        .rate = 0.0,
+        .lastDone = 0.0,
+        .lastHeard = 0.0,
+        .thread = 0,
+        .stats = createConnectionStats(),
+        .headerRead = 0,
+        .body = NULL,
+        .bodyRead = 0,
+        .discard = false,
         .n = 0,
+        .head = 0,
         .read = 0,
         .buffer = NULL
     };
@@ -30,6 +40,7 @@ int createClientReceiveBuffer(Connection *c, size_t n)
         if (c->buffer)
         {
             c->n = n;
+            c->head = 0;
             c->read = 0;
             return 0;
         }
@@ -42,16 +53,32 @@ int createClientReceiveBuffer(Connection *c, size_t n)
 void clearClientReceiveBuffer(Connection *c)
 {
     memset(c->buffer, 0, c->n);
+    c->head = 0;
     c->read = 0;
 }
 
 
+/* Move any data not yet taken from the buffer to its start, to make room for
+ * the rest of a partly received message
+ */
+void compactClientReceiveBuffer(Connection *c)
+{
+    if (c->head)
+    {
+        memmove(c->buffer, c->buffer + c->head, c->read - c->head);
+        c->read -= c->head;
+        c->head = 0;
+    }
+}
+
+
 void freeClientReceiveBuffer(Connection *c)
 {
     if (c)
     {
         free(c->buffer);
         c->n = 0;
+        c->head = 0;
         c->read = 0;
         c->buffer = NULL;
     }
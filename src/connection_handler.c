@@ -1,5 +1,6 @@
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -10,11 +11,15 @@
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "libgroot/include/log.h"
@@ -24,19 +29,131 @@
 
 #include "arg_ranges.h"
 #include "array.h"
+#include "colour.h"
 #include "network_ctx.h"
+#include "protocol.h"
+#include "report.h"
 #include "request_handler.h"
+#include "run_length.h"
 #include "stack.h"
+#include "stats.h"
 
 
-static void initialiseWorker(NetworkCTX *network, const Block *block, Stack *rowStack);
-static void releaseWorker(NetworkCTX *network, int i, Stack *rows);
-static void returnRow(NetworkCTX *network, int i, Stack *rows);
-static int allocateRow(NetworkCTX *network, int i, Stack *rows);
-static void completeRow(NetworkCTX *network, int i);
+/* Number of events each I/O thread takes from its event set at a time */
+#define LISTENER_EVENTS_MAX 64
 
-static Stack * createRowStack(const Block *block);
-static void destroyRowStack(Stack *s);
+/* Event data of the listener's wake event, rather than a connection index */
+#define LISTENER_WAKE UINT32_MAX
+
+/* Weight of each unit's rate in a worker's running rate */
+#define RATE_WEIGHT 0.25
+
+/* Longest wait in seconds between a worker's attempts to reach its master */
+#define RETRY_WAIT_MAX 8
+
+
+/* Each I/O thread waits on its own event set, holding a share of the workers */
+typedef struct IOThread
+{
+    Listener *listener;     /* Listener the thread belongs to */
+    unsigned int id;        /* Index of the thread and its event set */
+    unsigned char *scratch; /* Row for encoded iteration values to be decoded into before colouring */
+    pthread_t pid;          /* Thread ID */
+} IOThread;
+
+/* Progress of a unit of the block, across every copy of it handed out */
+typedef struct UnitState
+{
+    unsigned int copies; /* Number of workers (or the master) holding the unit */
+    size_t claimed;      /* Rows of the unit taken from a copy, received or not */
+    size_t received;     /* Rows of the unit received, from any copy */
+    double issued;       /* Time the first copy still held was handed out */
+    bool queued;         /* Whether the unit is on the unit stack */
+} UnitState;
+
+/* Progress of one block of the listener's window */
+typedef struct ListenerBlock
+{
+    const Block *block;    /* Block being received (NULL if the slot is free) */
+    Stack *units;          /* First row of each unit yet to be handed out */
+    UnitState *unitStates; /* State of each unit of the block */
+    bool *claimed;         /* Whether each row of the block has been taken from a copy of its unit */
+    size_t rows;           /* Rows in the block */
+    size_t wroteRows;      /* Rows received */
+} ListenerBlock;
+
+/* State of the listener for the plot. The mutex guards the window, and the
+ * set of connections (accepting, closing, and handing out units), which all
+ * I/O threads share
+ */
+struct Listener
+{
+    NetworkCTX *network;                   /* Network of the master */
+    const Block *image;                    /* Any block of the image, for the row size and parameters they share */
+    ListenerBlock window[LISTENER_WINDOW]; /* Blocks being received, each in the slot of its ID */
+    size_t oldest;                         /* ID of the oldest block not yet wholly received */
+    bool done;                             /* Whether the I/O threads are to stop */
+    int error;                             /* Whether the plot failed */
+    int wake;                              /* Event counter written to wake every I/O thread */
+    IOThread *threads;                     /* I/O threads */
+    unsigned int started;                  /* Number of I/O threads started */
+    LocalWorker *local;                    /* Master's own share of the plot (if any) */
+    pthread_t localPid;                    /* Thread ID of the local worker */
+    bool localStarted;                     /* Whether the local worker has been started */
+    pthread_mutex_t mutex;                 /* Guards the shared state */
+    pthread_cond_t woken;                  /* Signalled along with the wake event */
+    pthread_cond_t received;               /* Signalled when a block is wholly received, or the listener stops */
+};
+
+
+static int joinMaster(NetworkCTX *network, PlotCTX **p);
+static int connectToMaster(NetworkCTX *network, PlotCTX **p);
+static void setReceiveTimeout(const NetworkCTX *network);
+static void disconnectMaster(NetworkCTX *network);
+
+static int initialiseListenerBlock(ListenerBlock *b, const NetworkCTX *network, const Block *block);
+static void clearListenerBlock(ListenerBlock *b);
+static void * ioThread(void *threadInfo);
+static int getEventTimeout(double nextBeat);
+static void * localThread(void *listenerInfo);
+static int plotLocalRows(Listener *l, size_t row, size_t rows);
+static bool isListenerDone(Listener *l);
+static void stopListener(Listener *l, int error);
+static void wakeListener(Listener *l);
+
+static void initialiseWorker(Listener *l);
+static int startWorker(Listener *l, int i);
+static int serviceWorker(IOThread *t, int i, uint32_t events);
+static bool skipMessage(Connection *c, uint64_t job);
+static void topUpWorkers(IOThread *t);
+static void checkWorkers(IOThread *t);
+static void releaseWorker(Listener *l, int i);
+static void returnUnits(Listener *l, int i);
+static int allocateUnits(Listener *l, int i);
+static unsigned int getWorkerDepth(const NetworkCTX *network, int i);
+static int takeUnit(Listener *l, size_t *row, bool copy);
+static UnitState * getStragglerUnit(const Listener *l, const ListenerBlock *b);
+static int issueUnit(Listener *l, int i, size_t row);
+static void dropUnit(Listener *l, size_t row);
+static void completeUnit(Listener *l, int i);
+static void updateWorkerRate(NetworkCTX *network, int i, const ConnectionUnit *unit);
+static void forgetWorkerRate(NetworkCTX *network, int i);
+static unsigned char * getMessageBody(Listener *l, int i, const MessageHeader *h);
+static int receiveRows(IOThread *t, int i);
+static size_t getMessageRows(const NetworkCTX *network, const Block *block, const MessageHeader *h);
+static bool claimRows(Listener *l, size_t row, size_t rows);
+static void unclaimRows(Listener *l, size_t row, size_t rows);
+static void addRows(Listener *l, size_t row, size_t rows);
+static ListenerBlock * getListenerBlock(Listener *l, size_t row);
+static UnitState * getUnitState(Listener *l, size_t row);
+static bool isBlockRow(const Block *block, size_t row);
+static unsigned char * getBlockRow(const Block *block, size_t row);
+static size_t getWorkerRowSize(const NetworkCTX *network, const Block *block);
+static size_t getReceiveBufferSize(const NetworkCTX *network, const Block *block);
+
+static Stack * createUnitStack(const NetworkCTX *network, const Block *block);
+static size_t getUnitRows(const NetworkCTX *network, const Block *block, size_t row);
+static void destroyUnitStack(Stack *s);
 
 
 /* Bind sockets where relevant for distributed computing, and generate necessary
@@ -82,6 +199,13 @@ int initialiseAsMaster(NetworkCTX *network)
     int s;
     Connection *c = &(network->connections[0]);
 
+    /* Connection requests are level-triggered, and taken one at a time */
+    struct epoll_event listenEvent =
+    {
+        .events = EPOLLIN,
+        .data.u32 = 0
+    };
+
     logMessage(DEBUG, "Creating socket");
     s = socket(AF_INET, SOCK_STREAM, 0);
 
@@ -133,6 +257,44 @@ int initialiseAsMaster(NetworkCTX *network)
         return 1;
     }
 
+    /* Each I/O thread has an event set for its workers, and the first also
+     * waits on connection requests
+     */
+    logMessage(DEBUG, "Creating event sets of %u I/O threads", network->ioThreads);
+    network->epoll = malloc(network->ioThreads * sizeof(*(network->epoll)));
+
+    if (!network->epoll)
+    {
+        logMessage(ERROR, "Could not allocate memory for event sets");
+        close(s);
+        return 1;
+    }
+
+    for (unsigned int t = 0; t < network->ioThreads; ++t)
+        network->epoll[t] = epoll_create1(0);
+
+    for (unsigned int t = 0; t < network->ioThreads; ++t)
+    {
+        if (network->epoll[t] < 0)
+        {
+            logMessage(ERROR, "Event set could not be created");
+            close(s);
+            return 1;
+        }
+    }
+
+    if (epoll_ctl(network->epoll[0], EPOLL_CTL_ADD, s, &listenEvent))
+    {
+        logMessage(ERROR, "Socket could not be added to event set");
+        close(s);
+        return 1;
+    }
+
+    /* Messages carry the job identifier, so that any from a worker of an earlier
+     * plot are told apart
+     */
+    network->job = ((uint64_t) time(NULL) << 32) ^ (uint64_t) getpid();
+
     network->fds[0].fd = s;
     network->fds[0].events = POLLIN;
     ++(network->n);
@@ -143,6 +305,8 @@ int initialiseAsMaster(NetworkCTX *network)
 /* Accept connection request and return index in Connection array */
 int acceptConnection(NetworkCTX *network)
 {
+    const int SOCK_OPT = 1;
+
     int s;
 
     Connection c = createConnection();
@@ -174,11 +338,23 @@ int acceptConnection(NetworkCTX *network)
                ntohs(c.addr.sin_port),
                s);
 
+    /* Workers are read until nothing is left on each event, so their sockets
+     * must not block
+     */
+    if (ioctl(s, FIONBIO, (const void *) &SOCK_OPT) < 0)
+    {
+        logMessage(ERROR, "Socket mode could not be changed, closing connection");
+        close(s);
+        return -1;
+    }
+
     for (int i = 1; i < network->max; ++i)
     {
         /* If space for the new connection */
         if (network->fds[i].fd < 0)
         {
+            /* Workers are dealt out to the I/O threads in turn */
+            c.thread = (unsigned int) (i - 1) % network->ioThreads;
             network->connections[i] = c;
 
             network->fds[i] = createPollfd();
@@ -198,6 +374,172 @@ int acceptConnection(NetworkCTX *network)
 
 /* Initialise machine as worker - connect to a master and read parameters */
 int initialiseAsWorker(NetworkCTX *network, PlotCTX **p)
+{
+    return joinMaster(network, p);
+}
+
+
+/* Join the master again after losing the connection to it (or hearing nothing
+ * from it for too long), to carry on with the same plot. Units outstanding
+ * at the worker are handed out again by the master. Returns 1 if the plot is
+ * over: the master said so before the connection failed, could not be
+ * reached in time, or is now on another plot. Returns 2 if the master said
+ * the frame is finished, so the next of the sequence is to be joined instead
+ */
+int rejoinMaster(NetworkCTX *network)
+{
+    int ret;
+    PlotCTX *p = NULL;
+    uint64_t job = network->job;
+
+    switch (takePlotDone(network, 0))
+    {
+        case 1:
+            logMessage(INFO, "Master has finished the plot");
+            return 1;
+        case 2:
+            return 2;
+        default:
+            break;
+    }
+
+    logMessage(WARNING, "Lost connection to master, rejoining");
+
+    /* The heartbeat thread is held off until the worker has rejoined */
+    pthread_mutex_lock(&(network->send));
+
+    disconnectMaster(network);
+    ret = joinMaster(network, &p);
+
+    pthread_mutex_unlock(&(network->send));
+
+    if (ret)
+        return 1;
+
+    freePlotCTX(p);
+
+    if (network->job != job)
+    {
+        logMessage(WARNING, "Master has moved on to another plot");
+        return 1;
+    }
+
+    logMessage(INFO, "Rejoined master");
+
+    return 0;
+}
+
+
+/* Join the next frame of a sequence once the master has finished the last:
+ * connect again, and read the plot of the frame in place of `p`. Frames differ
+ * only in their range, so the worker's row and threads carry over to the next.
+ * Returns 1 if the frame could not be joined
+ */
+int joinNextFrame(NetworkCTX *network, PlotCTX **p)
+{
+    int ret;
+    PlotCTX *next = NULL;
+
+    logMessage(INFO, "Master has finished the frame, joining the next");
+
+    /* The heartbeat thread is held off until the worker has joined */
+    pthread_mutex_lock(&(network->send));
+
+    disconnectMaster(network);
+    ret = joinMaster(network, &next);
+
+    pthread_mutex_unlock(&(network->send));
+
+    if (ret)
+        return 1;
+
+    if (next->precision != (*p)->precision || next->width != (*p)->width || next->height != (*p)->height
+        || next->colour.depth != (*p)->colour.depth)
+    {
+        logMessage(ERROR, "Next frame is not of the same dimensions, precision and bit depth");
+        freePlotCTX(next);
+        return 1;
+    }
+
+    freePlotCTX(*p);
+    *p = next;
+
+    logMessage(INFO, "Joined next frame");
+
+    return 0;
+}
+
+
+/* Join the master's next plot on the connection kept from the last, reading
+ * its plot in place of `p`. Plots of a master serving render jobs may differ
+ * in every respect. Returns 1 if the master has finished, or the connection
+ * was lost while waiting
+ */
+int joinNextPlot(NetworkCTX *network, PlotCTX **p)
+{
+    PlotCTX *next = NULL;
+
+    logMessage(INFO, "Master has finished the plot, waiting for the next");
+
+    switch (readNextParameters(network, &next))
+    {
+        case 0:
+            break;
+        case 1:
+            logMessage(INFO, "Master has finished serving plots");
+            return 1;
+        default:
+            logMessage(WARNING, "Lost connection to master while waiting for the next plot");
+            freePlotCTX(next);
+            return 1;
+    }
+
+    /* The master's heartbeat interval may have changed with the plot */
+    setReceiveTimeout(network);
+
+    freePlotCTX(*p);
+    *p = next;
+
+    logMessage(INFO, "Joined next plot");
+
+    return 0;
+}
+
+
+/* Connect to the master and read the plot parameters, trying again for up to
+ * `retry` seconds - the master may not yet be listening, or may be between
+ * blocks. Each wait between attempts is twice the last
+ */
+static int joinMaster(NetworkCTX *network, PlotCTX **p)
+{
+    unsigned int wait = 1;
+    double deadline = getMonotonicTime() + network->retry;
+
+    while (connectToMaster(network, p))
+    {
+        double left = deadline - getMonotonicTime();
+
+        if (left <= 0.0)
+        {
+            logMessage(ERROR, "Could not join master");
+            return 1;
+        }
+
+        /* The last wait ends at the deadline */
+        if (left < wait)
+            wait = (unsigned int) left + 1;
+
+        logMessage(INFO, "Trying master again in %u seconds", wait);
+        sleep(wait);
+
+        wait = (wait * 2 > RETRY_WAIT_MAX) ? RETRY_WAIT_MAX : wait * 2;
+    }
+
+    return 0;
+}
+
+
+static int connectToMaster(NetworkCTX *network, PlotCTX **p)
 {
     int s;
     Connection *c = &(network->connections[0]);
@@ -217,7 +559,7 @@ int initialiseAsWorker(NetworkCTX *network, PlotCTX **p)
 
     if (connect(s, (struct sockaddr *) &c->addr, (socklen_t) sizeof(c->addr)))
     {
-        logMessage(ERROR, "Unable to connect to master");
+        logMessage(WARNING, "Unable to connect to master");
         close(s);
         return 1;
     }
@@ -226,19 +568,50 @@ int initialiseAsWorker(NetworkCTX *network, PlotCTX **p)
     network->fds[0].fd = s;
     ++(network->n);
 
+    /* Until the master's heartbeat interval is known, the worker's own is used */
+    setReceiveTimeout(network);
+
     logMessage(DEBUG, "Getting program parameters from master");
     if (readParameters(network, p))
     {
-        close(s);
-        network->fds[0] = createPollfd();
-        --(network->n);
+        disconnectMaster(network);
         return 1;
     }
 
+    setReceiveTimeout(network);
+
     return 0;
 }
 
 
+/* Have reads from the master give up once it has missed HEARTBEAT_MISSES
+ * heartbeats, as it may have gone without closing the connection
+ */
+static void setReceiveTimeout(const NetworkCTX *network)
+{
+    struct timeval timeout =
+    {
+        .tv_sec = (time_t) (HEARTBEAT_MISSES * network->heartbeat),
+        .tv_usec = 0
+    };
+
+    if (setsockopt(network->fds[0].fd, SOL_SOCKET, SO_RCVTIMEO, (const void *) &timeout, (socklen_t) sizeof(timeout)))
+        logMessage(WARNING, "Could not set timeout on socket - a silent master will not be noticed");
+}
+
+
+/* Close the connection to the master, keeping the receive buffer */
+static void disconnectMaster(NetworkCTX *network)
+{
+    close(network->fds[0].fd);
+
+    network->fds[0] = createPollfd();
+    --(network->n);
+
+    clearClientReceiveBuffer(&(network->connections[0]));
+}
+
+
 void closeConnection(NetworkCTX *network, int i)
 {
     logMessage(INFO, "Closing connection with socket %d", network->fds[i].fd);
@@ -251,6 +624,9 @@ void closeConnection(NetworkCTX *network, int i)
 }
 
 
+/* Workers are told the plot is finished first, so that they do not try to
+ * rejoin it
+ */
 void closeAllConnections(NetworkCTX *network)
 {
     for (int i = 1; i < network->max; ++i)
@@ -258,6 +634,9 @@ void closeAllConnections(NetworkCTX *network)
         if (network->fds[i].fd < 0)
             continue;
 
+        if (sendPlotDone(network, i))
+            logMessage(DEBUG, "Could not tell worker on socket %d the plot is finished", network->fds[i].fd);
+
         closeConnection(network, i);
     }
 
@@ -265,188 +644,1445 @@ void closeAllConnections(NetworkCTX *network)
 }
 
 
-/* Listener */
-int listener(NetworkCTX *network, const Block *block)
+/* Move the workers on to the next frame of a sequence. Each is told the frame
+ * is finished and closed, and joins the next frame as a new worker through the
+ * listening socket, which is kept open. Messages of the next frame carry the
+ * next job identifier, so any left over from the last are told apart
+ */
+void nextFrameConnections(NetworkCTX *network)
 {
-    size_t wroteRows = 0;
-
-    Stack *rowStack = createRowStack(block);
-    if (!rowStack)
-        return 1;
+    double now = getMonotonicTime();
 
     for (int i = 1; i < network->max; ++i)
     {
         if (network->fds[i].fd < 0)
             continue;
-        
-        if (allocateRow(network, i, rowStack))
-            releaseWorker(network, i, rowStack);
+
+        if (sendPlotNext(network, i, false))
+            logMessage(DEBUG, "Could not tell worker on socket %d the frame is finished", network->fds[i].fd);
+
+        forgetWorkerRate(network, i);
+        addConnectionStats(&(network->past), &(network->connections[i].stats), now);
+        ++(network->pastCount);
+
+        closeConnection(network, i);
     }
 
-    while (1)
+    ++(network->job);
+}
+
+
+/* Keep the workers for the master's next plot, once it has served a render
+ * job. Each is told the plot is finished and to wait on its connection, and is
+ * taken out of its event set until the next listener starts it. Whatever is
+ * still to come of the plot carries the last job identifier, so is thrown away
+ * as it is received. Rates and traffic are counted afresh for each plot
+ */
+void keepConnections(NetworkCTX *network)
+{
+    for (int i = 1; i < network->max; ++i)
     {
-        /* Wait for a socket to become active. On return, the set is modified to
-         * only contain the active sockets (hence the reinitialisation of sets
-         * at the top of the loop)
-         */
-        int active = poll(network->fds, (nfds_t) network->n, -1);
+        Connection *c = &(network->connections[i]);
 
-        if (active <= 0)
+        if (network->fds[i].fd < 0)
+            continue;
+
+        if (sendPlotNext(network, i, true))
         {
-            logMessage(ERROR, "Failed to poll sockets");
-            destroyRowStack(rowStack);
-            return 1;
+            logMessage(WARNING, "Could not tell worker on socket %d the plot is finished, closing connection",
+                       network->fds[i].fd);
+            closeConnection(network, i);
+            continue;
         }
 
-        for (int i = 0; i < network->max && active > 0; ++i)
+        /* A worker accepted since the last plot started is in no event set */
+        epoll_ctl(network->epoll[c->thread], EPOLL_CTL_DEL, network->fds[i].fd, NULL);
+
+        /* The block rows were being received into is gone */
+        if (c->body)
         {
-            int ret;
-            int s = network->fds[i].fd;
+            c->body = c->buffer;
+            c->discard = true;
+        }
 
-            if (!network->fds[i].revents || s < 0)
-                continue;
+        c->unitCount = 0;
+        c->unitDone = 0;
+        c->rate = 0.0;
+        c->lastDone = 0.0;
+        c->stats = createConnectionStats();
+    }
 
-            /* If socket is active */
-            --active;
+    network->rateTotal = 0.0;
+    network->rated = 0;
+    network->past = createConnectionStats();
+    network->pastCount = 0;
 
-            if ((network->fds[i].revents & POLLIN) == 0)
-            {
-                releaseWorker(network, i, rowStack);
-                continue;
-            }
+    ++(network->job);
+}
 
-            /* If data to be read on master socket, there is a connection request */
-            if (i == 0)
-            {
-                initialiseWorker(network, block, rowStack);
-                continue;
-            }
 
-            ret = nonblockingRead(network, i);
+/* Look after the workers while the master waits for its next render job, once
+ * each heartbeat interval: accept workers asking to join, pass over whatever
+ * the workers send, and close those not heard from in HEARTBEAT_MISSES
+ * heartbeats, sending the rest a heartbeat. Workers accepted here are sent
+ * their parameters with the others once the next plot starts
+ */
+void tendConnections(NetworkCTX *network)
+{
+    double timeout = HEARTBEAT_MISSES * network->heartbeat;
+    double now = getMonotonicTime();
 
-            if (ret)
-            {
-                if (ret == 1)
-                    releaseWorker(network, i, rowStack);
-                
-                continue;
-            }
+    struct pollfd request =
+    {
+        .fd = network->fds[0].fd,
+        .events = POLLIN,
+        .revents = 0
+    };
 
-            if (network->connections[i].read == network->connections[i].n)
-            {
-                Connection *c = &(network->connections[i]);
-                size_t rows = (block->remainder) ? block->remainderRows : block->rows;
+    while (poll(&request, 1, 0) > 0 && (request.revents & POLLIN))
+    {
+        int i = acceptConnection(network);
+
+        if (i < 0)
+            break;
+
+        network->connections[i].lastHeard = now;
+
+        /* Bodies are only ever thrown away until the plot starts */
+        if (createClientReceiveBuffer(&(network->connections[i]), GENERAL_NETWORK_BUFFER_SIZE))
+        {
+            logMessage(ERROR, "Could not allocate receive buffer for worker, closing connection");
+            closeConnection(network, i);
+        }
+    }
+
+    for (int i = 1; i < network->max; ++i)
+    {
+        Connection *c = &(network->connections[i]);
+        int ret;
+
+        if (network->fds[i].fd < 0)
+            continue;
 
-                memcpy(block->array + c->row * c->n, c->buffer, c->n);
+        while (!(ret = receiveMessageData(network, i)))
+        {
+            c->lastHeard = now;
 
-                logMessage(INFO, "Row %zu from socket %d wrote to array", c->row, s);
-                completeRow(network, i);
+            if (c->body && c->bodyRead == c->message.length)
+                c->body = NULL;
 
-                if (++wroteRows >= rows)
-                {
-                    logMessage(INFO, "All rows wrote to image");
-                    destroyRowStack(rowStack);
-                    return 0;
-                }
+            if (c->body || (ret = takeMessageHeader(c)) == 1)
+                continue;
 
-                if (allocateRow(network, i, rowStack))
-                    releaseWorker(network, i, rowStack);
+            /* Nothing of the next plot is expected before it starts */
+            if (ret || !skipMessage(c, network->job))
+            {
+                ret = 2;
+                break;
             }
         }
+
+        if (ret >= 0)
+        {
+            logMessage(WARNING, "Lost worker on socket %d, closing connection", network->fds[i].fd);
+            closeConnection(network, i);
+        }
+        else if (now - c->lastHeard > timeout)
+        {
+            logMessage(WARNING, "Worker on socket %d not heard from in %.0f seconds, closing connection",
+                       network->fds[i].fd, now - c->lastHeard);
+            closeConnection(network, i);
+        }
+        else if (sendHeartbeat(network, i))
+        {
+            logMessage(WARNING, "Could not send heartbeat to worker on socket %d, closing connection",
+                       network->fds[i].fd);
+            closeConnection(network, i);
+        }
     }
 }
 
 
-static void initialiseWorker(NetworkCTX *network, const Block *block, Stack *rowStack)
+/* Create the listener of the master, and add its wake event to the event set
+ * of each I/O thread. `block` is any block of the image. The threads are
+ * started by initialiseListener(), and the blocks handed out by
+ * queueListenerBlock()
+ */
+Listener * createListener(NetworkCTX *network, const Block *block, LocalWorker *local)
 {
-    int ret;
-
-    int i = acceptConnection(network);
-
-    if (i < 0)
-        return;
+    struct epoll_event wakeEvent =
+    {
+        .events = EPOLLIN | EPOLLET,
+        .data.u32 = LISTENER_WAKE
+    };
 
-    if (createClientReceiveBuffer(&(network->connections[i]), block->rowSize))
-        releaseWorker(network, i, rowStack);
+    Listener *l = malloc(sizeof(*l));
 
-    ret = sendParameters(network, i, block->parameters);
+    if (!l)
+        return NULL;
 
-    if (ret == 1)
+    if (pthread_mutex_init(&(l->mutex), NULL))
     {
-        logMessage(INFO, "Worker shutdown connection, closing connection");
-        releaseWorker(network, i, rowStack);
-        return;
+        free(l);
+        return NULL;
     }
-    else if (ret)
+
+    if (pthread_cond_init(&(l->woken), NULL))
     {
-        logMessage(ERROR, "Sending parameters to worker failed, closing connection");
-        releaseWorker(network, i, rowStack);
-        return;
+        pthread_mutex_destroy(&(l->mutex));
+        free(l);
+        return NULL;
     }
 
-    if (allocateRow(network, i, rowStack))
-        releaseWorker(network, i, rowStack);
-}
+    if (pthread_cond_init(&(l->received), NULL))
+    {
+        pthread_cond_destroy(&(l->woken));
+        pthread_mutex_destroy(&(l->mutex));
+        free(l);
+        return NULL;
+    }
 
+    memset(l->window, 0, sizeof(l->window));
 
-static int allocateRow(NetworkCTX *network, int i, Stack *rowStack)
-{
-    size_t row;
+    l->network = network;
+    l->image = block;
+    l->local = local;
+    l->oldest = 0;
+    l->done = false;
+    l->error = 0;
+    l->started = 0;
+    l->localStarted = false;
+    l->threads = calloc(network->ioThreads, sizeof(*(l->threads)));
+    l->wake = eventfd(0, EFD_NONBLOCK);
 
-    /* Get next row number for the worker to work on */
-    if (!popStack(&row, rowStack))
+    if (!l->threads || l->wake < 0)
     {
-        clearClientReceiveBuffer(&(network->connections[0]));
-        snprintf(network->connections[0].buffer, network->connections[0].n, "%zu", row);
+        logMessage(ERROR, "Could not create listener");
+        freeListener(l);
+        return NULL;
+    }
 
-        logMessage(DEBUG, "Allocating row %s to worker on socket %d", network->connections[0].buffer, network->fds[i].fd);
+    for (unsigned int t = 0; t < network->ioThreads; ++t)
+    {
+        IOThread *thread = &(l->threads[t]);
 
-        if (writeSocket(network->connections[0].buffer, network->fds[i].fd, network->connections[0].n) <= 0)
-            return 1;
+        thread->listener = l;
+        thread->id = t;
 
-        network->connections[i].row = row;
-        network->connections[i].rowAllocated = true;
-    }
+        if (network->iterations && network->compress)
+        {
+            thread->scratch = malloc(getWorkerRowSize(network, block));
 
-    return 0;
-}
+            if (!thread->scratch)
+            {
+                logMessage(ERROR, "Could not allocate memory to decode rows into");
+                freeListener(l);
+                return NULL;
+            }
+        }
 
+        if (epoll_ctl(network->epoll[t], EPOLL_CTL_ADD, l->wake, &wakeEvent))
+        {
+            logMessage(ERROR, "Could not add wake event to event set");
+            freeListener(l);
+            return NULL;
+        }
+    }
 
-/* Close socket connection and modify fd_set and NetworkCTX socket array */
-static void releaseWorker(NetworkCTX *network, int i, Stack *rows)
-{
-    returnRow(network, i, rows);
-    completeRow(network, i);
-    closeConnection(network, i);
+    return l;
 }
 
 
-static void returnRow(NetworkCTX *network, int i, Stack *rows)
+/* Listener - hand out the rows of the blocks in the window to the workers in
+ * units of `unitRows` rows. Each worker is kept some units ahead, so that
+ * none waits on the master between units: `unitDepth` units, scaled by the
+ * worker's rate against the others', so a slow worker is not left with a
+ * queue of units once the rest are done. Units of the oldest block go first,
+ * and once every unit of it has been handed out, workers move on to the next
+ * block while its last rows come in. Once every unit of the window has been
+ * handed out, an idle worker is given a copy of the unit handed out longest
+ * ago, and each row is taken from whichever copy sends it first. Workers
+ * answer units in the order they were given. The workers are shared between
+ * `ioThreads` threads, each waiting on its own edge-triggered event set. With
+ * `local`, the master plots units alongside them
+ */
+int initialiseListener(Listener *l)
 {
-    if (network->connections[i].rowAllocated)
-        pushStack(rows, network->connections[i].row);
-}
+    if (!l)
+        return 1;
 
+    /* Workers kept from the last plot (of a master serving render jobs) are
+     * started as if just accepted
+     */
+    pthread_mutex_lock(&(l->mutex));
 
-static void completeRow(NetworkCTX *network, int i)
-{
-    network->connections[i].row = 0;
-    network->connections[i].rowAllocated = false;
-    clearClientReceiveBuffer(&(network->connections[i]));
-}
+    for (int i = 1; i < l->network->max; ++i)
+    {
+        if (l->network->fds[i].fd >= 0 && startWorker(l, i))
+            releaseWorker(l, i);
+    }
 
+    pthread_mutex_unlock(&(l->mutex));
 
-static Stack * createRowStack(const Block *block)
-{
+    for (; l->started < l->network->ioThreads; ++(l->started))
+    {
+        if (pthread_create(&(l->threads[l->started].pid), NULL, ioThread, &(l->threads[l->started])))
+        {
+            logMessage(ERROR, "I/O thread could not be created");
+            return 1;
+        }
+    }
+
+    if (l->local)
+    {
+        if (pthread_create(&(l->localPid), NULL, localThread, l))
+        {
+            logMessage(ERROR, "Local worker thread could not be created");
+            return 1;
+        }
+
+        l->localStarted = true;
+    }
+
+    return 0;
+}
+
+
+/* Add a block to the window, and have its units handed out. The window holds
+ * LISTENER_WINDOW consecutive blocks, so the block before the last must have
+ * been waited on. The block must not be modified until waitListenerBlock()
+ * has returned for it
+ */
+int queueListenerBlock(Listener *l, const Block *block)
+{
+    ListenerBlock *b = &(l->window[block->id % LISTENER_WINDOW]);
+    int ret = 0;
+
+    pthread_mutex_lock(&(l->mutex));
+
+    if (b->block)
+    {
+        logMessage(ERROR, "Block %zu queued to listener before block %zu was received", block->id,
+                   b->block->id);
+        ret = 1;
+    }
+    else if (initialiseListenerBlock(b, l->network, block))
+    {
+        logMessage(ERROR, "Could not create listener state for block %zu", block->id);
+        ret = 1;
+    }
+    else
+    {
+        /* Idle workers, and the local worker, are given units once woken */
+        wakeListener(l);
+    }
+
+    pthread_mutex_unlock(&(l->mutex));
+
+    return ret;
+}
+
+
+/* Wait for every row of a queued block to be received, then take it out of
+ * the window. Returns 1 if the listener failed first
+ */
+int waitListenerBlock(Listener *l, const Block *block)
+{
+    ListenerBlock *b = &(l->window[block->id % LISTENER_WINDOW]);
+    int ret;
+
+    pthread_mutex_lock(&(l->mutex));
+
+    while (!l->done && b->block == block && b->wroteRows < b->rows)
+        pthread_cond_wait(&(l->received), &(l->mutex));
+
+    ret = (l->error || b->block != block || b->wroteRows < b->rows) ? 1 : 0;
+
+    if (!ret)
+    {
+        clearListenerBlock(b);
+        l->oldest = block->id + 1;
+    }
+
+    pthread_mutex_unlock(&(l->mutex));
+
+    if (!ret)
+        logMessage(INFO, "All rows of block %zu wrote to image", block->id);
+
+    return ret;
+}
+
+
+/* Write an interim report of the workers' traffic, while no worker can come
+ * or go
+ */
+int reportListener(Listener *l, RunReport *r)
+{
+    int ret;
+
+    pthread_mutex_lock(&(l->mutex));
+    ret = writeRunReport(r, NULL, l->network, false);
+    pthread_mutex_unlock(&(l->mutex));
+
+    return ret;
+}
+
+
+/* Stop the I/O threads and the local worker, then free the listener. Closing
+ * the wake event removes it from the event sets
+ */
+void freeListener(Listener *l)
+{
+    if (!l)
+        return;
+
+    if (l->started || l->localStarted)
+        stopListener(l, 0);
+
+    for (unsigned int t = 0; t < l->started; ++t)
+    {
+        if (pthread_join(l->threads[t].pid, NULL))
+            logMessage(WARNING, "I/O thread could not be harvested");
+    }
+
+    if (l->localStarted && pthread_join(l->localPid, NULL))
+        logMessage(WARNING, "Local worker thread could not be harvested");
+
+    if (l->threads)
+    {
+        for (unsigned int t = 0; t < l->network->ioThreads; ++t)
+            free(l->threads[t].scratch);
+    }
+
+    if (l->wake >= 0)
+        close(l->wake);
+
+    for (unsigned int b = 0; b < LISTENER_WINDOW; ++b)
+        clearListenerBlock(&(l->window[b]));
+
+    free(l->threads);
+    pthread_cond_destroy(&(l->received));
+    pthread_cond_destroy(&(l->woken));
+    pthread_mutex_destroy(&(l->mutex));
+    free(l);
+}
+
+
+/* Set up a slot of the window to receive the block */
+static int initialiseListenerBlock(ListenerBlock *b, const NetworkCTX *network, const Block *block)
+{
+    b->rows = (block->remainder) ? block->remainderRows : block->rows;
+    b->wroteRows = 0;
+    b->units = createUnitStack(network, block);
+    b->unitStates = calloc((b->rows + network->unitRows - 1) / network->unitRows, sizeof(*(b->unitStates)));
+    b->claimed = calloc(b->rows, sizeof(*(b->claimed)));
+
+    if (!b->units || !b->unitStates || !b->claimed)
+    {
+        clearListenerBlock(b);
+        return 1;
+    }
+
+    for (size_t u = 0; u * network->unitRows < b->rows; ++u)
+        b->unitStates[u].queued = true;
+
+    b->block = block;
+
+    return 0;
+}
+
+
+/* Free the state of a slot of the window, leaving it free */
+static void clearListenerBlock(ListenerBlock *b)
+{
+    free(b->claimed);
+    free(b->unitStates);
+    destroyUnitStack(b->units);
+
+    b->block = NULL;
+    b->units = NULL;
+    b->unitStates = NULL;
+    b->claimed = NULL;
+}
+
+
+/* Body of each I/O thread - serve the thread's workers (and, on the first
+ * thread, connection requests) until the listener is stopped, checking on its
+ * workers each heartbeat interval
+ */
+static void * ioThread(void *threadInfo)
+{
+    IOThread *t = threadInfo;
+    Listener *l = t->listener;
+    NetworkCTX *network = l->network;
+
+    struct epoll_event events[LISTENER_EVENTS_MAX];
+    double nextBeat = getMonotonicTime() + network->heartbeat;
+
+    while (!isListenerDone(l))
+    {
+        int active = epoll_wait(network->epoll[t->id], events, LISTENER_EVENTS_MAX, getEventTimeout(nextBeat));
+
+        if (getMonotonicTime() >= nextBeat)
+        {
+            checkWorkers(t);
+            nextBeat = getMonotonicTime() + network->heartbeat;
+        }
+
+        if (active < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            logMessage(ERROR, "Failed to wait on sockets");
+            stopListener(l, 1);
+            break;
+        }
+
+        for (int j = 0; j < active; ++j)
+        {
+            uint32_t i = events[j].data.u32;
+
+            if (i == LISTENER_WAKE)
+            {
+                topUpWorkers(t);
+            }
+            else if (i == 0) /* Connection request on master socket */
+            {
+                initialiseWorker(l);
+            }
+            else if (serviceWorker(t, (int) i, events[j].events))
+            {
+                pthread_mutex_lock(&(l->mutex));
+                releaseWorker(l, (int) i);
+                pthread_mutex_unlock(&(l->mutex));
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+/* Milliseconds from now until the next heartbeat, as a timeout of epoll_wait() */
+static int getEventTimeout(double nextBeat)
+{
+    double timeout = nextBeat - getMonotonicTime();
+
+    return (timeout > 0.0) ? (int) (timeout * 1000.0) + 1 : 0;
+}
+
+
+/* Body of the master's local worker - plot units of the stacks, then copies
+ * of stragglers, until the listener is stopped. When there are none, it waits
+ * for the next block, or in case a lost worker's units are returned, so a
+ * master left with no workers still finishes the plot
+ */
+static void * localThread(void *listenerInfo)
+{
+    Listener *l = listenerInfo;
+
+    pthread_mutex_lock(&(l->mutex));
+
+    while (!l->done)
+    {
+        UnitState *u;
+        size_t row, rows;
+        int ret;
+
+        if (takeUnit(l, &row, true))
+        {
+            pthread_cond_wait(&(l->woken), &(l->mutex));
+            continue;
+        }
+
+        rows = getUnitRows(l->network, getListenerBlock(l, row)->block, row);
+
+        pthread_mutex_unlock(&(l->mutex));
+
+        logMessage(DEBUG, "Plotting rows %zu to %zu locally", row, row + rows - 1);
+        ret = plotLocalRows(l, row, rows);
+
+        pthread_mutex_lock(&(l->mutex));
+
+        /* The block may since have been wholly received from other copies */
+        if ((u = getUnitState(l, row)))
+            --(u->copies);
+
+        if (ret)
+        {
+            logMessage(ERROR, "Work could not be queued to threads");
+            l->done = true;
+            l->error = 1;
+            wakeListener(l);
+            break;
+        }
+
+        logMessage(INFO, "Rows %zu to %zu plotted locally", row, row + rows - 1);
+    }
+
+    pthread_mutex_unlock(&(l->mutex));
+
+    return NULL;
+}
+
+
+/* Plot rows with the thread pool, each straight into its place in its block.
+ * Rows already taken from another copy of the unit are skipped
+ */
+static int plotLocalRows(Listener *l, size_t row, size_t rows)
+{
+    int ret = 0;
+
+    LocalWorker *local = l->local;
+    char *array = local->row->array;
+
+    for (size_t i = row; i < row + rows && !ret; ++i)
+    {
+        unsigned char *dest = NULL;
+
+        /* A block stays in the window while rows taken from it are to come */
+        pthread_mutex_lock(&(l->mutex));
+
+        if (claimRows(l, i, 1))
+            dest = getBlockRow(getListenerBlock(l, i)->block, i);
+
+        pthread_mutex_unlock(&(l->mutex));
+
+        if (!dest)
+            continue;
+
+        local->row->id = i;
+        local->row->array = (char *) dest;
+        ret = runThreads(local->threads, local->genFractalRow, local->row);
+
+        if (!ret)
+        {
+            pthread_mutex_lock(&(l->mutex));
+            addRows(l, i, 1);
+            pthread_mutex_unlock(&(l->mutex));
+        }
+    }
+
+    local->row->array = array;
+
+    return ret;
+}
+
+
+static bool isListenerDone(Listener *l)
+{
+    bool done;
+
+    pthread_mutex_lock(&(l->mutex));
+    done = l->done;
+    pthread_mutex_unlock(&(l->mutex));
+
+    return done;
+}
+
+
+/* Have every I/O thread stop, once it has dealt with the events it holds */
+static void stopListener(Listener *l, int error)
+{
+    pthread_mutex_lock(&(l->mutex));
+
+    l->done = true;
+
+    if (error)
+        l->error = 1;
+
+    wakeListener(l);
+
+    pthread_mutex_unlock(&(l->mutex));
+}
+
+
+/* Raise the wake event in every I/O thread's event set, and wake the local
+ * worker and any wait on a block. The event is edge-triggered, so each write
+ * is seen once by every thread without the counter being read back. The
+ * caller holds the lock
+ */
+static void wakeListener(Listener *l)
+{
+    const uint64_t WAKE = 1;
+
+    if (write(l->wake, &WAKE, sizeof(WAKE)) < 0 && errno != EAGAIN)
+        logMessage(WARNING, "Could not wake I/O threads");
+
+    pthread_cond_broadcast(&(l->woken));
+    pthread_cond_broadcast(&(l->received));
+}
+
+
+/* Accept a worker, and hand it to the event set of its I/O thread once it has
+ * its parameters and first units
+ */
+static void initialiseWorker(Listener *l)
+{
+    int i;
+
+    pthread_mutex_lock(&(l->mutex));
+
+    i = acceptConnection(l->network);
+
+    if (i >= 0 && startWorker(l, i))
+        releaseWorker(l, i);
+
+    pthread_mutex_unlock(&(l->mutex));
+}
+
+
+/* Returns 1 if the worker is to be released */
+static int startWorker(Listener *l, int i)
+{
+    int ret;
+
+    NetworkCTX *network = l->network;
+    Connection *c = &(network->connections[i]);
+    const Block *block = l->image;
+
+    struct epoll_event workerEvent =
+    {
+        .events = EPOLLIN | EPOLLET,
+        .data.u32 = (uint32_t) i
+    };
+
+    c->lastHeard = getMonotonicTime();
+    c->stats.idleSince = c->lastHeard;
+
+    /* A worker kept from the last plot has a buffer sized for it, and may be
+     * part way through a message of it, which is read over the new buffer
+     */
+    freeClientReceiveBuffer(c);
+
+    if (createClientReceiveBuffer(c, getReceiveBufferSize(network, block)))
+    {
+        logMessage(ERROR, "Could not allocate receive buffer for worker, closing connection");
+        return 1;
+    }
+
+    if (c->body)
+        c->body = c->buffer;
+
+    ret = sendParameters(network, i, block->parameters);
+
+    if (ret == 1)
+    {
+        logMessage(INFO, "Worker shutdown connection, closing connection");
+        return 1;
+    }
+    else if (ret)
+    {
+        logMessage(ERROR, "Sending parameters to worker failed, closing connection");
+        return 1;
+    }
+
+    if (allocateUnits(l, i))
+        return 1;
+
+    if (epoll_ctl(network->epoll[c->thread], EPOLL_CTL_ADD, network->fds[i].fd, &workerEvent))
+    {
+        logMessage(ERROR, "Could not add worker to event set, closing connection");
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/* Receive everything worker `i` has sent - its events are edge-triggered, so
+ * there must be nothing left to read. Each header is received to the
+ * connection, and the body after it to wherever getMessageBody() places it.
+ * Returns 1 if the worker is to be released
+ */
+static int serviceWorker(IOThread *t, int i, uint32_t events)
+{
+    int ret;
+
+    Listener *l = t->listener;
+    NetworkCTX *network = l->network;
+    Connection *c = &(network->connections[i]);
+
+    if ((events & EPOLLIN) == 0)
+        return 1;
+
+    c->lastHeard = getMonotonicTime();
+
+    while (!(ret = receiveMessageData(network, i)))
+    {
+        if (c->body && c->bodyRead == c->message.length)
+        {
+            /* Bodies of an earlier plot were only received to be thrown away */
+            if (c->message.job != network->job)
+            {
+                c->body = NULL;
+            }
+            else if (receiveRows(t, i))
+            {
+                logMessage(WARNING, "Could not take rows from socket %d, closing connection", network->fds[i].fd);
+                return 1;
+            }
+        }
+
+        if (!c->body)
+        {
+            ret = takeMessageHeader(c);
+
+            if (ret == 1 || (!ret && skipMessage(c, network->job)))
+                continue;
+
+            if (ret || !(c->body = getMessageBody(l, i, &(c->message))))
+            {
+                logMessage(WARNING, "Unexpected message from socket %d, closing connection", network->fds[i].fd);
+                return 1;
+            }
+        }
+    }
+
+    /* Nothing left to read */
+    if (ret < 0)
+        return 0;
+
+    return 1;
+}
+
+
+/* Pass over a message that is not for the plot of job `job`: a heartbeat,
+ * which has no body and need only have been received, or anything a worker
+ * kept from an earlier plot sent of it, whose body is read over the receive
+ * buffer. Returns false if the message is to be received
+ */
+static bool skipMessage(Connection *c, uint64_t job)
+{
+    if (c->message.job == job)
+        return c->message.type == MESSAGE_HEARTBEAT && !c->message.length;
+
+    if (c->message.length)
+    {
+        c->body = c->buffer;
+        c->discard = true;
+    }
+
+    return true;
+}
+
+
+/* Give the thread's workers any units that have been returned to the stack by
+ * lost workers - those with no outstanding units would otherwise never be
+ * heard from again to be given them
+ */
+static void topUpWorkers(IOThread *t)
+{
+    Listener *l = t->listener;
+    NetworkCTX *network = l->network;
+
+    pthread_mutex_lock(&(l->mutex));
+
+    for (int i = 1; i < network->max && !l->done; ++i)
+    {
+        if (network->fds[i].fd < 0 || network->connections[i].thread != t->id)
+            continue;
+
+        if (allocateUnits(l, i))
+            releaseWorker(l, i);
+    }
+
+    pthread_mutex_unlock(&(l->mutex));
+}
+
+
+/* Close the connections of the thread's workers that have not been heard from
+ * in HEARTBEAT_MISSES heartbeats, and send the rest a heartbeat of the master
+ */
+static void checkWorkers(IOThread *t)
+{
+    Listener *l = t->listener;
+    NetworkCTX *network = l->network;
+    double timeout = HEARTBEAT_MISSES * network->heartbeat;
+    double now = getMonotonicTime();
+
+    pthread_mutex_lock(&(l->mutex));
+
+    for (int i = 1; i < network->max; ++i)
+    {
+        Connection *c = &(network->connections[i]);
+
+        if (network->fds[i].fd < 0 || c->thread != t->id)
+            continue;
+
+        if (now - c->lastHeard > timeout)
+        {
+            logMessage(WARNING, "Worker on socket %d not heard from in %.0f seconds, closing connection",
+                       network->fds[i].fd, now - c->lastHeard);
+            releaseWorker(l, i);
+        }
+        else if (sendHeartbeat(network, i))
+        {
+            logMessage(WARNING, "Could not send heartbeat to worker on socket %d, closing connection",
+                       network->fds[i].fd);
+            releaseWorker(l, i);
+        }
+    }
+
+    pthread_mutex_unlock(&(l->mutex));
+}
+
+
+/* Give the worker units of work until it is as far ahead as its rate allows
+ * or none are left - then, if it has nothing to do, a copy of a straggler. The
+ * caller holds the listener's lock
+ */
+static int allocateUnits(Listener *l, int i)
+{
+    Connection *c = &(l->network->connections[i]);
+    unsigned int depth = getWorkerDepth(l->network, i);
+    size_t row;
+
+    while (c->unitCount < depth && !takeUnit(l, &row, !c->unitCount))
+    {
+        if (issueUnit(l, i, row))
+            return 1;
+    }
+
+    return 0;
+}
+
+
+/* Number of units worker `i` is kept ahead by - `unitDepth`, scaled by the
+ * worker's rate against the mean rate of the workers. Workers of unknown rate
+ * are kept `unitDepth` ahead
+ */
+static unsigned int getWorkerDepth(const NetworkCTX *network, int i)
+{
+    const Connection *c = &(network->connections[i]);
+    double depth;
+
+    if (c->rate <= 0.0 || network->rated < 2 || network->rateTotal <= 0.0)
+        return network->unitDepth;
+
+    depth = network->unitDepth * c->rate * network->rated / network->rateTotal;
+
+    if (depth < 1.0)
+        return 1;
+    else if (depth > CONNECTION_UNITS_MAX)
+        return CONNECTION_UNITS_MAX;
+
+    return (unsigned int) (depth + 0.5);
+}
+
+
+/* Take the next unit to be handed out from the stack of the oldest block of
+ * the window with one left or, once every stack is empty and if `copy` is set,
+ * the straggler of the oldest block with one. Returns 1 if there is none. The
+ * caller holds the listener's lock
+ */
+static int takeUnit(Listener *l, size_t *row, bool copy)
+{
+    UnitState *u = NULL;
+
+    for (unsigned int k = 0; k < LISTENER_WINDOW && !u; ++k)
+    {
+        ListenerBlock *b = &(l->window[(l->oldest + k) % LISTENER_WINDOW]);
+
+        if (!b->block)
+            continue;
+
+        while (!popStack(row, b->units))
+        {
+            u = getUnitState(l, *row);
+            u->queued = false;
+
+            /* A returned unit may since have been taken from another copy */
+            if (u->claimed < getUnitRows(l->network, b->block, *row))
+                break;
+
+            u = NULL;
+        }
+    }
+
+    for (unsigned int k = 0; k < LISTENER_WINDOW && !u && copy; ++k)
+    {
+        ListenerBlock *b = &(l->window[(l->oldest + k) % LISTENER_WINDOW]);
+
+        if (!b->block || !(u = getStragglerUnit(l, b)))
+            continue;
+
+        *row = b->block->id * b->block->rows + (size_t) (u - b->unitStates) * l->network->unitRows;
+        logMessage(DEBUG, "Handing out a copy of rows from %zu", *row);
+    }
+
+    if (!u)
+        return 1;
+
+    if (!(u->copies)++)
+        u->issued = getMonotonicTime();
+
+    return 0;
+}
+
+
+/* Find the unit of the block held by a single worker (or the master) for the
+ * longest, of those with rows not yet taken from it. Returns NULL if there is
+ * none
+ */
+static UnitState * getStragglerUnit(const Listener *l, const ListenerBlock *b)
+{
+    UnitState *straggler = NULL;
+    size_t blockOffset = b->block->id * b->block->rows;
+
+    for (size_t u = 0; u * l->network->unitRows < b->rows; ++u)
+    {
+        UnitState *state = &(b->unitStates[u]);
+        size_t rows = getUnitRows(l->network, b->block, blockOffset + u * l->network->unitRows);
+
+        if (state->copies != 1 || state->claimed == rows)
+            continue;
+
+        if (!straggler || state->issued < straggler->issued)
+            straggler = state;
+    }
+
+    return straggler;
+}
+
+
+/* Send a unit taken by takeUnit() to worker `i`. The unit is dropped again if
+ * it could not be sent
+ */
+static int issueUnit(Listener *l, int i, size_t row)
+{
+    NetworkCTX *network = l->network;
+    Connection *c = &(network->connections[i]);
+    ConnectionUnit *unit = &(c->units[c->unitCount]);
+    size_t rows = getUnitRows(network, getListenerBlock(l, row)->block, row);
+
+    logMessage(DEBUG, "Allocating rows %zu to %zu to worker on socket %d", row, row + rows - 1,
+               network->fds[i].fd);
+
+    if (sendWorkUnit(network, i, row, rows))
+    {
+        dropUnit(l, row);
+        return 1;
+    }
+
+    unit->row = row;
+    unit->rows = rows;
+    unit->issued = getMonotonicTime();
+
+    if (c->stats.idleSince >= 0.0)
+    {
+        c->stats.idle += unit->issued - c->stats.idleSince;
+        c->stats.idleSince = -1.0;
+    }
+
+    ++(c->unitCount);
+
+    return 0;
+}
+
+
+/* Give up a copy of a unit of the window, putting it back on its stack if it
+ * is not yet wholly received. A unit may then be handed out while other copies
+ * of it are still held, since those may already have passed the rows still
+ * missing
+ */
+static void dropUnit(Listener *l, size_t row)
+{
+    ListenerBlock *b = getListenerBlock(l, row);
+    UnitState *u = getUnitState(l, row);
+
+    --(u->copies);
+
+    if (u->received < getUnitRows(l->network, b->block, row) && !u->queued)
+    {
+        pushStack(b->units, row);
+        u->queued = true;
+    }
+}
+
+
+/* Close the worker's connection, and have the other workers given its units.
+ * Rows it was sending are left for another copy of their unit. The caller
+ * holds the listener's lock
+ */
+static void releaseWorker(Listener *l, int i)
+{
+    NetworkCTX *network = l->network;
+    Connection *c = &(network->connections[i]);
+    bool returned = c->unitCount;
+
+    if (c->body && !c->discard)
+        unclaimRows(l, c->message.row, getMessageRows(network, l->image, &(c->message)));
+
+    c->body = NULL;
+
+    returnUnits(l, i);
+    forgetWorkerRate(network, i);
+
+    addConnectionStats(&(network->past), &(c->stats), getMonotonicTime());
+    ++(network->pastCount);
+
+    closeConnection(network, i);
+
+    if (returned)
+        wakeListener(l);
+}
+
+
+/* Put the units of the window outstanding at a worker back to be given to
+ * another. Units of blocks already received are copies whose rows have all
+ * been taken
+ */
+static void returnUnits(Listener *l, int i)
+{
+    Connection *c = &(l->network->connections[i]);
+
+    for (unsigned int j = 0; j < c->unitCount; ++j)
+    {
+        if (getUnitState(l, c->units[j].row))
+            dropUnit(l, c->units[j].row);
+    }
+
+    c->unitCount = 0;
+    c->unitDone = 0;
+}
+
+
+/* Retire the oldest unit outstanding at a worker, once every row of it has
+ * been sent (whether or not they were taken)
+ */
+static void completeUnit(Listener *l, int i)
+{
+    Connection *c = &(l->network->connections[i]);
+    UnitState *u = getUnitState(l, c->units[0].row);
+
+    updateWorkerRate(l->network, i, &(c->units[0]));
+
+    ++(c->stats.units);
+    c->stats.turnaround += c->lastDone - c->units[0].issued;
+
+    /* Units of blocks already received are copies whose rows have all been taken */
+    if (u)
+        --(u->copies);
+
+    memmove(c->units, c->units + 1, (c->unitCount - 1) * sizeof(*(c->units)));
+    --(c->unitCount);
+    c->unitDone = 0;
+
+    if (!c->unitCount)
+        c->stats.idleSince = c->lastDone;
+}
+
+
+/* Fold the rate the worker plotted a unit at into its running rate. A unit
+ * is started once the unit before it is done, or once sent if later
+ */
+static void updateWorkerRate(NetworkCTX *network, int i, const ConnectionUnit *unit)
+{
+    Connection *c = &(network->connections[i]);
+    double now = getMonotonicTime();
+    double start = (unit->issued > c->lastDone) ? unit->issued : c->lastDone;
+    double rate;
+
+    c->lastDone = now;
+
+    if (now <= start)
+        return;
+
+    rate = unit->rows / (now - start);
+
+    forgetWorkerRate(network, i);
+
+    c->rate = (c->rate > 0.0) ? RATE_WEIGHT * rate + (1.0 - RATE_WEIGHT) * c->rate : rate;
+
+    network->rateTotal += c->rate;
+    ++(network->rated);
+}
+
+
+/* Take the worker's rate out of the total (the rate itself is kept) */
+static void forgetWorkerRate(NetworkCTX *network, int i)
+{
+    const Connection *c = &(network->connections[i]);
+
+    if (c->rate > 0.0)
+    {
+        network->rateTotal -= c->rate;
+        --(network->rated);
+    }
+}
+
+
+/* Find where the body of a message from worker `i` is to be received: rows of
+ * pixels go straight into their place in their block, and rows to be decoded
+ * or coloured into the receive buffer. Rows already taken from another copy
+ * of their unit are received only to be thrown away. Returns NULL if the
+ * message is not the next rows expected of the worker
+ */
+static unsigned char * getMessageBody(Listener *l, int i, const MessageHeader *h)
+{
+    NetworkCTX *network = l->network;
+    Connection *c = &(network->connections[i]);
+    size_t rowSize = getWorkerRowSize(network, l->image);
+    unsigned char *dest = NULL;
+
+    if (h->type != MESSAGE_ROWS || h->job != network->job || !c->unitCount || !h->length)
+        return NULL;
+
+    if (h->row != c->units[0].row + c->unitDone)
+        return NULL;
+
+    if (h->flags & MESSAGE_FLAG_RUN_LENGTH)
+    {
+        if (!network->compress || h->length > c->n)
+            return NULL;
+    }
+    else if (h->length % rowSize || h->length / rowSize > c->units[0].rows - c->unitDone)
+    {
+        return NULL;
+    }
+
+    /* Rows of blocks already received are those of which every row was taken */
+    pthread_mutex_lock(&(l->mutex));
+
+    if (claimRows(l, h->row, getMessageRows(network, l->image, h)))
+        dest = getBlockRow(getListenerBlock(l, h->row)->block, h->row);
+
+    pthread_mutex_unlock(&(l->mutex));
+
+    c->discard = !dest;
+
+    if (c->discard || (h->flags & MESSAGE_FLAG_RUN_LENGTH) || network->iterations)
+        return c->buffer;
+
+    return dest;
+}
+
+
+/* Finish the rows received from worker `i`, decoding and colouring them into
+ * the block as needed, and retire its unit once every row of it has been
+ * sent. Returns 1 if the rows could not be decoded, or the worker could not be
+ * given more work
+ */
+static int receiveRows(IOThread *t, int i)
+{
+    Listener *l = t->listener;
+    NetworkCTX *network = l->network;
+    const Block *block = l->image;
+    Connection *c = &(network->connections[i]);
+    const MessageHeader *h = &(c->message);
+    const unsigned char *body = c->body;
+    size_t rowSize = getWorkerRowSize(network, block);
+    size_t rows = getMessageRows(network, block, h);
+    int ret = 0;
+
+    if (!c->discard)
+    {
+        unsigned char *dest;
+
+        /* A block stays in the window while rows taken from it are to come */
+        pthread_mutex_lock(&(l->mutex));
+        dest = getBlockRow(getListenerBlock(l, h->row)->block, h->row);
+        pthread_mutex_unlock(&(l->mutex));
+
+        if (h->flags & MESSAGE_FLAG_RUN_LENGTH)
+        {
+            /* Pixels are decoded straight into the block, and iteration values
+             * into the scratch row to be coloured from
+             */
+            unsigned char *decoded = (network->iterations) ? t->scratch : dest;
+            BitDepth depth = (network->iterations) ? BIT_DEPTH_ITERATIONS : block->parameters->colour.depth;
+
+            if (decodeRunLength(decoded, rowSize, body, h->length, getRunLengthUnit(depth)))
+                return 1;
+
+            body = decoded;
+        }
+
+        if (network->iterations)
+        {
+            for (size_t j = 0; j < rows; ++j)
+                mapIterationRow(dest + j * block->rowSize, body + j * rowSize, block->parameters->width,
+                                &(block->parameters->colour));
+        }
+    }
+
+    c->body = NULL;
+    c->unitDone += rows;
+
+    pthread_mutex_lock(&(l->mutex));
+
+    c->stats.bytes += MESSAGE_HEADER_SIZE + h->length;
+
+    if (!c->discard)
+    {
+        addRows(l, h->row, rows);
+        c->stats.rows += rows;
+    }
+
+    if (c->unitDone == c->units[0].rows)
+    {
+        logMessage(INFO, "Rows %zu to %zu from socket %d done", c->units[0].row,
+                   c->units[0].row + c->units[0].rows - 1, network->fds[i].fd);
+        completeUnit(l, i);
+
+        if (!l->done)
+            ret = allocateUnits(l, i);
+    }
+
+    pthread_mutex_unlock(&(l->mutex));
+
+    return ret;
+}
+
+
+/* Number of rows in the body of a message of rows */
+static size_t getMessageRows(const NetworkCTX *network, const Block *block, const MessageHeader *h)
+{
+    if (h->flags & MESSAGE_FLAG_RUN_LENGTH)
+        return 1;
+
+    return h->length / getWorkerRowSize(network, block);
+}
+
+
+/* Take rows of the window from one copy of their unit. Returns false, taking
+ * none, if any has already been taken or the block has been received. The
+ * caller holds the listener's lock
+ */
+static bool claimRows(Listener *l, size_t row, size_t rows)
+{
+    ListenerBlock *b = getListenerBlock(l, row);
+    bool *claimed;
+
+    if (!b)
+        return false;
+
+    claimed = b->claimed + (row - b->block->id * b->block->rows);
+
+    for (size_t j = 0; j < rows; ++j)
+    {
+        if (claimed[j])
+            return false;
+    }
+
+    for (size_t j = 0; j < rows; ++j)
+        claimed[j] = true;
+
+    getUnitState(l, row)->claimed += rows;
+
+    return true;
+}
+
+
+/* Release rows taken from a copy that will not now send them */
+static void unclaimRows(Listener *l, size_t row, size_t rows)
+{
+    ListenerBlock *b = getListenerBlock(l, row);
+
+    if (!b)
+        return;
+
+    memset(b->claimed + (row - b->block->id * b->block->rows), false, rows * sizeof(*(b->claimed)));
+    getUnitState(l, row)->claimed -= rows;
+}
+
+
+/* Count received rows towards their unit and block, waking the wait on the
+ * block once every row is in. The caller holds the lock
+ */
+static void addRows(Listener *l, size_t row, size_t rows)
+{
+    ListenerBlock *b = getListenerBlock(l, row);
+
+    getUnitState(l, row)->received += rows;
+    b->wroteRows += rows;
+
+    if (b->wroteRows >= b->rows)
+        pthread_cond_broadcast(&(l->received));
+}
+
+
+/* Slot of the window holding `row`. Returns NULL if the row's block is not in
+ * the window. The caller holds the lock
+ */
+static ListenerBlock * getListenerBlock(Listener *l, size_t row)
+{
+    for (unsigned int b = 0; b < LISTENER_WINDOW; ++b)
+    {
+        if (l->window[b].block && isBlockRow(l->window[b].block, row))
+            return &(l->window[b]);
+    }
+
+    return NULL;
+}
+
+
+/* State of the unit holding `row`. Returns NULL if the row's block is not in
+ * the window
+ */
+static UnitState * getUnitState(Listener *l, size_t row)
+{
+    ListenerBlock *b = getListenerBlock(l, row);
+
+    if (!b)
+        return NULL;
+
+    return &(b->unitStates[(row - b->block->id * b->block->rows) / l->network->unitRows]);
+}
+
+
+/* Whether `row` (numbered from the top of the image) is in the block */
+static bool isBlockRow(const Block *block, size_t row)
+{
+    size_t blockOffset = block->id * block->rows;
+    size_t rows = (block->remainder) ? block->remainderRows : block->rows;
+
+    return row >= blockOffset && row < blockOffset + rows;
+}
+
+
+/* Rows are numbered from the top of the image, not the block */
+static unsigned char * getBlockRow(const Block *block, size_t row)
+{
+    return (unsigned char *) block->array + (row - block->id * block->rows) * block->rowSize;
+}
+
+
+/* Size of a row as sent by the workers */
+static size_t getWorkerRowSize(const NetworkCTX *network, const Block *block)
+{
+    if (network->iterations)
+        return (block->parameters->width * BIT_DEPTH_ITERATIONS) / CHAR_BIT;
+
+    return block->rowSize;
+}
+
+
+/* Rows of pixels are received straight into the block, so the receive buffer
+ * need only hold rows that are decoded or coloured on the way in
+ */
+static size_t getReceiveBufferSize(const NetworkCTX *network, const Block *block)
+{
+    size_t rowSize = getWorkerRowSize(network, block);
+
+    return (network->iterations) ? network->unitRows * rowSize : rowSize;
+}
+
+
+/* Create a stack of the first row of each unit of work in the block */
+static Stack * createUnitStack(const NetworkCTX *network, const Block *block)
+{
     size_t rows = (block->remainder) ? block->remainderRows : block->rows;
-    Stack *s = createStack(rows);
+    Stack *s = createStack((rows + network->unitRows - 1) / network->unitRows);
 
     size_t blockOffset = block->id * block->rows;
 
     if (!s)
         return NULL;
     
-    for (size_t i = blockOffset; i < blockOffset + rows; ++i)
+    for (size_t i = blockOffset; i < blockOffset + rows; i += network->unitRows)
     {
         if (pushStack(s, i))
         {
@@ -459,7 +2095,19 @@ static Stack * createRowStack(const Block *block)
 }
 
 
-static void destroyRowStack(Stack *s)
+/* Number of rows in the unit of work starting at `row` - units are cut short
+ * at the end of the block
+ */
+static size_t getUnitRows(const NetworkCTX *network, const Block *block, size_t row)
+{
+    size_t rows = (block->remainder) ? block->remainderRows : block->rows;
+    size_t blockEnd = block->id * block->rows + rows;
+
+    return (blockEnd - row < network->unitRows) ? blockEnd - row : network->unitRows;
+}
+
+
+static void destroyUnitStack(Stack *s)
 {
     freeStack(s);
-}
\ No newline at end of file
+}
@@ -0,0 +1,586 @@
+#include <complex.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "double_double.h"
+
+#include "mandelbrot_parameters.h"
+
+
+/* The error-free transformations below depend on every operation being
+ * rounded exactly as written, which -ffast-math does not guarantee
+ */
+#ifdef __FAST_MATH__
+    #error "double_double.c must be compiled with -fno-fast-math"
+#endif
+
+/* Number of pixels iterated together. The kernel loops over lanes with no
+ * branches, so the compiler is free to vectorise them
+ */
+#define DD_LANES 4
+
+
+/* State of every lane and of the batch of pixels being fed through them */
+typedef struct LanesDD
+{
+    double zrHi[DD_LANES], zrLo[DD_LANES];  /* Current function value */
+    double ziHi[DD_LANES], ziLo[DD_LANES];
+    double crHi[DD_LANES], crLo[DD_LANES];  /* Constant added each iteration */
+    double ciHi[DD_LANES], ciLo[DD_LANES];
+    double srHi[DD_LANES], srLo[DD_LANES];  /* Value saved for periodicity checking */
+    double siHi[DD_LANES], siLo[DD_LANES];
+    double nv[DD_LANES];                    /* Iteration count (past the maximum once found periodic) */
+    double checks[DD_LANES];                /* Checks since the value was saved */
+    double limit[DD_LANES];                 /* Checks before the value is next saved */
+    size_t lane[DD_LANES];                  /* Pixel index held by each lane */
+    unsigned int active;                    /* Number of lanes holding a pixel */
+    unsigned long *n;                       /* Output iteration counts */
+    complex *z;                             /* Output final function values */
+    const ComplexDD *c;                     /* Values of the pixels in the batch */
+    size_t count;                           /* Number of pixels in the batch */
+    size_t next;                            /* Next pixel to be loaded into a lane */
+    ComplexDD constant;                     /* Julia set constant */
+    bool julia;                             /* Whether a Julia set (else Mandelbrot set) */
+    Formula formula;                        /* Function iterated */
+    unsigned int degree;                    /* Degree of a Multibrot set */
+    unsigned long max;                      /* Maximum iteration count */
+    uintmax_t iterations;                   /* Iterations run on the batch */
+} LanesDD;
+
+
+/* Number of iterations between checks for finished lanes */
+static const int LANE_CHECK_INTERVAL = 8;
+
+static const size_t LANE_EMPTY = SIZE_MAX;
+
+
+static DoubleDouble quickTwoSum(double a, double b);
+static DoubleDouble twoSum(double a, double b);
+static DoubleDouble twoProduct(double a, double b);
+static inline DoubleDouble ddSqr(DoubleDouble a);
+static DoubleDouble ddPow10(long exponent);
+
+static uintmax_t iterateBatch(unsigned long *n, complex *z, const ComplexDD *c, size_t count, ComplexDD constant,
+                              bool julia, Formula formula, unsigned int degree, unsigned long max);
+static void iterateLanes(LanesDD *s);
+static inline void iterateLanesFormula(LanesDD *s, Formula formula);
+static void fillLane(LanesDD *s, unsigned int l);
+static void retireLane(LanesDD *s, unsigned int l);
+
+
+DoubleDouble doubleToDD(double x)
+{
+    DoubleDouble r = {x, 0.0};
+    return r;
+}
+
+
+/* The significand of long double fits in the two halves exactly */
+DoubleDouble longDoubleToDD(long double x)
+{
+    DoubleDouble r;
+
+    r.hi = (double) x;
+    r.lo = (double) (x - r.hi);
+
+    return r;
+}
+
+
+long double ddToLongDouble(DoubleDouble x)
+{
+    return (long double) x.hi + x.lo;
+}
+
+
+DoubleDouble ddAdd(DoubleDouble a, DoubleDouble b)
+{
+    DoubleDouble s = twoSum(a.hi, b.hi);
+    DoubleDouble t = twoSum(a.lo, b.lo);
+
+    s = quickTwoSum(s.hi, s.lo + t.hi);
+
+    return quickTwoSum(s.hi, s.lo + t.lo);
+}
+
+
+DoubleDouble ddSub(DoubleDouble a, DoubleDouble b)
+{
+    b.hi = -b.hi;
+    b.lo = -b.lo;
+
+    return ddAdd(a, b);
+}
+
+
+DoubleDouble ddMul(DoubleDouble a, DoubleDouble b)
+{
+    DoubleDouble p = twoProduct(a.hi, b.hi);
+    return quickTwoSum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+
+DoubleDouble ddMulD(DoubleDouble a, double b)
+{
+    DoubleDouble p = twoProduct(a.hi, b);
+    return quickTwoSum(p.hi, p.lo + a.lo * b);
+}
+
+
+/* Long division, taking a further quotient digit for each half */
+DoubleDouble ddDiv(DoubleDouble a, DoubleDouble b)
+{
+    double q1 = a.hi / b.hi;
+    DoubleDouble r = ddSub(a, ddMulD(b, q1));
+
+    double q2 = r.hi / b.hi;
+    r = ddSub(r, ddMulD(b, q2));
+
+    double q3 = r.hi / b.hi;
+
+    return ddAdd(quickTwoSum(q1, q2), doubleToDD(q3));
+}
+
+
+DoubleDouble ddDivD(DoubleDouble a, double b)
+{
+    double q1 = a.hi / b;
+    DoubleDouble r = ddSub(a, twoProduct(q1, b));
+
+    return quickTwoSum(q1, r.hi / b);
+}
+
+
+int ddCmp(DoubleDouble a, DoubleDouble b)
+{
+    if (a.hi != b.hi)
+        return (a.hi > b.hi) - (a.hi < b.hi);
+
+    return (a.lo > b.lo) - (a.lo < b.lo);
+}
+
+
+/* Convert a decimal string to a double-double. strtold() only gives the
+ * precision of long double, so the digits are accumulated in double-double
+ * arithmetic. Returns 1 if no number could be read
+ */
+int stringToDD(DoubleDouble *x, char *nptr, char **endptr)
+{
+    char *s = nptr;
+
+    DoubleDouble value = {0.0, 0.0};
+    long exponent = 0;
+    bool negative = false, digits = false;
+
+    while (isspace((unsigned char) *s))
+        ++s;
+
+    if (*s == '+' || *s == '-')
+        negative = (*(s++) == '-');
+
+    for (; isdigit((unsigned char) *s); ++s, digits = true)
+        value = ddAdd(ddMulD(value, 10.0), doubleToDD(*s - '0'));
+
+    if (*s == '.')
+    {
+        for (++s; isdigit((unsigned char) *s); ++s, --exponent, digits = true)
+            value = ddAdd(ddMulD(value, 10.0), doubleToDD(*s - '0'));
+    }
+
+    if (!digits)
+    {
+        if (endptr)
+            *endptr = nptr;
+
+        return 1;
+    }
+
+    if (*s == 'e' || *s == 'E')
+    {
+        char *end;
+        long e = strtol(s + 1, &end, 10);
+
+        if (end != s + 1)
+        {
+            exponent += e;
+            s = end;
+        }
+    }
+
+    if (exponent > 0)
+        value = ddMul(value, ddPow10(exponent));
+    else if (exponent < 0)
+        value = ddDiv(value, ddPow10(-exponent));
+
+    if (negative)
+    {
+        value.hi = -value.hi;
+        value.lo = -value.lo;
+    }
+
+    *x = value;
+
+    if (endptr)
+        *endptr = s;
+
+    return 0;
+}
+
+
+/* Run the Mandelbrot set function of the formula on `count` pixels, adding
+ * the iterations run to `iterations`
+ */
+void mandelbrotDD(unsigned long *n, complex *z, const ComplexDD *c, size_t count, Formula formula,
+                  unsigned int degree, unsigned long max, uintmax_t *iterations)
+{
+    ComplexDD zero = {{0.0, 0.0}, {0.0, 0.0}};
+    *iterations += iterateBatch(n, z, c, count, zero, false, formula, degree, max);
+}
+
+
+/* Run the Julia set function of the formula on `count` pixels, adding the
+ * iterations run to `iterations`
+ */
+void juliaDD(unsigned long *n, complex *z, const ComplexDD *c, size_t count, ComplexDD constant, Formula formula,
+             unsigned int degree, unsigned long max, uintmax_t *iterations)
+{
+    *iterations += iterateBatch(n, z, c, count, constant, true, formula, degree, max);
+}
+
+
+/* Sum of two doubles where |a| >= |b|, as a double-double */
+static DoubleDouble quickTwoSum(double a, double b)
+{
+    DoubleDouble r;
+
+    r.hi = a + b;
+    r.lo = b - (r.hi - a);
+
+    return r;
+}
+
+
+/* Exact sum of two doubles, as a double-double */
+static DoubleDouble twoSum(double a, double b)
+{
+    DoubleDouble r;
+    double v;
+
+    r.hi = a + b;
+    v = r.hi - a;
+    r.lo = (a - (r.hi - v)) + (b - v);
+
+    return r;
+}
+
+
+/* Exact product of two doubles, as a double-double. Without a fused
+ * multiply-add, the operands are split into halves whose products are exact
+ */
+static DoubleDouble twoProduct(double a, double b)
+{
+    DoubleDouble r;
+
+    r.hi = a * b;
+
+    #ifdef FP_FAST_FMA
+    r.lo = fma(a, b, -r.hi);
+    #else
+    const double SPLIT = 134217729.0; /* 2^27 + 1 */
+
+    double t = SPLIT * a;
+    double aHi = t - (t - a);
+    double aLo = a - aHi;
+
+    t = SPLIT * b;
+    double bHi = t - (t - b);
+    double bLo = b - bHi;
+
+    r.lo = ((aHi * bHi - r.hi) + aHi * bLo + aLo * bHi) + aLo * bLo;
+    #endif
+
+    return r;
+}
+
+
+/* Square of a double-double. Forced inline, as each formula's loop takes two */
+static inline __attribute__ ((always_inline)) DoubleDouble ddSqr(DoubleDouble a)
+{
+    DoubleDouble p = twoProduct(a.hi, a.hi);
+    return quickTwoSum(p.hi, p.lo + 2.0 * a.hi * a.lo);
+}
+
+
+static DoubleDouble ddPow10(long exponent)
+{
+    DoubleDouble result = {1.0, 0.0};
+    DoubleDouble base = {10.0, 0.0};
+
+    for (; exponent > 0; exponent >>= 1, base = ddSqr(base))
+    {
+        if (exponent & 1)
+            result = ddMul(result, base);
+    }
+
+    return result;
+}
+
+
+/* Iterate the batch, returning the iterations run. As in simd.c, pixels given
+ * the maximum count without iterating that far only count what they ran
+ */
+static uintmax_t iterateBatch(unsigned long *n, complex *z, const ComplexDD *c, size_t count, ComplexDD constant,
+                              bool julia, Formula formula, unsigned int degree, unsigned long max)
+{
+    LanesDD s =
+    {
+        .active = 0,
+        .n = n,
+        .z = z,
+        .c = c,
+        .count = count,
+        .next = 0,
+        .constant = constant,
+        .julia = julia,
+        .formula = formula,
+        .degree = degree,
+        .max = max,
+        .iterations = 0
+    };
+
+    iterateLanes(&s);
+
+    return s.iterations;
+}
+
+
+/* Run the loop of the batch's formula */
+static void iterateLanes(LanesDD *s)
+{
+    switch (s->formula)
+    {
+        case FORMULA_MULTIBROT:
+            iterateLanesFormula(s, FORMULA_MULTIBROT);
+            break;
+        case FORMULA_BURNING_SHIP:
+            iterateLanesFormula(s, FORMULA_BURNING_SHIP);
+            break;
+        case FORMULA_TRICORN:
+            iterateLanesFormula(s, FORMULA_TRICORN);
+            break;
+        default:
+            iterateLanesFormula(s, FORMULA_MANDELBROT);
+            break;
+    }
+}
+
+
+/* Iterate pixels DD_LANES at a time. Each lane holds one pixel; once it escapes
+ * or reaches the maximum its value is frozen, and every LANE_CHECK_INTERVAL
+ * iterations finished lanes are retired and refilled with the next pixel.
+ *
+ * As in the other kernels, an orbit that returns exactly to a saved value is
+ * periodic, and the saved value is replaced after a doubling number of
+ * iterations (Brent's method). A periodic lane's count is moved past the
+ * maximum, keeping the iterations it ran. Always inlined with a constant
+ * formula, so each formula gets its own loop
+ */
+static inline __attribute__ ((always_inline)) void iterateLanesFormula(LanesDD *s, Formula formula)
+{
+    const double escapeRadiusSqr = ESCAPE_RADIUS_SQR;
+    const double maxCount = (double) s->max;
+    const unsigned int degree = s->degree;
+
+    for (unsigned int l = 0; l < DD_LANES; ++l)
+        fillLane(s, l);
+
+    while (s->active > 0)
+    {
+        for (int k = 0; k < LANE_CHECK_INTERVAL; ++k)
+        {
+            for (unsigned int l = 0; l < DD_LANES; ++l)
+            {
+                DoubleDouble zr = {s->zrHi[l], s->zrLo[l]};
+                DoubleDouble zi = {s->ziHi[l], s->ziLo[l]};
+                DoubleDouble cr = {s->crHi[l], s->crLo[l]};
+                DoubleDouble ci = {s->ciHi[l], s->ciLo[l]};
+
+                /* The escape test only needs the leading halves */
+                bool live = (zr.hi * zr.hi + zi.hi * zi.hi < escapeRadiusSqr) && (s->nv[l] < maxCount);
+
+                DoubleDouble zr2 = ddSqr(zr);
+                DoubleDouble zi2 = ddSqr(zi);
+                DoubleDouble zri = ddMul(zr, zi);
+
+                zri.hi *= 2.0;
+                zri.lo *= 2.0;
+
+                switch (formula)
+                {
+                    case FORMULA_MULTIBROT:
+                    {
+                        /* z^d by repeated multiplication from z^2 */
+                        DoubleDouble re = ddSub(zr2, zi2);
+                        DoubleDouble im = zri;
+
+                        for (unsigned int d = 2; d < degree; ++d)
+                        {
+                            DoubleDouble t = ddSub(ddMul(re, zr), ddMul(im, zi));
+                            im = ddAdd(ddMul(re, zi), ddMul(im, zr));
+                            re = t;
+                        }
+
+                        zr = ddAdd(re, cr);
+                        zi = ddAdd(im, ci);
+                        break;
+                    }
+                    case FORMULA_BURNING_SHIP:
+                        /* The sign of a double-double is that of its leading half */
+                        zri.lo = (zri.hi < 0.0) ? -zri.lo : zri.lo;
+                        zri.hi = fabs(zri.hi);
+
+                        zr = ddAdd(ddSub(zr2, zi2), cr);
+                        zi = ddAdd(zri, ci);
+                        break;
+                    case FORMULA_TRICORN:
+                        zr = ddAdd(ddSub(zr2, zi2), cr);
+                        zi = ddSub(ci, zri);
+                        break;
+                    default:
+                        zr = ddAdd(ddSub(zr2, zi2), cr);
+                        zi = ddAdd(zri, ci);
+                        break;
+                }
+
+                bool periodic = zr.hi == s->srHi[l] && zr.lo == s->srLo[l]
+                                && zi.hi == s->siHi[l] && zi.lo == s->siLo[l];
+                bool save = s->checks[l] + 1.0 == s->limit[l];
+
+                s->zrHi[l] = (live) ? zr.hi : s->zrHi[l];
+                s->zrLo[l] = (live) ? zr.lo : s->zrLo[l];
+                s->ziHi[l] = (live) ? zi.hi : s->ziHi[l];
+                s->ziLo[l] = (live) ? zi.lo : s->ziLo[l];
+
+                s->nv[l] = s->nv[l] + ((live) ? 1.0 : 0.0) + ((live && periodic) ? maxCount + 1.0 : 0.0);
+
+                s->srHi[l] = (live && save) ? zr.hi : s->srHi[l];
+                s->srLo[l] = (live && save) ? zr.lo : s->srLo[l];
+                s->siHi[l] = (live && save) ? zi.hi : s->siHi[l];
+                s->siLo[l] = (live && save) ? zi.lo : s->siLo[l];
+
+                s->checks[l] = (live) ? ((save) ? 0.0 : s->checks[l] + 1.0) : s->checks[l];
+                s->limit[l] = (live && save) ? 2.0 * s->limit[l] : s->limit[l];
+            }
+        }
+
+        for (unsigned int l = 0; l < DD_LANES; ++l)
+        {
+            if (s->lane[l] == LANE_EMPTY)
+                continue;
+
+            if (s->zrHi[l] * s->zrHi[l] + s->ziHi[l] * s->ziHi[l] >= escapeRadiusSqr || s->nv[l] >= maxCount)
+                retireLane(s, l);
+        }
+    }
+}
+
+
+/* Load the next pixel that needs iterating into a lane. Pixels that need no
+ * iterations are written straight to the output. An empty lane is left
+ * escaped, so it is never iterated
+ */
+static void fillLane(LanesDD *s, unsigned int l)
+{
+    s->lane[l] = LANE_EMPTY;
+    s->zrHi[l] = ESCAPE_RADIUS;
+    s->zrLo[l] = s->ziHi[l] = s->ziLo[l] = 0.0;
+    s->crHi[l] = s->crLo[l] = s->ciHi[l] = s->ciLo[l] = 0.0;
+    s->checks[l] = s->nv[l] = 0.0;
+    s->limit[l] = 1.0;
+
+    while (s->next < s->count)
+    {
+        size_t i = (s->next)++;
+
+        ComplexDD c = s->c[i];
+
+        double re = c.re.hi;
+        double im = c.im.hi;
+        double cdot = re * re + im * im;
+
+        if (s->julia)
+        {
+            if (cdot >= ESCAPE_RADIUS_SQR || s->max == 0)
+            {
+                s->n[i] = 0;
+                s->z[i] = re + im * I;
+                continue;
+            }
+
+            s->zrHi[l] = c.re.hi;
+            s->zrLo[l] = c.re.lo;
+            s->ziHi[l] = c.im.hi;
+            s->ziLo[l] = c.im.lo;
+            c = s->constant;
+        }
+        else
+        {
+            /* Ignore main and secondary bulb of z^2 + c */
+            if (s->formula == FORMULA_MANDELBROT
+                && (256.0 * cdot * cdot - 96.0 * cdot + 32.0 * re - 3.0 < 0.0
+                    || 16.0 * (cdot + 2.0 * re + 1.0) - 1.0 < 0.0))
+            {
+                s->n[i] = s->max;
+                s->z[i] = 0.0;
+                continue;
+            }
+
+            s->zrHi[l] = 0.0;
+        }
+
+        s->crHi[l] = c.re.hi;
+        s->crLo[l] = c.re.lo;
+        s->ciHi[l] = c.im.hi;
+        s->ciLo[l] = c.im.lo;
+
+        s->srHi[l] = s->zrHi[l];
+        s->srLo[l] = s->zrLo[l];
+        s->siHi[l] = s->ziHi[l];
+        s->siLo[l] = s->ziLo[l];
+
+        s->lane[l] = i;
+        ++(s->active);
+
+        return;
+    }
+}
+
+
+/* Write out the pixel held by a finished lane and refill it. A lane found to
+ * be periodic holds the iterations it ran past the maximum count
+ */
+static void retireLane(LanesDD *s, unsigned int l)
+{
+    size_t i = s->lane[l];
+    double maxCount = (double) s->max;
+
+    if (s->nv[l] > maxCount)
+    {
+        s->n[i] = s->max;
+        s->iterations += (uintmax_t) (s->nv[l] - maxCount - 1.0);
+    }
+    else
+    {
+        s->n[i] = (unsigned long) s->nv[l];
+        s->iterations += s->n[i];
+    }
+
+    s->z[i] = s->zrHi[l] + s->ziHi[l] * I;
+    --(s->active);
+
+    fillLane(s, l);
+}
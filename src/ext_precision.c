@@ -1,4 +1,5 @@
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "ext_precision.h"
@@ -11,7 +12,7 @@
 const PrecisionMode PREC_MODE_MIN = STD_PRECISION;
 
 #ifndef MP_PREC
-const PrecisionMode PREC_MODE_MAX = EXT_PRECISION;
+const PrecisionMode PREC_MODE_MAX = DD_PRECISION;
 #else
 const PrecisionMode PREC_MODE_MAX = MUL_PRECISION;
 
@@ -33,12 +34,47 @@ mpfr_prec_t mpSignificandSize = MP_SIGNIFICAND_SIZE_DEFAULT;
  * 
  * Extended-precision mode enables the use of `long double` and
  * `long double complex` data types.
+ *
+ * Double-double mode represents each value as the unevaluated sum of two
+ * doubles, giving about twice the significand of double in software.
  * 
  * Arbitrary precision mode makes use of the GMP library for floating-points
  * (`mpfr_t`), and the MPC library for complex types (`mpc_t`).
  */
 
 
+#ifdef MP_PREC
+ScratchMP * createScratchMP(mpfr_prec_t precision)
+{
+    ScratchMP *s = malloc(sizeof(*s));
+
+    if (!s)
+        return NULL;
+
+    s->precision = precision;
+
+    mpfr_inits2(precision, s->reMin, s->imMax, s->pxWidth, s->pxHeight, s->constantRe, s->constantIm, s->real,
+                s->imag, s->cRe, s->cIm, s->zRe, s->zIm, s->zReSqr, s->zImSqr, s->norm, s->savedRe,
+                s->savedIm, s->powRe, s->powIm, (mpfr_ptr) NULL);
+
+    return s;
+}
+
+
+void freeScratchMP(ScratchMP *s)
+{
+    if (s)
+    {
+        mpfr_clears(s->reMin, s->imMax, s->pxWidth, s->pxHeight, s->constantRe, s->constantIm, s->real, s->imag,
+                    s->cRe, s->cIm, s->zRe, s->zIm, s->zReSqr, s->zImSqr, s->norm, s->savedRe,
+                    s->savedIm, s->powRe, s->powIm, (mpfr_ptr) NULL);
+    }
+
+    free(s);
+}
+#endif
+
+
 int getPrecisionString(char *dest, PrecisionMode prec, size_t n)
 {
     const char *precStr;
@@ -51,6 +87,9 @@ int getPrecisionString(char *dest, PrecisionMode prec, size_t n)
         case EXT_PRECISION:
             precStr = "EXTENDED";
             break;
+        case DD_PRECISION:
+            precStr = "DOUBLE-DOUBLE";
+            break;
         
         #ifdef MP_PREC
         case MUL_PRECISION:
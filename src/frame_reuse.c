@@ -0,0 +1,203 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libgroot/include/log.h"
+
+#include "frame_reuse.h"
+
+#include "colour.h"
+#include "parameters.h"
+#include "subdivide.h"
+
+
+static size_t getKeptRows(const PlotCTX *p);
+
+
+FrameReuse * createFrameReuse(void)
+{
+    FrameReuse *r = malloc(sizeof(*r));
+
+    if (r)
+    {
+        r->last = NULL;
+        r->next = NULL;
+        r->lastStatus = NULL;
+        r->nextStatus = NULL;
+    }
+
+    return r;
+}
+
+
+/* Allocate space for the kept rows of two frames, and the escape status of
+ * their pixels if subdividing. Returns 1 if the pixels of the plot cannot be
+ * reused (without a pixel on the centre, or with several pixels to a byte) or
+ * the memory could not be allocated
+ */
+int initialiseFrameReuse(FrameReuse *r, const PlotCTX *p, size_t rowSize, bool status)
+{
+    size_t rows;
+
+    if (!r)
+        return 1;
+
+    if (p->width % 2 == 0 || p->height % 2 == 0)
+    {
+        logMessage(INFO, "Frames are 2x zooms, but need an odd width and height for their pixels to be reused");
+        return 1;
+    }
+
+    if (p->colour.depth < CHAR_BIT || p->colour.depth == BIT_DEPTH_ASCII)
+        return 1;
+
+    r->xCentre = (p->width - 1) / 2;
+    r->yCentre = (p->height - 1) / 2;
+    r->rowStart = (r->yCentre + 1) / 2;
+    r->rowEnd = (p->height - 1 + r->yCentre) / 2 + 1;
+    r->width = p->width;
+    r->rowSize = rowSize;
+    r->pixelSize = rowSize / p->width;
+    r->ready = false;
+
+    rows = getKeptRows(p);
+
+    r->last = malloc(rows * rowSize);
+    r->next = malloc(rows * rowSize);
+
+    if (status)
+    {
+        r->lastStatus = calloc(rows * p->width, sizeof(*(r->lastStatus)));
+        r->nextStatus = calloc(rows * p->width, sizeof(*(r->nextStatus)));
+    }
+
+    if (!r->last || !r->next || (status && (!r->lastStatus || !r->nextStatus)))
+    {
+        logMessage(WARNING, "Could not allocate memory to keep frames - every pixel of each frame will be plotted");
+        return 1;
+    }
+
+    logMessage(INFO, "Reusing a quarter of the pixels of each frame from the last");
+
+    return 0;
+}
+
+
+/* Memory used to keep the pixels of frames (the upper bound, if the plot
+ * cannot reuse them)
+ */
+size_t getFrameReuseSize(const PlotCTX *p, bool status)
+{
+    size_t pixelSize = (p->colour.depth < CHAR_BIT) ? 1 : p->colour.depth / CHAR_BIT;
+    size_t rows = getKeptRows(p);
+
+    if (p->width > SIZE_MAX / 4 / (pixelSize + 1) / rows)
+        return SIZE_MAX;
+
+    return 2 * rows * p->width * (pixelSize + ((status) ? 1 : 0));
+}
+
+
+/* Whether row `row` of the frame has pixels on those of the last frame */
+bool isReusedRow(const FrameReuse *r, size_t row)
+{
+    return (r && r->ready && (row + r->yCentre) % 2 == 0);
+}
+
+
+/* Get the pixel of the last frame that pixel (x, y) of the frame lies on, and
+ * its escape status (if `status` is not NULL). Returns NULL if there is none
+ */
+const char * getReusedPixel(const FrameReuse *r, size_t x, size_t y, unsigned char *status)
+{
+    size_t column, row;
+
+    if ((x + r->xCentre) % 2 != 0 || !isReusedRow(r, y))
+        return NULL;
+
+    column = (x + r->xCentre) / 2;
+    row = (y + r->yCentre) / 2 - r->rowStart;
+
+    if (status)
+        *status = (r->lastStatus) ? r->lastStatus[row * r->width + column] : SUBDIVISION_UNKNOWN;
+
+    return r->last + row * r->rowSize + column * r->pixelSize;
+}
+
+
+/* Keep the rows of the frame from `row` that the next frame takes pixels
+ * from. Rows are kept once plotted in full
+ */
+void keepFrameRows(FrameReuse *r, const char *rows, size_t row, size_t n)
+{
+    size_t start = (row > r->rowStart) ? row : r->rowStart;
+    size_t end = (row + n < r->rowEnd) ? row + n : r->rowEnd;
+
+    if (start < end)
+        memcpy(r->next + (start - r->rowStart) * r->rowSize, rows + (start - row) * r->rowSize,
+               (end - start) * r->rowSize);
+}
+
+
+/* Keep the escape status of a rectangle of pixels of the frame, from column
+ * `x` of row `y`, in rows of `width` elements. Pixels not kept are left as
+ * unknown, so are not taken to be unescaped when reused
+ */
+void keepFrameStatus(FrameReuse *r, const unsigned char *status, size_t x, size_t y, size_t width, size_t height)
+{
+    if (!r->nextStatus)
+        return;
+
+    for (size_t row = y; row < y + height; ++row)
+    {
+        if (row >= r->rowStart && row < r->rowEnd)
+            memcpy(&r->nextStatus[(row - r->rowStart) * r->width + x], &status[(row - y) * width], width);
+    }
+}
+
+
+/* Take the kept rows of the frame plotted as those of the last frame */
+void swapFrameReuse(FrameReuse *r)
+{
+    char *rows = r->last;
+    unsigned char *status = r->lastStatus;
+
+    r->last = r->next;
+    r->next = rows;
+
+    if (r->nextStatus)
+    {
+        r->lastStatus = r->nextStatus;
+        r->nextStatus = status;
+
+        memset(r->nextStatus, SUBDIVISION_UNKNOWN, (r->rowEnd - r->rowStart) * r->width);
+    }
+
+    r->ready = true;
+}
+
+
+void freeFrameReuse(FrameReuse *r)
+{
+    if (r)
+    {
+        free(r->last);
+        free(r->next);
+        free(r->lastStatus);
+        free(r->nextStatus);
+    }
+
+    free(r);
+}
+
+
+/* Number of rows of a frame kept for the next: the middle half */
+static size_t getKeptRows(const PlotCTX *p)
+{
+    size_t yCentre = (p->height - 1) / 2;
+
+    return (p->height - 1 + yCentre) / 2 + 1 - (yCentre + 1) / 2;
+}
\ No newline at end of file
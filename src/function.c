@@ -1,7 +1,11 @@
 #include <complex.h>
 #include <limits.h>
+#include <math.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <pthread.h>
 
@@ -9,10 +13,18 @@
 
 #include "function.h"
 
+#include "anti_alias.h"
 #include "array.h"
 #include "colour.h"
+#include "double_double.h"
+#include "frame_reuse.h"
+#include "gpu.h"
 #include "mandelbrot_parameters.h"
 #include "parameters.h"
+#include "perturbation.h"
+#include "simd.h"
+#include "stats.h"
+#include "subdivide.h"
 
 #ifdef MP_PREC
 #include <mpfr.h>
@@ -20,736 +32,1240 @@
 #endif
 
 
-static double dotProduct(complex z);
-static long double dotProductExt(long double complex z);
+/* Pixels run through the extended-precision functions before being coloured together */
+#define EXT_BATCH_LEN 64
+
+#ifdef OPENCL
+/* Pixels of a GPU launch before the GPU's rate has been measured */
+#define GPU_LAUNCH_LEN_MIN 4096
+#endif
+
+
+/* Thread functions of a plot type, one per precision, and those supersampling
+ * its edge pixels
+ */
+typedef struct PlotKernels
+{
+    PlotFunction std;
+    PlotFunction ext;
+    PlotFunction dd;
+
+    #ifdef MP_PREC
+    PlotFunction mp;
+    #endif
 
-static complex mandelbrot(unsigned long *n, complex c, unsigned long max);
-static long double complex mandelbrotExt(unsigned long *n, long double complex c, unsigned long max);
+    PlotFunction antiAlias;
+    PlotFunction antiAliasExt;
+    PlotFunction antiAliasDD;
+} PlotKernels;
+
+/* Pixels waiting to be run through the vectorised functions */
+typedef struct PixelBatch
+{
+    complex c[SIMD_BATCH_LEN];
+    unsigned long n[SIMD_BATCH_LEN];
+    complex z[SIMD_BATCH_LEN];
+    char *px[SIMD_BATCH_LEN];
+    int bitOffset[SIMD_BATCH_LEN];
+    unsigned char *status[SIMD_BATCH_LEN];
+    size_t count;
+} PixelBatch;
+
+/* Points of edge pixels waiting to be plotted, to be blended into the pixels.
+ * The points of a pixel are consecutive
+ */
+typedef struct SampleBatch
+{
+    double x[ANTI_ALIAS_BATCH_LEN];   /* Column and row of each point in the block, in pixels */
+    double y[ANTI_ALIAS_BATCH_LEN];
+    char *px[ANTI_ALIAS_BATCH_LEN];   /* Where each point is coloured */
+    size_t count;
+} SampleBatch;
+
+/* Plot and colour a batch of points at the precision of a tile context */
+typedef void (*PlotSamples)(void *ctx, SampleBatch *batch);
+
+/* Values cached for plotting rectangles of a tile */
+typedef struct TileCTX
+{
+    Block *block;
+    complex constant;     /* Julia set constant */
+    Formula formula;      /* Function iterated */
+    unsigned int degree;  /* Degree of a Multibrot set */
+    unsigned long nMax;   /* Maximum iteration count */
+    ColourScheme *colour;
+    ThreadStats *stats;   /* Work counted for the thread */
+    double reMin;         /* Real value of the first column */
+    double imMax;         /* Imaginary value of the first row of the image */
+    double pxWidth, pxHeight;
+    size_t blockOffset;   /* Row of the image at the start of the block */
+} TileCTX;
+
+/* Pixels waiting to be coloured (extended-precision) */
+typedef struct PixelBatchExt
+{
+    long double complex c[EXT_BATCH_LEN];
+    unsigned long n[EXT_BATCH_LEN];
+    long double complex z[EXT_BATCH_LEN];
+    char *px[EXT_BATCH_LEN];
+    int bitOffset[EXT_BATCH_LEN];
+    unsigned char *status[EXT_BATCH_LEN];
+    size_t count;
+} PixelBatchExt;
+
+/* Values cached for plotting rectangles of a tile (extended-precision) */
+typedef struct TileCTXExt
+{
+    Block *block;
+    long double complex constant;
+    Formula formula;
+    unsigned int degree;
+    unsigned long nMax;
+    ColourScheme *colour;
+    ThreadStats *stats;
+    long double reMin;
+    long double imMax;
+    long double pxWidth, pxHeight;
+    size_t blockOffset;
+} TileCTXExt;
+
+/* Pixels waiting to be run through the double-double functions */
+typedef struct PixelBatchDD
+{
+    ComplexDD c[DD_BATCH_LEN];
+    unsigned long n[DD_BATCH_LEN];
+    complex z[DD_BATCH_LEN];
+    char *px[DD_BATCH_LEN];
+    int bitOffset[DD_BATCH_LEN];
+    unsigned char *status[DD_BATCH_LEN];
+    size_t count;
+} PixelBatchDD;
+
+/* Values cached for plotting rectangles of a tile (double-double) */
+typedef struct TileCTXDD
+{
+    Block *block;
+    ComplexDD constant;
+    Formula formula;
+    unsigned int degree;
+    unsigned long nMax;
+    ColourScheme *colour;
+    ThreadStats *stats;
+    DoubleDouble reMin;
+    DoubleDouble imMax;
+    DoubleDouble pxWidth, pxHeight;
+    size_t blockOffset;
+} TileCTXDD;
 
 #ifdef MP_PREC
-static void mandelbrotMP(unsigned long *n, mpc_t z, mpfr_t norm, mpc_t c, unsigned long max);
+/* Values cached for plotting rectangles of a tile (multiple-precision) */
+typedef struct TileCTXMP
+{
+    Block *block;
+    Formula formula;
+    unsigned int degree;
+    unsigned long nMax;
+    ColourScheme *colour;
+    ThreadStats *stats;
+    size_t blockOffset;   /* Row of the image at the start of the block */
+    ScratchMP *mp;        /* Plot values and calculation variables of the thread */
+} TileCTXMP;
+
+/* Values cached for plotting rectangles of a tile (perturbation) */
+typedef struct TileCTXPerturbation
+{
+    Block *block;
+    const ReferenceOrbit *orbit;
+    unsigned long nMax;
+    ColourScheme *colour;
+    ThreadStats *stats;
+    size_t blockOffset;   /* Row of the image at the start of the block */
+} TileCTXPerturbation;
+#endif
+
+#ifdef OPENCL
+/* Pixels queued for a launch on the GPU, and the values cached for plotting
+ * tiles at the precision of the plot
+ */
+typedef struct TileCTXGPU
+{
+    Block *block;
+    GPU *gpu;
+    bool doubleDouble;    /* Whether pixels are double-double (else standard precision) */
+    TileCTX std;
+    TileCTXDD dd;
+    unsigned long nMax;
+    ColourScheme *colour;
+    ThreadStats *stats;
+    void *c;              /* Values of the queued pixels, in the mapped pixel buffer of the GPU */
+    char **px;            /* Where each queued pixel is coloured */
+    int *bitOffset;
+    size_t count;         /* Number of pixels queued */
+} TileCTXGPU;
 #endif
 
-static complex julia(unsigned long *n, complex z, complex c, unsigned long max);
-static long double complex juliaExt(unsigned long *n, long double complex z, long double complex c, unsigned long max);
+
+static void initialiseTileCTX(TileCTX *ctx, Thread *t);
+static void initialiseTileCTXExt(TileCTXExt *ctx, Thread *t);
+static void initialiseTileCTXDD(TileCTXDD *ctx, Thread *t);
 
 #ifdef MP_PREC
-static void juliaMP(unsigned long *n, mpc_t z, mpfr_t norm, mpc_t c, unsigned long max);
+static int initialiseTileCTXMP(TileCTXMP *ctx, Thread *t);
+static void * generateFractalPerturbation(void *threadInfo);
 #endif
 
+static void plotTiles(Thread *t, PlotRectangle plot, FillRectangle fill, void *ctx);
+static Subdivision * createTileSubdivision(Thread *t, PlotRectangle plot, FillRectangle fill, void *ctx);
+static int plotTile(Thread *t, Subdivision *subdivision, size_t tile, PlotRectangle plot, void *ctx);
 
-void * generateFractalRow(void *threadInfo)
-{
-    Thread *t = threadInfo;
+static void antiAliasTiles(Thread *t, PlotSamples plot, void *ctx);
+static void blendSampleBatch(SampleBatch *batch, char *const *pixels, size_t count, PlotSamples plot, void *ctx,
+                             const Block *block);
 
-    /*
-     * Because the loop may run for millions of iterations, all relevant struct
-     * members are cached before use.
-     */
+#ifdef OPENCL
+static void * plotTilesGPU(Thread *t);
+static int queueTileGPU(TileCTXGPU *ctx, size_t tile);
+static int launchGPU(TileCTXGPU *ctx);
+#endif
 
-    unsigned int tCount = t->tCount;
+static bool takeReusedPixel(const Block *block, size_t column, size_t row, char *px, unsigned char *status,
+                            ThreadStats *stats);
 
-    /* Plot parameters */
-    PlotCTX *p = t->block->parameters;
+static int fillRectangle(void *data, size_t x, size_t y, size_t width, size_t height);
+static int fillRectangleExt(void *data, size_t x, size_t y, size_t width, size_t height);
+static int fillRectangleDD(void *data, size_t x, size_t y, size_t width, size_t height);
 
-    /* Julia set constant */
-    complex constant = p->c.c;
+#ifdef MP_PREC
+static int fillRectangleMP(void *data, size_t x, size_t y, size_t width, size_t height);
 
-    /* Maximum iteration count */
-    unsigned long nMax = p->iterations;
+static int plotRectanglePerturbation(void *data, size_t x, size_t y, size_t width, size_t height,
+                                     unsigned char *status, size_t stride);
+static void plotBatchPerturbation(TileCTXPerturbation *ctx, PixelBatchExt *batch);
+static int fillRectanglePerturbation(void *data, size_t x, size_t y, size_t width, size_t height);
+#endif
 
-    PlotType type = p->type;
-    ColourScheme *colour = &(p->colour);
-    BitDepth colourDepth = colour->depth;
+static void getPixelSizeDD(DoubleDouble *pxWidth, DoubleDouble *pxHeight, const PlotCTX *p);
 
-    /* Real value at top-left of plot */
-    double reMin = creal(p->minimum.c);
-    double imMax = cimag(p->maximum.c);
+#ifdef MP_PREC
+static ScratchMP * getScratchMP(Thread *t);
+static void setPlotValuesMP(ScratchMP *s, const PlotCTX *p);
+#endif
 
-    /* Pixel dimensions */
-    double pxWidth = (p->width > 1) ? (creal(p->maximum.c) - creal(p->minimum.c)) / (p->width - 1) : 0.0;
-    double pxHeight = (p->height > 1) ? (cimag(p->maximum.c) - cimag(p->minimum.c)) / (p->height - 1) : 0.0;
+static void getTileBounds(size_t *xStart, size_t *xEnd, size_t *yStart, size_t *yEnd, size_t tile,
+                          const Block *block);
+static size_t getColumnOffset(size_t x, const Block *block);
+static int getBitOffset(size_t x, const Block *block);
+static void nextPixel(char **px, int *bitOffset, const Block *block);
 
-    /* Row array */
-    size_t columns = p->width;
-    size_t nmemb = t->block->memSize;
+static void countPixel(ThreadStats *stats, unsigned long n, unsigned long max);
+static void countBatch(ThreadStats *stats, const unsigned long *n, unsigned char *const *status, size_t count,
+                       unsigned long max);
 
-    char *px = t->block->array + t->tid * nmemb;
+static long double dotProductExt(long double complex z);
 
-    logMessage(DEBUG, "Thread %u: Generating row plot", t->tid);
+static long double complex mandelbrotExt(unsigned long *n, long double complex c, Formula formula,
+                                         unsigned int degree, unsigned long max, uintmax_t *iterations);
 
-    /* Number of bits into current byte (if bit depth < CHAR_BIT) */
-    int bitOffset;
+#ifdef MP_PREC
+static void mandelbrotMP(unsigned long *n, ScratchMP *s, Formula formula, unsigned int degree, unsigned long max,
+                         uintmax_t *iterations);
+#endif
 
-    /* Set complex value to start of the row */
-    complex c = reMin + pxWidth * t->tid + (imMax - t->block->id * pxHeight) * I;
+static long double complex juliaExt(unsigned long *n, long double complex z, long double complex c,
+                                    Formula formula, unsigned int degree, unsigned long max, uintmax_t *iterations);
 
-    /* Iterate over the row - offset by thread ID to ensure each thread gets a unique column */
-    for (size_t x = t->tid; x < columns; x += tCount, c += pxWidth * tCount)
-    {
-        complex z;
-        unsigned long n;
+#ifdef MP_PREC
+static void juliaMP(unsigned long *n, ScratchMP *s, Formula formula, unsigned int degree, unsigned long max,
+                    uintmax_t *iterations);
+#endif
 
-        /* Run fractal function on c */
-        switch (type)
-        {
-            case PLOT_JULIA:
-                z = julia(&n, c, constant, nMax);
-                break;
-            case PLOT_MANDELBROT:
-                z = mandelbrot(&n, c, nMax);
-                break;
-            default:
-                pthread_exit(NULL);
-        }
+static inline long double complex escapeTimeExt(unsigned long *n, long double complex z, long double complex c,
+                                                Formula formula, unsigned int degree, unsigned long max,
+                                                uintmax_t *iterations);
+static inline long double complex escapeTimeFormulaExt(unsigned long *n, long double complex z,
+                                                       long double complex c, Formula formula, unsigned int degree,
+                                                       unsigned long max, uintmax_t *iterations);
 
-        /* Map iteration count to RGB colour value */
-        mapColour(px, n, z, bitOffset, nMax, colour);
+#ifdef MP_PREC
+static void escapeTimeMP(unsigned long *n, ScratchMP *s, const mpfr_t cRe, const mpfr_t cIm, Formula formula,
+                         unsigned int degree, unsigned long max, uintmax_t *iterations);
+static inline void escapeTimeFormulaMP(unsigned long *n, ScratchMP *s, const mpfr_t cRe, const mpfr_t cIm,
+                                       Formula formula, unsigned int degree, unsigned long max,
+                                       uintmax_t *iterations);
+static void powerMP(ScratchMP *s, unsigned int degree);
+#endif
 
-        /* Increment pixel pointer */
-        if (colourDepth >= CHAR_BIT || colourDepth == BIT_DEPTH_ASCII)
-        {
-            px += nmemb * tCount;
-        }
-        else if (++bitOffset == CHAR_BIT)
-        {
-            px += nmemb * tCount;
-            bitOffset = 0;
-        }
+
+/* Kernels of each plot type (see function_kernel.h). Each kernel hands its
+ * pixels to a loop specialised for the formula, which adds the iterations it
+ * runs to the thread's statistics
+ */
+#define FUNCTION_KERNEL(name) name##Mandelbrot
+#define FUNCTION_KERNEL_SIMD(batch, ctx) mandelbrotSIMD((batch)->n, (batch)->z, (batch)->c, (batch)->count, \
+                                                        (ctx)->formula, (ctx)->degree, (ctx)->nMax, \
+                                                        &((ctx)->stats->iterations))
+#define FUNCTION_KERNEL_EXT(n, c, ctx) mandelbrotExt(n, c, (ctx)->formula, (ctx)->degree, (ctx)->nMax, \
+                                                     &((ctx)->stats->iterations))
+#define FUNCTION_KERNEL_DD(batch, ctx) mandelbrotDD((batch)->n, (batch)->z, (batch)->c, (batch)->count, \
+                                                    (ctx)->formula, (ctx)->degree, (ctx)->nMax, \
+                                                    &((ctx)->stats->iterations))
+#define FUNCTION_KERNEL_MP(n, ctx) mandelbrotMP(n, (ctx)->mp, (ctx)->formula, (ctx)->degree, (ctx)->nMax, \
+                                                &((ctx)->stats->iterations))
+#include "function_kernel.h"
+
+#define FUNCTION_KERNEL(name) name##Julia
+#define FUNCTION_KERNEL_SIMD(batch, ctx) juliaSIMD((batch)->n, (batch)->z, (batch)->c, (batch)->count, \
+                                                   (ctx)->constant, (ctx)->formula, (ctx)->degree, (ctx)->nMax, \
+                                                   &((ctx)->stats->iterations))
+#define FUNCTION_KERNEL_EXT(n, c, ctx) juliaExt(n, c, (ctx)->constant, (ctx)->formula, (ctx)->degree, (ctx)->nMax, \
+                                                &((ctx)->stats->iterations))
+#define FUNCTION_KERNEL_DD(batch, ctx) juliaDD((batch)->n, (batch)->z, (batch)->c, (batch)->count, \
+                                               (ctx)->constant, (ctx)->formula, (ctx)->degree, (ctx)->nMax, \
+                                               &((ctx)->stats->iterations))
+#define FUNCTION_KERNEL_MP(n, ctx) juliaMP(n, (ctx)->mp, (ctx)->formula, (ctx)->degree, (ctx)->nMax, \
+                                           &((ctx)->stats->iterations))
+#include "function_kernel.h"
+
+static const PlotKernels *const PLOT_KERNELS[] =
+{
+    [PLOT_JULIA] = &plotKernelsJulia,
+    [PLOT_MANDELBROT] = &plotKernelsMandelbrot
+};
+
+
+/* Get the thread function plotting blocks of the plot, specialised for its
+ * type and precision. Perturbation only applies at multiple precision. Returns
+ * NULL if the plot has no kernel
+ */
+PlotFunction getPlotFunction(const PlotCTX *p, bool perturbation)
+{
+    const PlotKernels *kernels;
+
+    #ifdef MP_PREC
+    if (perturbation && p->precision == MUL_PRECISION && p->formula == FORMULA_MANDELBROT)
+        return generateFractalPerturbation;
+    #else
+    (void) perturbation;
+    #endif
+
+    if ((size_t) p->type >= sizeof(PLOT_KERNELS) / sizeof(PLOT_KERNELS[0]) || !PLOT_KERNELS[p->type])
+    {
+        logMessage(ERROR, "No plotting function for the plot type");
+        return NULL;
     }
 
-    logMessage(DEBUG, "Thread %u: Row plot generated - exiting", t->tid);
-    
-    pthread_exit(NULL);
+    kernels = PLOT_KERNELS[p->type];
+
+    switch (p->precision)
+    {
+        case STD_PRECISION:
+            return kernels->std;
+        case EXT_PRECISION:
+            return kernels->ext;
+        case DD_PRECISION:
+            return kernels->dd;
+
+        #ifdef MP_PREC
+        case MUL_PRECISION:
+            return kernels->mp;
+        #endif
+
+        default:
+            logMessage(ERROR, "No plotting function for the precision");
+            return NULL;
+    }
 }
 
 
-void * generateFractalRowExt(void *threadInfo)
+/* Get the thread function supersampling the edge pixels of blocks of the plot,
+ * specialised for its type and precision. Returns NULL if the plot has none
+ */
+PlotFunction getAntiAliasFunction(const PlotCTX *p)
 {
-    Thread *t = threadInfo;
+    const PlotKernels *kernels;
+
+    if ((size_t) p->type >= sizeof(PLOT_KERNELS) / sizeof(PLOT_KERNELS[0]) || !PLOT_KERNELS[p->type])
+    {
+        logMessage(ERROR, "No plotting function for the plot type");
+        return NULL;
+    }
+
+    kernels = PLOT_KERNELS[p->type];
+
+    switch (p->precision)
+    {
+        case STD_PRECISION:
+            return kernels->antiAlias;
+        case EXT_PRECISION:
+            return kernels->antiAliasExt;
+        case DD_PRECISION:
+            return kernels->antiAliasDD;
+        default:
+            logMessage(WARNING, "Edges are only supersampled at standard, extended and double-double precision - "
+                       "plotting without anti-aliasing");
+            return NULL;
+    }
+}
 
-    /*
-     * Because the loop may run for millions of iterations, all relevant struct
-     * members are cached before use.
-     */
 
-    unsigned int tCount = t->tCount;
+#ifdef MP_PREC
+/* Plot the block using perturbation theory: each pixel is iterated as an offset
+ * from the block's reference orbit, which carries the plot type
+ */
+static void * generateFractalPerturbation(void *threadInfo)
+{
+    Thread *t = threadInfo;
 
     /* Plot parameters */
     PlotCTX *p = t->block->parameters;
 
-    /* Julia set constant */
-    long double complex constant = p->c.lc;
+    TileCTXPerturbation ctx =
+    {
+        .block = t->block,
+        .orbit = t->block->orbit,
+        .nMax = p->iterations,
+        .colour = &(p->colour),
+        .stats = &(t->stats),
+        .blockOffset = t->block->id * t->block->rows
+    };
+
+    if (!ctx.orbit)
+    {
+        logMessage(ERROR, "Thread %u: No reference orbit to plot from", t->tid);
+        return NULL;
+    }
 
-    /* Maximum iteration count */
-    unsigned long nMax = p->iterations;
+    plotTiles(t, plotRectanglePerturbation, fillRectanglePerturbation, &ctx);
 
-    PlotType type = p->type;
-    ColourScheme *colour = &(p->colour);
-    BitDepth colourDepth = colour->depth;
+    return NULL;
+}
+#endif
 
-    /* Real value at top-left of plot */
-    long double reMin = creall(p->minimum.lc);
-    long double imMax = cimagl(p->maximum.lc);
 
-    /* Pixel dimensions */
-    long double pxWidth = (p->width > 1) ? (creall(p->maximum.lc) - creall(p->minimum.lc)) / (p->width - 1) : 0.0L;
-    long double pxHeight = (p->height > 1) ? (cimagl(p->maximum.lc) - cimagl(p->minimum.lc)) / (p->height - 1) : 0.0L;
+/*
+ * Because the loops may run for billions of iterations, all relevant struct
+ * members are cached before use.
+ */
 
-    /* Row array */
-    size_t columns = p->width;
-    size_t nmemb = t->block->memSize;
+/* Cache the values of the plot for plotting rectangles of the thread's block */
+static void initialiseTileCTX(TileCTX *ctx, Thread *t)
+{
+    /* Plot parameters */
+    PlotCTX *p = t->block->parameters;
 
-    char *px = t->block->array + t->tid * nmemb;
+    /* Offset of block from start ('top-left') of image array */
+    size_t blockOffset = t->block->id * t->block->rows;
 
-    logMessage(DEBUG, "Thread %u: Generating row plot", t->tid);
+    ctx->block = t->block;
+    ctx->constant = p->c.c;
+    ctx->formula = p->formula;
+    ctx->degree = p->degree;
+    ctx->nMax = p->iterations;
+    ctx->colour = &(p->colour);
+    ctx->stats = &(t->stats);
+    ctx->reMin = creal(p->minimum.c);
 
-    /* Number of bits into current byte (if bit depth < CHAR_BIT) */
-    int bitOffset;
+    /* Pixel dimensions */
+    ctx->pxWidth = (p->width > 1) ? (creal(p->maximum.c) - creal(p->minimum.c)) / (p->width - 1) : 0.0;
+    ctx->pxHeight = (p->height > 1) ? (cimag(p->maximum.c) - cimag(p->minimum.c)) / (p->height - 1) : 0.0;
 
-    /* Set complex value to start of the row */
-    long double complex c = reMin + pxWidth * t->tid + (imMax - t->block->id * pxHeight) * I;
+    /* Rows are placed from the top of the image, however the image is split */
+    ctx->imMax = cimag(p->maximum.c);
+    ctx->blockOffset = blockOffset;
+}
 
-    /* Iterate over the row - offset by thread ID to ensure each thread gets a unique column */
-    for (size_t x = t->tid; x < columns; x += tCount, c += pxWidth * tCount)
-    {
-        long double complex z;
-        unsigned long n;
 
-        /* Run fractal function on c */
-        switch (type)
-        {
-            case PLOT_JULIA:
-                z = juliaExt(&n, c, constant, nMax);
-                break;
-            case PLOT_MANDELBROT:
-                z = mandelbrotExt(&n, c, nMax);
-                break;
-            default:
-                pthread_exit(NULL);
-        }
+/* Cache the values of the plot for plotting rectangles of the thread's block
+ * (extended-precision)
+ */
+static void initialiseTileCTXExt(TileCTXExt *ctx, Thread *t)
+{
+    PlotCTX *p = t->block->parameters;
+    size_t blockOffset = t->block->id * t->block->rows;
 
-        /* Map iteration count to RGB colour value */
-        mapColourExt(px, n, z, bitOffset, nMax, colour);
+    ctx->block = t->block;
+    ctx->constant = p->c.lc;
+    ctx->formula = p->formula;
+    ctx->degree = p->degree;
+    ctx->nMax = p->iterations;
+    ctx->colour = &(p->colour);
+    ctx->stats = &(t->stats);
+    ctx->reMin = creall(p->minimum.lc);
 
-        /* Increment pixel pointer */
-        if (colourDepth >= CHAR_BIT || colourDepth == BIT_DEPTH_ASCII)
-        {
-            px += nmemb * tCount;
-        }
-        else if (++bitOffset == CHAR_BIT)
-        {
-            px += nmemb * tCount;
-            bitOffset = 0;
-        }
-    }
+    ctx->pxWidth = (p->width > 1) ? (creall(p->maximum.lc) - creall(p->minimum.lc)) / (p->width - 1) : 0.0L;
+    ctx->pxHeight = (p->height > 1) ? (cimagl(p->maximum.lc) - cimagl(p->minimum.lc)) / (p->height - 1) : 0.0L;
 
-    logMessage(DEBUG, "Thread %u: Row plot generated - exiting", t->tid);
-    
-    pthread_exit(NULL);
+    ctx->imMax = cimagl(p->maximum.lc);
+    ctx->blockOffset = blockOffset;
 }
 
 
-#ifdef MP_PREC
-void * generateFractalRowMP(void *threadInfo)
+/* Cache the values of the plot for plotting rectangles of the thread's block
+ * (double-double)
+ */
+static void initialiseTileCTXDD(TileCTXDD *ctx, Thread *t)
 {
-    Thread *t = threadInfo;
+    PlotCTX *p = t->block->parameters;
+    size_t blockOffset = t->block->id * t->block->rows;
 
-    /*
-     * Because the loop may run for millions of iterations, all relevant struct
-     * members are cached before use.
-     */
+    ctx->block = t->block;
+    ctx->constant = p->c.dd;
+    ctx->formula = p->formula;
+    ctx->degree = p->degree;
+    ctx->nMax = p->iterations;
+    ctx->colour = &(p->colour);
+    ctx->stats = &(t->stats);
+    ctx->reMin = p->minimum.dd.re;
 
-    unsigned int tCount = t->tCount;
+    getPixelSizeDD(&(ctx->pxWidth), &(ctx->pxHeight), p);
 
-    /* Plot parameters */
+    ctx->imMax = p->maximum.dd.im;
+    ctx->blockOffset = blockOffset;
+}
+
+
+#ifdef MP_PREC
+/* Cache the values of the plot for plotting rectangles of the thread's block
+ * (multiple-precision). Returns 1 if the thread's variables could not be
+ * created
+ */
+static int initialiseTileCTXMP(TileCTXMP *ctx, Thread *t)
+{
     PlotCTX *p = t->block->parameters;
 
-    /* Julia set constant */
-    mpc_t constant;
-    mpc_init2(constant, mpSignificandSize);
-    mpc_set(constant, p->c.mpc, MP_COMPLEX_RND);
+    ctx->block = t->block;
+    ctx->formula = p->formula;
+    ctx->degree = p->degree;
+    ctx->nMax = p->iterations;
+    ctx->colour = &(p->colour);
+    ctx->stats = &(t->stats);
+    ctx->blockOffset = t->block->id * t->block->rows;
+    ctx->mp = getScratchMP(t);
 
-    /* Maximum iteration count */
-    unsigned long nMax = p->iterations;
+    if (!ctx->mp)
+        return 1;
 
-    PlotType type = p->type;
-    ColourScheme *colour = &(p->colour);
-    BitDepth colourDepth = colour->depth;
+    setPlotValuesMP(ctx->mp, p);
 
-    /* Values at top-left of plot */
-    mpfr_t reMin, imMax;
-    mpfr_init2(reMin, mpSignificandSize);
-    mpfr_init2(imMax, mpSignificandSize);
+    return 0;
+}
+#endif
 
-    mpfr_set(reMin, mpc_realref(p->minimum.mpc), MP_REAL_RND);
-    mpfr_set(imMax, mpc_imagref(p->maximum.mpc), MP_IMAG_RND);
 
-    /* Width value */
-    mpfr_t pxWidth;
-    mpfr_init2(pxWidth, mpSignificandSize);
+/* Claim tiles of the thread's block and plot them until none are left. Blocks
+ * of a single row, handed out one at a time, are only logged when debugging
+ */
+static void plotTiles(Thread *t, PlotRectangle plot, FillRectangle fill, void *ctx)
+{
+    LogLevel level = (t->block->rows > 1) ? INFO : DEBUG;
+    Subdivision *subdivision = createTileSubdivision(t, plot, fill, ctx);
 
-    if (p->width > 1)
-    {
-        mpfr_t width;
-        mpfr_init2(width, mpSignificandSize);
+    size_t tile;
+    double start;
 
-        mpfr_set_uj(width, (uintmax_t) (p->width - 1), MP_REAL_RND);
-        mpfr_sub(pxWidth, mpc_realref(p->maximum.mpc), mpc_realref(p->minimum.mpc), MP_REAL_RND);
-        mpfr_div(pxWidth, pxWidth, width, MP_REAL_RND);
+    logMessage(level, "Thread %u: Generating plot", t->tid);
 
-        mpfr_clear(width);
-    }
-    else
+    start = getMonotonicTime();
+
+    while (!claimTile(t, &tile))
     {
-        mpfr_set_d(pxWidth, 0.0, MP_REAL_RND);
+        if (plotTile(t, subdivision, tile, plot, ctx))
+            break;
     }
 
-    /* Height value */
-    mpfr_t pxHeight;
-    mpfr_init2(pxHeight, mpSignificandSize);
+    freeSubdivision(subdivision);
 
-    if (p->height > 1)
-    {
-        mpfr_t height;
-        mpfr_init2(height, mpSignificandSize);
+    t->stats.busy += getMonotonicTime() - start;
+
+    logMessage(level, "Thread %u: Plot generated - exiting", t->tid);
+}
 
-        mpfr_set_uj(height, (uintmax_t) (p->height - 1), MP_IMAG_RND);
-        mpfr_sub(pxHeight, mpc_imagref(p->maximum.mpc), mpc_imagref(p->minimum.mpc), MP_IMAG_RND);
-        mpfr_div(pxHeight, pxHeight, height, MP_IMAG_RND);
 
-        mpfr_clear(height);
-    }
-    else
+/* Create the subdivision buffer for a thread's tiles, if the block is to be
+ * subdivided. Without one, every pixel is computed
+ */
+static Subdivision * createTileSubdivision(Thread *t, PlotRectangle plot, FillRectangle fill, void *ctx)
+{
+    Subdivision *subdivision;
+
+    if (!t->block->subdivide)
+        return NULL;
+
+    subdivision = createSubdivision(t->block->tileWidth, t->block->tileHeight);
+
+    if (!subdivision)
     {
-        mpfr_set_d(pxHeight, 0.0, MP_IMAG_RND);
+        logMessage(WARNING, "Thread %u: Could not allocate subdivision buffer - computing every pixel", t->tid);
+        return NULL;
     }
 
-    /* Row array */
-    size_t columns = p->width;
-    size_t nmemb = t->block->memSize;
+    initialiseSubdivision(subdivision, plot, fill, ctx);
 
-    char *px = t->block->array + t->tid * nmemb;
+    return subdivision;
+}
 
-    /* Real offset into the row */
-    mpfr_t real;
-    mpfr_init2(real, mpSignificandSize);
 
-    mpfr_mul_ui(real, pxWidth, t->tid, MP_REAL_RND);
-    mpfr_add(real, reMin, real, MP_REAL_RND);
+/* Plot a tile, by subdivision if a Subdivision object is given */
+static int plotTile(Thread *t, Subdivision *subdivision, size_t tile, PlotRectangle plot, void *ctx)
+{
+    size_t xStart, xEnd, yStart, yEnd;
+    getTileBounds(&xStart, &xEnd, &yStart, &yEnd, tile, t->block);
 
-    /* Imaginary value of the row */
-    mpfr_t imag;
-    mpfr_init2(imag, mpSignificandSize);
-    mpfr_set_uj(imag, (uintmax_t) t->block->id, MP_IMAG_RND);
+    ++(t->stats.tiles);
 
-    mpfr_mul(imag, imag, pxHeight, MP_IMAG_RND);
-    mpfr_sub(imag, imMax, imag, MP_IMAG_RND);
+    if (!subdivision)
+        return plot(ctx, xStart, yStart, xEnd - xStart, yEnd - yStart, NULL, 0);
 
-    mpc_t c;
-    mpc_init2(c, mpSignificandSize);
-    mpc_set_fr_fr(c, real, imag, MP_COMPLEX_RND);
+    if (subdivideTile(subdivision, xStart, xEnd, yStart, yEnd))
+        return 1;
 
-    mpfr_t increment;
-    mpfr_init2(increment, mpSignificandSize);
+    /* Keep the status of the tile for the next frame to subdivide with */
+    if (t->block->reuse)
+    {
+        keepFrameStatus(t->block->reuse, subdivision->status, xStart, t->block->id * t->block->rows + yStart,
+                        xEnd - xStart, yEnd - yStart);
+    }
 
-    mpfr_mul_ui(increment, pxWidth, tCount, MP_REAL_RND);
+    return 0;
+}
 
-    logMessage(DEBUG, "Thread %u: Generating row plot", t->tid);
 
-    /* Number of bits into current byte (if bit depth < CHAR_BIT) */
-    int bitOffset;
+/* Claim tiles of the thread's block and plot the points of their edge pixels,
+ * found by findEdges(). Points are plotted a batch at a time, and each pixel is
+ * blended once its points are coloured, so its own colour is kept until then
+ */
+static void antiAliasTiles(Thread *t, PlotSamples plot, void *ctx)
+{
+    Block *block = t->block;
+    const AntiAlias *aa = block->antiAlias;
+    unsigned int samples = getSampleCount(aa);
+    size_t blockOffset = block->id * block->rows;
 
-    /* Calculation variables */
-    mpc_t z;
-    mpc_init2(z, mpSignificandSize);
+    SampleBatch batch;
+    RGB colours[ANTI_ALIAS_BATCH_LEN];
 
-    mpfr_t norm;
-    mpfr_init2(norm, mpSignificandSize);
+    /* Edge pixels of the batch */
+    char *pixels[ANTI_ALIAS_BATCH_LEN];
+    size_t count = 0;
 
-    /* Iterate over the row - offset by thread ID to ensure each thread gets a unique column */
-    for (size_t x = t->tid; x < columns; x += tCount, mpc_add_fr(c, c, increment, MP_REAL_RND))
-    {
-        unsigned long n;
+    size_t tile;
+    double start = getMonotonicTime();
 
-        /* Run fractal function on c */
-        switch (type)
-        {
-            case PLOT_JULIA:
-                juliaMP(&n, c, norm, constant, nMax);
-                break;
-            case PLOT_MANDELBROT:
-                mandelbrotMP(&n, z, norm, c, nMax);
-                break;
-            default:
-                mpfr_clears(reMin, imMax, pxWidth, pxHeight, real, imag, increment, norm, NULL);
-                mpc_clear(constant);
-                mpc_clear(z);
-                mpc_clear(c);
-                pthread_exit(NULL);
-        }
+    batch.count = 0;
 
-        /* Map iteration count to RGB colour value */
-        mapColourMP(px, n, norm, bitOffset, nMax, colour);
+    while (!claimTile(t, &tile))
+    {
+        size_t xStart, xEnd, yStart, yEnd;
+        getTileBounds(&xStart, &xEnd, &yStart, &yEnd, tile, block);
 
-        /* Increment pixel pointer */
-        if (colourDepth >= CHAR_BIT || colourDepth == BIT_DEPTH_ASCII)
-        {
-            px += nmemb * tCount;
-        }
-        else if (++bitOffset == CHAR_BIT)
+        for (size_t y = yStart; y < yEnd; ++y)
         {
-            px += nmemb * tCount;
-            bitOffset = 0;
+            for (size_t x = xStart; x < xEnd; ++x)
+            {
+                if (!isEdgePixel(aa, x, y))
+                    continue;
+
+                /* The points of a pixel are never split between batches */
+                if (batch.count + samples > ANTI_ALIAS_BATCH_LEN)
+                {
+                    blendSampleBatch(&batch, pixels, count, plot, ctx, block);
+                    count = 0;
+                }
+
+                pixels[count++] = block->array + y * block->rowSize + getColumnOffset(x, block);
+
+                for (unsigned int k = 0; k < samples; ++k, ++(batch.count))
+                {
+                    double dx, dy;
+                    getSampleOffset(&dx, &dy, aa, x, blockOffset + y, k);
+
+                    batch.x[batch.count] = x + dx;
+                    batch.y[batch.count] = y + dy;
+                    batch.px[batch.count] = (char *) &colours[batch.count];
+                }
+            }
         }
     }
 
-    mpfr_clears(reMin, imMax, pxWidth, pxHeight, real, imag, increment, norm, NULL);
-    mpc_clear(constant);
-    mpc_clear(z);
-    mpc_clear(c);
+    if (batch.count > 0)
+        blendSampleBatch(&batch, pixels, count, plot, ctx, block);
 
-    logMessage(DEBUG, "Thread %u: Row plot generated - exiting", t->tid);
-    
-    pthread_exit(NULL);
+    t->stats.busy += getMonotonicTime() - start;
 }
-#endif
 
 
-void * generateFractal(void *threadInfo)
+/* Plot a batch of points, then blend each of its `count` pixels from their
+ * points
+ */
+static void blendSampleBatch(SampleBatch *batch, char *const *pixels, size_t count, PlotSamples plot, void *ctx,
+                             const Block *block)
 {
-    Thread *t = threadInfo;
+    const AntiAlias *aa = block->antiAlias;
+    unsigned int samples = getSampleCount(aa);
 
-    /*
-     * Because the loops may run for billions of iterations, all relevant struct
-     * members are cached before use.
-     */
+    plot(ctx, batch);
 
-    unsigned int tCount = t->tCount;
+    for (size_t i = 0; i < count; ++i)
+        blendSamples(pixels[i], (const RGB *) batch->px[i * samples], aa, block->parameters->colour.depth);
 
-    /* Plot parameters */
+    batch->count = 0;
+}
+
+
+#ifdef OPENCL
+/* Seconds each GPU launch is sized to take. The GPU claims tiles from the same
+ * pool as the processor threads, as many at a time as it gets through in this
+ * long at its measured rate, so the block is split between the GPU and the
+ * processor by their throughput, and the processor threads are left waiting on
+ * the last launch of a block for no longer than this
+ */
+static const double GPU_LAUNCH_TIME = 0.02;
+
+
+/* Claim tiles of the thread's block and plot them on the thread's GPU until
+ * none are left. Tiles are not subdivided, as the GPU gains more from a full
+ * launch than from skipping pixels
+ */
+static void * plotTilesGPU(Thread *t)
+{
     PlotCTX *p = t->block->parameters;
+    LogLevel level = (t->block->rows > 1) ? INFO : DEBUG;
 
-    /* Julia set constant */
-    complex constant = p->c.c;
+    TileCTXGPU ctx =
+    {
+        .block = t->block,
+        .gpu = t->gpu,
+        .doubleDouble = (p->precision == DD_PRECISION),
+        .nMax = p->iterations,
+        .colour = &(p->colour),
+        .stats = &(t->stats),
+        .c = NULL,
+        .px = malloc(GPU_BATCH_LEN * sizeof(char *)),
+        .bitOffset = malloc(GPU_BATCH_LEN * sizeof(int)),
+        .count = 0
+    };
+
+    size_t tile;
+    bool claimed = true;
+    double start;
+    int ret = 0;
+
+    /* Tiles are left to the processor threads if the GPU cannot take them */
+    if (!ctx.px || !ctx.bitOffset || setGPUPlot(ctx.gpu, p))
+    {
+        logMessage(ERROR, "Thread %u: GPU could not be prepared - leaving the block to the processor", t->tid);
+        free(ctx.px);
+        free(ctx.bitOffset);
+        return NULL;
+    }
 
-    /* Maximum iteration count */
-    unsigned long nMax = p->iterations;
+    if (ctx.doubleDouble)
+        initialiseTileCTXDD(&(ctx.dd), t);
+    else
+        initialiseTileCTX(&(ctx.std), t);
 
-    PlotType type = p->type;
-    ColourScheme *colour = &(p->colour);
-    BitDepth colourDepth = colour->depth;
+    logMessage(level, "Thread %u: Generating plot on GPU", t->tid);
 
-    /* Values at top-left of plot */
-    double reMin = creal(p->minimum.c);
-    double imMax = cimag(p->maximum.c);
+    start = getMonotonicTime();
 
-    /* Pixel dimensions */
-    double pxWidth = (p->width > 1) ? (creal(p->maximum.c) - creal(p->minimum.c)) / (p->width - 1) : 0.0;
-    double pxHeight = (p->height > 1) ? (cimag(p->maximum.c) - cimag(p->minimum.c)) / (p->height - 1) : 0.0;
+    while (claimed && !ret)
+    {
+        /* Launches are sized by the GPU's rate, once it has been measured */
+        double fill = ctx.gpu->rate * GPU_LAUNCH_TIME;
+        size_t target = (fill < GPU_LAUNCH_LEN_MIN) ? GPU_LAUNCH_LEN_MIN
+                        : (fill < GPU_BATCH_LEN) ? (size_t) fill : GPU_BATCH_LEN;
+
+        while (!ret && ctx.count < target && (claimed = !claimTile(t, &tile)))
+        {
+            ++(t->stats.tiles);
+            ret = queueTileGPU(&ctx, tile);
+        }
 
-    /* Image array */
-    char *px;
-    char *array = t->block->array;
-    size_t rows = (t->block->remainder) ? t->block->remainderRows : t->block->rows;
-    size_t columns = p->width;
-    size_t nmemb = t->block->memSize;
+        if (!ret && ctx.count > 0)
+            ret = launchGPU(&ctx);
+    }
 
-    size_t rowSize = t->block->rowSize;
+    if (ret)
+        logMessage(ERROR, "Thread %u: GPU failed - its tiles of block %zu are missing", t->tid, t->block->id);
 
-    /* Offset of block from start ('top-left') of image array */
-    size_t blockOffset = t->block->id * t->block->rows;
-    double rowOffset = imMax - blockOffset * pxHeight;
+    free(ctx.px);
+    free(ctx.bitOffset);
+
+    t->stats.busy += getMonotonicTime() - start;
+
+    logMessage(level, "Thread %u: Plot generated - exiting", t->tid);
+
+    return NULL;
+}
+
+
+/* Queue the pixels of a tile for the GPU, launching whenever the pixel buffer
+ * is full
+ */
+static int queueTileGPU(TileCTXGPU *ctx, size_t tile)
+{
+    Block *block = ctx->block;
+    size_t xStart, xEnd, yStart, yEnd;
 
-    logMessage(INFO, "Thread %u: Generating plot", t->tid);
+    getTileBounds(&xStart, &xEnd, &yStart, &yEnd, tile, block);
 
-    /* Offset by thread ID to ensure each thread gets a unique row */
-    for (size_t y = t->tid; y < rows; y += tCount)
+    for (size_t row = yStart; row < yEnd; ++row)
     {
-        /* Number of bits into current byte (if bit depth < CHAR_BIT) */
-        int bitOffset = 0;
+        char *px = block->array + row * block->rowSize + getColumnOffset(xStart, block);
+        int bitOffset = getBitOffset(xStart, block);
 
-        /* Set complex value to start of the row */
-        complex c = reMin + (rowOffset - y * pxHeight) * I;
+        size_t imageRow = block->id * block->rows + row;
+        bool reused = isReusedRow(block->reuse, imageRow);
 
-        /* Set pixel pointer to start of the row */
-        px = array + y * rowSize;
+        double im = 0.0;
+        DoubleDouble imDD = {0.0, 0.0};
 
-        /* Iterate over the row */
-        for (size_t x = 0; x < columns; ++x, c += pxWidth)
+        if (ctx->doubleDouble)
+            imDD = ddSub(ctx->dd.imMax, ddMulD(ctx->dd.pxHeight, (double) imageRow));
+        else
+            im = ctx->std.imMax - imageRow * ctx->std.pxHeight;
+
+        for (size_t column = xStart; column < xEnd; ++column)
         {
-            complex z;
-            unsigned long n;
+            size_t i;
 
-            /* Run fractal function on c */
-            switch (type)
+            if (reused && takeReusedPixel(block, column, imageRow, px, NULL, ctx->stats))
             {
-                case PLOT_JULIA:
-                    z = julia(&n, c, constant, nMax);
-                    break;
-                case PLOT_MANDELBROT:
-                    z = mandelbrot(&n, c, nMax);
-                    break;
-                default:
-                    pthread_exit(NULL);
+                nextPixel(&px, &bitOffset, block);
+                continue;
             }
 
-            /* Map iteration count to RGB colour value */
-            mapColour(px, n, z, bitOffset, nMax, colour);
+            if (ctx->count == GPU_BATCH_LEN && launchGPU(ctx))
+                return 1;
+
+            /* The pixel buffer is mapped for the first pixel of each launch */
+            if (!ctx->c && !(ctx->c = mapGPUPixels(ctx->gpu)))
+                return 1;
+
+            i = (ctx->count)++;
 
-            /* Increment pixel pointer */
-            if (colourDepth >= CHAR_BIT || colourDepth == BIT_DEPTH_ASCII)
+            if (ctx->doubleDouble)
             {
-                px += nmemb;
+                ComplexDD *c = ctx->c;
+
+                c[i].re = ddAdd(ctx->dd.reMin, ddMulD(ctx->dd.pxWidth, (double) column));
+                c[i].im = imDD;
             }
-            else if (++bitOffset == CHAR_BIT)
+            else
             {
-                px += nmemb;
-                bitOffset = 0;
+                complex *c = ctx->c;
+                c[i] = ctx->std.reMin + ctx->std.pxWidth * column + im * I;
             }
+
+            ctx->px[i] = px;
+            ctx->bitOffset[i] = bitOffset;
+
+            nextPixel(&px, &bitOffset, block);
         }
     }
 
-    logMessage(INFO, "Thread %u: Plot generated - exiting", t->tid);
-    
-    pthread_exit(NULL);
+    return 0;
 }
 
 
-void * generateFractalExt(void *threadInfo)
+/* Run the queued pixels on the GPU and colour them, measuring the GPU's rate */
+static int launchGPU(TileCTXGPU *ctx)
 {
-    Thread *t = threadInfo;
+    const unsigned long *n;
+    const complex *z;
+    double time = getMonotonicTime();
 
-    /*
-     * Because the loops may run for billions of iterations, all relevant struct
-     * members are cached before use.
-     */
+    ctx->c = NULL;
 
-    unsigned int tCount = t->tCount;
+    if (runGPU(ctx->gpu, ctx->count, &n, &z, &(ctx->stats->iterations)))
+        return 1;
 
-    /* Plot parameters */
-    PlotCTX *p = t->block->parameters;
+    time = getMonotonicTime() - time;
 
-    /* Julia set constant */
-    long double complex constant = p->c.lc;
+    /* Map iteration counts to RGB colour values */
+    mapColourBatch(ctx->px, ctx->bitOffset, n, z, ctx->count, ctx->nMax, ctx->colour);
 
-    /* Maximum iteration count */
-    unsigned long nMax = p->iterations;
+    for (size_t i = 0; i < ctx->count; ++i)
+        countPixel(ctx->stats, n[i], ctx->nMax);
 
-    PlotType type = p->type;
-    ColourScheme *colour = &(p->colour);
-    BitDepth colourDepth = colour->depth;
+    if (unmapGPUResults(ctx->gpu))
+        return 1;
 
-    /* Values at top-left of plot */
-    long double reMin = creall(p->minimum.lc);
-    long double imMax = cimagl(p->maximum.lc);
-    
-    /* Pixel dimensions */
-    long double pxWidth = (p->width > 1) ? (creall(p->maximum.lc) - creall(p->minimum.lc)) / (p->width - 1) : 0.0L;
-    long double pxHeight = (p->height > 1) ? (cimagl(p->maximum.lc) - cimagl(p->minimum.lc)) / (p->height - 1) : 0.0L;
+    /* Pixels per second, smoothed over launches as the cost of pixels varies */
+    if (time > 0.0)
+    {
+        double rate = ctx->count / time;
+        ctx->gpu->rate = (ctx->gpu->rate > 0.0) ? (ctx->gpu->rate + rate) / 2.0 : rate;
+    }
 
-    /* Image array */
-    char *px;
-    char *array = t->block->array;
-    size_t rows = (t->block->remainder) ? t->block->remainderRows : t->block->rows;
-    size_t columns = p->width;
-    size_t nmemb = t->block->memSize;
-    size_t rowSize = t->block->rowSize;
+    ctx->count = 0;
 
-    /* Offset of block from start ('top-left') of image array */
-    size_t blockOffset = t->block->id * t->block->rows;
-    long double rowOffset = imMax - blockOffset * pxHeight;
+    return 0;
+}
+#endif
+
+
+/* Take pixel (column, row) of the image from the last frame of a sequence, if
+ * it lies on one of its pixels, along with its escape status. Returns true if
+ * the pixel was taken, so need not be plotted
+ */
+static bool takeReusedPixel(const Block *block, size_t column, size_t row, char *px, unsigned char *status,
+                            ThreadStats *stats)
+{
+    const char *reused = getReusedPixel(block->reuse, column, row, status);
 
-    logMessage(INFO, "Thread %u: Generating plot", t->tid);
+    if (!reused)
+        return false;
 
-    /* Offset by thread ID to ensure each thread gets a unique row */
-    for (size_t y = t->tid; y < rows; y += tCount)
+    memcpy(px, reused, block->memSize);
+    ++(stats->reused);
+
+    return true;
+}
+
+
+/* Colour a rectangle of pixels of the block as unescaped */
+static int fillRectangle(void *data, size_t x, size_t y, size_t width, size_t height)
+{
+    TileCTX *ctx = data;
+    Block *block = ctx->block;
+
+    for (size_t row = y; row < y + height; ++row)
     {
-        /* Number of bits into current byte (if bit depth < CHAR_BIT) */
-        int bitOffset = 0;
+        char *px = block->array + row * block->rowSize + getColumnOffset(x, block);
+        int bitOffset = getBitOffset(x, block);
 
-        /* Set complex value to start of the row */
-        long double complex c = reMin + (rowOffset - y * pxHeight) * I;
+        for (size_t column = x; column < x + width; ++column)
+        {
+            mapColour(px, ctx->nMax, 0.0, bitOffset, ctx->nMax, ctx->colour);
+            nextPixel(&px, &bitOffset, block);
+        }
+    }
+
+    ctx->stats->filled += width * height;
+
+    return 0;
+}
 
-        /* Set pixel pointer to start of the row */
-        px = array + y * rowSize;
 
-        /* Iterate over the row */
-        for (size_t x = 0; x < columns; ++x, c += pxWidth)
+/* Colour a rectangle of pixels of the block as unescaped (extended-precision) */
+static int fillRectangleExt(void *data, size_t x, size_t y, size_t width, size_t height)
+{
+    TileCTXExt *ctx = data;
+    Block *block = ctx->block;
+
+    for (size_t row = y; row < y + height; ++row)
+    {
+        char *px = block->array + row * block->rowSize + getColumnOffset(x, block);
+        int bitOffset = getBitOffset(x, block);
+
+        for (size_t column = x; column < x + width; ++column)
         {
-            long double complex z;
-            unsigned long n;
+            mapColourExt(px, ctx->nMax, 0.0L, bitOffset, ctx->nMax, ctx->colour);
+            nextPixel(&px, &bitOffset, block);
+        }
+    }
 
-            /* Run fractal function on c */
-            switch (type)
-            {
-                case PLOT_JULIA:
-                    z = juliaExt(&n, c, constant, nMax);
-                    break;
-                case PLOT_MANDELBROT:
-                    z = mandelbrotExt(&n, c, nMax);
-                    break;
-                default:
-                    pthread_exit(NULL);
-            }
+    ctx->stats->filled += width * height;
+
+    return 0;
+}
+
+
+/* Colour a rectangle of pixels of the block as unescaped (double-double) */
+static int fillRectangleDD(void *data, size_t x, size_t y, size_t width, size_t height)
+{
+    TileCTXDD *ctx = data;
+    Block *block = ctx->block;
+
+    for (size_t row = y; row < y + height; ++row)
+    {
+        char *px = block->array + row * block->rowSize + getColumnOffset(x, block);
+        int bitOffset = getBitOffset(x, block);
+
+        for (size_t column = x; column < x + width; ++column)
+        {
+            mapColour(px, ctx->nMax, 0.0, bitOffset, ctx->nMax, ctx->colour);
+            nextPixel(&px, &bitOffset, block);
+        }
+    }
+
+    ctx->stats->filled += width * height;
+
+    return 0;
+}
+
+
+#ifdef MP_PREC
+/* Colour a rectangle of pixels of the block as unescaped (multiple-precision) */
+static int fillRectangleMP(void *data, size_t x, size_t y, size_t width, size_t height)
+{
+    TileCTXMP *ctx = data;
+    Block *block = ctx->block;
+
+    for (size_t row = y; row < y + height; ++row)
+    {
+        char *px = block->array + row * block->rowSize + getColumnOffset(x, block);
+        int bitOffset = getBitOffset(x, block);
+
+        for (size_t column = x; column < x + width; ++column)
+        {
+            mapColourMP(px, ctx->nMax, ctx->mp->norm, bitOffset, ctx->nMax, ctx->colour);
+            nextPixel(&px, &bitOffset, block);
+        }
+    }
+
+    ctx->stats->filled += width * height;
+
+    return 0;
+}
+
+
+/* Plot a rectangle of pixels of the block as offsets from the reference orbit.
+ * Pixels are iterated one at a time, but coloured in batches
+ */
+static int plotRectanglePerturbation(void *data, size_t x, size_t y, size_t width, size_t height,
+                                     unsigned char *status, size_t stride)
+{
+    TileCTXPerturbation *ctx = data;
+    Block *block = ctx->block;
+    const ReferenceOrbit *orbit = ctx->orbit;
 
-            /* Map iteration count to RGB colour value */
-            mapColourExt(px, n, z, bitOffset, nMax, colour);
+    PixelBatchExt batch;
+    batch.count = 0;
 
-            /* Increment pixel pointer */
-            if (colourDepth >= CHAR_BIT || colourDepth == BIT_DEPTH_ASCII)
+    for (size_t row = y; row < y + height; ++row)
+    {
+        char *px = block->array + row * block->rowSize + getColumnOffset(x, block);
+        int bitOffset = getBitOffset(x, block);
+
+        long double im = (orbit->yCentre - (long double) (ctx->blockOffset + row)) * orbit->pxHeight;
+
+        bool reused = isReusedRow(block->reuse, ctx->blockOffset + row);
+
+        for (size_t column = x; column < x + width; ++column)
+        {
+            unsigned char *pxStatus = (status) ? &status[(row - y) * stride + (column - x)] : NULL;
+
+            if (reused && takeReusedPixel(block, column, ctx->blockOffset + row, px, pxStatus, ctx->stats))
             {
-                px += nmemb;
+                nextPixel(&px, &bitOffset, block);
+                continue;
             }
-            else if (++bitOffset == CHAR_BIT)
+
+            size_t i = (batch.count)++;
+
+            batch.c[i] = ((long double) column - orbit->xCentre) * orbit->pxWidth + im * I;
+            batch.px[i] = px;
+            batch.bitOffset[i] = bitOffset;
+            batch.status[i] = pxStatus;
+
+            nextPixel(&px, &bitOffset, block);
+
+            if (batch.count == EXT_BATCH_LEN)
             {
-                px += nmemb;
-                bitOffset = 0;
+                plotBatchPerturbation(ctx, &batch);
+                batch.count = 0;
             }
         }
     }
 
-    logMessage(INFO, "Thread %u: Plot generated - exiting", t->tid);
-    
-    pthread_exit(NULL);
+    if (batch.count > 0)
+        plotBatchPerturbation(ctx, &batch);
+
+    return 0;
 }
 
 
-#ifdef MP_PREC
-void * generateFractalMP(void *threadInfo)
+/* Iterate a batch of offsets from the reference orbit and colour them */
+static void plotBatchPerturbation(TileCTXPerturbation *ctx, PixelBatchExt *batch)
 {
-    Thread *t = threadInfo;
+    for (size_t i = 0; i < batch->count; ++i)
+        batch->z[i] = perturbation(&(batch->n[i]), ctx->orbit, batch->c[i], ctx->nMax, &(ctx->stats->iterations));
 
-    /*
-     * Because the loops may run for billions of iterations, all relevant struct
-     * members are cached before use.
-     */
+    /* Map iteration counts to RGB colour values */
+    mapColourBatchExt(batch->px, batch->bitOffset, batch->n, batch->z, batch->count, ctx->nMax, ctx->colour);
+    countBatch(ctx->stats, batch->n, batch->status, batch->count, ctx->nMax);
+}
 
-    unsigned int tCount = t->tCount;
 
-    /* Plot parameters */
-    PlotCTX *p = t->block->parameters;
+/* Colour a rectangle of pixels of the block as unescaped (perturbation) */
+static int fillRectanglePerturbation(void *data, size_t x, size_t y, size_t width, size_t height)
+{
+    TileCTXPerturbation *ctx = data;
+    Block *block = ctx->block;
 
-    /* Julia set constant */
-    mpc_t constant;
-    mpc_init2(constant, mpSignificandSize);
-    mpc_set(constant, p->c.mpc, MP_COMPLEX_RND);
+    for (size_t row = y; row < y + height; ++row)
+    {
+        char *px = block->array + row * block->rowSize + getColumnOffset(x, block);
+        int bitOffset = getBitOffset(x, block);
 
-    /* Maximum iteration count */
-    unsigned long nMax = p->iterations;
+        for (size_t column = x; column < x + width; ++column)
+        {
+            mapColourExt(px, ctx->nMax, 0.0L, bitOffset, ctx->nMax, ctx->colour);
+            nextPixel(&px, &bitOffset, block);
+        }
+    }
 
-    PlotType type = p->type;
-    ColourScheme *colour = &(p->colour);
-    BitDepth colourDepth = colour->depth;
+    ctx->stats->filled += width * height;
+
+    return 0;
+}
 
-    /* Values at top-left of plot */
-    mpfr_t reMin, imMax;
-    mpfr_init2(reMin, mpSignificandSize);
-    mpfr_init2(imMax, mpSignificandSize);
 
-    mpfr_set(reMin, mpc_realref(p->minimum.mpc), MP_REAL_RND);
-    mpfr_set(imMax, mpc_imagref(p->maximum.mpc), MP_IMAG_RND);
+/* Get the thread's multiple-precision variables, creating them on first use.
+ * They are only recreated if the significand size has changed
+ */
+static ScratchMP * getScratchMP(Thread *t)
+{
+    if (t->scratch && t->scratch->precision != mpSignificandSize)
+    {
+        freeScratchMP(t->scratch);
+        t->scratch = NULL;
+    }
 
-    /* Image array */
-    char *px;
-    char *array = t->block->array;
-    size_t rows = (t->block->remainder) ? t->block->remainderRows : t->block->rows;
-    size_t columns = p->width;
-    size_t nmemb = t->block->memSize;
+    if (!t->scratch)
+    {
+        t->scratch = createScratchMP(mpSignificandSize);
 
-    size_t rowSize = t->block->rowSize;
+        if (!t->scratch)
+            logMessage(ERROR, "Thread %u: Memory allocation failed", t->tid);
+    }
 
-    /* Width value */
-    mpfr_t pxWidth;
-    mpfr_init2(pxWidth, mpSignificandSize);
+    return t->scratch;
+}
 
-    if (p->width > 1)
-    {
-        mpfr_t width;
-        mpfr_init2(width, mpSignificandSize);
 
-        mpfr_set_uj(width, (uintmax_t) (p->width - 1), MP_REAL_RND);
-        mpfr_sub(pxWidth, mpc_realref(p->maximum.mpc), mpc_realref(p->minimum.mpc), MP_REAL_RND);
-        mpfr_div(pxWidth, pxWidth, width, MP_REAL_RND);
+/* Set the values of the plot that are constant for every pixel */
+static void setPlotValuesMP(ScratchMP *s, const PlotCTX *p)
+{
+    /* Julia set constant */
+    mpfr_set(s->constantRe, mpc_realref(p->c.mpc), MP_REAL_RND);
+    mpfr_set(s->constantIm, mpc_imagref(p->c.mpc), MP_IMAG_RND);
+
+    /* Values at top-left of plot */
+    mpfr_set(s->reMin, mpc_realref(p->minimum.mpc), MP_REAL_RND);
+    mpfr_set(s->imMax, mpc_imagref(p->maximum.mpc), MP_IMAG_RND);
 
-        mpfr_clear(width);
+    /* Pixel dimensions - the row values are free to hold the divisors */
+    if (p->width > 1)
+    {
+        mpfr_set_uj(s->real, (uintmax_t) (p->width - 1), MP_REAL_RND);
+        mpfr_sub(s->pxWidth, mpc_realref(p->maximum.mpc), mpc_realref(p->minimum.mpc), MP_REAL_RND);
+        mpfr_div(s->pxWidth, s->pxWidth, s->real, MP_REAL_RND);
     }
     else
     {
-        mpfr_set_d(pxWidth, 0.0, MP_REAL_RND);
+        mpfr_set_zero(s->pxWidth, 1);
     }
 
-    /* Height value */
-    mpfr_t pxHeight;
-    mpfr_init2(pxHeight, mpSignificandSize);
-
     if (p->height > 1)
     {
-        mpfr_t height;
-        mpfr_init2(height, mpSignificandSize);
-
-        mpfr_set_uj(height, (uintmax_t) (p->height - 1), MP_IMAG_RND);
-        mpfr_sub(pxHeight, mpc_imagref(p->maximum.mpc), mpc_imagref(p->minimum.mpc), MP_IMAG_RND);
-        mpfr_div(pxHeight, pxHeight, height, MP_IMAG_RND);
-
-        mpfr_clear(height);
+        mpfr_set_uj(s->imag, (uintmax_t) (p->height - 1), MP_IMAG_RND);
+        mpfr_sub(s->pxHeight, mpc_imagref(p->maximum.mpc), mpc_imagref(p->minimum.mpc), MP_IMAG_RND);
+        mpfr_div(s->pxHeight, s->pxHeight, s->imag, MP_IMAG_RND);
     }
     else
     {
-        mpfr_set_d(pxHeight, 0.0, MP_IMAG_RND);
+        mpfr_set_zero(s->pxHeight, 1);
     }
+}
+#endif
 
-    /* Offset of block from start ('top-left') of image array */
-    mpfr_t blockOffset, rowOffset;
-    mpfr_init2(blockOffset, mpSignificandSize);
-    mpfr_init2(rowOffset, mpSignificandSize);
 
-    mpfr_set_uj(blockOffset, (uintmax_t) (t->block->id * t->block->rows + t->tid), MP_IMAG_RND);
-    mpfr_mul(blockOffset, blockOffset, pxHeight, MP_IMAG_RND);
-    mpfr_sub(rowOffset, imMax, blockOffset, MP_IMAG_RND);
+/* Get the pixel dimensions of a plot (double-double) */
+static void getPixelSizeDD(DoubleDouble *pxWidth, DoubleDouble *pxHeight, const PlotCTX *p)
+{
+    *pxWidth = (p->width > 1) ? ddDivD(ddSub(p->maximum.dd.re, p->minimum.dd.re), (double) (p->width - 1))
+                              : doubleToDD(0.0);
+    *pxHeight = (p->height > 1) ? ddDivD(ddSub(p->maximum.dd.im, p->minimum.dd.im), (double) (p->height - 1))
+                                : doubleToDD(0.0);
+}
 
-    mpfr_clear(blockOffset);
 
-    /* Calculation variables */
-    mpc_t z, c;
-    mpc_init2(z, mpSignificandSize);
-    mpc_init2(c, mpSignificandSize);
+/* Get the column and row range [start, end) of a tile within the block */
+static void getTileBounds(size_t *xStart, size_t *xEnd, size_t *yStart, size_t *yEnd, size_t tile,
+                          const Block *block)
+{
+    size_t rows = (block->remainder) ? block->remainderRows : block->rows;
+    size_t columns = block->parameters->width;
+    size_t tilesPerRow = (columns + block->tileWidth - 1) / block->tileWidth;
 
-    /* Rather than calculate row im-value as rowOffset - y * pxHeight, just subtract pxHeight * tCount each time */
-    mpfr_mul_ui(pxHeight, pxHeight, (unsigned long) tCount, MP_IMAG_RND);
+    *xStart = (tile % tilesPerRow) * block->tileWidth;
+    *yStart = (tile / tilesPerRow) * block->tileHeight;
 
-    mpfr_t norm;
-    mpfr_init2(norm, mpSignificandSize);
+    *xEnd = (*xStart + block->tileWidth < columns) ? *xStart + block->tileWidth : columns;
+    *yEnd = (*yStart + block->tileHeight < rows) ? *yStart + block->tileHeight : rows;
+}
 
-    logMessage(INFO, "Thread %u: Generating plot", t->tid);
 
-    /* Offset by thread ID to ensure each thread gets a unique row */
-    for (size_t y = t->tid; y < rows; y += tCount)
-    {
-        /* Number of bits into current byte (if bit depth < CHAR_BIT) */
-        int bitOffset = 0;
+/* Byte offset of a column from the start of its row */
+static size_t getColumnOffset(size_t x, const Block *block)
+{
+    BitDepth depth = block->parameters->colour.depth;
 
-        /* Set complex value to start of the row */
-        mpc_set_fr_fr(c, reMin, rowOffset, MP_COMPLEX_RND);
+    if (depth >= CHAR_BIT || depth == BIT_DEPTH_ASCII)
+        return x * block->memSize;
 
-        /* Set pixel pointer to start of the row */
-        px = array + y * rowSize;
+    return x / CHAR_BIT;
+}
 
-        /* Iterate over the row */
-        for (size_t x = 0; x < columns; ++x, mpc_add_fr(c, c, pxWidth, MP_REAL_RND))
-        {
-            unsigned long n;
 
-            /* Run fractal function on c */
-            switch (type)
-            {
-                case PLOT_JULIA:
-                    juliaMP(&n, c, norm, constant, nMax);
-                    break;
-                case PLOT_MANDELBROT:
-                    mandelbrotMP(&n, z, norm, c, nMax);
-                    break;
-                default:
-                    mpfr_clears(reMin, imMax, pxWidth, pxHeight, rowOffset, norm, NULL);
-                    mpc_clear(constant);
-                    mpc_clear(z);
-                    mpc_clear(c);
-                    pthread_exit(NULL);
-            }
+/* Bit offset of a column into its byte (if bit depth < CHAR_BIT) */
+static int getBitOffset(size_t x, const Block *block)
+{
+    BitDepth depth = block->parameters->colour.depth;
 
-            /* Map iteration count to RGB colour value */
-            mapColourMP(px, n, norm, bitOffset, nMax, colour);
+    if (depth >= CHAR_BIT || depth == BIT_DEPTH_ASCII)
+        return 0;
+
+    return (int) (x % CHAR_BIT);
+}
 
-            /* Increment pixel pointer */
-            if (colourDepth >= CHAR_BIT || colourDepth == BIT_DEPTH_ASCII)
-            {
-                px += nmemb;
-            }
-            else if (++bitOffset == CHAR_BIT)
-            {
-                px += nmemb;
-                bitOffset = 0;
-            }
-        }
 
-        mpfr_sub(rowOffset, rowOffset, pxHeight, MP_IMAG_RND);
+/* Move a pixel pointer on to the next column */
+static void nextPixel(char **px, int *bitOffset, const Block *block)
+{
+    BitDepth depth = block->parameters->colour.depth;
+
+    if (depth >= CHAR_BIT || depth == BIT_DEPTH_ASCII)
+    {
+        *px += block->memSize;
     }
+    else if (++(*bitOffset) == CHAR_BIT)
+    {
+        *px += block->memSize;
+        *bitOffset = 0;
+    }
+}
 
-    mpfr_clears(reMin, imMax, pxWidth, pxHeight, rowOffset, norm, NULL);
-    mpc_clear(constant);
-    mpc_clear(z);
-    mpc_clear(c);
 
-    logMessage(INFO, "Thread %u: Plot generated - exiting", t->tid);
-    
-    pthread_exit(NULL);
+/* Count a pixel given the iteration count `n` in the thread's statistics. Its
+ * iterations are counted by the function that ran them, as a pixel found to be
+ * interior early is given the maximum count without running that far
+ */
+static void countPixel(ThreadStats *stats, unsigned long n, unsigned long max)
+{
+    ++(stats->pixels);
+
+    if (n < max)
+        ++(stats->escaped);
 }
-#endif
 
 
-static double dotProduct(complex z)
+/* Count a batch of pixels in the thread's statistics, and set their escape
+ * status for subdivision
+ */
+static void countBatch(ThreadStats *stats, const unsigned long *n, unsigned char *const *status, size_t count,
+                       unsigned long max)
 {
-    return creal(z) * creal(z) + cimag(z) * cimag(z);
+    for (size_t i = 0; i < count; ++i)
+    {
+        countPixel(stats, n[i], max);
+
+        if (status[i])
+            *(status[i]) = (n[i] < max) ? SUBDIVISION_ESCAPED : SUBDIVISION_UNESCAPED;
+    }
 }
 
 
@@ -759,21 +1275,22 @@ static long double dotProductExt(long double complex z)
 }
 
 
-/* Perform Mandelbrot set function */
-static complex mandelbrot(unsigned long *n, complex c, unsigned long max)
+/* Perform Mandelbrot set function of the formula (extended-precision) */
+static long double complex mandelbrotExt(unsigned long *n, long double complex c, Formula formula,
+                                         unsigned int degree, unsigned long max, uintmax_t *iterations)
 {
-    complex z = 0.0 + 0.0 * I;
-    double cdot = dotProduct(c);
+    long double complex z = 0.0L + 0.0L * I;
+    long double cdot = dotProductExt(c);
 
-    if (256.0 * cdot * cdot - 96.0 * cdot + 32.0 * creal(c) - 3.0 >= 0.0
-        && 16.0 * (cdot + 2.0 * creal(c) + 1.0) - 1.0 >= 0.0)
+    if (formula != FORMULA_MANDELBROT
+        || (256.0L * cdot * cdot - 96.0L * cdot + 32.0L * creall(c) - 3.0L >= 0.0L
+            && 16.0L * (cdot + 2.0L * creall(c) + 1.0L) - 1.0L >= 0.0L))
     {
-        for (*n = 0; cabs(z) < ESCAPE_RADIUS && *n < max; ++(*n))
-            z = z * z + c;
+        z = escapeTimeExt(n, z, c, formula, degree, max, iterations);
     }
     else
     {
-        /* Ignore main and secondary bulb */
+        /* Ignore main and secondary bulb, running no iterations */
         *n = max;
     }
 
@@ -781,76 +1298,256 @@ static complex mandelbrot(unsigned long *n, complex c, unsigned long max)
 }
 
 
-/* Perform Mandelbrot set function (extended-precision) */
-static long double complex mandelbrotExt(unsigned long *n, long double complex c, unsigned long max)
+#ifdef MP_PREC
+/* Perform Mandelbrot set function of the formula on the thread's current
+ * pixel (multiple-precision)
+ */
+static void mandelbrotMP(unsigned long *n, ScratchMP *s, Formula formula, unsigned int degree, unsigned long max,
+                         uintmax_t *iterations)
 {
-    long double complex z = 0.0L + 0.0L * I;
-    long double cdot = dotProductExt(c);
+    mpfr_set_zero(s->zRe, 1);
+    mpfr_set_zero(s->zIm, 1);
+    escapeTimeMP(n, s, s->cRe, s->cIm, formula, degree, max, iterations);
+}
+#endif
 
-    if (256.0L * cdot * cdot - 96.0L * cdot + 32.0L * creall(c) - 3.0L >= 0.0L
-        && 16.0L * (cdot + 2.0L * creall(c) + 1.0L) - 1.0L >= 0.0L)
+
+/* Perform Julia set function of the formula (extended-precision) */
+static long double complex juliaExt(unsigned long *n, long double complex z, long double complex c,
+                                    Formula formula, unsigned int degree, unsigned long max, uintmax_t *iterations)
+{
+    return escapeTimeExt(n, z, c, formula, degree, max, iterations);
+}
+
+
+#ifdef MP_PREC
+/* Perform Julia set function of the formula on the thread's current pixel
+ * (multiple-precision)
+ */
+static void juliaMP(unsigned long *n, ScratchMP *s, Formula formula, unsigned int degree, unsigned long max,
+                    uintmax_t *iterations)
+{
+    mpfr_set(s->zRe, s->cRe, MP_REAL_RND);
+    mpfr_set(s->zIm, s->cIm, MP_IMAG_RND);
+    escapeTimeMP(n, s, s->constantRe, s->constantIm, formula, degree, max, iterations);
+}
+#endif
+
+
+/* Run the escape-time loop of the formula (extended-precision). Inlined into
+ * each kernel, as a call per pixel is costly with extended precision
+ */
+static inline __attribute__ ((always_inline)) long double complex escapeTimeExt(
+    unsigned long *n, long double complex z, long double complex c, Formula formula, unsigned int degree,
+    unsigned long max, uintmax_t *iterations)
+{
+    switch (formula)
     {
-        for (*n = 0; cabsl(z) < ESCAPE_RADIUS_EXT && *n < max; ++(*n))
-            z = z * z + c;
+        case FORMULA_MULTIBROT:
+            return escapeTimeFormulaExt(n, z, c, FORMULA_MULTIBROT, degree, max, iterations);
+        case FORMULA_BURNING_SHIP:
+            return escapeTimeFormulaExt(n, z, c, FORMULA_BURNING_SHIP, degree, max, iterations);
+        case FORMULA_TRICORN:
+            return escapeTimeFormulaExt(n, z, c, FORMULA_TRICORN, degree, max, iterations);
+        default:
+            return escapeTimeFormulaExt(n, z, c, FORMULA_MANDELBROT, degree, max, iterations);
     }
-    else
+}
+
+
+/* Iterate the formula until z escapes or the maximum iteration count is
+ * reached (extended-precision). The escape test compares squared magnitudes to
+ * avoid a square root.
+ *
+ * An orbit returning exactly to an earlier value is periodic and never escapes,
+ * so it is stopped early, given the maximum count but counting only the
+ * iterations it ran. The value compared against is replaced after a doubling
+ * number of iterations (Brent's method), so cycles of any length are found
+ * without storing the orbit.
+ *
+ * Always inlined with a constant formula, so each formula gets its own loop
+ */
+static inline __attribute__ ((always_inline)) long double complex escapeTimeFormulaExt(
+    unsigned long *n, long double complex z, long double complex c, Formula formula, unsigned int degree,
+    unsigned long max, uintmax_t *iterations)
+{
+    long double complex saved = z;
+    unsigned long period = 0;
+    unsigned long limit = 1;
+
+    for (*n = 0; dotProductExt(z) < ESCAPE_RADIUS_SQR_EXT && *n < max; ++(*n))
     {
-        /* Ignore main and secondary bulb */
-        *n = max;
+        switch (formula)
+        {
+            case FORMULA_MULTIBROT:
+            {
+                long double complex power = z * z;
+
+                for (unsigned int d = 2; d < degree; ++d)
+                    power *= z;
+
+                z = power + c;
+                break;
+            }
+            case FORMULA_BURNING_SHIP:
+                z = fabsl(creall(z)) + fabsl(cimagl(z)) * I;
+                z = z * z + c;
+                break;
+            case FORMULA_TRICORN:
+                z = conjl(z * z) + c;
+                break;
+            default:
+                z = z * z + c;
+                break;
+        }
+
+        if (z == saved)
+        {
+            *iterations += *n + 1;
+            *n = max;
+            return z;
+        }
+
+        if (++period == limit)
+        {
+            saved = z;
+            period = 0;
+            limit *= 2;
+        }
     }
 
+    *iterations += *n;
+
     return z;
 }
 
 
 #ifdef MP_PREC
-/* Perform Mandelbrot set function (multiple-precision) */
-static void mandelbrotMP(unsigned long *n, mpc_t z, mpfr_t norm, mpc_t c, unsigned long max)
+/* Run the escape-time loop of the formula (multiple-precision) */
+static void escapeTimeMP(unsigned long *n, ScratchMP *s, const mpfr_t cRe, const mpfr_t cIm, Formula formula,
+                         unsigned int degree, unsigned long max, uintmax_t *iterations)
 {
-    mpc_set_d_d(z, 0.0, 0.0, MP_COMPLEX_RND);
-    mpc_norm(norm, z, MP_REAL_RND);
-
-    for (*n = 0; mpfr_cmp_d(norm, ESCAPE_RADIUS_MP * ESCAPE_RADIUS_MP) < 0 && *n < max; ++(*n))
+    switch (formula)
     {
-        mpc_sqr(z, z, MP_COMPLEX_RND);
-        mpc_add(z, z, c, MP_COMPLEX_RND);
-        mpc_norm(norm, z, MP_REAL_RND);
+        case FORMULA_MULTIBROT:
+            escapeTimeFormulaMP(n, s, cRe, cIm, FORMULA_MULTIBROT, degree, max, iterations);
+            break;
+        case FORMULA_BURNING_SHIP:
+            escapeTimeFormulaMP(n, s, cRe, cIm, FORMULA_BURNING_SHIP, degree, max, iterations);
+            break;
+        case FORMULA_TRICORN:
+            escapeTimeFormulaMP(n, s, cRe, cIm, FORMULA_TRICORN, degree, max, iterations);
+            break;
+        default:
+            escapeTimeFormulaMP(n, s, cRe, cIm, FORMULA_MANDELBROT, degree, max, iterations);
+            break;
     }
 }
-#endif
 
 
-/* Perform Julia set function */
-static complex julia(unsigned long *n, complex z, complex c, unsigned long max)
+/* Iterate the formula until z escapes or is found to be periodic
+ * (multiple-precision). With z = x + yi, each iteration takes the squares x^2,
+ * y^2 and (x + y)^2, which give both the next value,
+ *
+ *   z^2 = (x^2 - y^2) + ((x + y)^2 - x^2 - y^2)i
+ *
+ * and, once updated, the squared magnitude tested for escape. The Burning Ship
+ * takes |x| and |y| first, which leaves the squares unchanged, and the Tricorn
+ * negates the imaginary part. The squared magnitude of the final value is left
+ * in `norm`
+ */
+static inline __attribute__ ((always_inline)) void escapeTimeFormulaMP(unsigned long *n, ScratchMP *s,
+                                                                      const mpfr_t cRe, const mpfr_t cIm,
+                                                                      Formula formula, unsigned int degree,
+                                                                      unsigned long max, uintmax_t *iterations)
 {
-    for (*n = 0; cabs(z) < ESCAPE_RADIUS && *n < max; ++(*n))
-        z = z * z + c;
+    unsigned long period = 0;
+    unsigned long limit = 1;
 
-    return z;
-}
+    mpfr_set(s->savedRe, s->zRe, MP_REAL_RND);
+    mpfr_set(s->savedIm, s->zIm, MP_IMAG_RND);
 
+    mpfr_sqr(s->zReSqr, s->zRe, MP_REAL_RND);
+    mpfr_sqr(s->zImSqr, s->zIm, MP_IMAG_RND);
+    mpfr_add(s->norm, s->zReSqr, s->zImSqr, MP_REAL_RND);
 
-/* Perform Julia set function (extended-precision) */
-static long double complex juliaExt(unsigned long *n, long double complex z, long double complex c, unsigned long max)
-{
-    for (*n = 0; cabsl(z) < ESCAPE_RADIUS && *n < max; ++(*n))
-        z = z * z + c;
+    for (*n = 0; mpfr_cmp_d(s->norm, ESCAPE_RADIUS_MP * ESCAPE_RADIUS_MP) < 0 && *n < max; ++(*n))
+    {
+        if (formula == FORMULA_MULTIBROT)
+        {
+            powerMP(s, degree);
 
-    return z;
+            mpfr_add(s->zRe, s->powRe, cRe, MP_REAL_RND);
+            mpfr_add(s->zIm, s->powIm, cIm, MP_IMAG_RND);
+        }
+        else
+        {
+            if (formula == FORMULA_BURNING_SHIP)
+            {
+                mpfr_abs(s->zRe, s->zRe, MP_REAL_RND);
+                mpfr_abs(s->zIm, s->zIm, MP_IMAG_RND);
+            }
+
+            /* Imaginary part first, as it needs the old real part */
+            mpfr_add(s->zIm, s->zRe, s->zIm, MP_IMAG_RND);
+            mpfr_sqr(s->zIm, s->zIm, MP_IMAG_RND);
+
+            if (formula == FORMULA_TRICORN)
+                mpfr_sub(s->zIm, s->norm, s->zIm, MP_IMAG_RND);
+            else
+                mpfr_sub(s->zIm, s->zIm, s->norm, MP_IMAG_RND);
+
+            mpfr_add(s->zIm, s->zIm, cIm, MP_IMAG_RND);
+
+            mpfr_sub(s->zRe, s->zReSqr, s->zImSqr, MP_REAL_RND);
+            mpfr_add(s->zRe, s->zRe, cRe, MP_REAL_RND);
+        }
+
+        mpfr_sqr(s->zReSqr, s->zRe, MP_REAL_RND);
+        mpfr_sqr(s->zImSqr, s->zIm, MP_IMAG_RND);
+        mpfr_add(s->norm, s->zReSqr, s->zImSqr, MP_REAL_RND);
+
+        if (mpfr_equal_p(s->zRe, s->savedRe) && mpfr_equal_p(s->zIm, s->savedIm))
+        {
+            *iterations += *n + 1;
+            *n = max;
+            return;
+        }
+
+        if (++period == limit)
+        {
+            mpfr_set(s->savedRe, s->zRe, MP_REAL_RND);
+            mpfr_set(s->savedIm, s->zIm, MP_IMAG_RND);
+            period = 0;
+            limit *= 2;
+        }
+    }
+
+    *iterations += *n;
 }
 
 
-#ifdef MP_PREC
-/* Perform Julia set function (multiple-precision) */
-static void juliaMP(unsigned long *n, mpc_t z, mpfr_t norm, mpc_t c, unsigned long max)
+/* Raise z to the power d into `powRe` and `powIm`, starting from z^2 as in
+ * escapeTimeFormulaMP(). The squares of z are free to hold the products, as
+ * they are taken again once z is updated
+ */
+static void powerMP(ScratchMP *s, unsigned int degree)
 {
-    mpc_norm(norm, z, MP_REAL_RND);
-    
-    for (*n = 0; mpfr_cmp_d(norm, ESCAPE_RADIUS * ESCAPE_RADIUS) < 0 && *n < max; ++(*n))
+    mpfr_sub(s->powRe, s->zReSqr, s->zImSqr, MP_REAL_RND);
+    mpfr_add(s->powIm, s->zRe, s->zIm, MP_IMAG_RND);
+    mpfr_sqr(s->powIm, s->powIm, MP_IMAG_RND);
+    mpfr_sub(s->powIm, s->powIm, s->norm, MP_IMAG_RND);
+
+    for (unsigned int d = 2; d < degree; ++d)
     {
-        mpc_sqr(z, z, MP_COMPLEX_RND);
-        mpc_add(z, z, c, MP_COMPLEX_RND);
-        mpc_norm(norm, z, MP_REAL_RND);
+        mpfr_mul(s->zReSqr, s->powRe, s->zRe, MP_REAL_RND);
+        mpfr_mul(s->zImSqr, s->powIm, s->zIm, MP_REAL_RND);
+
+        mpfr_mul(s->powRe, s->powRe, s->zIm, MP_IMAG_RND);
+        mpfr_mul(s->powIm, s->powIm, s->zRe, MP_IMAG_RND);
+        mpfr_add(s->powIm, s->powRe, s->powIm, MP_IMAG_RND);
+
+        mpfr_sub(s->powRe, s->zReSqr, s->zImSqr, MP_REAL_RND);
     }
 }
 #endif
\ No newline at end of file
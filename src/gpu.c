@@ -0,0 +1,679 @@
+#include <complex.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libgroot/include/log.h"
+
+#include "gpu.h"
+
+#include "double_double.h"
+#include "mandelbrot_parameters.h"
+#include "parameters.h"
+
+
+/* Minimum/maximum index of the device to plot on, counted across platforms */
+const unsigned int GPU_DEVICE_MIN = 0;
+const unsigned int GPU_DEVICE_MAX = 255;
+
+
+#ifdef OPENCL
+#define GPU_PLATFORMS_MAX 16
+#define GPU_DEVICES_MAX 64
+#define GPU_OPTIONS_LEN_MAX 512
+#define GPU_BUILD_LOG_LEN_MAX 4096
+
+
+/* Escape-time kernels, in OpenCL C. The plot type, precision and formula are
+ * fixed by the build options, so each plot gets a program with a single loop.
+ * The loops follow those of simd.c and double_double.c step for step, so the
+ * GPU finds the same iteration counts as the processor. Pixels given the
+ * maximum count without running that far (in the main or secondary bulb, or
+ * found to be periodic) write the iterations they did run to `run`. The source
+ * is split to keep each string within the length a compiler must accept
+ */
+static const char *KERNEL_SOURCE[] =
+{
+    "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n"
+    "\n"
+    "#define CHECK_INTERVAL 8\n"
+    "\n"
+    "#if !DOUBLE_DOUBLE\n"
+    "__kernel void escapeTime(__global const double2 *c, __global ulong *n, __global double2 *z,\n"
+    "                         __global ulong *run, const double4 juliaConstant, const ulong nMax)\n"
+    "{\n"
+    "    size_t i = get_global_id(0);\n"
+    "    double re = c[i].x, im = c[i].y;\n"
+    "    double cdot = re * re + im * im;\n"
+    "    double zr, zi, cr, ci, sr, si;\n"
+    "    ulong k = 0, checks = 0, limit = 1;\n"
+    "\n"
+    "#if JULIA\n"
+    "    if (cdot >= ESCAPE_RADIUS_SQR || nMax == 0) {\n"
+    "        n[i] = 0; run[i] = 0; z[i].x = re; z[i].y = im; return;\n"
+    "    }\n"
+    "\n"
+    "    zr = re; zi = im; cr = juliaConstant.x; ci = juliaConstant.z;\n"
+    "#else\n"
+    "#if FORMULA == FORMULA_MANDELBROT\n"
+    "    if (256.0 * cdot * cdot - 96.0 * cdot + 32.0 * re - 3.0 < 0.0\n"
+    "        || 16.0 * (cdot + 2.0 * re + 1.0) - 1.0 < 0.0) {\n"
+    "        n[i] = nMax; run[i] = 0; z[i].x = 0.0; z[i].y = 0.0; return;\n"
+    "    }\n"
+    "#endif\n"
+    "\n"
+    "    zr = 0.0; zi = 0.0; cr = re; ci = im;\n"
+    "#endif\n"
+    "\n"
+    "    sr = zr; si = zi;\n"
+    "\n"
+    "    for (;;) {\n"
+    "        for (int j = 0; j < CHECK_INTERVAL; ++j) {\n"
+    "            double zr2 = zr * zr, zi2 = zi * zi;\n"
+    "\n"
+    "            if (zr2 + zi2 >= ESCAPE_RADIUS_SQR || k >= nMax)\n"
+    "                break;\n"
+    "\n"
+    "#if FORMULA == FORMULA_MULTIBROT\n"
+    "            double pr = zr2 - zi2, pi = 2.0 * zr * zi;\n"
+    "\n"
+    "            for (int d = 2; d < DEGREE; ++d) {\n"
+    "                double t = pr * zr - pi * zi;\n"
+    "                pi = pr * zi + pi * zr;\n"
+    "                pr = t;\n"
+    "            }\n"
+    "\n"
+    "            zr = pr + cr; zi = pi + ci;\n"
+    "#elif FORMULA == FORMULA_BURNING_SHIP\n"
+    "            zi = fabs(2.0 * zr * zi) + ci; zr = zr2 - zi2 + cr;\n"
+    "#elif FORMULA == FORMULA_TRICORN\n"
+    "            zi = ci - 2.0 * zr * zi; zr = zr2 - zi2 + cr;\n"
+    "#else\n"
+    "            zi = 2.0 * zr * zi + ci; zr = zr2 - zi2 + cr;\n"
+    "#endif\n"
+    "\n"
+    "            ++k;\n"
+    "        }\n"
+    "\n"
+    "        if (zr * zr + zi * zi >= ESCAPE_RADIUS_SQR || k >= nMax)\n"
+    "            break;\n"
+    "\n"
+    "        /* Brent's method, as in simd_kernel.h */\n"
+    "        if (zr == sr && zi == si) {\n"
+    "            n[i] = nMax; run[i] = k; z[i].x = zr; z[i].y = zi; return;\n"
+    "        }\n"
+    "\n"
+    "        if (++checks >= limit) {\n"
+    "            sr = zr; si = zi; limit *= 2; checks = 0;\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    n[i] = k; run[i] = k; z[i].x = zr; z[i].y = zi;\n"
+    "}\n"
+    "#endif\n",
+
+    "#if DOUBLE_DOUBLE\n"
+    "#pragma OPENCL FP_CONTRACT OFF\n"
+    "\n"
+    "typedef struct DoubleDouble { double hi, lo; } DoubleDouble;\n"
+    "\n"
+    "DoubleDouble quickTwoSum(double a, double b) {\n"
+    "    DoubleDouble r; r.hi = a + b; r.lo = b - (r.hi - a); return r;\n"
+    "}\n"
+    "\n"
+    "DoubleDouble twoSum(double a, double b) {\n"
+    "    DoubleDouble r; double v;\n"
+    "    r.hi = a + b; v = r.hi - a; r.lo = (a - (r.hi - v)) + (b - v); return r;\n"
+    "}\n"
+    "\n"
+    "DoubleDouble twoProduct(double a, double b) {\n"
+    "    DoubleDouble r; r.hi = a * b; r.lo = fma(a, b, -r.hi); return r;\n"
+    "}\n"
+    "\n"
+    "DoubleDouble ddAdd(DoubleDouble a, DoubleDouble b) {\n"
+    "    DoubleDouble s = twoSum(a.hi, b.hi), t = twoSum(a.lo, b.lo);\n"
+    "    s = quickTwoSum(s.hi, s.lo + t.hi);\n"
+    "    return quickTwoSum(s.hi, s.lo + t.lo);\n"
+    "}\n"
+    "\n"
+    "DoubleDouble ddSub(DoubleDouble a, DoubleDouble b) {\n"
+    "    b.hi = -b.hi; b.lo = -b.lo; return ddAdd(a, b);\n"
+    "}\n"
+    "\n"
+    "DoubleDouble ddMul(DoubleDouble a, DoubleDouble b) {\n"
+    "    DoubleDouble p = twoProduct(a.hi, b.hi);\n"
+    "    return quickTwoSum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));\n"
+    "}\n"
+    "\n"
+    "DoubleDouble ddSqr(DoubleDouble a) {\n"
+    "    DoubleDouble p = twoProduct(a.hi, a.hi);\n"
+    "    return quickTwoSum(p.hi, p.lo + 2.0 * a.hi * a.lo);\n"
+    "}\n"
+    "\n"
+    "__kernel void escapeTime(__global const double4 *c, __global ulong *n, __global double2 *z,\n"
+    "                         __global ulong *run, const double4 juliaConstant, const ulong nMax)\n"
+    "{\n"
+    "    size_t i = get_global_id(0);\n"
+    "    double4 p = c[i];\n"
+    "    double cdot = p.x * p.x + p.z * p.z;\n"
+    "    DoubleDouble zr, zi, cr, ci, sr, si;\n"
+    "    ulong k = 0, checks = 0, limit = 1;\n"
+    "\n"
+    "#if JULIA\n"
+    "    if (cdot >= ESCAPE_RADIUS_SQR || nMax == 0) {\n"
+    "        n[i] = 0; run[i] = 0; z[i].x = p.x; z[i].y = p.z; return;\n"
+    "    }\n"
+    "\n"
+    "    zr.hi = p.x; zr.lo = p.y; zi.hi = p.z; zi.lo = p.w;\n"
+    "    cr.hi = juliaConstant.x; cr.lo = juliaConstant.y; ci.hi = juliaConstant.z; ci.lo = juliaConstant.w;\n"
+    "#else\n"
+    "#if FORMULA == FORMULA_MANDELBROT\n"
+    "    if (256.0 * cdot * cdot - 96.0 * cdot + 32.0 * p.x - 3.0 < 0.0\n"
+    "        || 16.0 * (cdot + 2.0 * p.x + 1.0) - 1.0 < 0.0) {\n"
+    "        n[i] = nMax; run[i] = 0; z[i].x = 0.0; z[i].y = 0.0; return;\n"
+    "    }\n"
+    "#endif\n"
+    "\n"
+    "    zr.hi = 0.0; zr.lo = 0.0; zi.hi = 0.0; zi.lo = 0.0;\n"
+    "    cr.hi = p.x; cr.lo = p.y; ci.hi = p.z; ci.lo = p.w;\n"
+    "#endif\n"
+    "\n"
+    "    sr = zr; si = zi;\n"
+    "\n"
+    "    /* The escape test only needs the leading halves */\n"
+    "    while (zr.hi * zr.hi + zi.hi * zi.hi < ESCAPE_RADIUS_SQR && k < nMax) {\n"
+    "        DoubleDouble zr2 = ddSqr(zr), zi2 = ddSqr(zi), zri = ddMul(zr, zi);\n"
+    "\n"
+    "        zri.hi *= 2.0; zri.lo *= 2.0;\n"
+    "\n"
+    "#if FORMULA == FORMULA_MULTIBROT\n"
+    "        DoubleDouble pr = ddSub(zr2, zi2), pi = zri;\n"
+    "\n"
+    "        for (int d = 2; d < DEGREE; ++d) {\n"
+    "            DoubleDouble t = ddSub(ddMul(pr, zr), ddMul(pi, zi));\n"
+    "            pi = ddAdd(ddMul(pr, zi), ddMul(pi, zr));\n"
+    "            pr = t;\n"
+    "        }\n"
+    "\n"
+    "        zr = ddAdd(pr, cr); zi = ddAdd(pi, ci);\n"
+    "#elif FORMULA == FORMULA_BURNING_SHIP\n"
+    "        zri.lo = (zri.hi < 0.0) ? -zri.lo : zri.lo;\n"
+    "        zri.hi = fabs(zri.hi);\n"
+    "        zr = ddAdd(ddSub(zr2, zi2), cr); zi = ddAdd(zri, ci);\n"
+    "#elif FORMULA == FORMULA_TRICORN\n"
+    "        zr = ddAdd(ddSub(zr2, zi2), cr); zi = ddSub(ci, zri);\n"
+    "#else\n"
+    "        zr = ddAdd(ddSub(zr2, zi2), cr); zi = ddAdd(zri, ci);\n"
+    "#endif\n"
+    "\n"
+    "        ++k;\n"
+    "\n"
+    "        /* Brent's method, as in double_double.c */\n"
+    "        if (zr.hi == sr.hi && zr.lo == sr.lo && zi.hi == si.hi && zi.lo == si.lo) {\n"
+    "            n[i] = nMax; run[i] = k; z[i].x = zr.hi; z[i].y = zi.hi; return;\n"
+    "        }\n"
+    "\n"
+    "        if (checks + 1 == limit) {\n"
+    "            sr = zr; si = zi; limit *= 2; checks = 0;\n"
+    "        } else {\n"
+    "            ++checks;\n"
+    "        }\n"
+    "    }\n"
+    "\n"
+    "    n[i] = k; run[i] = k; z[i].x = zr.hi; z[i].y = zi.hi;\n"
+    "}\n"
+    "#endif\n"
+};
+
+
+static int findDevice(GPU *gpu, unsigned int device);
+static int buildProgram(GPU *gpu, const PlotCTX *p);
+static size_t getPixelSize(PrecisionMode precision);
+
+
+GPU * createGPU(void)
+{
+    GPU *gpu = malloc(sizeof(*gpu));
+
+    if (gpu)
+    {
+        gpu->context = NULL;
+        gpu->queue = NULL;
+        gpu->device = NULL;
+        gpu->program = NULL;
+        gpu->kernel = NULL;
+        gpu->c = gpu->n = gpu->z = gpu->run = NULL;
+        gpu->cMap = gpu->nMap = gpu->zMap = NULL;
+        gpu->rate = 0.0;
+        gpu->name[0] = '\0';
+    }
+
+    return gpu;
+}
+
+
+/* Open a device, counted across every platform, and allocate its buffers.
+ * The device must support double precision
+ */
+int initialiseGPU(GPU *gpu, unsigned int device)
+{
+    cl_int err;
+    cl_device_fp_config fp64 = 0;
+
+    if (!gpu)
+        return 1;
+
+    /* Results are read straight into the arrays the colouring functions take */
+    if (sizeof(unsigned long) != sizeof(cl_ulong) || sizeof(complex) != 2 * sizeof(cl_double))
+    {
+        logMessage(ERROR, "Host types do not match the device types of the GPU kernels");
+        return 1;
+    }
+
+    if (findDevice(gpu, device))
+        return 1;
+
+    if (clGetDeviceInfo(gpu->device, CL_DEVICE_NAME, sizeof(gpu->name), gpu->name, NULL) != CL_SUCCESS)
+        strcpy(gpu->name, "unknown");
+
+    gpu->name[sizeof(gpu->name) - 1] = '\0';
+
+    if (clGetDeviceInfo(gpu->device, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(fp64), &fp64, NULL) != CL_SUCCESS
+        || !fp64)
+    {
+        logMessage(ERROR, "GPU %u (%s) does not support double precision", device, gpu->name);
+        return 1;
+    }
+
+    gpu->context = clCreateContext(NULL, 1, &(gpu->device), NULL, NULL, &err);
+
+    if (err != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not create an OpenCL context on GPU %u (error %d)", device, (int) err);
+        return 1;
+    }
+
+    gpu->queue = clCreateCommandQueue(gpu->context, gpu->device, 0, &err);
+
+    if (err != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not create an OpenCL command queue on GPU %u (error %d)", device, (int) err);
+        return 1;
+    }
+
+    /* Pinned buffers, large enough for a batch at the widest precision */
+    gpu->c = clCreateBuffer(gpu->context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                            GPU_BATCH_LEN * getPixelSize(DD_PRECISION), NULL, &err);
+
+    if (err == CL_SUCCESS)
+    {
+        gpu->n = clCreateBuffer(gpu->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                                GPU_BATCH_LEN * sizeof(cl_ulong), NULL, &err);
+    }
+
+    if (err == CL_SUCCESS)
+    {
+        gpu->z = clCreateBuffer(gpu->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                                GPU_BATCH_LEN * 2 * sizeof(cl_double), NULL, &err);
+    }
+
+    if (err == CL_SUCCESS)
+    {
+        gpu->run = clCreateBuffer(gpu->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR,
+                                  GPU_BATCH_LEN * sizeof(cl_ulong), NULL, &err);
+    }
+
+    if (err != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not allocate buffers on GPU %u (error %d)", device, (int) err);
+        return 1;
+    }
+
+    logMessage(DEBUG, "GPU %u (%s) initialised", device, gpu->name);
+
+    return 0;
+}
+
+
+/* Open a device to plot alongside the processor threads, with its program
+ * built for the plot. Returns NULL, leaving the plot to the processor, if the
+ * plot cannot be run on a GPU or the device could not be opened
+ */
+GPU * openGPU(const PlotCTX *p, unsigned int device)
+{
+    GPU *gpu;
+
+    if (p->precision != STD_PRECISION && p->precision != DD_PRECISION)
+    {
+        logMessage(WARNING, "The GPU only plots at standard and double-double precision - plotting on the "
+                            "processor alone");
+        return NULL;
+    }
+
+    gpu = createGPU();
+
+    if (!gpu || initialiseGPU(gpu, device) || setGPUPlot(gpu, p))
+    {
+        logMessage(WARNING, "GPU %u could not be used - plotting on the processor alone", device);
+        freeGPU(gpu);
+        return NULL;
+    }
+
+    logMessage(INFO, "Plotting on GPU %u (%s) alongside the processor threads", device, gpu->name);
+
+    return gpu;
+}
+
+
+/* Prepare the device for the plot. The program is only rebuilt when the plot
+ * type, precision or formula change, as for each frame of a sequence they do not
+ */
+int setGPUPlot(GPU *gpu, const PlotCTX *p)
+{
+    cl_double4 constant;
+    cl_ulong max = p->iterations;
+    cl_int err;
+
+    if (!gpu->program || gpu->precision != p->precision || gpu->type != p->type || gpu->formula != p->formula
+        || gpu->degree != p->degree)
+    {
+        if (buildProgram(gpu, p))
+            return 1;
+    }
+
+    if (p->precision == DD_PRECISION)
+    {
+        constant.s[0] = p->c.dd.re.hi;
+        constant.s[1] = p->c.dd.re.lo;
+        constant.s[2] = p->c.dd.im.hi;
+        constant.s[3] = p->c.dd.im.lo;
+    }
+    else
+    {
+        constant.s[0] = creal(p->c.c);
+        constant.s[1] = 0.0;
+        constant.s[2] = cimag(p->c.c);
+        constant.s[3] = 0.0;
+    }
+
+    err = clSetKernelArg(gpu->kernel, 0, sizeof(gpu->c), &(gpu->c));
+    err |= clSetKernelArg(gpu->kernel, 1, sizeof(gpu->n), &(gpu->n));
+    err |= clSetKernelArg(gpu->kernel, 2, sizeof(gpu->z), &(gpu->z));
+    err |= clSetKernelArg(gpu->kernel, 3, sizeof(gpu->run), &(gpu->run));
+    err |= clSetKernelArg(gpu->kernel, 4, sizeof(constant), &constant);
+    err |= clSetKernelArg(gpu->kernel, 5, sizeof(max), &max);
+
+    if (err != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not set the arguments of the GPU kernel");
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/* Map the pixel buffer for the host to write up to GPU_BATCH_LEN values of c
+ * into, as complex or ComplexDD by the precision of the plot
+ */
+void * mapGPUPixels(GPU *gpu)
+{
+    cl_int err;
+
+    gpu->cMap = clEnqueueMapBuffer(gpu->queue, gpu->c, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0,
+                                   GPU_BATCH_LEN * getPixelSize(gpu->precision), 0, NULL, NULL, &err);
+
+    if (err != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not map the pixel buffer of the GPU (error %d)", (int) err);
+        gpu->cMap = NULL;
+    }
+
+    return gpu->cMap;
+}
+
+
+/* Iterate the first `count` pixels written to the pixel buffer, and map the
+ * iteration counts and final values for the host to read, adding the
+ * iterations run to `iterations`. The results must be unmapped with
+ * unmapGPUResults() before the pixel buffer is mapped again
+ */
+int runGPU(GPU *gpu, size_t count, const unsigned long **n, const complex **z, uintmax_t *iterations)
+{
+    cl_ulong *run;
+    cl_int err;
+
+    err = clEnqueueUnmapMemObject(gpu->queue, gpu->c, gpu->cMap, 0, NULL, NULL);
+    gpu->cMap = NULL;
+
+    if (err != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not unmap the pixel buffer of the GPU (error %d)", (int) err);
+        return 1;
+    }
+
+    err = clEnqueueNDRangeKernel(gpu->queue, gpu->kernel, 1, NULL, &count, NULL, 0, NULL, NULL);
+
+    if (err != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not run the GPU kernel (error %d)", (int) err);
+        return 1;
+    }
+
+    /* Blocking maps wait for the kernel, as the queue runs in order */
+    gpu->nMap = clEnqueueMapBuffer(gpu->queue, gpu->n, CL_TRUE, CL_MAP_READ, 0, count * sizeof(cl_ulong),
+                                   0, NULL, NULL, &err);
+
+    if (err == CL_SUCCESS)
+    {
+        gpu->zMap = clEnqueueMapBuffer(gpu->queue, gpu->z, CL_TRUE, CL_MAP_READ, 0, count * 2 * sizeof(cl_double),
+                                       0, NULL, NULL, &err);
+    }
+
+    if (err != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not read the results of the GPU kernel (error %d)", (int) err);
+        return 1;
+    }
+
+    /* Only the total of the iterations run is needed */
+    run = clEnqueueMapBuffer(gpu->queue, gpu->run, CL_TRUE, CL_MAP_READ, 0, count * sizeof(cl_ulong),
+                             0, NULL, NULL, &err);
+
+    if (err != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not read the results of the GPU kernel (error %d)", (int) err);
+        return 1;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        *iterations += run[i];
+
+    if (clEnqueueUnmapMemObject(gpu->queue, gpu->run, run, 0, NULL, NULL) != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not unmap the result buffers of the GPU");
+        return 1;
+    }
+
+    *n = gpu->nMap;
+    *z = gpu->zMap;
+
+    return 0;
+}
+
+
+int unmapGPUResults(GPU *gpu)
+{
+    cl_int err = CL_SUCCESS;
+
+    if (gpu->nMap)
+        err |= clEnqueueUnmapMemObject(gpu->queue, gpu->n, gpu->nMap, 0, NULL, NULL);
+
+    if (gpu->zMap)
+        err |= clEnqueueUnmapMemObject(gpu->queue, gpu->z, gpu->zMap, 0, NULL, NULL);
+
+    gpu->nMap = gpu->zMap = NULL;
+
+    if (err != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not unmap the result buffers of the GPU");
+        return 1;
+    }
+
+    return 0;
+}
+
+
+void freeGPU(GPU *gpu)
+{
+    if (!gpu)
+        return;
+
+    if (gpu->queue)
+    {
+        if (gpu->cMap)
+            clEnqueueUnmapMemObject(gpu->queue, gpu->c, gpu->cMap, 0, NULL, NULL);
+
+        unmapGPUResults(gpu);
+        clFinish(gpu->queue);
+    }
+
+    if (gpu->c)
+        clReleaseMemObject(gpu->c);
+
+    if (gpu->n)
+        clReleaseMemObject(gpu->n);
+
+    if (gpu->z)
+        clReleaseMemObject(gpu->z);
+
+    if (gpu->run)
+        clReleaseMemObject(gpu->run);
+
+    if (gpu->kernel)
+        clReleaseKernel(gpu->kernel);
+
+    if (gpu->program)
+        clReleaseProgram(gpu->program);
+
+    if (gpu->queue)
+        clReleaseCommandQueue(gpu->queue);
+
+    if (gpu->context)
+        clReleaseContext(gpu->context);
+
+    free(gpu);
+}
+
+
+/* Find the device at an index counted across the devices of every platform */
+static int findDevice(GPU *gpu, unsigned int device)
+{
+    cl_platform_id platforms[GPU_PLATFORMS_MAX];
+    cl_uint platformCount;
+    unsigned int index = 0;
+
+    if (clGetPlatformIDs(GPU_PLATFORMS_MAX, platforms, &platformCount) != CL_SUCCESS || platformCount == 0)
+    {
+        logMessage(ERROR, "No OpenCL platforms found");
+        return 1;
+    }
+
+    if (platformCount > GPU_PLATFORMS_MAX)
+        platformCount = GPU_PLATFORMS_MAX;
+
+    for (cl_uint i = 0; i < platformCount; ++i)
+    {
+        cl_device_id devices[GPU_DEVICES_MAX];
+        cl_uint deviceCount;
+
+        if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, GPU_DEVICES_MAX, devices, &deviceCount) != CL_SUCCESS)
+            continue;
+
+        if (deviceCount > GPU_DEVICES_MAX)
+            deviceCount = GPU_DEVICES_MAX;
+
+        if (device < index + deviceCount)
+        {
+            gpu->device = devices[device - index];
+            return 0;
+        }
+
+        index += deviceCount;
+    }
+
+    logMessage(ERROR, "No OpenCL device %u (%u found)", device, index);
+
+    return 1;
+}
+
+
+/* Build the program of the plot's type, precision and formula */
+static int buildProgram(GPU *gpu, const PlotCTX *p)
+{
+    char options[GPU_OPTIONS_LEN_MAX];
+    cl_int err;
+
+    if (gpu->kernel)
+        clReleaseKernel(gpu->kernel);
+
+    if (gpu->program)
+        clReleaseProgram(gpu->program);
+
+    gpu->kernel = NULL;
+    gpu->program = NULL;
+
+    snprintf(options, sizeof(options),
+             "-D JULIA=%d -D DOUBLE_DOUBLE=%d -D FORMULA=%d -D DEGREE=%u -D ESCAPE_RADIUS_SQR=%.17g "
+             "-D FORMULA_MANDELBROT=%d -D FORMULA_MULTIBROT=%d -D FORMULA_BURNING_SHIP=%d -D FORMULA_TRICORN=%d",
+             p->type == PLOT_JULIA, p->precision == DD_PRECISION, (int) p->formula, p->degree, ESCAPE_RADIUS_SQR,
+             FORMULA_MANDELBROT, FORMULA_MULTIBROT, FORMULA_BURNING_SHIP, FORMULA_TRICORN);
+
+    gpu->program = clCreateProgramWithSource(gpu->context, sizeof(KERNEL_SOURCE) / sizeof(KERNEL_SOURCE[0]),
+                                             KERNEL_SOURCE, NULL, &err);
+
+    if (err != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not create the GPU program (error %d)", (int) err);
+        return 1;
+    }
+
+    logMessage(DEBUG, "Building GPU program with options: %s", options);
+
+    if (clBuildProgram(gpu->program, 1, &(gpu->device), options, NULL, NULL) != CL_SUCCESS)
+    {
+        char buildLog[GPU_BUILD_LOG_LEN_MAX] = "";
+
+        clGetProgramBuildInfo(gpu->program, gpu->device, CL_PROGRAM_BUILD_LOG, sizeof(buildLog), buildLog, NULL);
+        buildLog[sizeof(buildLog) - 1] = '\0';
+
+        logMessage(ERROR, "Could not build the GPU program:\n%s", buildLog);
+        return 1;
+    }
+
+    gpu->kernel = clCreateKernel(gpu->program, "escapeTime", &err);
+
+    if (err != CL_SUCCESS)
+    {
+        logMessage(ERROR, "Could not create the GPU kernel (error %d)", (int) err);
+        return 1;
+    }
+
+    gpu->precision = p->precision;
+    gpu->type = p->type;
+    gpu->formula = p->formula;
+    gpu->degree = p->degree;
+
+    return 0;
+}
+
+
+/* Size of the value of c the host writes for each pixel */
+static size_t getPixelSize(PrecisionMode precision)
+{
+    return (precision == DD_PRECISION) ? sizeof(ComplexDD) : sizeof(complex);
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "libgroot/include/log.h"
+
+#include "heartbeat.h"
+
+#include "network_ctx.h"
+#include "request_handler.h"
+
+
+static void * heartbeatThread(void *heartbeatInfo);
+
+
+/* Create a heartbeat. The thread is started by initialiseHeartbeat(). Its
+ * interval is timed on the monotonic clock, so is not thrown by changes to
+ * the time of day
+ */
+Heartbeat * createHeartbeat(void)
+{
+    pthread_condattr_t attr;
+    Heartbeat *heartbeat = malloc(sizeof(*heartbeat));
+
+    if (!heartbeat)
+        return NULL;
+
+    if (pthread_mutex_init(&(heartbeat->mutex), NULL))
+    {
+        free(heartbeat);
+        return NULL;
+    }
+
+    if (pthread_condattr_init(&attr))
+    {
+        pthread_mutex_destroy(&(heartbeat->mutex));
+        free(heartbeat);
+        return NULL;
+    }
+
+    if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) || pthread_cond_init(&(heartbeat->stopped), &attr))
+    {
+        pthread_condattr_destroy(&attr);
+        pthread_mutex_destroy(&(heartbeat->mutex));
+        free(heartbeat);
+        return NULL;
+    }
+
+    pthread_condattr_destroy(&attr);
+
+    heartbeat->network = NULL;
+    heartbeat->running = false;
+    heartbeat->shutdown = false;
+
+    return heartbeat;
+}
+
+
+/* Start the heartbeat thread */
+int initialiseHeartbeat(Heartbeat *heartbeat, NetworkCTX *network)
+{
+    if (!heartbeat)
+        return 1;
+
+    heartbeat->network = network;
+
+    if (pthread_create(&(heartbeat->pid), NULL, heartbeatThread, heartbeat))
+    {
+        logMessage(ERROR, "Heartbeat thread could not be created");
+        return 1;
+    }
+
+    heartbeat->running = true;
+
+    return 0;
+}
+
+
+/* Stop the heartbeat thread and free it */
+void freeHeartbeat(Heartbeat *heartbeat)
+{
+    if (heartbeat)
+    {
+        if (heartbeat->running)
+        {
+            pthread_mutex_lock(&(heartbeat->mutex));
+            heartbeat->shutdown = true;
+            pthread_cond_signal(&(heartbeat->stopped));
+            pthread_mutex_unlock(&(heartbeat->mutex));
+
+            if (pthread_join(heartbeat->pid, NULL))
+                logMessage(WARNING, "Heartbeat thread could not be harvested");
+        }
+
+        pthread_cond_destroy(&(heartbeat->stopped));
+        pthread_mutex_destroy(&(heartbeat->mutex));
+    }
+
+    free(heartbeat);
+}
+
+
+/* Body of the heartbeat thread - send a heartbeat each interval until
+ * shutdown. The interval is the master's once the worker has joined, and is
+ * read under the send lock, which a worker rejoining its master holds. A
+ * failed heartbeat is left to the plotting thread to notice, as the
+ * connection is its to replace
+ */
+static void * heartbeatThread(void *heartbeatInfo)
+{
+    Heartbeat *heartbeat = heartbeatInfo;
+    NetworkCTX *network = heartbeat->network;
+
+    struct timespec next;
+    unsigned int interval;
+
+    pthread_mutex_lock(&(network->send));
+    interval = network->heartbeat;
+    pthread_mutex_unlock(&(network->send));
+
+    pthread_mutex_lock(&(heartbeat->mutex));
+
+    while (!heartbeat->shutdown)
+    {
+        /* Timed from now rather than the last deadline, so that heartbeats
+         * missed while the process was stopped are not all sent at once
+         */
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        next.tv_sec += (time_t) interval;
+
+        while (!heartbeat->shutdown
+               && pthread_cond_timedwait(&(heartbeat->stopped), &(heartbeat->mutex), &next) == 0)
+        {
+            continue;
+        }
+
+        if (heartbeat->shutdown)
+            break;
+
+        pthread_mutex_unlock(&(heartbeat->mutex));
+        pthread_mutex_lock(&(network->send));
+
+        if (network->fds[0].fd >= 0 && sendHeartbeat(network, 0))
+            logMessage(DEBUG, "Could not send heartbeat to master");
+
+        interval = network->heartbeat;
+
+        pthread_mutex_unlock(&(network->send));
+        pthread_mutex_lock(&(heartbeat->mutex));
+    }
+
+    pthread_mutex_unlock(&(heartbeat->mutex));
+
+    return NULL;
+}
@@ -1,9 +1,12 @@
+#include <limits.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <pthread.h>
+#include <sys/types.h>
 #include <unistd.h>
 
 #include "libgroot/include/log.h"
@@ -11,17 +14,35 @@
 
 #include "image.h"
 
+#include "anti_alias.h"
 #include "array.h"
+#include "block_writer.h"
+#include "checkpoint.h"
 #include "connection_handler.h"
 #include "ext_precision.h"
+#include "frame_reuse.h"
 #include "function.h"
+#include "gpu.h"
+#include "heartbeat.h"
 #include "network_ctx.h"
 #include "parameters.h"
+#include "perturbation.h"
+#include "png.h"
+#include "pyramid.h"
 #include "program_ctx.h"
+#include "raw.h"
+#include "report.h"
 #include "request_handler.h"
+#include "sequence.h"
+#include "stats.h"
+#include "subdivide.h"
+#include "symmetry.h"
 
 
-#define IMAGE_HEADER_LEN_MAX 128
+#define IMAGE_HEADER_LEN_MAX RAW_HEADER_LEN
+
+/* Memory used to recolour a raw image, unless limited otherwise */
+#define RECOLOUR_MEMORY_DEFAULT ((size_t) 64 << 20)
 
 
 /* Minimum/maximum memory limit values */
@@ -32,16 +53,51 @@ const size_t MEMORY_MAX = SIZE_MAX;
 const unsigned int THREAD_COUNT_MIN = 1;
 const unsigned int THREAD_COUNT_MAX = 512;
 
+/* Minimum/maximum dimensions of a unit of work (0 selects the default) */
+const size_t TILE_WIDTH_MIN = 0;
+const size_t TILE_WIDTH_MAX = SIZE_MAX;
+const size_t TILE_HEIGHT_MIN = 0;
+const size_t TILE_HEIGHT_MAX = SIZE_MAX;
+
+
+static int getImageHeader(unsigned char *dest, size_t *len, const PlotCTX *p, size_t n);
+static int initialiseImageBlock(Block *block, PlotCTX *p, const ProgramCTX *ctx, size_t reserve);
+static FrameReuse * openFrameReuse(const Block *block, const Sequence *sequence);
+static AntiAlias * openAntiAlias(const Block *block, const ProgramCTX *ctx, Block **row);
+static int antiAliasBlock(Thread *threads, Block *block, PlotFunction antiAlias, Block *row, PlotFunction genFractal,
+                          const Symmetry *symmetry, bool readable);
+static int plotRow(Thread *threads, Block *row, PlotFunction genFractal, size_t y, char *dest, ReferenceOrbit *orbit);
+static int openNextFrame(PlotCTX *p, Sequence *sequence, PNGEncoder *png);
+static int rejoinWorker(NetworkCTX *network, PlotCTX **p, Block *block);
+static int joinWorkerFrame(NetworkCTX *network, PlotCTX **p, Block *block);
+static int joinWorkerPlot(NetworkCTX *network, PlotCTX **p, Block **block, PlotFunction *genFractalRow,
+                          unsigned char **packed);
+static Checkpoint * openCheckpoint(PlotCTX *p, const ProgramCTX *ctx, const Block *block, size_t *start);
+static PNGEncoder * openPNGEncoder(const PlotCTX *p, const ProgramCTX *ctx);
+static Pyramid * openPyramid(const PlotCTX *p, const ProgramCTX *ctx);
+static RunReport * openRunReport(const ProgramCTX *ctx);
+static int selectBlock(Block *block, size_t id);
+static Block * createSpareBlock(const Block *block);
+
+
+/* Create image file and write header. When resuming, the image is instead
+ * opened as it was left, and its header checked against the plot. Either way
+ * the file is open for reading too, so it can be mapped
+ */
+int initialiseImage(PlotCTX *p, bool resume)
+{
+    unsigned char header[IMAGE_HEADER_LEN_MAX];
+    size_t len = 0;
 
-static void blockToImage(const Block *block);
-
+    if (p->output != OUTPUT_TERMINAL && getImageHeader(header, &len, p, sizeof(header)))
+    {
+        logMessage(ERROR, "Could not determine bit depth");
+        return 1;
+    }
 
-/* Create image file and write header */
-int initialiseImage(PlotCTX *p)
-{
     logMessage(DEBUG, "Opening image file \'%s\'", p->plotFilepath);
 
-    p->file = fopen(p->plotFilepath, "wb");
+    p->file = fopen(p->plotFilepath, (resume) ? "r+b" : "w+b");
 
     if (!p->file)
     {
@@ -51,71 +107,124 @@ int initialiseImage(PlotCTX *p)
 
     logMessage(DEBUG, "Image file successfully opened");
 
-    if (p->output == OUTPUT_PNM)
+    if (len && resume)
     {
-        char header[IMAGE_HEADER_LEN_MAX];
+        unsigned char found[IMAGE_HEADER_LEN_MAX];
 
-        logMessage(DEBUG, "Writing header to image");
+        logMessage(DEBUG, "Checking header of image");
 
-        /* Write PNM file header */
-        switch (p->colour.depth)
+        if (fread(found, sizeof(char), len, p->file) != len || memcmp(found, header, len))
         {
-            case BIT_DEPTH_1:
-                /* PBM file */
-                snprintf(header, sizeof(header), "P4 %zu %zu ", p->width, p->height);
-                break;
-            case BIT_DEPTH_8:
-                /* PGM file */
-                snprintf(header, sizeof(header), "P5 %zu %zu 255 ", p->width, p->height);
-                break;
-            case BIT_DEPTH_24:
-                /* PPM file */
-                snprintf(header, sizeof(header), "P6 %zu %zu 255 ", p->width, p->height);
-                break;
-            default:
-                logMessage(ERROR, "Could not determine bit depth");
-                return 1;
+            logMessage(ERROR, "Image \'%s\' is not of this plot", p->plotFilepath);
+            fclose(p->file);
+            p->file = NULL;
+            return 1;
         }
 
-        fprintf(p->file, "%s", header);
+        /* A stream switching from reading to writing must be positioned first */
+        fseeko(p->file, 0, SEEK_CUR);
+
+        logMessage(DEBUG, "Header of image matches plot");
+    }
+    else if (len)
+    {
+        logMessage(DEBUG, "Writing header to image");
+
+        if (fwrite(header, sizeof(char), len, p->file) != len)
+        {
+            logMessage(ERROR, "Header could not be written to image");
+            return 1;
+        }
 
-        logMessage(DEBUG, "Header \'%s\' successfully wrote to image", header);
+        logMessage(DEBUG, "Header successfully wrote to image");
     }
 
     return 0;
 }
 
 
-/* Initialise plot array, run function, then write to file */
-int imageOutput(PlotCTX *p, ProgramCTX *ctx)
+/* Create the pool of processing threads, pinned as asked, with a thread
+ * plotting on the GPU alongside them if one was asked for and can take the
+ * plot. The pool is given each block as work is queued to it, so may be kept
+ * for later plots
+ */
+Thread * createImageThreads(const PlotCTX *p, const ProgramCTX *ctx)
 {
-    /* Processing threads */
     Thread *threads;
 
-    /* Image block object */
-    Block *block;
+    #ifdef OPENCL
+    if (ctx->gpu)
+        threads = createThreadsGPU(NULL, ctx->threads, openGPU(p, ctx->gpuDevice));
+    else
+        threads = createThreads(NULL, ctx->threads);
+    #else
+    (void) p;
+    threads = createThreads(NULL, ctx->threads);
+    #endif
 
-    /* Pointer to fractal generation function */
-    void * (*genFractal)(void *);
+    if (threads && pinThreads(threads, ctx->affinity))
+        logMessage(WARNING, "Threads could not be pinned - leaving them to the scheduler");
 
-    switch (p->precision)
-    {
-        case STD_PRECISION:
-            genFractal = generateFractal;
-            break;
-        case EXT_PRECISION:
-            genFractal = generateFractalExt;
-            break;
-        
-        #ifdef MP_PREC
-        case MUL_PRECISION:
-            genFractal = generateFractalMP;
-            break;
-        #endif
-        
-        default:
-            return 1;
-    }
+    return threads;
+}
+
+
+/* Initialise plot array, run function, then write to file. The frames of a
+ * sequence (if any) are plotted one after another by the same threads into
+ * the same blocks. With `threads`, the plot is run on that pool rather than
+ * one of its own
+ */
+int imageOutput(PlotCTX *p, ProgramCTX *ctx, Sequence *sequence, Thread *threads)
+{
+    int ret = 0;
+
+    /* Processing threads created for the plot (if not given) */
+    Thread *own = NULL;
+
+    /* Image block objects - the threads fill one while the other is written */
+    Block *block, *spare;
+
+    /* Thread writing finished blocks to the file */
+    BlockWriter *writer;
+
+    /* Record of the blocks written (if any), and the block to start from */
+    Checkpoint *checkpoint = NULL;
+    size_t start = 0;
+
+    /* Encoder of the rows of a PNG image, or tile pyramid they are cut into */
+    PNGEncoder *png = NULL;
+    Pyramid *pyramid = NULL;
+
+    /* Pixels of each frame kept for the next (if frames are 2x zooms), and the
+     * memory they may take
+     */
+    FrameReuse *reuse = NULL;
+    size_t reuseSize = (sequence && sequence->doubling && !ctx->antiAlias) ? getFrameReuseSize(p, ctx->subdivide)
+                                                                           : 0;
+
+    /* Edge pixels of each block found to be supersampled (if anti-aliasing),
+     * the thread function supersampling them, and the row the rows either side
+     * of each block are plotted into
+     */
+    AntiAlias *aa = NULL;
+    PlotFunction antiAlias = NULL;
+    Block *edgeRow = NULL;
+
+    /* Statistics of the run (if asked for) */
+    RunReport *report = NULL;
+
+    /* Rows that are the image of earlier rows, and where the rows are found in
+     * the image file to be read back
+     */
+    Symmetry symmetry;
+    bool symmetric;
+    off_t offset;
+
+    /* Fractal generation function, specialised for the plot */
+    PlotFunction genFractal = getPlotFunction(p, ctx->perturbation);
+
+    if (!genFractal)
+        return 1;
 
     block = createBlock();
 
@@ -123,22 +232,144 @@ int imageOutput(PlotCTX *p, ProgramCTX *ctx)
         return 1;
 
     /* Set values in the Block object and allocate memory for the image array in
-     * manageable chunks (the "blocks")
+     * manageable chunks (the "blocks"), or map the image file as one block
+     */
+    if (initialiseImageBlock(block, p, ctx, reuseSize))
+    {
+        freeBlock(block);
+        return 1;
+    }
+
+    /* Threads claim tiles of the block as they become free, so rows of
+     * differing cost are balanced across them. Subdivision needs tiles with an
+     * interior, so uses square tiles unless told otherwise
+     */
+    if (ctx->subdivide && ctx->tileWidth == 0 && ctx->tileHeight == 0)
+        setBlockTiles(block, SUBDIVIDE_TILE_LEN, SUBDIVIDE_TILE_LEN);
+    else
+        setBlockTiles(block, ctx->tileWidth, ctx->tileHeight);
+
+    block->subdivide = ctx->subdivide;
+
+    /* Rows of a plot with symmetry are copied from their image rather than
+     * plotted. Rows in earlier blocks are read back from the image file, so
+     * only a file of fixed-size rows can be mirrored across blocks
+     */
+    symmetric = (ctx->symmetry && !getSymmetry(&symmetry, p));
+    offset = (p->output == OUTPUT_PNM || p->output == OUTPUT_RAW) ? ftello(p->file) : -1;
+
+    if (ctx->checkpoint && !(checkpoint = openCheckpoint(p, ctx, block, &start)))
+    {
+        freeBlock(block);
+        return 1;
+    }
+
+    if (p->output == OUTPUT_PNG && !(png = openPNGEncoder(p, ctx)))
+    {
+        freeCheckpoint(checkpoint);
+        freeBlock(block);
+        return 1;
+    }
+
+    if (p->output == OUTPUT_TILES && !(pyramid = openPyramid(p, ctx)))
+    {
+        freeCheckpoint(checkpoint);
+        freeBlock(block);
+        return 1;
+    }
+
+    #ifdef MP_PREC
+    /* The reference orbit is shared by every block of the image */
+    if (ctx->perturbation && p->precision == MUL_PRECISION)
+    {
+        logMessage(INFO, "Computing reference orbit");
+
+        block->orbit = createReferenceOrbit(p);
+
+        if (!block->orbit)
+        {
+            freePNGEncoder(png);
+            freePyramid(pyramid);
+            freeCheckpoint(checkpoint);
+            freeBlock(block);
+            return 1;
+        }
+    }
+    #endif
+
+    /* Both arrays keep the rows of the frame they hold for the next. A blended
+     * pixel is the mean of its area, so is not taken into a frame of half the
+     * pixel size
      */
-    if (initialiseBlock(block, p, ctx->mem))
+    if (!ctx->antiAlias)
+        reuse = openFrameReuse(block, sequence);
+
+    block->reuse = reuse;
+
+    /* Both arrays share the map of edge pixels, as one block is plotted at a time */
+    aa = openAntiAlias(block, ctx, &edgeRow);
+    antiAlias = (aa) ? getAntiAliasFunction(p) : NULL;
+    block->antiAlias = aa;
+
+    spare = createSpareBlock(block);
+
+    writer = createBlockWriter();
+
+    if (!writer || initialiseBlockWriter(writer, checkpoint, png, pyramid))
     {
+        freeBlockWriter(writer);
+        freePNGEncoder(png);
+        freePyramid(pyramid);
+        freeCheckpoint(checkpoint);
+        freeBlockBuffer(spare);
         freeBlock(block);
+        freeFrameReuse(reuse);
+        freeAntiAlias(aa);
+        freeBlock(edgeRow);
         return 1;
     }
 
-    /* Create a list of processing threads. The most optimised solution is one
-     * thread per processing core.
+    /* Create a pool of processing threads, unless given one kept across plots.
+     * The most optimised solution is one thread per processing core. The
+     * threads persist for every block and are only harvested by freeThreads()
      */
-    threads = createThreads(block, ctx->threads);
+    if (threads)
+        resetThreadStats(threads);
+    else
+        threads = own = createImageThreads(p, ctx);
+
+    if (!threads || (ctx->stats && !(report = openRunReport(ctx))))
+    {
+        freeThreads(own);
+        freeBlockWriter(writer);
+        freePNGEncoder(png);
+        freePyramid(pyramid);
+        freeCheckpoint(checkpoint);
+        freeBlockBuffer(spare);
+        freeBlock(block);
+        freeFrameReuse(reuse);
+        freeAntiAlias(aa);
+        freeBlock(edgeRow);
+        return 1;
+    }
 
-    if (!threads)
+    /* The arrays are written through first by the threads that will plot
+     * them, so each page is placed on the NUMA node of its threads
+     */
+    if (ctx->firstTouch && (touchBlock(threads, block) || touchBlock(threads, spare)))
     {
+        logMessage(ERROR, "Work could not be queued to threads");
+        freeRunReport(report);
+        freeThreads(own);
+        freeBlockWriter(writer);
+        freePNGEncoder(png);
+        freePyramid(pyramid);
+        freeCheckpoint(checkpoint);
+        freeBlockBuffer(spare);
         freeBlock(block);
+        freeFrameReuse(reuse);
+        freeAntiAlias(aa);
+        freeBlock(edgeRow);
         return 1;
     }
 
@@ -146,173 +377,453 @@ int imageOutput(PlotCTX *p, ProgramCTX *ctx)
      * may not be able to be stored in one whole memory chunk. Therefore, as per
      * the preceding functions, a block size is determined. A block is a section
      * of N rows of the image array that allow threads will perform on at once.
-     * Once all threads have finished, the block gets written to the image file
-     * and the cycle continues. The array may not divide evenly into blocks, so
-     * the reminader rows are calculated prior and stored in the block context
-     * structure
+     * Once all threads have finished, the block is handed to the writer thread
+     * and the threads move on to the next block in the other array. The array
+     * may not divide evenly into blocks, so the reminader rows are calculated
+     * prior and stored in the block context structure. A resumed plot starts
+     * from the first block the checkpoint does not hold
      */
-    for (block->id = 0; block->id <= block->bCount; ++(block->id))
+    while (1)
     {
-        if (block->id == block->bCount)
+        for (size_t id = start; ; ++id)
         {
-            /* If there are no remainder rows */
-            if (!(block->remainderRows))
+            Block *current = (spare && id % 2) ? spare : block;
+            double time;
+
+            if (selectBlock(current, id))
                 break;
 
-            /* If there are remaining rows */
-            block->remainder = true;
-        }
-        else
-        {
-            block->remainder = false;
-        }
+            logMessage(INFO, "Working on block %zu (%zu rows)",
+                       current->id,
+                       (current->remainder) ? current->remainderRows : current->rows);
 
-        logMessage(INFO, "Working on block %u (%zu rows)",
-                   block->id,
-                   (block->remainder) ? block->remainderRows : block->rows);
+            /* A frame without symmetry must not keep the mirrored rows of the last */
+            if (symmetric)
+                setBlockMirror(current, &symmetry, offset >= 0 && !current->map);
+            else
+                current->mirrorStart = current->mirrorEnd = 0;
 
-        /* Create threads to significantly decrease execution time */
-        for (unsigned int i = 0; i < threads->tCount; ++i)
-        {
-            Thread *t = &(threads[i]);
+            /* Hand the block to the thread pool and wait for it to be completed */
+            time = getMonotonicTime();
 
-            logMessage(INFO, "Spawning thread %u", t->tid);
-    
-            if (pthread_create(&(t->pid), NULL, genFractal, t))
+            if (runThreads(threads, genFractal, current))
             {
-                logMessage(ERROR, "Thread could not be created");
-                freeBlock(block);
-                freeThreads(threads);
-                return 1;
+                logMessage(ERROR, "Work could not be queued to threads");
+                ret = 1;
+                break;
             }
-        }
 
-        logMessage(INFO, "All threads successfully created");
-        
-        /* Wait for threads to exit */
-        for (unsigned int i = 0; i < threads->tCount; ++i)
-        {
-            Thread *t = &(threads[i]);
+            /* Edges are blended before any rows are copied from them */
+            if (antiAliasBlock(threads, current, antiAlias, edgeRow, genFractal, (symmetric) ? &symmetry : NULL,
+                               offset >= 0 && !current->map))
+            {
+                ret = 1;
+                break;
+            }
 
-            if (pthread_join(t->pid, NULL))
+            addBlockTime(report, getMonotonicTime() - time);
+
+            logMessage(INFO, "All threads finished block %zu", current->id);
+
+            /* Earlier blocks must be in the file before their rows are read back */
+            if (current->mirrorEnd > current->mirrorStart)
             {
-                logMessage(ERROR, "Thread %u could not be harvested", t->tid);
-                freeBlock(block);
-                freeThreads(threads);
-                return 1;
+                if ((offset >= 0 && (waitBlockWriter(writer) || fflush(p->file))) ||
+                    mirrorBlock(current, &symmetry, p->file, offset))
+                {
+                    ret = 1;
+                    break;
+                }
+            }
+
+            /* Rows the next frame takes pixels from are kept once complete */
+            if (reuse)
+            {
+                keepFrameRows(reuse, current->array, current->id * current->rows,
+                              (current->remainder) ? current->remainderRows : current->rows);
+            }
+
+            /* Without a spare array, the block must be written before it is reused */
+            time = getMonotonicTime();
+
+            if (queueBlockWrite(writer, current) || (!spare && waitBlockWriter(writer)))
+            {
+                ret = 1;
+                break;
             }
-                
-            logMessage(INFO, "Thread %u joined", t->tid);
+
+            addWriteWait(report, getMonotonicTime() - time);
+
+            /* The threads are idle between blocks, so their counts can be read */
+            if (isReportDue(report))
+                writeRunReport(report, threads, NULL, false);
+        }
+
+        if (waitBlockWriter(writer))
+            ret = 1;
+
+        if (png && !ret && finishPNG(png))
+            ret = 1;
+
+        if (ret || !sequence || isLastFrame(sequence))
+            break;
+
+        /* The next frame is plotted into the same blocks by the same threads */
+        if (openNextFrame(p, sequence, png))
+        {
+            ret = 1;
+            break;
+        }
+
+        #ifdef MP_PREC
+        if (block->orbit && rescaleReferenceOrbit(block->orbit, p))
+        {
+            ret = 1;
+            break;
         }
+        #endif
 
-        logMessage(INFO, "All threads successfully destroyed");
+        if (reuse)
+            swapFrameReuse(reuse);
 
-        blockToImage(block);
+        symmetric = (ctx->symmetry && !getSymmetry(&symmetry, p));
+        offset = (p->output == OUTPUT_PNM || p->output == OUTPUT_RAW) ? ftello(p->file) : -1;
+        start = 0;
     }
 
+    /* A finished plot has nothing to resume */
+    if (checkpoint && !ret)
+        removeCheckpoint(checkpoint);
+
+    if (report && writeRunReport(report, threads, NULL, true))
+        ret = 1;
+
     logMessage(DEBUG, "Freeing memory");
 
+    freeRunReport(report);
+    freeThreads(own);
+    freeBlockWriter(writer);
+    freePNGEncoder(png);
+    freePyramid(pyramid);
+    freeCheckpoint(checkpoint);
+    freeBlockBuffer(spare);
     freeBlock(block);
-    freeThreads(threads);
+    freeFrameReuse(reuse);
+    freeAntiAlias(aa);
+    freeBlock(edgeRow);
 
-    return 0;
+    return ret;
 }
 
 
-/* Initialise plot array, run function, then write to file */
-int imageOutputMaster(PlotCTX *p, NetworkCTX *network, ProgramCTX *ctx)
+/* Initialise plot array, run function, then write to file. The frames of a
+ * sequence (if any) are plotted one after another by the same workers. With
+ * `threads`, the master's share of rows and its supersampling run on that pool
+ * rather than one of its own
+ */
+int imageOutputMaster(PlotCTX *p, NetworkCTX *network, ProgramCTX *ctx, Sequence *sequence, Thread *threads)
 {
-    /* Image block object */
+    int ret = 0;
+
+    /* Image block objects - rows are received into both, and each written once
+     * its rows are in
+     */
     Block *block = createBlock();
+    Block *spare;
+
+    /* Thread writing finished blocks to the file */
+    BlockWriter *writer;
+
+    /* Threads serving the workers, across every block */
+    Listener *listen;
+
+    /* Statistics of the run (if asked for) */
+    RunReport *report = NULL;
+
+    /* Number of blocks in the image, and of arrays to receive them into */
+    size_t bCount;
+    size_t buffers;
+
+    /* Record of the blocks written (if any), and the block to start from */
+    Checkpoint *checkpoint = NULL;
+    size_t start = 0;
+
+    /* Encoder of the rows of a PNG image, or tile pyramid they are cut into */
+    PNGEncoder *png = NULL;
+    Pyramid *pyramid = NULL;
+
+    /* Processing threads created for the plot (if not given) */
+    Thread *own = NULL;
+
+    /* Master's own thread pool, plotting rows alongside the workers */
+    LocalWorker local =
+    {
+        .threads = NULL,
+        .genFractalRow = getPlotFunction(p, false),
+        .row = NULL
+    };
+
+    /* Edge pixels of each block found to be supersampled once its rows are in
+     * (if anti-aliasing), and the row the rows either side of each block are
+     * plotted into
+     */
+    AntiAlias *aa = NULL;
+    PlotFunction antiAlias = NULL;
+    Block *edgeRow = NULL;
 
     if (!block)
         return 1;
 
     /* Set values in the Block object and allocate memory for the image array in
-     * manageable chunks (the "blocks")
+     * manageable chunks (the "blocks"), or map the image file as one block
+     */
+    if (initialiseImageBlock(block, p, ctx, 0))
+    {
+        freeBlock(block);
+        return 1;
+    }
+
+    if (ctx->checkpoint && !(checkpoint = openCheckpoint(p, ctx, block, &start)))
+    {
+        freeBlock(block);
+        return 1;
+    }
+
+    if (p->output == OUTPUT_PNG && !(png = openPNGEncoder(p, ctx)))
+    {
+        freeCheckpoint(checkpoint);
+        freeBlock(block);
+        return 1;
+    }
+
+    if (p->output == OUTPUT_TILES && !(pyramid = openPyramid(p, ctx)))
+    {
+        freeCheckpoint(checkpoint);
+        freeBlock(block);
+        return 1;
+    }
+
+    /* Rows are plotted as a worker would, but into the block in place of the
+     * row's own array, so need no copying
+     */
+    if (network->local)
+    {
+        local.row = createBlock();
+
+        if (!local.genFractalRow || !local.row || initialiseBlockAsRow(local.row, p))
+        {
+            freeBlock(local.row);
+            freePNGEncoder(png);
+            freePyramid(pyramid);
+            freeCheckpoint(checkpoint);
+            freeBlock(block);
+            return 1;
+        }
+    }
+
+    /* Workers plot rows, not blocks, so the master supersamples the edges of
+     * each block once its rows are in, whatever the rows came in as
      */
-    if (initialiseBlock(block, p, ctx->mem))
+    aa = openAntiAlias(block, ctx, &edgeRow);
+    antiAlias = (aa) ? getAntiAliasFunction(p) : NULL;
+    block->antiAlias = aa;
+
+    /* The local worker's rows and the supersampling share one pool, created
+     * (if not given) only when either runs here
+     */
+    if (threads)
+        resetThreadStats(threads);
+    else if (network->local || aa)
+        threads = own = createImageThreads(p, ctx);
+
+    if ((network->local || aa) && (!threads || !local.genFractalRow))
+    {
+        freeAntiAlias(aa);
+        freeBlock(edgeRow);
+        freeBlock(local.row);
+        freePNGEncoder(png);
+        freePyramid(pyramid);
+        freeCheckpoint(checkpoint);
+        freeBlock(block);
+        return 1;
+    }
+
+    if (network->local)
+        local.threads = threads;
+
+    spare = createSpareBlock(block);
+
+    writer = createBlockWriter();
+
+    if (!writer || initialiseBlockWriter(writer, checkpoint, png, pyramid))
+    {
+        freeBlockWriter(writer);
+        freeAntiAlias(aa);
+        freeBlock(edgeRow);
+        freeThreads(own);
+        freeBlock(local.row);
+        freePNGEncoder(png);
+        freePyramid(pyramid);
+        freeCheckpoint(checkpoint);
+        freeBlockBuffer(spare);
+        freeBlock(block);
+        return 1;
+    }
+
+    if (ctx->stats && !(report = openRunReport(ctx)))
     {
+        freeBlockWriter(writer);
+        freeAntiAlias(aa);
+        freeBlock(edgeRow);
+        freeThreads(own);
+        freeBlock(local.row);
+        freePNGEncoder(png);
+        freePyramid(pyramid);
+        freeCheckpoint(checkpoint);
+        freeBlockBuffer(spare);
         freeBlock(block);
         return 1;
     }
 
+    bCount = block->bCount + ((block->remainderRows) ? 1 : 0);
+    buffers = (spare) ? 2 : 1;
+
     /* Because image dimensions can lead to billions of pixels, the plot array
      * may not be able to be stored in one whole memory chunk. Therefore, as per
      * the preceding functions, a block size is determined. A block is a section
-     * of N rows of the image array that allow threads will perform on at once.
-     * Once all threads have finished, the block gets written to the image file
-     * and the cycle continues. The array may not divide evenly into blocks, so
-     * the reminader rows are calculated prior and stored in the block context
-     * structure
+     * of N rows of the image array that the workers fill. Each array holds a
+     * block in the listener's window, so the workers move on to the next block
+     * while the last rows of one come in, rather than waiting on the slowest
+     * row of every block. Blocks are handed to the writer thread in order once
+     * every row is in, and an array is reused once its block is written. The
+     * array may not divide evenly into blocks, so the reminader rows are
+     * calculated prior and stored in the block context structure. A resumed
+     * plot starts from the first block the checkpoint does not hold
      */
-    for (block->id = 0; block->id <= block->bCount; ++(block->id))
+    while (1)
     {
-        if (block->id == block->bCount)
-        {
-            /* If there are no remainder rows */
-            if (!(block->remainderRows))
-                break;
+        listen = createListener(network, block, (network->local) ? &local : NULL);
 
-            /* If there are remaining rows */
-            block->remainder = true;
+        if (!listen || initialiseListener(listen))
+        {
+            freeListener(listen);
+            ret = 1;
+            break;
         }
-        else
+
+        for (size_t id = start, next = start; id < bCount && !ret; ++id)
         {
-            block->remainder = false;
+            Block *current = (spare && id % 2) ? spare : block;
+
+            for (; next < bCount && next < id + buffers && !ret; ++next)
+            {
+                Block *queued = (spare && next % 2) ? spare : block;
+
+                /* The array's last block may still be being written */
+                if ((next >= start + buffers && waitBlockWriter(writer)) || selectBlock(queued, next))
+                {
+                    ret = 1;
+                    break;
+                }
+
+                logMessage(INFO, "Working on block %zu (%zu rows)",
+                           queued->id,
+                           (queued->remainder) ? queued->remainderRows : queued->rows);
+
+                if (queueListenerBlock(listen, queued))
+                    ret = 1;
+            }
+
+            if (ret || waitListenerBlock(listen, current) ||
+                antiAliasBlock(threads, current, antiAlias, edgeRow, local.genFractalRow, NULL, false) ||
+                queueBlockWrite(writer, current))
+            {
+                ret = 1;
+            }
+
+            /* The local worker may be plotting, so only the workers are reported */
+            if (!ret && isReportDue(report))
+                reportListener(listen, report);
         }
 
-        logMessage(INFO, "Working on block %u (%zu rows)",
-                   block->id,
-                   (block->remainder) ? block->remainderRows : block->rows);
+        freeListener(listen);
+
+        if (waitBlockWriter(writer))
+            ret = 1;
+
+        if (png && !ret && finishPNG(png))
+            ret = 1;
 
-        if (listener(network, block))
+        if (ret || !sequence || isLastFrame(sequence))
+            break;
+
+        /* The workers join the next frame, plotted into the same blocks */
+        nextFrameConnections(network);
+
+        if (openNextFrame(p, sequence, png))
         {
-            freeBlock(block);
-            return 1;
+            ret = 1;
+            break;
         }
 
-        blockToImage(block);
+        start = 0;
     }
 
+    /* The workers still connected are closed once the plot is done */
+    if (report && writeRunReport(report, threads, network, true))
+        ret = 1;
+
+    /* A finished plot has nothing to resume */
+    if (checkpoint && !ret)
+        removeCheckpoint(checkpoint);
+
+    freeRunReport(report);
+    freeBlockWriter(writer);
+    freePNGEncoder(png);
+    freePyramid(pyramid);
+    freeCheckpoint(checkpoint);
+    freeAntiAlias(aa);
+    freeBlock(edgeRow);
+    freeThreads(own);
+    freeBlock(local.row);
+    freeBlockBuffer(spare);
     freeBlock(block);
 
     logMessage(INFO, "Closing network connections");
 
-    return 0;
+    return ret;
 }
 
 
-/* Initialise plot array, run function, then write to file */
-int imageRowOutput(PlotCTX *p, NetworkCTX *network, ProgramCTX *ctx)
+/* Initialise plot array, run function, then write to file. A worker moved on
+ * to the next frame of a sequence, or the next plot of a master serving render
+ * jobs, takes its plot in place of `p`. Returns 0 only once the master ends the
+ * plot, so a worker that loses its master exits as one that could not join it
+ */
+int imageRowOutput(PlotCTX **p, NetworkCTX *network, ProgramCTX *ctx)
 {
+    int status = 0;
+
     /* Processing threads */
     Thread *threads;
 
     /* Image block object */
     Block *block;
 
-    /* Pointer to fractal row generation function */
-    void * (*genFractalRow)(void *);
+    /* Buffer for run-length encoding each row, if the master accepts it */
+    unsigned char *packed = NULL;
 
-    switch (p->precision)
-    {
-        case STD_PRECISION:
-            genFractalRow = generateFractalRow;
-            break;
-        case EXT_PRECISION:
-            genFractalRow = generateFractalRowExt;
-            break;
-        
-        #ifdef MP_PREC
-        case MUL_PRECISION:
-            genFractalRow = generateFractalRowMP;
-            break;
-        #endif
-        
-        default:
-            return 1;
-    }
+    /* Thread keeping the master aware of the worker while it plots */
+    Heartbeat *heartbeat;
+
+    /* Statistics of the run (if asked for) */
+    RunReport *report = NULL;
+
+    /* Fractal generation function, plotting rows handed out by the master */
+    PlotFunction genFractalRow = getPlotFunction(*p, false);
+
+    if (!genFractalRow)
+        return 1;
 
     block = createBlock();
 
@@ -322,95 +833,240 @@ int imageRowOutput(PlotCTX *p, NetworkCTX *network, ProgramCTX *ctx)
     /* Set values in the Block object and allocate memory for the image array as
      * a single row of the image
      */
-    if (initialiseBlockAsRow(block, p))
+    if (initialiseBlockAsRow(block, *p))
     {
         freeBlock(block);
         return 1;
     }
 
-    /* Create a list of processing threads. The most optimised solution is one
-     * thread per processing core.
+    /* Create a pool of processing threads. The most optimised solution is one
+     * thread per processing core. The threads persist for every block and are
+     * only harvested by freeThreads()
      */
-    threads = createThreads(block, ctx->threads);
+    threads = createImageThreads(*p, ctx);
 
-    if (!threads)
+    if (!threads || (ctx->stats && !(report = openRunReport(ctx))))
     {
+        freeThreads(threads);
         freeBlock(block);
         return 1;
     }
 
-    while (1)
+    if (network->compress)
     {
-        int ret = getRowNumber(block, network, p);
+        packed = malloc(block->rowSize);
 
-        if (ret == 1)
-        {
-            /* Safe shutdown */
-            break;
-        }
-        else if (ret)
+        if (!packed)
+            logMessage(WARNING, "Could not allocate memory to encode rows - rows will be sent unencoded");
+    }
+
+    heartbeat = createHeartbeat();
+
+    if (initialiseHeartbeat(heartbeat, network))
+    {
+        freeHeartbeat(heartbeat);
+        freeRunReport(report);
+        free(packed);
+        freeBlock(block);
+        freeThreads(threads);
+        return 1;
+    }
+
+    while (1)
+    {
+        size_t row, rows;
+        int ret = getWorkUnit(&row, &rows, network, *p);
+
+        if (ret == 1)
         {
-            freeBlock(block);
-            freeThreads(threads);
-            return 1;
+            /* Safe shutdown */
+            break;
         }
+        else if (ret == 3)
+        {
+            /* The next frame is plotted into the same row by the same threads */
+            if (joinWorkerFrame(network, p, block))
+            {
+                status = 1;
+                break;
+            }
 
-        logMessage(INFO, "Working on row %zu", block->id);
+            continue;
+        }
+        else if (ret == 4)
+        {
+            /* The next plot is plotted by the same threads, into a row of its own */
+            if (joinWorkerPlot(network, p, &block, &genFractalRow, &packed))
+            {
+                status = 1;
+                break;
+            }
 
-        /* Create threads to significantly decrease execution time */
-        for (unsigned int i = 0; i < threads->tCount; ++i)
+            continue;
+        }
+        else if (ret)
         {
-            Thread *t = &(threads[i]);
-            logMessage(DEBUG, "Spawning thread %u", t->tid);
-    
-            if (pthread_create(&(t->pid), NULL, genFractalRow, t))
+            /* Units the worker held are handed out again by the master, so
+             * the worker starts afresh. If it cannot rejoin, the master is
+             * taken to be lost
+             */
+            if (rejoinWorker(network, p, block))
             {
-                logMessage(ERROR, "Thread could not be created");
-                freeBlock(block);
-                freeThreads(threads);
-                return 1;
+                status = 1;
+                break;
             }
+
+            continue;
         }
 
-        logMessage(DEBUG, "All threads successfully created");
-        
-        /* Wait for threads to exit */
-        for (unsigned int i = 0; i < threads->tCount; ++i)
-        {
-            Thread *t = &(threads[i]);
+        logMessage(INFO, "Working on rows %zu to %zu", row, row + rows - 1);
 
-            if (pthread_join(t->pid, NULL))
+        /* Each row is sent as soon as it is done, while the master reads the
+         * unit as one
+         */
+        for (block->id = row; block->id < row + rows; ++(block->id))
+        {
+            /* Hand the row to the thread pool and wait for it to be completed */
+            if (runThreads(threads, genFractalRow, block))
             {
-                logMessage(ERROR, "Thread %u could not be harvested", t->tid);
-                freeBlock(block);
+                logMessage(ERROR, "Work could not be queued to threads");
+                freeHeartbeat(heartbeat);
+                freeRunReport(report);
+                free(packed);
                 freeThreads(threads);
+                freeBlock(block);
                 return 1;
             }
-                
-            logMessage(DEBUG, "Thread %u joined", t->tid);
-        }
 
-        logMessage(DEBUG, "All threads successfully destroyed");
+            logMessage(DEBUG, "All threads finished row %zu", block->id);
 
-        ret = sendRowData(network, block);
+            ret = sendRowData(network, block, packed);
 
-        if (ret == -2)
-        {
-            /* Safe shutdown */
-            break;
+            if (ret)
+                break;
         }
-        else if (ret)
+
+        if (isReportDue(report))
+            writeRunReport(report, threads, NULL, false);
+
+        if (ret && rejoinWorker(network, p, block))
         {
-            freeBlock(block);
-            freeThreads(threads);
-            return 1;
+            status = 1;
+            break;
         }
     }
 
+    writeRunReport(report, threads, NULL, true);
+
     logMessage(DEBUG, "Freeing memory");
+    freeHeartbeat(heartbeat);
+    freeRunReport(report);
+    free(packed);
     freeBlock(block);
     freeThreads(threads);
-    return 0;
+    return status;
+}
+
+
+/* Colour the iteration values of a raw image into the image file. Rows are
+ * read, coloured and written a chunk at a time, without plotting them again
+ */
+int imageRecolour(PlotCTX *p, const ProgramCTX *ctx)
+{
+    int ret = 0;
+
+    FILE *raw;
+    unsigned char *values;
+    char *rows;
+
+    /* Encoder of the rows of a PNG image, or tile pyramid they are cut into */
+    PNGEncoder *png = NULL;
+    Pyramid *pyramid = NULL;
+
+    size_t rawRowSize = p->width * (BIT_DEPTH_ITERATIONS / CHAR_BIT);
+    size_t rowSize = (p->width * p->colour.depth) / CHAR_BIT;
+    size_t mem = (ctx->mem) ? ctx->mem : RECOLOUR_MEMORY_DEFAULT;
+    size_t chunk = mem / (rawRowSize + rowSize);
+
+    if (chunk < 1)
+        chunk = 1;
+    else if (chunk > p->height)
+        chunk = p->height;
+
+    logMessage(DEBUG, "Opening raw image \'%s\'", ctx->recolourFilepath);
+
+    raw = fopen(ctx->recolourFilepath, "rb");
+
+    if (!raw)
+    {
+        logMessage(ERROR, "File \'%s\' could not be opened", ctx->recolourFilepath);
+        return 1;
+    }
+
+    if (fseeko(raw, RAW_HEADER_LEN, SEEK_SET))
+    {
+        logMessage(ERROR, "Could not find rows of raw image");
+        fclose(raw);
+        return 1;
+    }
+
+    if ((p->output == OUTPUT_PNG && !(png = openPNGEncoder(p, ctx))) ||
+        (p->output == OUTPUT_TILES && !(pyramid = openPyramid(p, ctx))))
+    {
+        freePNGEncoder(png);
+        fclose(raw);
+        return 1;
+    }
+
+    values = malloc(chunk * rawRowSize);
+    rows = malloc(chunk * rowSize);
+
+    if (!values || !rows)
+    {
+        logMessage(ERROR, "Memory allocation failed");
+        free(values);
+        free(rows);
+        freePNGEncoder(png);
+        freePyramid(pyramid);
+        fclose(raw);
+        return 1;
+    }
+
+    logMessage(INFO, "Recolouring raw image %zu rows at a time", chunk);
+
+    for (size_t row = 0, n; row < p->height; row += n)
+    {
+        n = (p->height - row < chunk) ? p->height - row : chunk;
+
+        if (fread(values, rawRowSize, n, raw) != n)
+        {
+            logMessage(ERROR, "Raw image ends before row %zu", row + n);
+            ret = 1;
+            break;
+        }
+
+        for (size_t j = 0; j < n; ++j)
+            mapIterationRow(rows + j * rowSize, values + j * rawRowSize, p->width, &(p->colour));
+
+        if ((png) ? writePNGRows(png, rows, n) : (pyramid) ? writePyramidRows(pyramid, rows, n) :
+                                                              fwrite(rows, rowSize, n, p->file) != n)
+        {
+            logMessage(ERROR, "Rows could not be written to image file");
+            ret = 1;
+            break;
+        }
+    }
+
+    if (png && !ret && finishPNG(png))
+        ret = 1;
+
+    free(values);
+    free(rows);
+    freePNGEncoder(png);
+    freePyramid(pyramid);
+    fclose(raw);
+
+    return ret;
 }
 
 
@@ -434,31 +1090,433 @@ int closeImage(PlotCTX *p)
 }
 
 
-/* Write block to image file */
-static void blockToImage(const Block *block)
+/* Header of the image - PNM, or that of a raw or PNG image, or the descriptor
+ * of a tile pyramid - and its length
+ */
+static int getImageHeader(unsigned char *dest, size_t *len, const PlotCTX *p, size_t n)
 {
-    FILE *f = block->parameters->file;
-    size_t n = (block->remainder) ? block->remainderBlockSize : block->blockSize;
+    char *header = (char *) dest;
 
-    logMessage(INFO, "Writing %zu bytes to image file", n);
+    if (p->output == OUTPUT_RAW)
+    {
+        *len = RAW_HEADER_LEN;
+        return (n < RAW_HEADER_LEN) ? 1 : getRawHeader(dest, p);
+    }
+    else if (p->output == OUTPUT_PNG)
+    {
+        *len = (n < PNG_HEADER_LEN) ? 0 : getPNGHeader(dest, p);
+        return (*len == 0);
+    }
+    else if (p->output == OUTPUT_TILES)
+    {
+        *len = getPyramidHeader(header, p, n);
+        return (*len == 0);
+    }
 
-    if (block->parameters->colour.depth != BIT_DEPTH_ASCII)
+    switch (p->colour.depth)
     {
-        fwrite(block->array, sizeof(char), n, f);
+        case BIT_DEPTH_1:
+            /* PBM file */
+            snprintf(header, n, "P4 %zu %zu ", p->width, p->height);
+            break;
+        case BIT_DEPTH_8:
+            /* PGM file */
+            snprintf(header, n, "P5 %zu %zu 255 ", p->width, p->height);
+            break;
+        case BIT_DEPTH_24:
+            /* PPM file */
+            snprintf(header, n, "P6 %zu %zu 255 ", p->width, p->height);
+            break;
+        default:
+            return 1;
     }
+
+    *len = strlen(header);
+
+    return 0;
+}
+
+
+/* Set up the block the image is plotted into, leaving `reserve` bytes aside
+ * besides the arrays. Binary images of fixed-size rows can instead be mapped,
+ * and plotted in place in the image file
+ */
+static int initialiseImageBlock(Block *block, PlotCTX *p, const ProgramCTX *ctx, size_t reserve)
+{
+    block->hugePages = ctx->hugePages;
+
+    if (!ctx->map)
+    {
+        if (p->output == OUTPUT_PNG)
+            reserve += getPNGEncoderSize(p, ctx->threads);
+        else if (p->output == OUTPUT_TILES)
+            reserve += getPyramidSize(p, ctx->threads);
+
+        return initialiseBlock(block, p, ctx->mem, BLOCK_WRITER_BUFFERS, reserve);
+    }
+
+    if (p->output != OUTPUT_PNM && p->output != OUTPUT_RAW)
+    {
+        logMessage(ERROR, "Only PNM and raw images can be mapped");
+        return 1;
+    }
+
+    return initialiseBlockAsMap(block, p);
+}
+
+
+/* Keep the pixels of each frame of a sequence for the next, if every frame is
+ * a 2x zoom of the last. Returns NULL if the pixels are not to be kept
+ */
+static FrameReuse * openFrameReuse(const Block *block, const Sequence *sequence)
+{
+    FrameReuse *reuse;
+
+    if (!sequence || !sequence->doubling)
+        return NULL;
+
+    reuse = createFrameReuse();
+
+    if (initialiseFrameReuse(reuse, block->parameters, block->rowSize, block->subdivide))
+    {
+        freeFrameReuse(reuse);
+        return NULL;
+    }
+
+    return reuse;
+}
+
+
+/* Find and supersample the edge pixels of each block, if asked, giving the row
+ * block to plot the rows either side of each block into. Returns NULL if the
+ * plot is not to be anti-aliased
+ */
+static AntiAlias * openAntiAlias(const Block *block, const ProgramCTX *ctx, Block **row)
+{
+    AntiAlias *aa;
+
+    *row = NULL;
+
+    if (!ctx->antiAlias || !getAntiAliasFunction(block->parameters))
+        return NULL;
+
+    aa = createAntiAlias();
+
+    if (initialiseAntiAlias(aa, block->parameters, ctx->antiAlias, block->rows))
+    {
+        freeAntiAlias(aa);
+        return NULL;
+    }
+
+    /* Rows either side of a block are plotted into a row of their own */
+    *row = createBlock();
+
+    if (!*row || initialiseBlockAsRow(*row, block->parameters))
+    {
+        logMessage(WARNING, "Could not allocate memory to find edges - plotting without anti-aliasing");
+        freeBlock(*row);
+        freeAntiAlias(aa);
+        *row = NULL;
+        return NULL;
+    }
+
+    return aa;
+}
+
+
+/* Supersample the edge pixels of a plotted block, if it is to be anti-aliased.
+ * Every edge is found before any pixel is blended, so no thread compares a
+ * pixel with one already blended. The first and last rows are compared with
+ * the rows either side of the block as they are plotted in their own blocks -
+ * the last row of the block before is kept (or plotted again when resuming),
+ * and the first row of the block after is plotted into `row`. Rows that are
+ * mirrored in their own block (with `symmetry`, if any) are not compared with
+ */
+static int antiAliasBlock(Thread *threads, Block *block, PlotFunction antiAlias, Block *row, PlotFunction genFractal,
+                          const Symmetry *symmetry, bool readable)
+{
+    AntiAlias *aa = block->antiAlias;
+    size_t start, rows;
+    int ret = 0;
+
+    if (!aa)
+        return 0;
+
+    start = block->id * block->rows;
+    rows = (block->remainder) ? block->remainderRows : block->rows;
+
+    aa->above = NULL;
+    aa->below = NULL;
+
+    if (start > 0 && !(symmetry && isMirroredImageRow(symmetry, start - 1, block->rows, readable)))
+    {
+        if (aa->kept != start)
+            ret = plotRow(threads, row, genFractal, start - 1, (char *) aa->halo, block->orbit);
+
+        aa->above = aa->halo;
+    }
+
+    if (!ret && start + rows < block->parameters->height
+        && !(symmetry && isMirroredImageRow(symmetry, start + rows, block->rows, readable)))
+    {
+        ret = plotRow(threads, row, genFractal, start + rows, (char *) aa->halo + aa->rowSize, block->orbit);
+        aa->below = aa->halo + aa->rowSize;
+    }
+
+    if (ret || runThreads(threads, findEdges, block))
+    {
+        logMessage(ERROR, "Work could not be queued to threads");
+        return 1;
+    }
+
+    /* The last row is kept as plotted for the next block, unless mirrored */
+    if (block->mirrorEnd == rows)
+        aa->kept = 0;
     else
+        keepRow(aa, block->array + (rows - 1) * block->rowSize, start + rows);
+
+    if (runThreads(threads, antiAlias, block))
     {
-        size_t rows = (block->remainder) ? block->remainderRows : block->rows;
-        char *array = block->array;
+        logMessage(ERROR, "Work could not be queued to threads");
+        return 1;
+    }
 
-        for (size_t i = 0; i < rows; ++i, array += block->rowSize)
-        {
-            const char ASCII_EOL = '\n';
+    return 0;
+}
 
-            fwrite(array, sizeof(char), block->rowSize, f);
-            fputc(ASCII_EOL, f);
-        }
+
+/* Plot image row `y` into `dest` on the threads, as a worker would */
+static int plotRow(Thread *threads, Block *row, PlotFunction genFractal, size_t y, char *dest, ReferenceOrbit *orbit)
+{
+    char *array = row->array;
+    int ret;
+
+    row->id = y;
+    row->array = dest;
+    row->orbit = orbit;
+
+    ret = runThreads(threads, genFractal, row);
+
+    /* The orbit belongs to the image's block */
+    row->array = array;
+    row->orbit = NULL;
+
+    return ret;
+}
+
+
+/* Close the image of the frame plotted, and open that of the next frame of the
+ * sequence. The PNG encoder (if any) carries on into the next image
+ */
+static int openNextFrame(PlotCTX *p, Sequence *sequence, PNGEncoder *png)
+{
+    if (closeImage(p) || nextFrame(sequence, p) || initialiseImage(p, false))
+        return 1;
+
+    if (png)
+        restartPNG(png, p->file);
+
+    logMessage(INFO, "Plotting frame %zu of %zu to \'%s\'", sequence->frame + 1, sequence->frames, p->plotFilepath);
+
+    return 0;
+}
+
+
+/* Rejoin the master after losing the connection to it, or join the next frame
+ * of a sequence if the master finished the frame first. Returns 1 if the
+ * worker is done
+ */
+static int rejoinWorker(NetworkCTX *network, PlotCTX **p, Block *block)
+{
+    int ret = rejoinMaster(network);
+
+    return (ret == 2) ? joinWorkerFrame(network, p, block) : ret;
+}
+
+
+/* Join the next frame of a sequence, carrying the worker's row over to it */
+static int joinWorkerFrame(NetworkCTX *network, PlotCTX **p, Block *block)
+{
+    if (joinNextFrame(network, p))
+        return 1;
+
+    block->parameters = *p;
+
+    return 0;
+}
+
+
+/* Join the master's next plot on the connection kept from the last. The plot
+ * may differ in every respect, so its row, row function and buffer for
+ * run-length encoding are set up afresh, while the threads carry over
+ */
+static int joinWorkerPlot(NetworkCTX *network, PlotCTX **p, Block **block, PlotFunction *genFractalRow,
+                          unsigned char **packed)
+{
+    if (joinNextPlot(network, p))
+        return 1;
+
+    freeBlock(*block);
+    free(*packed);
+    *packed = NULL;
+
+    *genFractalRow = getPlotFunction(*p, false);
+    *block = createBlock();
+
+    if (!(*genFractalRow) || !(*block) || initialiseBlockAsRow(*block, *p))
+        return 1;
+
+    if (network->compress)
+    {
+        *packed = malloc((*block)->rowSize);
+
+        if (!(*packed))
+            logMessage(WARNING, "Could not allocate memory to encode rows - rows will be sent unencoded");
+    }
+
+    return 0;
+}
+
+
+/* Create the checkpoint of the plot. When resuming, the plot carries on from
+ * the first block not wholly written by the last run, which need not have
+ * split the image into blocks the same way, so rows already written may be
+ * plotted again. Returns NULL if the checkpoint could not be created or read
+ */
+static Checkpoint * openCheckpoint(PlotCTX *p, const ProgramCTX *ctx, const Block *block, size_t *start)
+{
+    Checkpoint *checkpoint;
+
+    *start = 0;
+
+    /* A PNG image is one compressed stream, which cannot be picked up partway */
+    if (p->output != OUTPUT_PNM && p->output != OUTPUT_RAW)
+    {
+        logMessage(ERROR, "Only PNM and raw images can be checkpointed");
+        return NULL;
+    }
+
+    /* A mapped image is written in any order, so has no rows written in turn */
+    if (block->map)
+    {
+        logMessage(ERROR, "Mapped images cannot be checkpointed");
+        return NULL;
+    }
+
+    checkpoint = createCheckpoint();
+
+    if (initialiseCheckpoint(checkpoint, p) || (ctx->resume && readCheckpoint(checkpoint)))
+    {
+        freeCheckpoint(checkpoint);
+        return NULL;
+    }
+
+    if (!ctx->resume)
+        return checkpoint;
+
+    /* A finished plot is left with no block to plot */
+    *start = (checkpoint->rows >= p->height) ? block->bCount + 1 : checkpoint->rows / block->rows;
+
+    if (fseeko(p->file, checkpoint->offset + (off_t) (*start * block->rows * block->rowSize), SEEK_SET))
+    {
+        logMessage(ERROR, "Could not find block %zu in image file", *start);
+        freeCheckpoint(checkpoint);
+        return NULL;
+    }
+
+    logMessage(INFO, "Resuming plot from block %zu (row %zu)", *start, *start * block->rows);
+
+    return checkpoint;
+}
+
+
+/* Create the encoder of the rows of a PNG image, compressing on as many
+ * threads as are plotting. Returns NULL if it could not be created
+ */
+static PNGEncoder * openPNGEncoder(const PlotCTX *p, const ProgramCTX *ctx)
+{
+    PNGEncoder *png = createPNGEncoder();
+
+    if (!png || initialisePNGEncoder(png, p, ctx->threads))
+    {
+        logMessage(ERROR, "Could not create PNG encoder");
+        freePNGEncoder(png);
+        return NULL;
+    }
+
+    return png;
+}
+
+
+/* Create the tile pyramid the rows are cut into, writing tiles on as many
+ * threads as are plotting. Returns NULL if it could not be created
+ */
+static Pyramid * openPyramid(const PlotCTX *p, const ProgramCTX *ctx)
+{
+    Pyramid *pyramid = createPyramid();
+
+    if (!pyramid || initialisePyramid(pyramid, p, ctx->threads))
+    {
+        logMessage(ERROR, "Could not create tile pyramid");
+        freePyramid(pyramid);
+        return NULL;
+    }
+
+    return pyramid;
+}
+
+
+static RunReport * openRunReport(const ProgramCTX *ctx)
+{
+    RunReport *report = createRunReport();
+
+    if (!report || initialiseRunReport(report, ctx->statsFilepath, ctx->statsInterval))
+    {
+        logMessage(ERROR, "Could not create statistics report");
+        freeRunReport(report);
+        return NULL;
+    }
+
+    return report;
+}
+
+
+/* Set a block to cover the `id`th block of the image. Returns 1 if there is
+ * no such block
+ */
+static int selectBlock(Block *block, size_t id)
+{
+    /* The remainder rows, if any, follow the full-size blocks */
+    if (id > block->bCount || (id == block->bCount && !(block->remainderRows)))
+        return 1;
+
+    block->id = id;
+    block->remainder = (id == block->bCount);
+
+    return 0;
+}
+
+
+/* Create a second array for the blocks of an image, so one block can be
+ * written while the next is filled. Returns NULL if the image is a single
+ * block (leaving nothing to overlap) or the array could not be allocated
+ */
+static Block * createSpareBlock(const Block *block)
+{
+    Block *spare;
+
+    if (block->bCount < 2 && !(block->remainderRows))
+        return NULL;
+
+    spare = createBlock();
+
+    if (!spare || initialiseBlockBuffer(spare, block))
+    {
+        logMessage(WARNING, "Could not allocate a second block array - blocks will be written before the next is "
+                   "started");
+        freeBlockBuffer(spare);
+        return NULL;
     }
 
-    logMessage(INFO, "Block successfully wrote to file");
+    return spare;
 }
\ No newline at end of file
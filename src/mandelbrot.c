@@ -15,6 +15,7 @@
 
 #include "arg_ranges.h"
 #include "array.h"
+#include "checkpoint.h"
 #include "connection_handler.h"
 #include "ext_precision.h"
 #include "getopt_error.h"
@@ -24,6 +25,12 @@
 #include "parameters.h"
 #include "process_options.h"
 #include "program_ctx.h"
+#include "pyramid.h"
+#include "raw.h"
+#include "sequence.h"
+#include "server.h"
+#include "simd.h"
+#include "subdivide.h"
 
 #ifdef MP_PREC
 #include <mpfr.h>
@@ -48,6 +55,11 @@ static void initialiseLog(void);
 
 static int usage(void);
 
+static int recolour(ProgramCTX *ctx, int argc, char **argv);
+
+static int serve(ProgramCTX *ctx, NetworkCTX *network);
+static int renderJob(const ProgramCTX *ctx, NetworkCTX *network, ServerJob *job, Thread **threads);
+
 static void programParameters(const ProgramCTX *ctx);
 
 static int validatePlotParameters(PlotCTX *p);
@@ -61,6 +73,7 @@ int main(int argc, char **argv)
     PlotCTX *p = NULL;
     ProgramCTX *ctx = NULL;
     NetworkCTX *network = NULL;
+    Sequence *sequence = NULL;
 
     /* Ignore SIGPIPE signals (appears on clients if master crashes) */
     signal(SIGPIPE, SIG_IGN);
@@ -95,10 +108,41 @@ int main(int argc, char **argv)
     /* Output settings */
     programParameters(ctx);
 
+    /* Select the vectorised kernels for this processor */
+    initialiseSIMD();
+
+    /* Colour a raw image rather than plot one */
+    if (ctx->recolour)
+    {
+        ret = recolour(ctx, argc, argv);
+
+        freeProgramCTX(ctx);
+        freeNetworkCTX(network);
+
+        if (closeLog())
+            return EXIT_FAILURE;
+
+        return (ret) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    /* Plot render jobs as they are given, rather than the plot of the options */
+    if (ctx->serve)
+    {
+        ret = serve(ctx, network);
+
+        freeProgramCTX(ctx);
+        freeNetworkCTX(network);
+
+        if (closeLog())
+            return EXIT_FAILURE;
+
+        return (ret) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
     if (network->mode != LAN_WORKER)
     {
         /* Will allocate memory of p. Requires freePlotCTX(p) later */
-        p = processPlotOptions(argc, argv);
+        p = processPlotOptions(ctx, argc, argv);
 
         if (validatePlotParameters(p))
         {
@@ -108,6 +152,26 @@ int main(int argc, char **argv)
             closeLog();
             return EXIT_FAILURE;
         }
+
+        /* Workers send the iteration values of a raw image as they are */
+        if (p->output == OUTPUT_RAW)
+            network->iterations = true;
+
+        /* The plot is the first frame of a sequence, if given more than one */
+        if (ctx->frames > 1)
+        {
+            sequence = createSequence();
+
+            if (initialiseSequence(sequence, ctx, p))
+            {
+                freeSequence(sequence);
+                freeProgramCTX(ctx);
+                freeNetworkCTX(network);
+                freePlotCTX(p);
+                closeLog();
+                return EXIT_FAILURE;
+            }
+        }
     }
 
     logMessage(INFO, "Initialising network");
@@ -115,6 +179,7 @@ int main(int argc, char **argv)
     /* Will allocate memory of p. Requires freePlotCTX(p) later */
     if (initialiseNetworkConnection(network, &p))
     {
+        freeSequence(sequence);
         freeProgramCTX(ctx);
 
         if (network->mode != LAN_WORKER)
@@ -132,8 +197,9 @@ int main(int argc, char **argv)
     /* Open image file and write header (if PNM) */
     if (p->output != OUTPUT_TERMINAL && network->mode != LAN_WORKER)
     {
-        if (initialiseImage(p))
+        if (initialiseImage(p, ctx->resume))
         { 
+            freeSequence(sequence);
             freePlotCTX(p);
             freeNetworkCTX(network);
             freeProgramCTX(ctx);
@@ -146,21 +212,26 @@ int main(int argc, char **argv)
     switch (network->mode)
     {
         case LAN_NONE:
-            ret = imageOutput(p, ctx);
+            ret = imageOutput(p, ctx, sequence, NULL);
             break;
         case LAN_MASTER:
-            ret = imageOutputMaster(p, network, ctx);
+            ret = imageOutputMaster(p, network, ctx, sequence, NULL);
             closeAllConnections(network);
             break;
         case LAN_WORKER:
-            ret = imageRowOutput(p, network, ctx);
-            closeConnection(network, 0);
+            ret = imageRowOutput(&p, network, ctx);
+
+            /* A worker that could not rejoin its master is left unconnected */
+            if (network->fds[0].fd >= 0)
+                closeConnection(network, 0);
+
             break;
         default:
             ret = 1;
             break;
     }
 
+    freeSequence(sequence);
     freeProgramCTX(ctx);
 
     if (ret)
@@ -201,6 +272,166 @@ static void initialiseLog(void)
 }
 
 
+/* Colour the raw image into an image file */
+static int recolour(ProgramCTX *ctx, int argc, char **argv)
+{
+    /* Will allocate memory of p. Requires freePlotCTX(p) later */
+    PlotCTX *p = processRecolourOptions(ctx, argc, argv);
+
+    if (!p)
+        return 1;
+
+    plotParameters(p);
+
+    if (initialiseImage(p, false) || imageRecolour(p, ctx) || closeImage(p))
+    {
+        freePlotCTX(p);
+        return 1;
+    }
+
+    freePlotCTX(p);
+
+    return 0;
+}
+
+
+/* Serve render jobs from the control socket until shut down. Each job is
+ * plotted as it would be on its own, but on the threads of the last job, and
+ * by a master with the workers of the last job. Workers are looked after
+ * while there is no job to plot
+ */
+static int serve(ProgramCTX *ctx, NetworkCTX *network)
+{
+    Server *server;
+    Thread *threads = NULL;
+
+    /* Raw images are plotted as iteration values whatever the default */
+    bool iterations = network->iterations;
+
+    logMessage(INFO, "Initialising network");
+
+    if (initialiseNetworkConnection(network, NULL))
+        return 1;
+
+    server = createServer();
+
+    if (initialiseServer(server, ctx->serveFilepath))
+    {
+        freeServer(server);
+
+        if (network->mode == LAN_MASTER)
+            closeAllConnections(network);
+
+        return 1;
+    }
+
+    while (1)
+    {
+        ServerJob *job;
+        int ret = waitServerJob(server, &job, network->heartbeat);
+
+        if (ret == 1)
+        {
+            logMessage(INFO, "Every job rendered - shutting down");
+            break;
+        }
+        else if (ret == 2)
+        {
+            if (network->mode == LAN_MASTER)
+                tendConnections(network);
+
+            continue;
+        }
+
+        network->iterations = iterations;
+        ret = renderJob(ctx, network, job, &threads);
+
+        if (ret)
+            logMessage(WARNING, "Job %" PRIu64 " could not be rendered", job->id);
+        else
+            logMessage(INFO, "Job %" PRIu64 " rendered", job->id);
+
+        finishServerJob(server, job, ret);
+    }
+
+    if (network->mode == LAN_MASTER)
+        closeAllConnections(network);
+
+    freeThreads(threads);
+    freeServer(server);
+
+    return 0;
+}
+
+
+/* Plot the image of a render job. The threads are created for the first job
+ * that needs them and kept for the rest
+ */
+static int renderJob(const ProgramCTX *ctx, NetworkCTX *network, ServerJob *job, Thread **threads)
+{
+    int ret;
+    PlotCTX *p;
+
+    /* Options of the plot may change the program's, which are kept for the next */
+    ProgramCTX jobCTX = *ctx;
+
+    logMessage(INFO, "Rendering job %" PRIu64, job->id);
+
+    if (validateJobOptions(job->argc, job->argv))
+        return 1;
+
+    #ifdef MP_PREC
+    mpSignificandSize = MP_SIGNIFICAND_SIZE_DEFAULT;
+    #endif
+
+    /* Will allocate memory of p. Requires freePlotCTX(p) later */
+    p = processPlotOptions(&jobCTX, job->argc, job->argv);
+
+    if (validatePlotParameters(p))
+    {
+        freePlotCTX(p);
+        return 1;
+    }
+
+    if (p->output == OUTPUT_RAW)
+        network->iterations = true;
+
+    plotParameters(p);
+
+    if (initialiseImage(p, false))
+    {
+        freePlotCTX(p);
+        return 1;
+    }
+
+    if (!(*threads) && (network->mode != LAN_MASTER || network->local)
+        && !(*threads = createImageThreads(p, &jobCTX)))
+    {
+        freePlotCTX(p);
+        return 1;
+    }
+
+    if (network->mode == LAN_MASTER)
+    {
+        ret = imageOutputMaster(p, network, &jobCTX, NULL, *threads);
+
+        /* The workers wait for the next job on their connections */
+        keepConnections(network);
+    }
+    else
+    {
+        ret = imageOutput(p, &jobCTX, NULL, *threads);
+    }
+
+    if (closeImage(p))
+        ret = 1;
+
+    freePlotCTX(p);
+
+    return ret;
+}
+
+
 /* `--help` output */
 static int usage(void)
 {
@@ -238,12 +469,65 @@ static int usage(void)
     printf("  -s HEIGHT, --height=HEIGHT    The height of the image file in pixels\n");
     printf("  -t                            Output to stdout (or, with -o, text file) using ASCII characters as "
            "shading\n");
+    printf("             --checkpoint       Record the rows written in a file beside the image (FILE%s), so\n"
+           "                                  an interrupted plot can be resumed\n", CHECKPOINT_EXTENSION);
+    printf("             --resume           Carry on an interrupted plot from its checkpoint, given the same\n"
+           "                                  parameters and output file\n");
+    printf("             --raw              Output smoothed iteration counts with the plot parameters, rather than\n"
+           "                                  pixels, to be coloured later with \'--recolour\' (default FILE = \'%s\')\n",
+           RAW_FILEPATH_DEFAULT);
+    printf("             --recolour=RAW     Colour the raw image RAW into FILE with the scheme of \'-c\', rather than\n"
+           "                                  plotting it again\n");
+    printf("             --mmap             Map the image file into memory and plot each pixel in place, rather than\n"
+           "                                  writing blocks through the file (PNM and raw images)\n");
+    printf("             --png              Output a PNG image, compressed on every thread as the rows are written\n"
+           "                                  (default FILE = \'%s\')\n", PNG_FILEPATH_DEFAULT);
+    printf("             --tiles[=SIZE]     Output a Deep Zoom tile pyramid of SIZE x SIZE pixel PNG tiles (default\n"
+           "                                  SIZE = %zu), with the descriptor in FILE and the tiles of each level\n"
+           "                                  in a directory beside it (default FILE = \'%s\')\n",
+           PYRAMID_TILE_SIZE_DEFAULT, TILES_FILEPATH_DEFAULT);
+    printf("             --stats=STATS      Write statistics of the run (work of each thread, traffic of each worker)\n"
+           "                                  to STATS as a line of JSON once finished (\'-\' for stdout)\n");
+    printf("             --stats-interval=SECS\n"
+           "                                Write statistics to STATS every SECS seconds while plotting too\n");
+    printf("             --frames=COUNT     Plot COUNT frames zooming from the centre and magnification of \'-x\' to\n"
+           "                                  that of \'--zoom-to\', each written to FILE numbered by frame\n"
+           "                                  (maximum = %zu). When each frame is a 2x zoom of the last (a step of\n"
+           "                                  6.5788 in magnification) and the image has an odd width and height,\n"
+           "                                  a quarter of each frame is taken from the last\n", FRAME_COUNT_MAX);
+    printf("             --zoom-to=MAG      Magnification of the last frame of \'--frames\'\n");
+    printf("             --serve=SOCKET     Plot render jobs given on the Unix domain socket SOCKET, rather than the\n"
+           "                                  options. Each line \'render OPTIONS...\' queues a plot of the output,\n"
+           "                                  plot type and plot parameter options, and \'shutdown\' exits once every\n"
+           "                                  job is done\n");
     printf("Distributed computing setup:\n");
     printf("  -g ADDR,   --worker=ADDR      Have computer work for a master at the respective IP address\n");
-    printf("  -G COUNT,  --master=COUNT     Setup computer as a network master, expecting COUNT workers to connect\n");
+    printf("  -G COUNT,  --master=COUNT     Setup computer as a network master, for up to COUNT workers at a time\n");
     printf("  -p PORT                       Communicate over the given port (default = %" PRIu16 ")\n", PORT_DEFAULT);
+    printf("             --unit-rows=ROWS   Give workers ROWS rows of the image at a time (default = %zu)\n",
+           UNIT_ROWS_DEFAULT);
+    printf("             --unit-depth=UNITS Keep up to UNITS units of work queued at each worker, so workers do not\n"
+           "                                  wait on the master between units (default = %u, maximum = %u)\n",
+           UNIT_DEPTH_DEFAULT, UNIT_DEPTH_MAX);
+    printf("             --no-compress      Have workers send rows as they are, rather than run-length encoded\n");
+    printf("             --send-iterations  Have workers send smoothed iteration counts, which the master colours,\n"
+           "                                  rather than pixels\n");
+    printf("             --io-threads=N     Receive rows from the workers on N threads (default = %u)\n",
+           IO_THREADS_DEFAULT);
+    printf("             --no-local         Leave every row to the workers, rather than plotting rows on the master's\n"
+           "                                  threads too\n");
+    printf("             --heartbeat=SECS   Have master and workers check on each other every SECS seconds, dropping\n"
+           "                                  a peer not heard from in %u (default = %u)\n",
+           HEARTBEAT_MISSES, HEARTBEAT_DEFAULT);
+    printf("             --retry=SECS       Have a worker keep trying to reach its master for SECS seconds, to join\n"
+           "                                  or rejoin the plot (default = %u)\n", RETRY_DEFAULT);
     printf("Plot type:\n");
     printf("  -j CONST,  --julia=CONST      Plot Julia set with specified constant parameter\n");
+    printf("             --formula=NAME     Iterate the formula NAME, which may be \'mandelbrot\' (z^2 + c, default),\n"
+           "                                  \'multibrot\' (z^d + c), \'burning-ship\' or \'tricorn\'\n"
+           "                                  With \'-j\', the Julia set of the formula is plotted\n");
+    printf("             --degree=D         Degree d of a Multibrot set (default = %u, maximum = %u)\n",
+           MULTIBROT_DEGREE_DEFAULT, DEGREE_MAX);
     printf("Plot parameters:\n");
     printf("  -i NMAX,   --iterations=NMAX  The maximum number of function iterations before a number is deemed to be "
            "within the set\n"
@@ -281,14 +565,45 @@ static int usage(void)
            (size_t) MP_SIGNIFICAND_SIZE_DEFAULT);
     printf("             --precision=PREC   Specify number of bits to use for the MPFR significand (default = %zu bits)"
            "\n", (size_t) MP_SIGNIFICAND_SIZE_DEFAULT);
+    printf("             --perturbation     Enable multiple-precision mode, computing only the orbit of the centre\n"
+           "                                  in MPFR and each pixel as an offset from it in hardware floating-point\n"
+           "                                  Much faster than '-A' at deep zoom\n");
     #endif
 
     printf("  -T COUNT,  --threads=COUNT    Use COUNT number of processing threads (default = processor count)\n");
+
+    #ifdef OPENCL
+    printf("             --gpu[=DEVICE]     Also plot on OpenCL device DEVICE (default = 0), which takes tiles\n"
+           "                                  alongside the processing threads in proportion to its speed\n"
+           "                                  Standard and double-double precision only\n");
+    #endif
+
+    printf("             --tile-width=COLS  Divide work between threads in tiles COLS pixels wide (default = 0)\n"
+           "                                  A width of 0 uses the full width of the image\n");
+    printf("             --tile-height=ROWS Divide work between threads in tiles ROWS pixels high (default = 0)\n"
+           "                                  Threads claim the next tile as they finish, so smaller tiles balance\n"
+           "                                  uneven plots better. If neither is set, tiles are %d pixels square,\n"
+           "                                  or single rows with \'--no-subdivide\'\n", SUBDIVIDE_TILE_LEN);
+    printf("             --no-subdivide     Compute every pixel, rather than filling areas enclosed by unescaped\n"
+           "                                  pixels\n");
+    printf("             --no-symmetry      Compute every row, rather than copying rows that mirror earlier rows\n");
+    printf("             --anti-alias[=N]   Plot pixels at sharp changes of colour again, at N x N jittered points\n"
+           "                                  each, and blend them (default N = 3, maximum = 16)\n");
+    printf("             --affinity=POLICY  Pin each thread to a CPU: \'compact\' fills one NUMA node before the\n"
+           "                                  next, \'scatter\' deals threads to the nodes in turn (default = none)\n");
+    printf("             --first-touch      Place each page of the block arrays on the NUMA node of the threads\n"
+           "                                  that plot it (best with \'--affinity\')\n");
+    printf("             --huge-pages       Back the block arrays with huge pages\n");
     printf("  -X,        --extended         Extend precision (%zu bits, compared to standard-precision %zu bits)\n"
            "                                  The extended floating-point type will be used for calculations\n"
-           "                                  This will increase precision at high zoom but may be slower\n",
+           "                                  This will increase precision at high zoom but may be slower\n"
+           "                                  Without a precision option, the lowest precision that can tell\n"
+           "                                  neighbouring pixels apart is chosen\n",
            (size_t) LDBL_MANT_DIG, (size_t) DBL_MANT_DIG);
-    printf("  -z MEM,    --memory=MEM       Limit memory usage to MEM megabytes (default = %u%% of free RAM)\n",
+    printf("             --double-double    Use double-double precision (%zu bits), stored as pairs of doubles\n"
+           "                                  Precision is better than \'-X\' and much faster than \'-A\'\n",
+           (size_t) DD_MANT_DIG);
+    printf("  -z MEM,    --memory=MEM       Limit memory usage to MEM megabytes (default = %u%% of available RAM)\n",
            FREE_MEMORY_ALLOCATION);
     printf("Log settings:\n");
     printf("             --log              Output log to file\n"
@@ -324,6 +639,7 @@ static int usage(void)
     printf("  %s\n", programName);
     printf("  %s -j \"0.1 - 0.2e-2i\" -o \"juliaset.pnm\"\n", programName);
     printf("  %s -t\n", programName);
+    printf("  %s --formula=burning-ship -x \"-1.7555 - 0.028i,36\" -i 500\n", programName);
     printf("  %s -i 200 --width=5500 --height=5000 --colour=9\n", programName);
     printf("  %s -g 192.168.1.31 -p 1337\n", programName);
 
@@ -412,8 +728,8 @@ static void plotParameters(const PlotCTX *p)
         depthStr[sizeof(depthStr) - 1] = '\0';
     }
 
-    /* Get plot type string from PlotType enum */
-    if (getPlotString(typeStr, p->type, sizeof(typeStr)))
+    /* Get plot type string from the plot type and formula */
+    if (getPlotString(typeStr, p, sizeof(typeStr)))
     {
         strncpy(typeStr, "Unknown plot type", sizeof(typeStr));
         typeStr[sizeof(typeStr) - 1] = '\0';
@@ -438,6 +754,14 @@ static void plotParameters(const PlotCTX *p)
                      FLT_PRINTF_PREC, creall(p->maximum.lc),
                      FLT_PRINTF_PREC, cimagl(p->maximum.lc));
             break;
+        case DD_PRECISION:
+            snprintf(minStr, sizeof(minStr), "%.*Lg + %.*Lgi",
+                     FLT_PRINTF_PREC, ddToLongDouble(p->minimum.dd.re),
+                     FLT_PRINTF_PREC, ddToLongDouble(p->minimum.dd.im));
+            snprintf(maxStr, sizeof(maxStr), "%.*Lg + %.*Lgi",
+                     FLT_PRINTF_PREC, ddToLongDouble(p->maximum.dd.re),
+                     FLT_PRINTF_PREC, ddToLongDouble(p->maximum.dd.im));
+            break;
         
         #ifdef MP_PREC
         case MUL_PRECISION:
@@ -473,6 +797,11 @@ static void plotParameters(const PlotCTX *p)
                          FLT_PRINTF_PREC, creall(p->c.lc),
                          FLT_PRINTF_PREC, cimagl(p->c.lc));
                 break;
+            case DD_PRECISION:
+                snprintf(cStr, sizeof(cStr), "%.*Lg + %.*Lgi",
+                         FLT_PRINTF_PREC, ddToLongDouble(p->c.dd.re),
+                         FLT_PRINTF_PREC, ddToLongDouble(p->c.dd.im));
+                break;
             
             #ifdef MP_PREC
             case MUL_PRECISION:
@@ -508,7 +837,7 @@ static void plotParameters(const PlotCTX *p)
                "    Dimensions  = %zu px * %zu px\n"
                "    Colour      = %s %s",
                outputStr,
-               (p->output == OUTPUT_PNM) ? p->plotFilepath : "-",
+               (p->output != OUTPUT_TERMINAL) ? p->plotFilepath : "-",
                p->width,
                p->height,
                colourStr,
@@ -544,6 +873,14 @@ static int validatePlotParameters(PlotCTX *p)
         getoptErrorMessage(OPT_NONE, NULL);
         return 1;
     }
+
+    /* Tiles are scaled down a byte at a time, so cannot be of 1-bit pixels */
+    if (p->output == OUTPUT_TILES && p->colour.depth == BIT_DEPTH_1)
+    {
+        fprintf(stderr, "%s: Invalid colour scheme for tiles\n", programName);
+        getoptErrorMessage(OPT_NONE, NULL);
+        return 1;
+    }
     
     /* Check real and imaginary range */
     switch (p->precision)
@@ -583,6 +920,22 @@ static int validatePlotParameters(PlotCTX *p)
                 return 1;
             }
 
+            break;
+        case DD_PRECISION:
+            if (ddCmp(p->maximum.dd.re, p->minimum.dd.re) < 0)
+            {
+                fprintf(stderr, "%s: Invalid range - maximum real value is smaller than the minimum\n", programName);
+                getoptErrorMessage(OPT_NONE, NULL);
+                return 1;
+            }
+            else if (ddCmp(p->maximum.dd.im, p->minimum.dd.im) < 0)
+            {
+                fprintf(stderr, "%s: Invalid range - maximum imaginary value is smaller than the minimum\n",
+                        programName);
+                getoptErrorMessage(OPT_NONE, NULL);
+                return 1;
+            }
+
             break;
         
         #ifdef MP_PREC
@@ -4,11 +4,16 @@
 /* Maximum magnitude before a number is considered to have escaped, assuming the
  * calculation has already hit the maximum iteration count. The number is
  * mathematically defined as 2, however a larger number allows for smoother
- * colour mapping.
+ * colour mapping. It bounds the orbits of every formula: Burning Ship and
+ * Tricorn grow as fast as z^2 once escaped, and a Multibrot as z^d
  */
 const double ESCAPE_RADIUS = 256.0;
 const long double ESCAPE_RADIUS_EXT = 256.0L;
 
+/* Squared escape radius, for comparison against squared magnitudes */
+const double ESCAPE_RADIUS_SQR = 256.0 * 256.0;
+const long double ESCAPE_RADIUS_SQR_EXT = 256.0L * 256.0L;
+
 #ifdef MP_PREC
 const double ESCAPE_RADIUS_MP = 256.0;
 #endif
\ No newline at end of file
@@ -0,0 +1,266 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "libgroot/include/log.h"
+
+#include "memory_limit.h"
+
+
+#define MEMINFO_PATH "/proc/meminfo"
+#define CGROUP_PATH "/proc/self/cgroup"
+
+/* Where the cgroup v2 hierarchy and the v1 memory controller are mounted */
+#define CGROUP2_ROOT "/sys/fs/cgroup"
+#define CGROUP1_MEMORY_ROOT "/sys/fs/cgroup/memory"
+
+#define PATH_LEN_MAX 4096
+#define LINE_LEN_MAX 256
+
+/* Limits from here up are taken as no limit (cgroup v1 rounds "unlimited"
+ * down to a page below this)
+ */
+#define CGROUP_UNLIMITED ((uintmax_t) 1 << 62)
+
+
+static size_t getMemInfoAvailable(void);
+static size_t getCgroupHeadroom(void);
+static size_t getHierarchyHeadroom(const char *root, const char *controller, const char *limitFile,
+                                   const char *usageFile, const char *inactiveKey);
+static bool isListed(const char *list, const char *name);
+static size_t getHeadroom(const char *dir, const char *limitFile, const char *usageFile, const char *inactiveKey);
+static int readValue(const char *dir, const char *file, uintmax_t *value);
+static int readKeyValue(const char *path, const char *key, uintmax_t *value);
+
+
+/* Bytes that can be allocated without swapping. This is the memory the
+ * kernel reckons to be available - counting page cache that can be dropped -
+ * capped by the headroom left under the limits of the process' cgroup (less
+ * the page cache the cgroup would drop first)
+ */
+size_t getAvailableMemory(void)
+{
+    size_t available = getMemInfoAvailable();
+    size_t headroom = getCgroupHeadroom();
+
+    if (headroom < available)
+    {
+        logMessage(DEBUG, "Memory limited by cgroup to %zu bytes (%zu bytes available on the system)", headroom,
+                   available);
+        available = headroom;
+    }
+
+    return available;
+}
+
+
+/* MemAvailable of /proc/meminfo, falling back to free physical memory if it
+ * cannot be read
+ */
+static size_t getMemInfoAvailable(void)
+{
+    uintmax_t kibibytes;
+    long availablePages, pageSize;
+
+    if (!readKeyValue(MEMINFO_PATH, "MemAvailable:", &kibibytes))
+        return (kibibytes > SIZE_MAX / 1024) ? SIZE_MAX : (size_t) kibibytes * 1024;
+
+    logMessage(DEBUG, "Could not read available memory from " MEMINFO_PATH " - using free physical memory");
+
+    availablePages = sysconf(_SC_AVPHYS_PAGES);
+    pageSize = sysconf(_SC_PAGE_SIZE);
+
+    if (availablePages < 1 || pageSize < 1)
+        return 0;
+
+    return (size_t) pageSize * (size_t) availablePages;
+}
+
+
+/* Least headroom under the memory limits of the process' cgroup (v2, or
+ * else v1) and its ancestors. SIZE_MAX if there are none
+ */
+static size_t getCgroupHeadroom(void)
+{
+    size_t headroom = getHierarchyHeadroom(CGROUP2_ROOT, "", "memory.max", "memory.current", "inactive_file");
+
+    if (headroom != SIZE_MAX)
+        return headroom;
+
+    return getHierarchyHeadroom(CGROUP1_MEMORY_ROOT, "memory", "memory.limit_in_bytes", "memory.usage_in_bytes",
+                                "total_inactive_file");
+}
+
+
+/* Headroom under the limits of the hierarchy mounted at `root`, from the
+ * process' cgroup up. Its path is on the line of /proc/self/cgroup listing
+ * `controller` (empty for v2), as in "4:memory:/path" or "0::/path". Within a
+ * cgroup namespace, the path is "/" and the process' cgroup is the root
+ */
+static size_t getHierarchyHeadroom(const char *root, const char *controller, const char *limitFile,
+                                   const char *usageFile, const char *inactiveKey)
+{
+    char line[PATH_LEN_MAX];
+    char dir[PATH_LEN_MAX];
+    char *group = NULL;
+    size_t headroom = SIZE_MAX;
+    size_t rootLen = strlen(root);
+    FILE *f = fopen(CGROUP_PATH, "r");
+
+    if (!f)
+        return SIZE_MAX;
+
+    while (!group && fgets(line, sizeof(line), f))
+    {
+        char *controllers = strchr(line, ':');
+        char *path = (controllers) ? strchr(controllers + 1, ':') : NULL;
+
+        if (!path)
+            continue;
+
+        *path = '\0';
+
+        if (isListed(controllers + 1, controller))
+        {
+            group = path + 1;
+            group[strcspn(group, "\n")] = '\0';
+        }
+    }
+
+    fclose(f);
+
+    if (!group || rootLen + strlen(group) >= sizeof(dir))
+        return SIZE_MAX;
+
+    snprintf(dir, sizeof(dir), "%s%s", root, group);
+
+    while (1)
+    {
+        size_t h = getHeadroom(dir, limitFile, usageFile, inactiveKey);
+        char *end = strrchr(dir, '/');
+
+        if (h < headroom)
+            headroom = h;
+
+        if (!end || (size_t) (end - dir) <= rootLen)
+            break;
+
+        *end = '\0';
+    }
+
+    return headroom;
+}
+
+
+/* Whether `name` is in a comma-separated list (or both are empty) */
+static bool isListed(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+
+    if (!len)
+        return (*list == '\0');
+
+    while (list)
+    {
+        if (!strncmp(list, name, len) && (list[len] == ',' || list[len] == '\0'))
+            return true;
+
+        list = strchr(list, ',');
+
+        if (list)
+            ++list;
+    }
+
+    return false;
+}
+
+
+/* Memory left under the limit of a cgroup. Inactive page cache is counted
+ * in its usage but dropped before the limit is hit, so is taken off
+ */
+static size_t getHeadroom(const char *dir, const char *limitFile, const char *usageFile, const char *inactiveKey)
+{
+    char path[PATH_LEN_MAX];
+    uintmax_t limit, usage, inactive;
+
+    if (readValue(dir, limitFile, &limit) || limit >= CGROUP_UNLIMITED)
+        return SIZE_MAX;
+
+    if (readValue(dir, usageFile, &usage))
+        usage = 0;
+
+    if (snprintf(path, sizeof(path), "%s/memory.stat", dir) < (int) sizeof(path)
+        && !readKeyValue(path, inactiveKey, &inactive))
+    {
+        usage = (inactive < usage) ? usage - inactive : 0;
+    }
+
+    return (limit > usage) ? (size_t) (limit - usage) : 0;
+}
+
+
+/* Read a file of a single number. "max" (no limit) is not read */
+static int readValue(const char *dir, const char *file, uintmax_t *value)
+{
+    char path[PATH_LEN_MAX];
+    char line[LINE_LEN_MAX];
+    char *end;
+    FILE *f;
+
+    if (snprintf(path, sizeof(path), "%s/%s", dir, file) >= (int) sizeof(path))
+        return 1;
+
+    f = fopen(path, "r");
+
+    if (!f)
+        return 1;
+
+    if (!fgets(line, sizeof(line), f))
+    {
+        fclose(f);
+        return 1;
+    }
+
+    fclose(f);
+
+    *value = strtoumax(line, &end, 10);
+
+    return (end == line) ? 1 : 0;
+}
+
+
+/* Read the number following `key` on a line of its own, as in /proc/meminfo
+ * and memory.stat
+ */
+static int readKeyValue(const char *path, const char *key, uintmax_t *value)
+{
+    char line[LINE_LEN_MAX];
+    size_t keyLen = strlen(key);
+    int ret = 1;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+        return 1;
+
+    while (fgets(line, sizeof(line), f))
+    {
+        char *end;
+
+        if (strncmp(line, key, keyLen) || (line[keyLen] != ' ' && line[keyLen] != '\t'))
+            continue;
+
+        *value = strtoumax(line + keyLen, &end, 10);
+        ret = (end == line + keyLen) ? 1 : 0;
+        break;
+    }
+
+    fclose(f);
+
+    return ret;
+}
\ No newline at end of file
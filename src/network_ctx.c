@@ -1,8 +1,12 @@
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include <netinet/in.h>
 #include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "connection.h"
 
@@ -20,6 +24,20 @@ NetworkCTX * createNetworkCTX(LANStatus status, int n, struct sockaddr_in *addr)
 
     ctx->max = (status == LAN_MASTER) ? n + 1 : 1;
     ctx->n = 0;
+    ctx->unitRows = 1;
+    ctx->unitDepth = 1;
+    ctx->job = 0;
+    ctx->compress = false;
+    ctx->iterations = false;
+    ctx->ioThreads = 1;
+    ctx->local = false;
+    ctx->rateTotal = 0.0;
+    ctx->rated = 0;
+    ctx->past = createConnectionStats();
+    ctx->pastCount = 0;
+    ctx->heartbeat = 1;
+    ctx->retry = 0;
+    ctx->epoll = NULL;
     ctx->connections = malloc((size_t) ctx->max * sizeof(*(ctx->connections)));
     ctx->fds = malloc((size_t) ctx->max * sizeof(*(ctx->fds)));
 
@@ -31,6 +49,14 @@ NetworkCTX * createNetworkCTX(LANStatus status, int n, struct sockaddr_in *addr)
         return NULL;
     }
 
+    if (pthread_mutex_init(&(ctx->send), NULL))
+    {
+        free(ctx->connections);
+        free(ctx->fds);
+        free(ctx);
+        return NULL;
+    }
+
     for (int i = 0; i < ctx->max; ++i)
     {
         ctx->connections[i] = createConnection();
@@ -40,6 +66,7 @@ NetworkCTX * createNetworkCTX(LANStatus status, int n, struct sockaddr_in *addr)
     /* Allocate a general-purpose network buffer for the host */
     if (createClientReceiveBuffer(&(ctx->connections[0]), GENERAL_NETWORK_BUFFER_SIZE))
     {
+        pthread_mutex_destroy(&(ctx->send));
         free(ctx->connections);
         free(ctx->fds);
         free(ctx);
@@ -62,8 +89,20 @@ void freeNetworkCTX(NetworkCTX *ctx)
                 freeClientReceiveBuffer(&(ctx->connections[i]));
         }
 
+        if (ctx->epoll)
+        {
+            for (unsigned int i = 0; i < ctx->ioThreads; ++i)
+            {
+                if (ctx->epoll[i] >= 0)
+                    close(ctx->epoll[i]);
+            }
+        }
+
+        free(ctx->epoll);
+
         free(ctx->connections);
         free(ctx->fds);
+        pthread_mutex_destroy(&(ctx->send));
     }
 
     free(ctx);
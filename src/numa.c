@@ -0,0 +1,249 @@
+/* CPU affinity and huge-page mappings are Linux extensions */
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "libgroot/include/log.h"
+
+#include "numa.h"
+
+
+#define NODE_PATH "/sys/devices/system/node"
+#define NODE_PATH_LEN_MAX 64
+#define LIST_LEN_MAX 4096
+
+/* Huge pages that anonymous mappings are rounded up to (x86-64 and AArch64) */
+#define HUGE_PAGE_SIZE ((size_t) 2 << 20)
+
+
+static int readList(bool *set, size_t n, const char *path);
+
+
+Topology * createTopology(void)
+{
+    Topology *t = malloc(sizeof(*t));
+
+    if (t)
+    {
+        t->cpus = NULL;
+        t->nodes = NULL;
+    }
+
+    return t;
+}
+
+
+/* Find the CPUs the process may run on, and the node of each from sysfs.
+ * Without sysfs, every CPU is taken to be on one node
+ */
+int initialiseTopology(Topology *t)
+{
+    cpu_set_t allowed;
+    unsigned int cpuNode[CPU_SETSIZE];
+    bool online[NUMA_NODES_MAX];
+
+    if (!t)
+        return 1;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed))
+    {
+        logMessage(ERROR, "Could not get the CPUs the process may run on");
+        return 1;
+    }
+
+    t->cpuCount = (unsigned int) CPU_COUNT(&allowed);
+    t->cpus = malloc(t->cpuCount * sizeof(*(t->cpus)));
+    t->nodes = malloc(t->cpuCount * sizeof(*(t->nodes)));
+
+    if (!t->cpus || !t->nodes || !t->cpuCount)
+        return 1;
+
+    memset(cpuNode, 0, sizeof(cpuNode));
+
+    if (readList(online, NUMA_NODES_MAX, NODE_PATH "/online"))
+    {
+        logMessage(DEBUG, "NUMA nodes unknown - taking every CPU to be on one node");
+        memset(online, 0, sizeof(online));
+        online[0] = true;
+    }
+    else
+    {
+        for (unsigned int node = 0; node < NUMA_NODES_MAX; ++node)
+        {
+            char path[NODE_PATH_LEN_MAX];
+            bool cpus[CPU_SETSIZE];
+
+            if (!online[node])
+                continue;
+
+            snprintf(path, sizeof(path), NODE_PATH "/node%u/cpulist", node);
+
+            if (readList(cpus, CPU_SETSIZE, path))
+                continue;
+
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (cpus[cpu])
+                    cpuNode[cpu] = node;
+            }
+        }
+    }
+
+    /* Number the nodes with an allowed CPU, listing their CPUs in turn */
+    t->cpuCount = 0;
+    t->nodeCount = 0;
+
+    for (unsigned int node = 0; node < NUMA_NODES_MAX; ++node)
+    {
+        unsigned int first = t->cpuCount;
+
+        for (int cpu = 0; cpu < CPU_SETSIZE && online[node]; ++cpu)
+        {
+            if (!CPU_ISSET((size_t) cpu, &allowed) || cpuNode[cpu] != node)
+                continue;
+
+            t->cpus[t->cpuCount] = cpu;
+            t->nodes[t->cpuCount] = t->nodeCount;
+            ++(t->cpuCount);
+        }
+
+        if (t->cpuCount > first)
+        {
+            t->nodeFirst[t->nodeCount] = first;
+            t->nodeCPUs[t->nodeCount] = t->cpuCount - first;
+            ++(t->nodeCount);
+        }
+    }
+
+    if (!t->cpuCount)
+        return 1;
+
+    logMessage(DEBUG, "%u CPUs available across %u NUMA node(s)", t->cpuCount, t->nodeCount);
+
+    return 0;
+}
+
+
+/* Index of the CPU the `i`th thread is pinned to. Threads wrap around the
+ * CPUs once there are more threads than CPUs
+ */
+unsigned int getAffinityCPU(const Topology *t, AffinityPolicy policy, unsigned int i)
+{
+    unsigned int node;
+
+    if (policy != AFFINITY_SCATTER)
+        return i % t->cpuCount;
+
+    node = i % t->nodeCount;
+
+    return t->nodeFirst[node] + (i / t->nodeCount) % t->nodeCPUs[node];
+}
+
+
+int pinThread(pthread_t pid, int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET((size_t) cpu, &set);
+
+    return (pthread_setaffinity_np(pid, sizeof(set), &set)) ? 1 : 0;
+}
+
+
+void freeTopology(Topology *t)
+{
+    if (t)
+    {
+        free(t->cpus);
+        free(t->nodes);
+    }
+
+    free(t);
+}
+
+
+/* Map an array backed by huge pages, rounding `size` up to a whole number of
+ * them. Pages reserved for the kernel's huge page pool are used if there are
+ * enough, otherwise transparent huge pages are asked for. Either way pages
+ * are not placed until first touched
+ */
+char * mapHugeArray(size_t *size)
+{
+    char *array;
+
+    if (*size > SIZE_MAX - HUGE_PAGE_SIZE)
+        return NULL;
+
+    *size = (*size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+    array = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (array != MAP_FAILED)
+        return array;
+
+    logMessage(DEBUG, "No reserved huge pages - asking for transparent huge pages");
+
+    array = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (array == MAP_FAILED)
+        return NULL;
+
+    if (madvise(array, *size, MADV_HUGEPAGE))
+        logMessage(DEBUG, "Transparent huge pages are not available");
+
+    return array;
+}
+
+
+void unmapArray(char *array, size_t size)
+{
+    if (array && munmap(array, size))
+        logMessage(WARNING, "Block array could not be unmapped");
+}
+
+
+/* Read a sysfs list of numbers and ranges (such as "0-3,8,10-11") into a set
+ * of `n` flags
+ */
+static int readList(bool *set, size_t n, const char *path)
+{
+    char list[LIST_LEN_MAX];
+    char *s = list;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+        return 1;
+
+    if (!fgets(list, sizeof(list), f))
+    {
+        fclose(f);
+        return 1;
+    }
+
+    fclose(f);
+    memset(set, 0, n * sizeof(*set));
+
+    while (*s >= '0' && *s <= '9')
+    {
+        unsigned long first = strtoul(s, &s, 10);
+        unsigned long last = (*s == '-') ? strtoul(s + 1, &s, 10) : first;
+
+        for (unsigned long i = first; i <= last && i < n; ++i)
+            set[i] = true;
+
+        if (*s == ',')
+            ++s;
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <complex.h>
 #include <float.h>
 #include <limits.h>
+#include <math.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -10,9 +11,11 @@
 #include "parameters.h"
 
 #include "colour.h"
+#include "double_double.h"
 #include "ext_precision.h"
 
 #ifdef MP_PREC
+#include <mpfr.h>
 #include <mpc.h>
 #endif
 
@@ -27,6 +30,19 @@ const size_t MANDELBROT_TERMINAL_HEIGHT_DEFAULT = 46;
 const ColourSchemeType COLOUR_SCHEME_DEFAULT = COLOUR_SCHEME_TYPE_RAINBOW;
 const ColourSchemeType TERMINAL_COLOUR_SCHEME_DEFAULT = COLOUR_SCHEME_TYPE_ASCII;
 
+/* Degree of a Multibrot set unless given */
+const unsigned int MULTIBROT_DEGREE_DEFAULT = 3;
+
+/* Default views of the Mandelbrot sets of formulas other than z^2 + c, with
+ * the aspect ratio of the default Mandelbrot set image
+ */
+static const long double complex MULTIBROT_MINIMUM_DEFAULT = -1.65L - 1.5L * I;
+static const long double complex MULTIBROT_MAXIMUM_DEFAULT = 1.65L + 1.5L * I;
+static const long double complex BURNING_SHIP_MINIMUM_DEFAULT = -2.15L - 2.05L * I;
+static const long double complex BURNING_SHIP_MAXIMUM_DEFAULT = 1.15L + 0.95L * I;
+static const long double complex TRICORN_MINIMUM_DEFAULT = -2.7L - 2.0L * I;
+static const long double complex TRICORN_MAXIMUM_DEFAULT = 1.7L + 2.0L * I;
+
 /* Default parameters for Julia set plot */
 const PlotCTX JULIA_PARAMETERS_DEFAULT =
 {
@@ -55,6 +71,20 @@ const PlotCTX JULIA_PARAMETERS_DEFAULT_EXT =
     .height = 800
 };
 
+/* Default parameters for Julia set plot (double-double) */
+const PlotCTX JULIA_PARAMETERS_DEFAULT_DD =
+{
+    .precision = DD_PRECISION,
+    .type = PLOT_JULIA,
+    .minimum.dd = {{-2.0, 0.0}, {-2.0, 0.0}},
+    .maximum.dd = {{2.0, 0.0}, {2.0, 0.0}},
+    .iterations = 100,
+    .output = OUTPUT_PNM,
+    .file = NULL,
+    .width = 800,
+    .height = 800
+};
+
 #ifdef MP_PREC
 /* Default parameters for Julia set plot (multiple-precision) */
 const PlotCTX JULIA_PARAMETERS_DEFAULT_MP =
@@ -97,6 +127,20 @@ const PlotCTX MANDELBROT_PARAMETERS_DEFAULT_EXT =
     .height = 500
 };
 
+/* Default parameters for Mandelbrot set plot (double-double) */
+const PlotCTX MANDELBROT_PARAMETERS_DEFAULT_DD =
+{
+    .precision = DD_PRECISION,
+    .type = PLOT_MANDELBROT,
+    .minimum.dd = {{-2.0, 0.0}, {-1.25, 0.0}},
+    .maximum.dd = {{0.75, 0.0}, {1.25, 0.0}},
+    .iterations = 100,
+    .output = OUTPUT_PNM,
+    .file = NULL,
+    .width = 550,
+    .height = 500
+};
+
 #ifdef MP_PREC
 /* Default parameters for Mandelbrot set plot (multiple-precision) */
 const PlotCTX MANDELBROT_PARAMETERS_DEFAULT_MP =
@@ -116,8 +160,23 @@ static int initialiseMP(PlotCTX *p);
 static void freeMP(PlotCTX *p);
 #endif
 
+static int initialiseFormula(PlotCTX *p, Formula formula);
+static void setRange(PlotCTX *p, long double complex minimum, long double complex maximum);
+
 static int initialiseImageOutputParameters(PlotCTX *p);
 static int initialiseTerminalOutputParameters(PlotCTX *p);
+static int initialiseRawOutputParameters(PlotCTX *p);
+static int initialisePNGOutputParameters(PlotCTX *p);
+static int initialiseTilesOutputParameters(PlotCTX *p);
+
+static long getResolutionBitsExt(long double magnitude, long double real, long double imag, size_t width,
+                                 size_t height, long precision);
+static long getResolutionBitsDD(const PlotCTX *p);
+
+
+#ifdef MP_PREC
+static long getResolutionBitsMP(const PlotCTX *p);
+#endif
 
 
 /* Create plot parameters object */
@@ -140,7 +199,7 @@ PlotCTX * createPlotCTX(PrecisionMode precision)
 
 
 /* Set default plot settings into PlotCTX object */
-int initialisePlotCTX(PlotCTX *p, PlotType plot, OutputType output)
+int initialisePlotCTX(PlotCTX *p, PlotType plot, Formula formula, OutputType output)
 {
     int ret;
 
@@ -157,11 +216,20 @@ int initialisePlotCTX(PlotCTX *p, PlotType plot, OutputType output)
         case OUTPUT_TERMINAL:
             ret = initialiseTerminalOutputParameters(p);
             break;
+        case OUTPUT_RAW:
+            ret = initialiseRawOutputParameters(p);
+            break;
+        case OUTPUT_PNG:
+            ret = initialisePNGOutputParameters(p);
+            break;
+        case OUTPUT_TILES:
+            ret = initialiseTilesOutputParameters(p);
+            break;
         default:
             return 1;
     }
 
-    if (ret)
+    if (ret || initialiseFormula(p, formula))
         return 1;
 
     return 0;
@@ -215,6 +283,40 @@ static void freeMP(PlotCTX *p)
 #endif
 
 
+/* Number of significand bits needed to tell neighbouring pixels apart, from
+ * the size of the coordinates relative to the pixel spacing. If neighbouring
+ * pixels already coincide, one more bit than the current precision is given
+ */
+long getResolutionBits(const PlotCTX *p)
+{
+    switch (p->precision)
+    {
+        case STD_PRECISION:
+            return getResolutionBitsExt(fmax(fmax(fabs(creal(p->minimum.c)), fabs(creal(p->maximum.c))),
+                                             fmax(fabs(cimag(p->minimum.c)), fabs(cimag(p->maximum.c)))),
+                                        creal(p->maximum.c) - creal(p->minimum.c),
+                                        cimag(p->maximum.c) - cimag(p->minimum.c),
+                                        p->width, p->height, DBL_MANT_DIG);
+        case EXT_PRECISION:
+            return getResolutionBitsExt(fmaxl(fmaxl(fabsl(creall(p->minimum.lc)), fabsl(creall(p->maximum.lc))),
+                                              fmaxl(fabsl(cimagl(p->minimum.lc)), fabsl(cimagl(p->maximum.lc)))),
+                                        creall(p->maximum.lc) - creall(p->minimum.lc),
+                                        cimagl(p->maximum.lc) - cimagl(p->minimum.lc),
+                                        p->width, p->height, LDBL_MANT_DIG);
+        case DD_PRECISION:
+            return getResolutionBitsDD(p);
+
+        #ifdef MP_PREC
+        case MUL_PRECISION:
+            return getResolutionBitsMP(p);
+        #endif
+
+        default:
+            return -1;
+    }
+}
+
+
 /* Get output type */
 int getOutputString(char *dest, const PlotCTX *p, size_t n)
 {
@@ -243,6 +345,15 @@ int getOutputString(char *dest, const PlotCTX *p, size_t n)
         case OUTPUT_TERMINAL:
             type = "Terminal output";
             break;
+        case OUTPUT_RAW:
+            type = "Raw iteration values";
+            break;
+        case OUTPUT_PNG:
+            type = "Portable Network Graphics (.png)";
+            break;
+        case OUTPUT_TILES:
+            type = "Deep Zoom tile pyramid (.dzi)";
+            break;
         default:
             return 1;
     }
@@ -254,30 +365,106 @@ int getOutputString(char *dest, const PlotCTX *p, size_t n)
 }
 
 
-/* Convert plot type to string */
-int getPlotString(char *dest, PlotType plot, size_t n)
+/* Convert plot type and formula to string */
+int getPlotString(char *dest, const PlotCTX *p, size_t n)
 {
-    const char *type;
+    const char *formula;
+    const char *set = (p->type == PLOT_JULIA) ? "Julia set" : "set";
 
-    switch (plot)
+    if (p->type != PLOT_JULIA && p->type != PLOT_MANDELBROT)
+        return 1;
+
+    switch (p->formula)
     {
-        case PLOT_JULIA:
-            type = "Julia set";
+        case FORMULA_MANDELBROT:
+            formula = (p->type == PLOT_JULIA) ? "" : "Mandelbrot ";
             break;
-        case PLOT_MANDELBROT:
-            type = "Mandelbrot set";
+        case FORMULA_MULTIBROT:
+            snprintf(dest, n, "Multibrot %s (d = %u)", set, p->degree);
+            return 0;
+        case FORMULA_BURNING_SHIP:
+            formula = "Burning Ship ";
+            break;
+        case FORMULA_TRICORN:
+            formula = "Tricorn ";
             break;
         default:
             return 1;
     }
 
-    strncpy(dest, type, n);
-    dest[n - 1] = '\0';
+    snprintf(dest, n, "%s%s", formula, set);
 
     return 0;
 }
 
 
+/* Set the formula, its degree and, for a Mandelbrot set, its default view.
+ * Julia sets of every formula share the default view of the Julia set
+ */
+static int initialiseFormula(PlotCTX *p, Formula formula)
+{
+    p->formula = formula;
+    p->degree = (formula == FORMULA_MULTIBROT) ? MULTIBROT_DEGREE_DEFAULT : 2;
+
+    setColourDegree(&(p->colour), p->degree);
+
+    if (p->type == PLOT_JULIA)
+        return 0;
+
+    switch (formula)
+    {
+        case FORMULA_MANDELBROT:
+            break;
+        case FORMULA_MULTIBROT:
+            setRange(p, MULTIBROT_MINIMUM_DEFAULT, MULTIBROT_MAXIMUM_DEFAULT);
+            break;
+        case FORMULA_BURNING_SHIP:
+            setRange(p, BURNING_SHIP_MINIMUM_DEFAULT, BURNING_SHIP_MAXIMUM_DEFAULT);
+            break;
+        case FORMULA_TRICORN:
+            setRange(p, TRICORN_MINIMUM_DEFAULT, TRICORN_MAXIMUM_DEFAULT);
+            break;
+        default:
+            return 1;
+    }
+
+    return 0;
+}
+
+
+/* Set the range of the plot at its precision */
+static void setRange(PlotCTX *p, long double complex minimum, long double complex maximum)
+{
+    switch (p->precision)
+    {
+        case STD_PRECISION:
+            p->minimum.c = (complex) minimum;
+            p->maximum.c = (complex) maximum;
+            break;
+        case EXT_PRECISION:
+            p->minimum.lc = minimum;
+            p->maximum.lc = maximum;
+            break;
+        case DD_PRECISION:
+            p->minimum.dd.re = longDoubleToDD(creall(minimum));
+            p->minimum.dd.im = longDoubleToDD(cimagl(minimum));
+            p->maximum.dd.re = longDoubleToDD(creall(maximum));
+            p->maximum.dd.im = longDoubleToDD(cimagl(maximum));
+            break;
+
+        #ifdef MP_PREC
+        case MUL_PRECISION:
+            mpc_set_ldc(p->minimum.mpc, minimum, MP_COMPLEX_RND);
+            mpc_set_ldc(p->maximum.mpc, maximum, MP_COMPLEX_RND);
+            break;
+        #endif
+
+        default:
+            break;
+    }
+}
+
+
 static int initialiseImageOutputParameters(PlotCTX *p)
 {
     switch (p->type)
@@ -291,6 +478,9 @@ static int initialiseImageOutputParameters(PlotCTX *p)
                 case EXT_PRECISION:
                     *p = JULIA_PARAMETERS_DEFAULT_EXT;
                     break;
+                case DD_PRECISION:
+                    *p = JULIA_PARAMETERS_DEFAULT_DD;
+                    break;
                 
                 #ifdef MP_PREC
                 case MUL_PRECISION:
@@ -315,6 +505,9 @@ static int initialiseImageOutputParameters(PlotCTX *p)
                 case EXT_PRECISION:
                     *p = MANDELBROT_PARAMETERS_DEFAULT_EXT;
                     break;
+                case DD_PRECISION:
+                    *p = MANDELBROT_PARAMETERS_DEFAULT_DD;
+                    break;
                 
                 #ifdef MP_PREC
                 case MUL_PRECISION:
@@ -359,6 +552,9 @@ static int initialiseTerminalOutputParameters(PlotCTX *p)
                 case EXT_PRECISION:
                     *p = JULIA_PARAMETERS_DEFAULT_EXT;
                     break;
+                case DD_PRECISION:
+                    *p = JULIA_PARAMETERS_DEFAULT_DD;
+                    break;
 
                 #ifdef MP_PREC
                 case MUL_PRECISION:
@@ -384,6 +580,9 @@ static int initialiseTerminalOutputParameters(PlotCTX *p)
                 case EXT_PRECISION:
                     *p = MANDELBROT_PARAMETERS_DEFAULT_EXT;
                     break;
+                case DD_PRECISION:
+                    *p = MANDELBROT_PARAMETERS_DEFAULT_DD;
+                    break;
                 
                 #ifdef MP_PREC
                 case MUL_PRECISION:
@@ -414,6 +613,56 @@ static int initialiseTerminalOutputParameters(PlotCTX *p)
 }
 
 
+/* A raw image has the defaults of an image file, but is plotted as iteration
+ * values. The colour scheme is only recorded, to colour the image by later
+ */
+static int initialiseRawOutputParameters(PlotCTX *p)
+{
+    if (initialiseImageOutputParameters(p))
+        return 1;
+
+    p->output = OUTPUT_RAW;
+    p->colour.depth = BIT_DEPTH_ITERATIONS;
+
+    strncpy(p->plotFilepath, RAW_FILEPATH_DEFAULT, sizeof(p->plotFilepath));
+    p->plotFilepath[sizeof(p->plotFilepath) - 1] = '\0';
+
+    return 0;
+}
+
+
+/* A PNG image has the defaults of any other image file */
+static int initialisePNGOutputParameters(PlotCTX *p)
+{
+    if (initialiseImageOutputParameters(p))
+        return 1;
+
+    p->output = OUTPUT_PNG;
+
+    strncpy(p->plotFilepath, PNG_FILEPATH_DEFAULT, sizeof(p->plotFilepath));
+    p->plotFilepath[sizeof(p->plotFilepath) - 1] = '\0';
+
+    return 0;
+}
+
+
+/* A tile pyramid has the defaults of any other image file. The file is its
+ * descriptor, with the tiles in a directory beside it
+ */
+static int initialiseTilesOutputParameters(PlotCTX *p)
+{
+    if (initialiseImageOutputParameters(p))
+        return 1;
+
+    p->output = OUTPUT_TILES;
+
+    strncpy(p->plotFilepath, TILES_FILEPATH_DEFAULT, sizeof(p->plotFilepath));
+    p->plotFilepath[sizeof(p->plotFilepath) - 1] = '\0';
+
+    return 0;
+}
+
+
 #ifdef MP_PREC
 /* Initialise MP parameters to extended-precision defaults */
 static int initialiseMP(PlotCTX *p)
@@ -440,4 +689,97 @@ static int initialiseMP(PlotCTX *p)
 
     return 0;
 }
+#endif
+
+
+/* Resolution from the largest coordinate and the real and imaginary extents
+ * of the plot
+ */
+static long getResolutionBitsExt(long double magnitude, long double real, long double imag, size_t width,
+                                 size_t height, long precision)
+{
+    long double spacing = 0.0L;
+
+    /* The finer of the two spacings limits the precision needed */
+    if (width > 1)
+        spacing = real / (width - 1);
+
+    if (height > 1 && imag / (height - 1) > 0.0L && (spacing == 0.0L || imag / (height - 1) < spacing))
+        spacing = imag / (height - 1);
+
+    if (width <= 1 && height <= 1)
+        return 0;
+    else if (!(spacing > 0.0L) || magnitude == 0.0L)
+        return precision + 1;
+
+    return (long) ilogbl(magnitude) - (long) ilogbl(spacing) + 1;
+}
+
+
+/* The extents are found in double-double, as only their leading halves can
+ * tell apart coordinates that agree to more than the precision of double
+ */
+static long getResolutionBitsDD(const PlotCTX *p)
+{
+    const ComplexDD *minimum = &(p->minimum.dd);
+    const ComplexDD *maximum = &(p->maximum.dd);
+
+    double magnitude = fmax(fmax(fabs(minimum->re.hi), fabs(maximum->re.hi)),
+                            fmax(fabs(minimum->im.hi), fabs(maximum->im.hi)));
+
+    return getResolutionBitsExt(magnitude, ddSub(maximum->re, minimum->re).hi, ddSub(maximum->im, minimum->im).hi,
+                                p->width, p->height, DD_MANT_DIG);
+}
+
+
+#ifdef MP_PREC
+static long getResolutionBitsMP(const PlotCTX *p)
+{
+    mpfr_srcptr coordinates[4] =
+    {
+        mpc_realref(p->minimum.mpc), mpc_imagref(p->minimum.mpc),
+        mpc_realref(p->maximum.mpc), mpc_imagref(p->maximum.mpc)
+    };
+
+    long magnitude = LONG_MIN;
+    long spacing = LONG_MAX;
+
+    mpfr_t size;
+    mpfr_init2(size, mpfr_get_prec(mpc_realref(p->minimum.mpc)));
+
+    /* Exponent of the largest coordinate */
+    for (int i = 0; i < 4; ++i)
+    {
+        if (!mpfr_zero_p(coordinates[i]) && mpfr_get_exp(coordinates[i]) > magnitude)
+            magnitude = mpfr_get_exp(coordinates[i]);
+    }
+
+    /* Exponent of the finer pixel spacing */
+    if (p->width > 1)
+    {
+        mpfr_sub(size, coordinates[2], coordinates[0], MP_REAL_RND);
+        mpfr_div_ui(size, size, (unsigned long) (p->width - 1), MP_REAL_RND);
+
+        if (mpfr_cmp_d(size, 0.0) > 0)
+            spacing = mpfr_get_exp(size);
+    }
+
+    if (p->height > 1)
+    {
+        mpfr_sub(size, coordinates[3], coordinates[1], MP_IMAG_RND);
+        mpfr_div_ui(size, size, (unsigned long) (p->height - 1), MP_IMAG_RND);
+
+        if (mpfr_cmp_d(size, 0.0) > 0 && mpfr_get_exp(size) < spacing)
+            spacing = mpfr_get_exp(size);
+    }
+
+    mpfr_clear(size);
+
+    if (p->width <= 1 && p->height <= 1)
+        return 0;
+    else if (magnitude == LONG_MIN || spacing == LONG_MAX)
+        return (long) mpfr_get_prec(coordinates[0]) + 1;
+
+    return magnitude - spacing + 1;
+}
 #endif
\ No newline at end of file
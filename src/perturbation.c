@@ -0,0 +1,427 @@
+#include <complex.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "libgroot/include/log.h"
+
+#include "perturbation.h"
+
+#include "ext_precision.h"
+#include "mandelbrot_parameters.h"
+#include "parameters.h"
+
+#ifdef MP_PREC
+#include <mpfr.h>
+#include <mpc.h>
+#endif
+
+
+#ifdef MP_PREC
+/* Smallest pixel dimension at which offsets are iterated as doubles. Smaller
+ * offsets come too close to the subnormal range of double to keep their
+ * precision, so long doubles are used
+ */
+static const long double PERTURBATION_STD_SCALE_MIN = 1.0e-290L;
+
+/* Series approximation is stopped once the cubic term is larger than this
+ * fraction of the linear term, as the terms left out may then be significant
+ */
+static const long double SERIES_TOLERANCE = 1.0e-12L;
+
+
+static int getPixelDimensions(ReferenceOrbit *orbit, const PlotCTX *p);
+static void computeOrbit(ReferenceOrbit *orbit, const PlotCTX *p);
+static int roundOrbit(ReferenceOrbit *orbit);
+static void computeSeries(ReferenceOrbit *orbit);
+#endif
+
+static complex perturbationStd(unsigned long *n, const ReferenceOrbit *orbit, complex delta, complex dc,
+                               unsigned long max);
+static long double complex perturbationExt(unsigned long *n, const ReferenceOrbit *orbit, long double complex delta,
+                                           long double complex dc, unsigned long max);
+
+
+#ifdef MP_PREC
+/* Compute the orbit of the centre of the plot in multiple-precision. Every
+ * other pixel is then iterated as a small offset from it in hardware
+ * floating-point, as deep zooms only need extra precision for the position of
+ * a pixel, not for the offset between pixels
+ */
+ReferenceOrbit * createReferenceOrbit(const PlotCTX *p)
+{
+    ReferenceOrbit *orbit;
+
+    if (p->type != PLOT_JULIA && p->type != PLOT_MANDELBROT)
+        return NULL;
+
+    if (p->iterations >= SIZE_MAX / sizeof(*(orbit->z)))
+    {
+        logMessage(ERROR, "Iteration count too large for a reference orbit");
+        return NULL;
+    }
+
+    orbit = malloc(sizeof(*orbit));
+
+    if (!orbit)
+    {
+        logMessage(ERROR, "Could not allocate reference orbit");
+        return NULL;
+    }
+
+    orbit->type = p->type;
+    orbit->zStd = NULL;
+    orbit->z = malloc((p->iterations + 1) * sizeof(*(orbit->z)));
+
+    if (!orbit->z)
+    {
+        logMessage(ERROR, "Could not allocate memory for %lu reference values", p->iterations + 1);
+        freeReferenceOrbit(orbit);
+        return NULL;
+    }
+
+    if (getPixelDimensions(orbit, p))
+    {
+        freeReferenceOrbit(orbit);
+        return NULL;
+    }
+
+    computeOrbit(orbit, p);
+
+    if (roundOrbit(orbit))
+    {
+        freeReferenceOrbit(orbit);
+        return NULL;
+    }
+
+    computeSeries(orbit);
+
+    logMessage(INFO, "Reference orbit computed (%zu iterations, %lu skipped by series approximation)",
+               orbit->length, orbit->skip);
+
+    return orbit;
+}
+
+
+/* Carry the orbit over to a plot of the same centre at another magnification,
+ * as the frames of a sequence are. The reference point is unchanged, so only
+ * the pixel dimensions and the series approximation are worked out again
+ */
+int rescaleReferenceOrbit(ReferenceOrbit *orbit, const PlotCTX *p)
+{
+    if (getPixelDimensions(orbit, p) || roundOrbit(orbit))
+        return 1;
+
+    computeSeries(orbit);
+
+    logMessage(INFO, "Reference orbit rescaled (%lu iterations skipped by series approximation)", orbit->skip);
+
+    return 0;
+}
+#endif
+
+
+/* Iterate a pixel at offset `delta` from the reference point, returning its
+ * final function value. The iterations run, less those skipped by the series
+ * approximation, are added to `iterations`
+ */
+long double complex perturbation(unsigned long *n, const ReferenceOrbit *orbit, long double complex delta,
+                                 unsigned long max, uintmax_t *iterations)
+{
+    long double complex z;
+
+    /* Offset added each iteration (a Julia set's constant is the same for all) */
+    long double complex dc = (orbit->type == PLOT_MANDELBROT) ? delta : 0.0L;
+
+    /* Offset of the function value after the skipped iterations */
+    long double complex u = (orbit->radius > 0.0L) ? delta / orbit->radius : 0.0L;
+    long double complex offset = ((orbit->c * u + orbit->b) * u + orbit->a) * u;
+
+    if (orbit->extended)
+        z = perturbationExt(n, orbit, offset, dc, max);
+    else
+        z = perturbationStd(n, orbit, (complex) offset, (complex) dc, max);
+
+    *iterations += *n - orbit->skip;
+
+    return z;
+}
+
+
+void freeReferenceOrbit(ReferenceOrbit *orbit)
+{
+    if (orbit)
+    {
+        free(orbit->z);
+        free(orbit->zStd);
+    }
+
+    free(orbit);
+}
+
+
+#ifdef MP_PREC
+/* Get the pixel dimensions and the position of the reference point, which is
+ * the centre of the plot
+ */
+static int getPixelDimensions(ReferenceOrbit *orbit, const PlotCTX *p)
+{
+    long double scale;
+
+    mpfr_t size;
+    mpfr_init2(size, mpSignificandSize);
+
+    orbit->pxWidth = 0.0L;
+    orbit->pxHeight = 0.0L;
+
+    if (p->width > 1)
+    {
+        mpfr_sub(size, mpc_realref(p->maximum.mpc), mpc_realref(p->minimum.mpc), MP_REAL_RND);
+        mpfr_div_ui(size, size, (unsigned long) (p->width - 1), MP_REAL_RND);
+        orbit->pxWidth = mpfr_get_ld(size, MP_REAL_RND);
+    }
+
+    if (p->height > 1)
+    {
+        mpfr_sub(size, mpc_imagref(p->maximum.mpc), mpc_imagref(p->minimum.mpc), MP_IMAG_RND);
+        mpfr_div_ui(size, size, (unsigned long) (p->height - 1), MP_IMAG_RND);
+        orbit->pxHeight = mpfr_get_ld(size, MP_IMAG_RND);
+    }
+
+    mpfr_clear(size);
+
+    orbit->xCentre = (p->width - 1) / 2.0L;
+    orbit->yCentre = (p->height - 1) / 2.0L;
+    orbit->radius = hypotl(orbit->xCentre * orbit->pxWidth, orbit->yCentre * orbit->pxHeight);
+
+    /* The smaller non-zero pixel dimension limits the range needed */
+    scale = (orbit->pxWidth > 0.0L && (orbit->pxHeight == 0.0L || orbit->pxWidth < orbit->pxHeight))
+            ? orbit->pxWidth
+            : orbit->pxHeight;
+
+    if ((p->width > 1 || p->height > 1) && !(scale >= LDBL_MIN / LDBL_EPSILON))
+    {
+        logMessage(ERROR, "Pixel size too small to be represented as a perturbation");
+        return 1;
+    }
+
+    orbit->extended = (scale < PERTURBATION_STD_SCALE_MIN);
+
+    if (orbit->extended)
+        logMessage(DEBUG, "Pixel size below %Lg - iterating offsets as long doubles", PERTURBATION_STD_SCALE_MIN);
+
+    return 0;
+}
+
+
+/* Iterate the reference point until it escapes or the maximum iteration count
+ * is reached, rounding each value to hardware floating-point
+ */
+static void computeOrbit(ReferenceOrbit *orbit, const PlotCTX *p)
+{
+    mpc_t z, c;
+    mpfr_t norm;
+
+    mpc_init2(z, mpSignificandSize);
+    mpc_init2(c, mpSignificandSize);
+    mpfr_init2(norm, mpSignificandSize);
+
+    /* Reference point in the centre of the plot */
+    mpc_add(z, p->minimum.mpc, p->maximum.mpc, MP_COMPLEX_RND);
+    mpc_div_2ui(z, z, 1, MP_COMPLEX_RND);
+
+    if (p->type == PLOT_MANDELBROT)
+    {
+        mpc_set(c, z, MP_COMPLEX_RND);
+        mpc_set_d_d(z, 0.0, 0.0, MP_COMPLEX_RND);
+    }
+    else
+    {
+        mpc_set(c, p->c.mpc, MP_COMPLEX_RND);
+    }
+
+    for (orbit->length = 0; ; ++(orbit->length))
+    {
+        orbit->z[orbit->length] = mpc_get_ldc(z, MP_COMPLEX_RND);
+        mpc_norm(norm, z, MP_REAL_RND);
+
+        if (mpfr_cmp_d(norm, ESCAPE_RADIUS_MP * ESCAPE_RADIUS_MP) >= 0 || orbit->length == p->iterations)
+            break;
+
+        mpc_sqr(z, z, MP_COMPLEX_RND);
+        mpc_add(z, z, c, MP_COMPLEX_RND);
+    }
+
+    mpc_clear(z);
+    mpc_clear(c);
+    mpfr_clear(norm);
+}
+
+
+/* Round the reference values to double, if offsets are iterated as doubles
+ * and they have not been already
+ */
+static int roundOrbit(ReferenceOrbit *orbit)
+{
+    if (orbit->extended || orbit->zStd)
+        return 0;
+
+    orbit->zStd = malloc((orbit->length + 1) * sizeof(*(orbit->zStd)));
+
+    if (!orbit->zStd)
+    {
+        logMessage(ERROR, "Could not allocate memory for %zu reference values", orbit->length + 1);
+        return 1;
+    }
+
+    for (size_t i = 0; i <= orbit->length; ++i)
+        orbit->zStd[i] = (complex) orbit->z[i];
+
+    return 0;
+}
+
+
+/* Find how many iterations every pixel can skip. While offsets are small, the
+ * offset after n iterations is well approximated by a cubic in the initial
+ * offset, whose coefficients only depend on the reference orbit. The quartic
+ * coefficient is also tracked, but only to check that the terms left out are
+ * negligible. The coefficients are scaled by powers of the plot radius so they
+ * stay in range
+ */
+static void computeSeries(ReferenceOrbit *orbit)
+{
+    long double r = orbit->radius;
+
+    /* Offsets start at zero for the Mandelbrot set, and at the pixel's offset
+     * for a Julia set
+     */
+    long double complex a = (orbit->type == PLOT_JULIA) ? r : 0.0L;
+    long double complex b = 0.0L;
+    long double complex c = 0.0L;
+    long double complex d = 0.0L;
+
+    orbit->skip = 0;
+
+    for (size_t m = 0; m < orbit->length && r > 0.0L; ++m)
+    {
+        long double complex z2 = 2.0L * orbit->z[m];
+
+        long double complex aNext = z2 * a + ((orbit->type == PLOT_MANDELBROT) ? r : 0.0L);
+        long double complex bNext = z2 * b + a * a;
+        long double complex cNext = z2 * c + 2.0L * a * b;
+        long double complex dNext = z2 * d + 2.0L * a * c + b * b;
+
+        long double linear = cabsl(aNext);
+
+        if (cabsl(cNext) > SERIES_TOLERANCE * linear || cabsl(dNext) > SERIES_TOLERANCE * linear)
+            break;
+
+        /* No pixel may escape during the skipped iterations (which also keeps
+         * the coefficients in range)
+         */
+        if (cabsl(orbit->z[m + 1]) + linear + cabsl(bNext) + cabsl(cNext) >= ESCAPE_RADIUS_EXT)
+            break;
+
+        a = aNext;
+        b = bNext;
+        c = cNext;
+        d = dNext;
+
+        orbit->skip = (unsigned long) (m + 1);
+    }
+
+    orbit->a = a;
+    orbit->b = b;
+    orbit->c = c;
+}
+#endif
+
+
+/* Iterate an offset from the reference orbit until the pixel escapes or the
+ * maximum iteration count is reached.
+ *
+ * The offset is rebased onto the start of the reference orbit if the pixel's
+ * value becomes smaller than its offset, where the offset would otherwise lose
+ * precision (Zhuoran's method), or if the reference orbit has ended. This
+ * avoids the glitches of pixels whose orbits diverge from the reference. The
+ * magnitudes are compared without squaring, as squared offsets may underflow
+ */
+static complex perturbationStd(unsigned long *n, const ReferenceOrbit *orbit, complex delta, complex dc,
+                               unsigned long max)
+{
+    const complex *ref = orbit->zStd;
+    size_t m = orbit->skip;
+
+    double dr = creal(delta), di = cimag(delta);
+    double cr = creal(dc), ci = cimag(dc);
+    double zr = creal(ref[m]) + dr, zi = cimag(ref[m]) + di;
+
+    for (*n = orbit->skip; zr * zr + zi * zi < ESCAPE_RADIUS_SQR && *n < max; ++(*n))
+    {
+        double refr, refi, tmp;
+
+        if (fabs(zr) + fabs(zi) < fabs(dr) + fabs(di) || m == orbit->length)
+        {
+            dr = zr - creal(ref[0]);
+            di = zi - cimag(ref[0]);
+            m = 0;
+        }
+
+        refr = creal(ref[m]);
+        refi = cimag(ref[m]);
+
+        /* delta = (2 * ref + delta) * delta + dc */
+        tmp = (2.0 * refr + dr) * dr - (2.0 * refi + di) * di + cr;
+        di = (2.0 * refr + dr) * di + (2.0 * refi + di) * dr + ci;
+        dr = tmp;
+
+        ++m;
+
+        zr = creal(ref[m]) + dr;
+        zi = cimag(ref[m]) + di;
+    }
+
+    return zr + zi * I;
+}
+
+
+/* Iterate an offset from the reference orbit (extended-precision) */
+static long double complex perturbationExt(unsigned long *n, const ReferenceOrbit *orbit, long double complex delta,
+                                           long double complex dc, unsigned long max)
+{
+    const long double complex *ref = orbit->z;
+    size_t m = orbit->skip;
+
+    long double dr = creall(delta), di = cimagl(delta);
+    long double cr = creall(dc), ci = cimagl(dc);
+    long double zr = creall(ref[m]) + dr, zi = cimagl(ref[m]) + di;
+
+    for (*n = orbit->skip; zr * zr + zi * zi < ESCAPE_RADIUS_SQR_EXT && *n < max; ++(*n))
+    {
+        long double refr, refi, tmp;
+
+        if (fabsl(zr) + fabsl(zi) < fabsl(dr) + fabsl(di) || m == orbit->length)
+        {
+            dr = zr - creall(ref[0]);
+            di = zi - cimagl(ref[0]);
+            m = 0;
+        }
+
+        refr = creall(ref[m]);
+        refi = cimagl(ref[m]);
+
+        tmp = (2.0L * refr + dr) * dr - (2.0L * refi + di) * di + cr;
+        di = (2.0L * refr + dr) * di + (2.0L * refi + di) * dr + ci;
+        dr = tmp;
+
+        ++m;
+
+        zr = creall(ref[m]) + dr;
+        zi = cimagl(ref[m]) + di;
+    }
+
+    return zr + zi * I;
+}
@@ -0,0 +1,613 @@
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "libgroot/include/log.h"
+
+#include "png.h"
+
+#include "colour.h"
+#include "parameters.h"
+
+
+/* Filtered data in each segment - as the blocks of pigz */
+#define PNG_SEGMENT_SIZE ((size_t) 128 << 10)
+
+/* Segments in a round, per thread, so threads finishing early take another */
+#define PNG_SEGMENTS_PER_THREAD 2
+
+#define PNG_COMPRESSION_LEVEL Z_DEFAULT_COMPRESSION
+#define PNG_MEM_LEVEL 8
+
+/* Memory of the state of a deflate stream, as given in zconf.h */
+#define PNG_DEFLATE_STATE_SIZE (((size_t) 1 << (MAX_WBITS + 2)) + ((size_t) 1 << (PNG_MEM_LEVEL + 9)))
+
+/* Space for the sync flush ending a segment, beyond the bound of deflate */
+#define PNG_FLUSH_MARGIN 16
+
+#define PNG_DIMENSION_MAX 0x7FFFFFFF
+
+/* Colour types of the IHDR chunk */
+#define PNG_COLOUR_GREY 0
+#define PNG_COLOUR_RGB 2
+
+/* Row filter types */
+enum
+{
+    PNG_FILTER_NONE,
+    PNG_FILTER_SUB,
+    PNG_FILTER_UP,
+    PNG_FILTER_AVERAGE,
+    PNG_FILTER_PAETH,
+    PNG_FILTER_COUNT
+};
+
+
+static const unsigned char PNG_SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+/* zlib stream header (32K window, default compression) */
+static const unsigned char ZLIB_HEADER[] = {0x78, 0x9C};
+
+/* Empty final block of fixed codes, ending the deflate stream after the last
+ * sync-flushed segment
+ */
+static const unsigned char DEFLATE_END[] = {0x03, 0x00};
+
+
+static void * compressThread(void *encoder);
+static int compressSegment(const PNGEncoder *png, PNGSegment *s, z_stream *strm);
+static void filterRow(unsigned char *dest, const unsigned char *row, const unsigned char *prior, size_t n, size_t bpp,
+                      int type);
+static unsigned char paethPredictor(unsigned char a, unsigned char b, unsigned char c);
+static size_t writeHeader(unsigned char *dest, size_t width, size_t height, BitDepth depth);
+static size_t writeChunk(unsigned char *dest, const char *type, const unsigned char *data, size_t n);
+static int putChunk(FILE *f, const char *type, const unsigned char *data, size_t n);
+static void encodeU32(unsigned char *dest, uint32_t x);
+static unsigned int getEncoderThreads(unsigned int threads);
+static size_t getSegmentRows(size_t rowSize);
+
+
+/* Fill the PNG_HEADER_LEN bytes of the header of a PNG image of the plot.
+ * Returns 0 if the plot cannot be a PNG image
+ */
+size_t getPNGHeader(unsigned char *dest, const PlotCTX *p)
+{
+    return writeHeader(dest, p->width, p->height, p->colour.depth);
+}
+
+
+PNGEncoder * createPNGEncoder(void)
+{
+    PNGEncoder *png = malloc(sizeof(*png));
+
+    if (!png)
+        return NULL;
+
+    if (pthread_mutex_init(&(png->mutex), NULL))
+    {
+        free(png);
+        return NULL;
+    }
+
+    png->segments = NULL;
+    png->segmentCount = 0;
+    png->prior = NULL;
+
+    return png;
+}
+
+
+/* Set up the encoder to write the rows of the plot after its header. With
+ * `threads` as 0, there is a thread for each processor
+ */
+int initialisePNGEncoder(PNGEncoder *png, const PlotCTX *p, unsigned int threads)
+{
+    size_t filteredSize;
+
+    if (!png)
+        return 1;
+
+    png->file = p->file;
+    png->depth = p->colour.depth;
+    png->width = p->width;
+    png->rowSize = (p->width * p->colour.depth) / CHAR_BIT;
+    png->bpp = (p->colour.depth > CHAR_BIT) ? p->colour.depth / CHAR_BIT : 1;
+    png->invert = (p->colour.depth == BIT_DEPTH_1);
+    png->adler = adler32(0L, Z_NULL, 0);
+
+    threads = getEncoderThreads(threads);
+
+    png->threads = threads;
+    png->segmentRows = getSegmentRows(png->rowSize);
+
+    filteredSize = png->segmentRows * (png->rowSize + 1);
+
+    png->prior = calloc(png->rowSize, sizeof(char));
+    png->segments = calloc((size_t) threads * PNG_SEGMENTS_PER_THREAD, sizeof(PNGSegment));
+
+    if (!png->prior || !png->segments)
+    {
+        logMessage(ERROR, "Memory allocation failed");
+        return 1;
+    }
+
+    for (png->segmentCount = 0; png->segmentCount < (size_t) threads * PNG_SEGMENTS_PER_THREAD; ++(png->segmentCount))
+    {
+        PNGSegment *s = &(png->segments[png->segmentCount]);
+
+        s->outSize = compressBound((uLong) filteredSize) + PNG_FLUSH_MARGIN;
+        s->filtered = malloc(filteredSize);
+        s->out = malloc(s->outSize);
+
+        if (!s->filtered || !s->out)
+        {
+            logMessage(ERROR, "Memory allocation failed");
+            free(s->filtered);
+            free(s->out);
+            return 1;
+        }
+    }
+
+    logMessage(DEBUG, "PNG rows compressed %zu at a time on %u threads", png->segmentRows, threads);
+
+    return 0;
+}
+
+
+/* Memory an encoder of the plot would take on `threads` threads (0 for a
+ * thread for each processor), so it can be left aside when planning blocks
+ */
+size_t getPNGEncoderSize(const PlotCTX *p, unsigned int threads)
+{
+    size_t rowSize = (p->width * p->colour.depth) / CHAR_BIT;
+    size_t filteredSize = getSegmentRows(rowSize) * (rowSize + 1);
+    size_t segmentSize = filteredSize + compressBound((uLong) filteredSize) + PNG_FLUSH_MARGIN;
+
+    threads = getEncoderThreads(threads);
+
+    return rowSize + (size_t) threads * (PNG_SEGMENTS_PER_THREAD * segmentSize + PNG_DEFLATE_STATE_SIZE);
+}
+
+
+/* Filter, compress and write the next `n` rows of the image. The rows are
+ * split into segments, and each round of segments compressed across the
+ * threads before being written in order
+ */
+int writePNGRows(PNGEncoder *png, const char *rows, size_t n)
+{
+    for (size_t row = 0; row < n; )
+    {
+        pthread_t *pids = NULL;
+        unsigned int created = 0;
+        size_t round;
+
+        for (round = 0; round < png->segmentCount && row < n; ++round)
+        {
+            PNGSegment *s = &(png->segments[round]);
+
+            s->rows = rows + row * png->rowSize;
+            s->prior = (row) ? s->rows - png->rowSize : png->prior;
+            s->count = (n - row < png->segmentRows) ? n - row : png->segmentRows;
+
+            row += s->count;
+        }
+
+        png->roundCount = round;
+        png->next = 0;
+
+        /* This thread compresses segments alongside the rest */
+        if (png->threads > 1 && round > 1)
+            pids = malloc((png->threads - 1) * sizeof(pthread_t));
+
+        if (pids)
+        {
+            for (; created < png->threads - 1 && created + 1 < round; ++created)
+            {
+                if (pthread_create(&(pids[created]), NULL, compressThread, png))
+                {
+                    logMessage(WARNING, "Compression thread could not be created");
+                    break;
+                }
+            }
+        }
+
+        compressThread(png);
+
+        for (unsigned int i = 0; i < created; ++i)
+        {
+            if (pthread_join(pids[i], NULL))
+                logMessage(WARNING, "Compression thread could not be harvested");
+        }
+
+        free(pids);
+
+        for (size_t i = 0; i < round; ++i)
+        {
+            PNGSegment *s = &(png->segments[i]);
+
+            if (s->error)
+            {
+                logMessage(ERROR, "Rows could not be compressed");
+                return 1;
+            }
+
+            png->adler = adler32_combine(png->adler, s->adler, (z_off_t) s->len);
+
+            if (putChunk(png->file, "IDAT", s->out, s->outLen))
+            {
+                logMessage(ERROR, "Rows could not be written to image file");
+                return 1;
+            }
+        }
+    }
+
+    if (n)
+        memcpy(png->prior, rows + (n - 1) * png->rowSize, png->rowSize);
+
+    return 0;
+}
+
+
+/* End the zlib stream and the image, once every row is written */
+int finishPNG(PNGEncoder *png)
+{
+    unsigned char end[sizeof(DEFLATE_END) + 4];
+
+    memcpy(end, DEFLATE_END, sizeof(DEFLATE_END));
+    encodeU32(end + sizeof(DEFLATE_END), (uint32_t) png->adler);
+
+    if (putChunk(png->file, "IDAT", end, sizeof(end)) || putChunk(png->file, "IEND", NULL, 0))
+    {
+        logMessage(ERROR, "End of image could not be written");
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/* Start another image of the same dimensions and depth in `file`, whose
+ * header has been written, reusing the encoder's buffers
+ */
+void restartPNG(PNGEncoder *png, FILE *file)
+{
+    png->file = file;
+    png->adler = adler32(0L, Z_NULL, 0);
+
+    memset(png->prior, 0, png->rowSize);
+}
+
+
+/* Start another image of `width` by `height` pixels in `file`, writing its
+ * header. The image may be narrower than the plot the encoder was set up for
+ * (rows of segments are counted at that width, so still fit its buffers)
+ */
+int startPNGImage(PNGEncoder *png, FILE *file, size_t width, size_t height)
+{
+    unsigned char header[PNG_HEADER_LEN];
+    size_t len;
+
+    if (width > png->width || !(len = writeHeader(header, width, height, png->depth)))
+        return 1;
+
+    if (fwrite(header, sizeof(char), len, file) != len)
+    {
+        logMessage(ERROR, "Header could not be written to image file");
+        return 1;
+    }
+
+    png->rowSize = (width * png->depth) / CHAR_BIT;
+    restartPNG(png, file);
+
+    return 0;
+}
+
+
+void freePNGEncoder(PNGEncoder *png)
+{
+    if (!png)
+        return;
+
+    for (size_t i = 0; i < png->segmentCount; ++i)
+    {
+        free(png->segments[i].filtered);
+        free(png->segments[i].out);
+    }
+
+    free(png->segments);
+    free(png->prior);
+    pthread_mutex_destroy(&(png->mutex));
+    free(png);
+}
+
+
+/* Claim and compress segments of the round until there are none left. Each
+ * thread keeps one deflate stream, reset for every segment
+ */
+static void * compressThread(void *encoder)
+{
+    PNGEncoder *png = encoder;
+    z_stream strm;
+    int initialised;
+
+    memset(&strm, 0, sizeof(strm));
+
+    /* Raw deflate, as the segments are wrapped in a single zlib stream */
+    initialised = (deflateInit2(&strm, PNG_COMPRESSION_LEVEL, Z_DEFLATED, -MAX_WBITS, PNG_MEM_LEVEL,
+                                Z_DEFAULT_STRATEGY) == Z_OK);
+
+    while (1)
+    {
+        size_t i;
+
+        pthread_mutex_lock(&(png->mutex));
+        i = (png->next)++;
+        pthread_mutex_unlock(&(png->mutex));
+
+        if (i >= png->roundCount)
+            break;
+
+        png->segments[i].error = (!initialised || compressSegment(png, &(png->segments[i]), &strm));
+    }
+
+    if (initialised)
+        deflateEnd(&strm);
+
+    return NULL;
+}
+
+
+/* Filter the rows of a segment and deflate them, ending on a sync flush so
+ * the next segment's output can follow
+ */
+static int compressSegment(const PNGEncoder *png, PNGSegment *s, z_stream *strm)
+{
+    const unsigned char *prior = (const unsigned char *) s->prior;
+    const unsigned char *row = (const unsigned char *) s->rows;
+    unsigned char *dest = s->filtered;
+
+    for (size_t i = 0; i < s->count; ++i, prior = row, row += png->rowSize, dest += png->rowSize + 1)
+    {
+        if (png->invert)
+        {
+            /* Bit depths below a byte are left unfiltered, as libpng does */
+            dest[0] = PNG_FILTER_NONE;
+
+            for (size_t j = 0; j < png->rowSize; ++j)
+                dest[j + 1] = (unsigned char) ~row[j];
+        }
+        else
+        {
+            /* Keep the filter whose output has the least sum of absolute
+             * differences - the heuristic of the PNG specification
+             */
+            unsigned long best = ULONG_MAX;
+            int bestType = PNG_FILTER_NONE;
+
+            for (int type = PNG_FILTER_NONE; type < PNG_FILTER_COUNT; ++type)
+            {
+                unsigned long sum = 0;
+
+                filterRow(dest, row, prior, png->rowSize, png->bpp, type);
+
+                for (size_t j = 1; j <= png->rowSize; ++j)
+                    sum += (dest[j] < 128) ? dest[j] : 256 - dest[j];
+
+                if (sum < best)
+                {
+                    best = sum;
+                    bestType = type;
+                }
+            }
+
+            if (bestType != PNG_FILTER_COUNT - 1)
+                filterRow(dest, row, prior, png->rowSize, png->bpp, bestType);
+        }
+    }
+
+    s->len = s->count * (png->rowSize + 1);
+    s->adler = adler32(adler32(0L, Z_NULL, 0), s->filtered, (uInt) s->len);
+
+    if (deflateReset(strm) != Z_OK)
+        return 1;
+
+    strm->next_in = s->filtered;
+    strm->avail_in = (uInt) s->len;
+    strm->next_out = s->out;
+    strm->avail_out = (uInt) s->outSize;
+
+    /* A full output buffer may hold back some of the flush */
+    if (deflate(strm, Z_SYNC_FLUSH) != Z_OK || strm->avail_in || !strm->avail_out)
+        return 1;
+
+    s->outLen = s->outSize - strm->avail_out;
+
+    return 0;
+}
+
+
+/* Filter a row of `n` bytes into the filter type byte and filtered bytes */
+static void filterRow(unsigned char *dest, const unsigned char *row, const unsigned char *prior, size_t n, size_t bpp,
+                      int type)
+{
+    size_t j;
+
+    dest[0] = (unsigned char) type;
+    ++dest;
+
+    switch (type)
+    {
+        case PNG_FILTER_SUB:
+            for (j = 0; j < bpp && j < n; ++j)
+                dest[j] = row[j];
+
+            for (; j < n; ++j)
+                dest[j] = (unsigned char) (row[j] - row[j - bpp]);
+
+            break;
+        case PNG_FILTER_UP:
+            for (j = 0; j < n; ++j)
+                dest[j] = (unsigned char) (row[j] - prior[j]);
+
+            break;
+        case PNG_FILTER_AVERAGE:
+            for (j = 0; j < bpp && j < n; ++j)
+                dest[j] = (unsigned char) (row[j] - prior[j] / 2);
+
+            for (; j < n; ++j)
+                dest[j] = (unsigned char) (row[j] - (row[j - bpp] + prior[j]) / 2);
+
+            break;
+        case PNG_FILTER_PAETH:
+            for (j = 0; j < bpp && j < n; ++j)
+                dest[j] = (unsigned char) (row[j] - prior[j]);
+
+            for (; j < n; ++j)
+                dest[j] = (unsigned char) (row[j] - paethPredictor(row[j - bpp], prior[j], prior[j - bpp]));
+
+            break;
+        default:
+            memcpy(dest, row, n);
+            break;
+    }
+}
+
+
+static unsigned char paethPredictor(unsigned char a, unsigned char b, unsigned char c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+
+    if (pa <= pb && pa <= pc)
+        return a;
+    else if (pb <= pc)
+        return b;
+
+    return c;
+}
+
+
+/* Header of an image of `width` by `height` pixels, as getPNGHeader() */
+static size_t writeHeader(unsigned char *dest, size_t width, size_t height, BitDepth depth)
+{
+    unsigned char ihdr[13];
+    size_t len = 0;
+
+    if (width < 1 || width > PNG_DIMENSION_MAX || height < 1 || height > PNG_DIMENSION_MAX)
+        return 0;
+
+    encodeU32(ihdr, (uint32_t) width);
+    encodeU32(ihdr + 4, (uint32_t) height);
+
+    switch (depth)
+    {
+        case BIT_DEPTH_1:
+            ihdr[8] = 1;
+            ihdr[9] = PNG_COLOUR_GREY;
+            break;
+        case BIT_DEPTH_8:
+            ihdr[8] = 8;
+            ihdr[9] = PNG_COLOUR_GREY;
+            break;
+        case BIT_DEPTH_24:
+            ihdr[8] = 8;
+            ihdr[9] = PNG_COLOUR_RGB;
+            break;
+        default:
+            return 0;
+    }
+
+    /* Deflate, adaptive filtering, no interlacing */
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+
+    memcpy(dest, PNG_SIGNATURE, sizeof(PNG_SIGNATURE));
+    len += sizeof(PNG_SIGNATURE);
+    len += writeChunk(dest + len, "IHDR", ihdr, sizeof(ihdr));
+    len += writeChunk(dest + len, "IDAT", ZLIB_HEADER, sizeof(ZLIB_HEADER));
+
+    return len;
+}
+
+
+/* Encode a chunk - length, type, data and CRC - returning its length */
+static size_t writeChunk(unsigned char *dest, const char *type, const unsigned char *data, size_t n)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    encodeU32(dest, (uint32_t) n);
+    memcpy(dest + 4, type, 4);
+
+    if (n)
+        memcpy(dest + 8, data, n);
+
+    crc = crc32(crc, dest + 4, (uInt) (n + 4));
+    encodeU32(dest + 8 + n, (uint32_t) crc);
+
+    return n + 12;
+}
+
+
+/* Write a chunk to the file, without copying its data */
+static int putChunk(FILE *f, const char *type, const unsigned char *data, size_t n)
+{
+    unsigned char head[8], tail[4];
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    encodeU32(head, (uint32_t) n);
+    memcpy(head + 4, type, 4);
+
+    crc = crc32(crc, head + 4, 4);
+
+    if (n)
+        crc = crc32(crc, data, (uInt) n);
+
+    encodeU32(tail, (uint32_t) crc);
+
+    if (fwrite(head, sizeof(head), 1, f) != 1 || (n && fwrite(data, n, 1, f) != 1) || fwrite(tail, sizeof(tail), 1, f) != 1)
+        return 1;
+
+    return 0;
+}
+
+
+/* PNG integers are big-endian */
+static void encodeU32(unsigned char *dest, uint32_t x)
+{
+    dest[0] = (unsigned char) (x >> 24);
+    dest[1] = (unsigned char) (x >> 16);
+    dest[2] = (unsigned char) (x >> 8);
+    dest[3] = (unsigned char) x;
+}
+
+
+static unsigned int getEncoderThreads(unsigned int threads)
+{
+    long procs;
+
+    if (threads)
+        return threads;
+
+    procs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (procs < 1) ? 1 : (procs > UINT_MAX) ? UINT_MAX : (unsigned int) procs;
+}
+
+
+/* Rows of a full segment - at least one, however long the rows */
+static size_t getSegmentRows(size_t rowSize)
+{
+    size_t rows = PNG_SEGMENT_SIZE / (rowSize + 1);
+
+    return (rows < 1) ? 1 : rows;
+}
\ No newline at end of file
@@ -1,12 +1,15 @@
 #include <complex.h>
 #include <ctype.h>
+#include <float.h>
 #include <math.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "percy/include/parser.h"
 
 #include "process_args.h"
 
+#include "double_double.h"
 #include "getopt_error.h"
 #include "parameters.h"
 
@@ -16,6 +19,10 @@
 #endif
 
 
+static void refineComplexDD(ComplexDD *z, char *arg, long double complex approx);
+static bool isCloseDD(DoubleDouble x, long double approx);
+
+
 /* Wrapper for stringToULong() */
 ParseErr uLongArg(unsigned long *x, char *arg, unsigned long min, unsigned long max)
 {
@@ -136,6 +143,23 @@ ParseErr complexArgExt(long double complex *z, char *arg, long double complex mi
 }
 
 
+/* Wrapper for stringToComplexL(), with the value then read again to
+ * double-double precision
+ */
+ParseErr complexArgDD(ComplexDD *z, char *arg, long double complex min, long double complex max)
+{
+    long double complex approx;
+    ParseErr argError = complexArgExt(&approx, arg, min, max);
+
+    if (argError != PARSE_SUCCESS)
+        return argError;
+
+    refineComplexDD(z, arg, approx);
+
+    return PARSE_SUCCESS;
+}
+
+
 ParseErr magArg(PlotCTX *p, char *arg, complex cMin, complex cMax, double mMin, double mMax)
 {
     complex range, centre;
@@ -250,6 +274,72 @@ ParseErr magArgExt(PlotCTX *p, char *arg, long double complex cMin, long double
 }
 
 
+ParseErr magArgDD(PlotCTX *p, char *arg, long double complex cMin, long double complex cMax, double mMin, double mMax)
+{
+    long double complex approx;
+    ComplexDD centre;
+    DoubleDouble rangeRe, rangeIm;
+    double magnification, scale;
+
+    char *endptr;
+    ParseErr argError = stringToComplexL(&approx, arg, cMin, cMax, &endptr);
+
+    if (argError == PARSE_SUCCESS)
+    {
+        /* Magnification not explicitly mentioned - default to 1 */
+        magnification = 1.0;
+    }
+    else if (argError == PARSE_EEND)
+    {
+        /* Check for comma separator */
+        while (isspace(*endptr))
+            ++endptr;
+
+        if (*endptr != ',')
+            return PARSE_EFORM;
+
+        ++endptr;
+
+        /* Get magnification argument */
+        argError = floatArg(&magnification, endptr, mMin, mMax);
+
+        if (argError == PARSE_ERANGE || argError == PARSE_EMIN || argError == PARSE_EMAX)
+        {
+            floatArgRangeErrorMessageExt(mMin, mMax);
+            return PARSE_ERANGE;
+        }
+        else if (argError != PARSE_SUCCESS)
+        {
+            return PARSE_EERR;
+        }
+    }
+    else if (argError == PARSE_ERANGE || argError == PARSE_EMIN || argError == PARSE_EMAX)
+    {
+        complexArgRangeErrorMessageExt(cMin, cMax);
+        return PARSE_ERANGE;
+    }
+    else
+    {
+        return PARSE_EFORM;
+    }
+
+    refineComplexDD(&centre, arg, approx);
+
+    /* Convert centrepoint and magnification to range */
+    scale = 0.5 * pow(0.9, magnification - 1.0);
+
+    rangeRe = ddMulD(ddSub(p->maximum.dd.re, p->minimum.dd.re), scale);
+    rangeIm = ddMulD(ddSub(p->maximum.dd.im, p->minimum.dd.im), scale);
+
+    p->minimum.dd.re = ddSub(centre.re, rangeRe);
+    p->minimum.dd.im = ddSub(centre.im, rangeIm);
+    p->maximum.dd.re = ddAdd(centre.re, rangeRe);
+    p->maximum.dd.im = ddAdd(centre.im, rangeIm);
+
+    return PARSE_SUCCESS;
+}
+
+
 #ifdef MP_PREC
 /* Wrapper for stringToComplexMPC() */
 ParseErr complexArgMP(mpc_t z, char *arg, mpc_t min, mpc_t max)
@@ -381,4 +471,66 @@ int validateIPAddress(char *addr)
     }
 
     return 0;
+}
+
+
+/* Read a complex argument, already validated and read in extended-precision,
+ * again in double-double. Forms not recognised here, or readings that do not
+ * agree with the extended-precision value, keep the extended-precision value
+ */
+static void refineComplexDD(ComplexDD *z, char *arg, long double complex approx)
+{
+    DoubleDouble re = {0.0, 0.0};
+    DoubleDouble im = {0.0, 0.0};
+    char *endptr;
+
+    z->re = longDoubleToDD(creall(approx));
+    z->im = longDoubleToDD(cimagl(approx));
+
+    if (stringToDD(&re, arg, &endptr))
+        return;
+
+    while (isspace(*endptr))
+        ++endptr;
+
+    if (*endptr == 'i')
+    {
+        /* Imaginary part only */
+        im = re;
+        re.hi = re.lo = 0.0;
+    }
+    else if (*endptr == '+' || *endptr == '-')
+    {
+        bool negative = (*(endptr++) == '-');
+
+        if (stringToDD(&im, endptr, &endptr))
+            return;
+
+        while (isspace(*endptr))
+            ++endptr;
+
+        if (*endptr != 'i')
+            return;
+
+        if (negative)
+        {
+            im.hi = -im.hi;
+            im.lo = -im.lo;
+        }
+    }
+
+    if (isCloseDD(re, creall(approx)) && isCloseDD(im, cimagl(approx)))
+    {
+        z->re = re;
+        z->im = im;
+    }
+}
+
+
+/* Whether a double-double differs from a long double by no more than the
+ * rounding error of the long double
+ */
+static bool isCloseDD(DoubleDouble x, long double approx)
+{
+    return fabsl(ddToLongDouble(x) - approx) <= 4.0L * LDBL_EPSILON * fabsl(approx);
 }
\ No newline at end of file
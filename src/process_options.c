@@ -1,3 +1,4 @@
+#include <float.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -13,13 +14,19 @@
 
 #include "process_options.h"
 
+#include "anti_alias.h"
 #include "arg_ranges.h"
 #include "getopt_error.h"
+#include "gpu.h"
 #include "image.h"
 #include "network_ctx.h"
 #include "parameters.h"
 #include "process_args.h"
 #include "program_ctx.h"
+#include "pyramid.h"
+#include "raw.h"
+#include "report.h"
+#include "sequence.h"
 
 #ifdef MP_PREC
 #include <mpfr.h>
@@ -28,6 +35,31 @@
 
 const uint16_t PORT_DEFAULT = 7939;
 
+/* Default number of rows in each unit of work, and units outstanding at each
+ * worker. Queuing a second unit hides the round trip to the master
+ */
+const size_t UNIT_ROWS_DEFAULT = 8;
+const unsigned int UNIT_DEPTH_DEFAULT = 2;
+
+/* Default number of threads a master receives from its workers on */
+const unsigned int IO_THREADS_DEFAULT = 1;
+
+/* Default seconds between heartbeats, and seconds a worker keeps trying to
+ * reach its master before giving up
+ */
+const unsigned int HEARTBEAT_DEFAULT = 5;
+const unsigned int RETRY_DEFAULT = 60;
+
+/* Bits of precision beyond the pixel spacing when the precision is chosen
+ * automatically, as rounding errors grow with each iteration
+ */
+static const long AUTO_PRECISION_GUARD_BITS = 12;
+
+#ifdef MP_PREC
+/* Significand size the plot is first read at when choosing the precision */
+static const mpfr_prec_t AUTO_PRECISION_PARSE_BITS = 4096;
+#endif
+
 
 #ifdef MP_PREC
 static const char *GETOPT_STRING = ":Ac:g:G:i:j:l:m:M:o:p:r:s:tT:vx:Xz:";
@@ -35,11 +67,25 @@ static const char *GETOPT_STRING = ":Ac:g:G:i:j:l:m:M:o:p:r:s:tT:vx:Xz:";
 static const char *GETOPT_STRING = ":c:g:G:i:j:l:m:M:o:p:r:s:tT:vx:Xz:";
 #endif
 
+/* Options that may be given to a render job - those of the plot and its
+ * image file, as the rest are the server's own
+ */
+#ifdef MP_PREC
+static const char *JOB_OPTIONS = "AcdijmMNoPrsWxXYZ3";
+#else
+static const char *JOB_OPTIONS = "cdijmMNorsWxXYZ3";
+#endif
+
 static const struct option LONG_OPTIONS[] =
 {
     #ifdef MP_PREC
     {"multiple", no_argument, NULL, 'A'},         /* Use multiple precision */
     {"precision", required_argument, NULL, 'P'},  /* Specify number of bits to use for the MP significand */
+    {"perturbation", no_argument, NULL, 'D'},     /* Iterate pixels as offsets from a multiple-precision orbit */
+    #endif
+
+    #ifdef OPENCL
+    {"gpu", optional_argument, NULL, '0'},        /* Plot on a GPU alongside the processor threads */
     #endif
 
     {"colour", required_argument, NULL, 'c'},     /* Colour scheme of PPM image */
@@ -47,6 +93,8 @@ static const struct option LONG_OPTIONS[] =
     {"master", required_argument, NULL, 'G'},     /* Initialise as a master for distributed computation */
     {"iterations", required_argument, NULL, 'i'}, /* Maximum iteration count of function */
     {"julia", required_argument, NULL, 'j'},      /* Plot a Julia set with specified constant */
+    {"formula", required_argument, NULL, 'Z'},    /* Function iterated to plot the set */
+    {"degree", required_argument, NULL, 'd'},     /* Degree of a Multibrot set */
     {"log", no_argument, NULL, 'k'},              /* Output log to file */
     {"log-file", required_argument, NULL, 'K'},   /* Specify filepath of log */
     {"log-level", required_argument, NULL, 'l'},  /* Minimum log level to output */
@@ -57,20 +105,55 @@ static const struct option LONG_OPTIONS[] =
     {"threads", required_argument, NULL, 'T'},    /* Specify thread count */
     {"centre", required_argument, NULL, 'x'},     /* Centre coordinate and magnification of plot */
     {"extended", no_argument, NULL, 'X'},         /* Use extended precision */
+    {"double-double", no_argument, NULL, 'Y'},    /* Use double-double precision */
     {"memory", required_argument, NULL, 'z'},     /* Maximum memory usage in MB */
+    {"checkpoint", no_argument, NULL, 'C'},       /* Record the rows written, so the plot can be resumed */
+    {"resume", no_argument, NULL, 'E'},           /* Carry on a plot from its checkpoint */
+    {"raw", no_argument, NULL, 'W'},              /* Output smoothed iteration values, to be coloured later */
+    {"recolour", required_argument, NULL, 'Q'},   /* Colour a raw image rather than plot one */
+    {"png", no_argument, NULL, 'N'},              /* Output a PNG image */
+    {"tiles", optional_argument, NULL, '3'},      /* Output a Deep Zoom tile pyramid */
+    {"mmap", no_argument, NULL, 'V'},             /* Plot in place in the mapped image file */
+    {"tile-width", required_argument, NULL, 'b'}, /* Width of each unit of work in pixels */
+    {"tile-height", required_argument, NULL, 'B'},
+    {"no-subdivide", no_argument, NULL, 'S'},     /* Compute every pixel of each tile */
+    {"no-symmetry", no_argument, NULL, 'F'},      /* Plot rows that mirror earlier rows */
+    {"anti-alias", optional_argument, NULL, '1'}, /* Supersample pixels at edges */
+    {"unit-rows", required_argument, NULL, 'u'},  /* Rows in each unit of work sent to a worker */
+    {"unit-depth", required_argument, NULL, 'U'}, /* Units of work outstanding at each worker */
+    {"no-compress", no_argument, NULL, 'n'},      /* Have workers send rows unencoded */
+    {"send-iterations", no_argument, NULL, 'I'},  /* Have workers send iteration values for the master to colour */
+    {"io-threads", required_argument, NULL, 'O'}, /* Threads the master receives rows from workers on */
+    {"no-local", no_argument, NULL, 'L'},         /* Have the master plot no rows itself */
+    {"heartbeat", required_argument, NULL, 'H'},  /* Seconds between heartbeats of master and workers */
+    {"retry", required_argument, NULL, 'R'},      /* Seconds a worker keeps trying to reach its master */
+    {"stats", required_argument, NULL, 'J'},      /* Write run statistics as JSON to a file */
+    {"stats-interval", required_argument, NULL, 'q'}, /* Seconds between interim statistics reports */
+    {"affinity", required_argument, NULL, 'a'},   /* Pin threads to CPUs by NUMA node */
+    {"first-touch", no_argument, NULL, 'f'},      /* Place block pages on the nodes of the threads plotting them */
+    {"huge-pages", no_argument, NULL, 'e'},       /* Back block arrays with huge pages */
+    {"frames", required_argument, NULL, 'w'},     /* Plot a sequence of frames zooming into the centre */
+    {"zoom-to", required_argument, NULL, 'y'},    /* Magnification of the last frame of a sequence */
+    {"serve", required_argument, NULL, '2'},      /* Serve render jobs on a Unix domain socket */
     {"help", no_argument, NULL, 'h'},             /* Display help message and exit */
     {0, 0, 0, 0}
 };
 
 
-static int parsePrecisionMode(PrecisionMode *precision, int argc, char **argv);
+static int parsePrecisionMode(PrecisionMode *precision, bool *automatic, int argc, char **argv);
+static PlotCTX * parsePlotOptions(PrecisionMode precision, PlotType plot, Formula formula, OutputType output,
+                                  int argc, char **argv);
+static PrecisionMode selectPrecision(ProgramCTX *ctx, const PlotCTX *p);
 static int parseGlobalOptions(ProgramCTX *ctx, int argc, char **argv);
 static NetworkCTX * parseNetworkOptions(int argc, char **argv);
 static int parseDiscreteOptions(PlotCTX *p, int argc, char **argv);
 static int parseContinuousOptions(PlotCTX *p, int argc, char **argv);
 static PlotType parsePlotType(int argc, char **argv);
+static int parseFormula(Formula *formula, int argc, char **argv);
 static OutputType parseOutputType(int argc, char **argv);
 static int parseMagnification(PlotCTX *p, int argc, char **argv);
+static int parseRecolourOptions(PlotCTX *p, int argc, char **argv);
+static ParseErr parseTileSize(PlotCTX *p, char *arg);
 
 
 /* Scan argv for invalid command-line options */
@@ -99,6 +182,28 @@ int validateOptions(int argc, char **argv)
 }
 
 
+/* Scan the options of a render job for any that are invalid, or not of the
+ * plot
+ */
+int validateJobOptions(int argc, char **argv)
+{
+    if (validateOptions(argc, argv))
+        return -1;
+
+    optind = 0;
+    while ((opt = getopt_long(argc, argv, GETOPT_STRING, LONG_OPTIONS, NULL)) != -1)
+    {
+        if (!strchr(JOB_OPTIONS, opt))
+        {
+            fprintf(stderr, "%s: %s: Option cannot be given to a render job\n", programName, argv[optind - 1]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
 int processProgramOptions(ProgramCTX *ctx, NetworkCTX **network, int argc, char **argv)
 {
     if (!ctx || !network)
@@ -122,48 +227,151 @@ int processProgramOptions(ProgramCTX *ctx, NetworkCTX **network, int argc, char
     if (!(*network))
         return -1;
 
+    if (ctx->serve && (*network)->mode == LAN_WORKER)
+    {
+        fprintf(stderr, "%s: --serve: Option mutually exclusive with -%c\n", programName, 'g');
+        getoptErrorMessage(OPT_NONE, NULL);
+        return -1;
+    }
+
     return 0;
 }
 
 
-PlotCTX * processPlotOptions(int argc, char **argv)
+PlotCTX * processPlotOptions(ProgramCTX *ctx, int argc, char **argv)
 {
     PlotCTX *p;
     PrecisionMode precision;
+    bool automatic;
+
+    Formula formula;
 
     PlotType plot = parsePlotType(argc, argv);
     OutputType output = parseOutputType(argc, argv);
 
-    if (output == OUTPUT_NONE)
+    if (output == OUTPUT_NONE || parseFormula(&formula, argc, argv))
+        return NULL;
+
+    if (ctx->frames > 1 && (output == OUTPUT_TERMINAL || output == OUTPUT_TILES))
+    {
+        if (output == OUTPUT_TERMINAL)
+            fprintf(stderr, "%s: --frames: Option mutually exclusive with -%c\n", programName, 't');
+        else
+            fprintf(stderr, "%s: --frames: Option mutually exclusive with --tiles\n", programName);
+
+        getoptErrorMessage(OPT_NONE, NULL);
+        return NULL;
+    }
+
+    if (parsePrecisionMode(&precision, &automatic, argc, argv))
         return NULL;
 
-    if (parsePrecisionMode(&precision, argc, argv))
+    /* Without a precision option, the plot is first read at the greatest
+     * precision available so that the pixel spacing is known exactly, then
+     * read again at the cheapest precision that resolves it
+     */
+    if (automatic)
+    {
+        #ifdef MP_PREC
+        mpSignificandSize = AUTO_PRECISION_PARSE_BITS;
+        #endif
+
+        p = parsePlotOptions(PREC_MODE_MAX, plot, formula, output, argc, argv);
+
+        if (!p)
+            return NULL;
+
+        /* The frames of a sequence share a precision, which must resolve the
+         * deepest of them
+         */
+        if (ctx->frames > 1 && magnifyToLastFrame(p, ctx))
+        {
+            fprintf(stderr, "%s: --zoom-to: The last frame could not be plotted\n", programName);
+            freePlotCTX(p);
+            return NULL;
+        }
+
+        precision = selectPrecision(ctx, p);
+
+        /* Terminal output goes to stdout, which must stay open for the real plot */
+        p->file = NULL;
+        freePlotCTX(p);
+    }
+
+    /* Only z^2 + c has the series that pixels are perturbed along */
+    if (ctx->perturbation && formula != FORMULA_MANDELBROT)
+    {
+        logMessage(WARNING, "Perturbation only applies to the Mandelbrot formula - every pixel will be iterated "
+                   "in multiple precision");
+        ctx->perturbation = false;
+    }
+
+    /* Subdivision fills areas enclosed by unescaped pixels, which holds for
+     * the sets of analytic formulas only. The folding of the Burning Ship is not
+     */
+    if (ctx->subdivide && formula == FORMULA_BURNING_SHIP)
+    {
+        logMessage(INFO, "The Burning Ship is not subdivided - every pixel will be iterated");
+        ctx->subdivide = false;
+    }
+
+    return parsePlotOptions(precision, plot, formula, output, argc, argv);
+}
+
+
+/* Read the plot of a raw image from its header, then the options of the image
+ * file it is coloured into. Plot options are those of the raw image
+ */
+PlotCTX * processRecolourOptions(ProgramCTX *ctx, int argc, char **argv)
+{
+    PlotCTX *p;
+    FILE *raw = fopen(ctx->recolourFilepath, "rb");
+
+    if (!raw)
+    {
+        fprintf(stderr, "%s: --recolour: File \'%s\' could not be opened\n", programName, ctx->recolourFilepath);
         return NULL;
+    }
 
-    p = createPlotCTX(precision);
+    p = readRawHeader(raw);
+    fclose(raw);
 
-    if (initialisePlotCTX(p, plot, output))
+    if (!p)
+    {
+        fprintf(stderr, "%s: --recolour: File \'%s\' is not a raw image\n", programName, ctx->recolourFilepath);
         return NULL;
+    }
 
-    if (parseContinuousOptions(p, argc, argv) || parseDiscreteOptions(p, argc, argv))
+    p->output = OUTPUT_PNM;
+
+    strncpy(p->plotFilepath, PLOT_FILEPATH_DEFAULT, sizeof(p->plotFilepath));
+    p->plotFilepath[sizeof(p->plotFilepath) - 1] = '\0';
+
+    if (parseRecolourOptions(p, argc, argv))
+    {
+        freePlotCTX(p);
         return NULL;
+    }
 
     return p;
 }
 
 
-/* Do one getopt pass to set the precision (default is standard precision) */
-static int parsePrecisionMode(PrecisionMode *precision, int argc, char **argv)
+/* Do one getopt pass to set the precision (default is automatic) */
+static int parsePrecisionMode(PrecisionMode *precision, bool *automatic, int argc, char **argv)
 {
+    bool XFlag = false, YFlag = false;
+
     #ifdef MP_PREC
     unsigned long tempPrecision = 0;
-    bool AFlag = false, PFlag = false, XFlag = false;
+    bool AFlag = false, DFlag = false, PFlag = false;
     #endif
 
-    if (!precision)
+    if (!precision || !automatic)
         return -1;
 
     *precision = STD_PRECISION;
+    *automatic = true;
 
     optind = 0;
     while ((opt = getopt_long(argc, argv, GETOPT_STRING, LONG_OPTIONS, NULL)) != -1)
@@ -177,9 +385,30 @@ static int parsePrecisionMode(PrecisionMode *precision, int argc, char **argv)
             #ifdef MP_PREC
             case 'A': /* Use multiple precision */
                 AFlag = true;
-                if (XFlag)
+                *automatic = false;
+                if (XFlag || YFlag)
+                {
+                    if (XFlag)
+                        fprintf(stderr, "%s: -%c: Option mutually exclusive with -%c\n", programName, opt, 'X');
+                    else
+                        fprintf(stderr, "%s: -%c: Option mutually exclusive with --double-double\n", programName, opt);
+
+                    getoptErrorMessage(OPT_NONE, NULL);
+                    return -1;
+                }
+
+                *precision = MUL_PRECISION;
+                break;
+            case 'D': /* Iterate pixels as offsets from a multiple-precision orbit */
+                DFlag = true;
+                *automatic = false;
+                if (XFlag || YFlag)
                 {
-                    fprintf(stderr, "%s: -%c: Option mutually exclusive with -%c\n", programName, opt, 'X');
+                    if (XFlag)
+                        fprintf(stderr, "%s: -%c: Option mutually exclusive with -%c\n", programName, opt, 'X');
+                    else
+                        fprintf(stderr, "%s: -%c: Option mutually exclusive with --double-double\n", programName, opt);
+
                     getoptErrorMessage(OPT_NONE, NULL);
                     return -1;
                 }
@@ -188,9 +417,14 @@ static int parsePrecisionMode(PrecisionMode *precision, int argc, char **argv)
                 break;
             case 'P': /* Specify number of bits to use for the MP significand */
                 PFlag = true;
-                if (XFlag)
+                *automatic = false;
+                if (XFlag || YFlag)
                 {
-                    fprintf(stderr, "%s: -%c: Option mutually exclusive with -%c\n", programName, opt, 'X');
+                    if (XFlag)
+                        fprintf(stderr, "%s: -%c: Option mutually exclusive with -%c\n", programName, opt, 'X');
+                    else
+                        fprintf(stderr, "%s: -%c: Option mutually exclusive with --double-double\n", programName, opt);
+
                     getoptErrorMessage(OPT_NONE, NULL);
                     return -1;
                 }
@@ -213,19 +447,50 @@ static int parsePrecisionMode(PrecisionMode *precision, int argc, char **argv)
             #endif
 
             case 'X': /* Use extended precision */
+                XFlag = true;
 
                 #ifdef MP_PREC
-                XFlag = true;
-                if (AFlag || PFlag)
+                if (AFlag || DFlag || PFlag)
                 {
                     fprintf(stderr, "%s: -%c: Option mutually exclusive with -%c\n",
-                            programName, opt, (AFlag) ? 'A' : 'P');
+                            programName, opt, (AFlag) ? 'A' : (DFlag) ? 'D' : 'P');
                     getoptErrorMessage(OPT_NONE, NULL);
                     return -1;
                 }
                 #endif
 
+                if (YFlag)
+                {
+                    fprintf(stderr, "%s: -%c: Option mutually exclusive with --double-double\n", programName, opt);
+                    getoptErrorMessage(OPT_NONE, NULL);
+                    return -1;
+                }
+
                 *precision = EXT_PRECISION;
+                *automatic = false;
+                break;
+            case 'Y': /* Use double-double precision */
+                YFlag = true;
+
+                #ifdef MP_PREC
+                if (AFlag || DFlag || PFlag)
+                {
+                    fprintf(stderr, "%s: --double-double: Option mutually exclusive with -%c\n",
+                            programName, (AFlag) ? 'A' : (DFlag) ? 'D' : 'P');
+                    getoptErrorMessage(OPT_NONE, NULL);
+                    return -1;
+                }
+                #endif
+
+                if (XFlag)
+                {
+                    fprintf(stderr, "%s: --double-double: Option mutually exclusive with -%c\n", programName, 'X');
+                    getoptErrorMessage(OPT_NONE, NULL);
+                    return -1;
+                }
+
+                *precision = DD_PRECISION;
+                *automatic = false;
                 break;
             default:
                 break;
@@ -246,7 +511,7 @@ static int parsePrecisionMode(PrecisionMode *precision, int argc, char **argv)
     }
 
     #ifdef MP_PREC
-    if (PFlag && !AFlag)
+    if (PFlag && !AFlag && !DFlag)
     {
         fprintf(stderr, "%s: -%c: Option must be used in conjunction with -%c\n", programName, 'P', 'A');
         getoptErrorMessage(OPT_NONE, NULL);
@@ -262,17 +527,101 @@ static int parsePrecisionMode(PrecisionMode *precision, int argc, char **argv)
 }
 
 
+/* Create a plot parameters object at the given precision and read the plot
+ * options into it
+ */
+static PlotCTX * parsePlotOptions(PrecisionMode precision, PlotType plot, Formula formula, OutputType output,
+                                  int argc, char **argv)
+{
+    PlotCTX *p = createPlotCTX(precision);
+
+    if (initialisePlotCTX(p, plot, formula, output))
+    {
+        freePlotCTX(p);
+        return NULL;
+    }
+
+    if (parseContinuousOptions(p, argc, argv) || parseDiscreteOptions(p, argc, argv))
+    {
+        freePlotCTX(p);
+        return NULL;
+    }
+
+    /* A colour scheme given after the degree is smoothed for it too */
+    setColourDegree(&(p->colour), p->degree);
+
+    /* A colour scheme sets its own bit depth, but only names the scheme of a
+     * raw image
+     */
+    if (output == OUTPUT_RAW)
+        p->colour.depth = BIT_DEPTH_ITERATIONS;
+
+    return p;
+}
+
+
+/* Choose the cheapest precision able to resolve the pixels of the plot. A
+ * multiple-precision plot has its significand sized to fit, and is plotted by
+ * perturbation if its formula allows
+ */
+static PrecisionMode selectPrecision(ProgramCTX *ctx, const PlotCTX *p)
+{
+    long needed = getResolutionBits(p);
+    long bits = needed + AUTO_PRECISION_GUARD_BITS;
+
+    if (bits <= DBL_MANT_DIG)
+    {
+        logMessage(INFO, "Automatic precision: pixels need %ld bits - using standard precision", needed);
+        return STD_PRECISION;
+    }
+    else if (bits <= LDBL_MANT_DIG)
+    {
+        logMessage(INFO, "Automatic precision: pixels need %ld bits - using extended precision", needed);
+        return EXT_PRECISION;
+    }
+    else if (bits <= DD_MANT_DIG)
+    {
+        logMessage(INFO, "Automatic precision: pixels need %ld bits - using double-double precision", needed);
+        return DD_PRECISION;
+    }
+
+    #ifdef MP_PREC
+    /* MPFR works in whole limbs, so a partial limb costs as much as a full one */
+    bits = (bits + mp_bits_per_limb - 1) / mp_bits_per_limb * mp_bits_per_limb;
+
+    if (bits > (long) MP_BITS_MAX)
+        bits = (long) MP_BITS_MAX;
+
+    mpSignificandSize = (mpfr_prec_t) bits;
+    ctx->perturbation = (p->formula == FORMULA_MANDELBROT);
+
+    logMessage(INFO, "Automatic precision: pixels need %ld bits - using multiple precision (%ld bit significand)%s",
+               needed, bits, (ctx->perturbation) ? " with perturbation" : "");
+
+    return MUL_PRECISION;
+    #else
+    (void) ctx;
+
+    logMessage(WARNING, "Automatic precision: pixels need %ld bits - using double-double precision, as multiple "
+               "precision is not built in", needed);
+
+    return DD_PRECISION;
+    #endif
+}
+
+
 /* Parse options common to every mode of operation */
 static int parseGlobalOptions(ProgramCTX *ctx, int argc, char **argv)
 {
     char tmpLogFilepath[sizeof(ctx->logFilepath)];
-    bool KFlag = false, vFlag = false;
+    bool KFlag = false, vFlag = false, yFlag = false;
 
     optind = 0;
     while ((opt = getopt_long(argc, argv, GETOPT_STRING, LONG_OPTIONS, NULL)) != -1)
     {
         ParseErr argError = PARSE_SUCCESS;
         unsigned long tempUL = 0;
+        uintmax_t tempUIntMax = 0;
 
         switch (opt)
         {
@@ -300,6 +649,103 @@ static int parseGlobalOptions(ProgramCTX *ctx, int argc, char **argv)
                 argError = uLongArg(&tempUL, optarg, THREAD_COUNT_MIN, THREAD_COUNT_MAX);
                 ctx->threads = (unsigned int) tempUL;
                 break;
+            #ifdef OPENCL
+            case '0': /* Plot on a GPU alongside the processor threads */
+                ctx->gpu = true;
+
+                if (optarg)
+                {
+                    argError = uLongArg(&tempUL, optarg, GPU_DEVICE_MIN, GPU_DEVICE_MAX);
+                    ctx->gpuDevice = (unsigned int) tempUL;
+                }
+
+                break;
+            #endif
+            case 'b': /* Width of each unit of work in pixels */
+                argError = uIntMaxArg(&tempUIntMax, optarg, TILE_WIDTH_MIN, TILE_WIDTH_MAX);
+                ctx->tileWidth = (size_t) tempUIntMax;
+                break;
+            case 'B': /* Height of each unit of work in pixels */
+                argError = uIntMaxArg(&tempUIntMax, optarg, TILE_HEIGHT_MIN, TILE_HEIGHT_MAX);
+                ctx->tileHeight = (size_t) tempUIntMax;
+                break;
+            case 'S': /* Compute every pixel of each tile */
+                ctx->subdivide = false;
+                break;
+            case 'F': /* Plot rows that mirror earlier rows */
+                ctx->symmetry = false;
+                break;
+            case '1': /* Supersample pixels at edges */
+                ctx->antiAlias = ANTI_ALIAS_GRID_DEFAULT;
+
+                if (optarg)
+                {
+                    argError = uLongArg(&tempUL, optarg, ANTI_ALIAS_GRID_MIN, ANTI_ALIAS_GRID_MAX);
+                    ctx->antiAlias = (unsigned int) tempUL;
+                }
+
+                break;
+            #ifdef MP_PREC
+            case 'D': /* Iterate pixels as offsets from a multiple-precision orbit */
+                ctx->perturbation = true;
+                break;
+            #endif
+            case 'C': /* Record the rows written, so the plot can be resumed */
+                ctx->checkpoint = true;
+                break;
+            case 'E': /* Carry on a plot from its checkpoint */
+                ctx->checkpoint = true;
+                ctx->resume = true;
+                break;
+            case 'V': /* Plot in place in the mapped image file */
+                ctx->map = true;
+                break;
+            case 'Q': /* Colour a raw image rather than plot one */
+                ctx->recolour = true;
+                strncpy(ctx->recolourFilepath, optarg, sizeof(ctx->recolourFilepath));
+                ctx->recolourFilepath[sizeof(ctx->recolourFilepath) - 1] = '\0';
+                break;
+            case 'J': /* Write run statistics as JSON to a file */
+                ctx->stats = true;
+                strncpy(ctx->statsFilepath, optarg, sizeof(ctx->statsFilepath));
+                ctx->statsFilepath[sizeof(ctx->statsFilepath) - 1] = '\0';
+                break;
+            case 'q': /* Seconds between interim statistics reports */
+                argError = floatArg(&ctx->statsInterval, optarg, REPORT_INTERVAL_MIN, REPORT_INTERVAL_MAX);
+                break;
+            case 'a': /* Pin threads to CPUs by NUMA node */
+                if (!strcmp(optarg, "none"))
+                    ctx->affinity = AFFINITY_NONE;
+                else if (!strcmp(optarg, "compact"))
+                    ctx->affinity = AFFINITY_COMPACT;
+                else if (!strcmp(optarg, "scatter"))
+                    ctx->affinity = AFFINITY_SCATTER;
+                else
+                    argError = PARSE_EFORM;
+
+                break;
+            case 'f': /* Place block pages on the nodes of the threads plotting them */
+                ctx->firstTouch = true;
+                break;
+            case 'e': /* Back block arrays with huge pages */
+                ctx->hugePages = true;
+                break;
+            case 'w': /* Plot a sequence of frames zooming into the centre */
+                argError = uIntMaxArg(&tempUIntMax, optarg, FRAME_COUNT_MIN, FRAME_COUNT_MAX);
+                ctx->frames = (size_t) tempUIntMax;
+                break;
+            case 'y': /* Magnification of the last frame of a sequence */
+                yFlag = true;
+                argError = floatArgExt(&ctx->zoomTo, optarg, MAGNIFICATION_MIN_EXT, MAGNIFICATION_MAX_EXT);
+                break;
+            case 'x': /* Centre coordinate and magnification of plot (read here as the start of a sequence) */
+                ctx->centre = optarg;
+                break;
+            case '2': /* Serve render jobs on a Unix domain socket */
+                ctx->serve = true;
+                strncpy(ctx->serveFilepath, optarg, sizeof(ctx->serveFilepath));
+                ctx->serveFilepath[sizeof(ctx->serveFilepath) - 1] = '\0';
+                break;
             case 'v': /* Output log to stderr */
                 vFlag = true;
                 setLogVerbosity(true);
@@ -337,6 +783,34 @@ static int parseGlobalOptions(ProgramCTX *ctx, int argc, char **argv)
         }
     }
 
+    if (ctx->frames > 1 && (!ctx->centre || !yFlag))
+    {
+        fprintf(stderr, "%s: --frames: Option must be used in conjunction with -%c and --zoom-to\n", programName, 'x');
+        getoptErrorMessage(OPT_NONE, NULL);
+        return -1;
+    }
+    else if (yFlag && ctx->frames < 2)
+    {
+        fprintf(stderr, "%s: --zoom-to: Option must be used in conjunction with --frames\n", programName);
+        getoptErrorMessage(OPT_NONE, NULL);
+        return -1;
+    }
+    else if (ctx->frames > 1 && (ctx->checkpoint || ctx->map || ctx->recolour))
+    {
+        fprintf(stderr, "%s: --frames: Option mutually exclusive with --%s\n", programName,
+                (ctx->checkpoint) ? ((ctx->resume) ? "resume" : "checkpoint") : (ctx->map) ? "mmap" : "recolour");
+        getoptErrorMessage(OPT_NONE, NULL);
+        return -1;
+    }
+    else if (ctx->serve && (ctx->frames > 1 || ctx->checkpoint || ctx->recolour))
+    {
+        fprintf(stderr, "%s: --serve: Option mutually exclusive with --%s\n", programName,
+                (ctx->frames > 1) ? "frames" : (ctx->checkpoint) ? ((ctx->resume) ? "resume" : "checkpoint") :
+                "recolour");
+        getoptErrorMessage(OPT_NONE, NULL);
+        return -1;
+    }
+
     if (KFlag)
     {
         strncpy(ctx->logFilepath, tmpLogFilepath, sizeof(ctx->logFilepath));
@@ -360,6 +834,15 @@ static NetworkCTX * parseNetworkOptions(int argc, char **argv)
     int numberOfWorkers = 0;
     char ipAddress[IP_ADDR_STR_LEN_MAX];
 
+    size_t unitRows = UNIT_ROWS_DEFAULT;
+    unsigned int unitDepth = UNIT_DEPTH_DEFAULT;
+    bool compress = true;
+    bool iterations = false;
+    unsigned int ioThreads = IO_THREADS_DEFAULT;
+    bool local = true;
+    unsigned int heartbeat = HEARTBEAT_DEFAULT;
+    unsigned int retry = RETRY_DEFAULT;
+
     NetworkCTX *network = NULL;
     LANStatus mode = LAN_NONE;
 
@@ -374,6 +857,7 @@ static NetworkCTX * parseNetworkOptions(int argc, char **argv)
     {
         ParseErr argError = PARSE_SUCCESS;
         unsigned long tempUL = 0;
+        uintmax_t tempUIntMax = 0;
 
         switch (opt)
         {
@@ -420,6 +904,35 @@ static NetworkCTX * parseNetworkOptions(int argc, char **argv)
                 argError = uLongArg(&tempUL, optarg, PORT_MIN, PORT_MAX);
                 addr.sin_port = htons((uint16_t) tempUL);
                 break;
+            case 'u': /* Rows in each unit of work sent to a worker */
+                argError = uIntMaxArg(&tempUIntMax, optarg, UNIT_ROWS_MIN, UNIT_ROWS_MAX);
+                unitRows = (size_t) tempUIntMax;
+                break;
+            case 'U': /* Units of work outstanding at each worker */
+                argError = uLongArg(&tempUL, optarg, UNIT_DEPTH_MIN, UNIT_DEPTH_MAX);
+                unitDepth = (unsigned int) tempUL;
+                break;
+            case 'n': /* Have workers send rows unencoded */
+                compress = false;
+                break;
+            case 'I': /* Have workers send iteration values for the master to colour */
+                iterations = true;
+                break;
+            case 'O': /* Threads the master receives rows from workers on */
+                argError = uLongArg(&tempUL, optarg, IO_THREADS_MIN, IO_THREADS_MAX);
+                ioThreads = (unsigned int) tempUL;
+                break;
+            case 'L': /* Have the master plot no rows itself */
+                local = false;
+                break;
+            case 'H': /* Seconds between heartbeats of master and workers */
+                argError = uLongArg(&tempUL, optarg, HEARTBEAT_MIN, HEARTBEAT_MAX);
+                heartbeat = (unsigned int) tempUL;
+                break;
+            case 'R': /* Seconds a worker keeps trying to reach its master */
+                argError = uLongArg(&tempUL, optarg, RETRY_MIN, RETRY_MAX);
+                retry = (unsigned int) tempUL;
+                break;
             default:
                 break;
         }
@@ -440,6 +953,15 @@ static NetworkCTX * parseNetworkOptions(int argc, char **argv)
     if (!network)
         return NULL;
 
+    network->unitRows = unitRows;
+    network->unitDepth = unitDepth;
+    network->compress = compress;
+    network->iterations = iterations;
+    network->ioThreads = ioThreads;
+    network->local = local;
+    network->heartbeat = heartbeat;
+    network->retry = retry;
+
     return network;
 }
 
@@ -472,6 +994,18 @@ static int parseDiscreteOptions(PlotCTX *p, int argc, char **argv)
             case 'i': /* Maximum iteration count of function */
                 argError = uLongArg(&p->iterations, optarg, ITERATIONS_MIN, ITERATIONS_MAX);
                 break;
+            case 'd': /* Degree of a Multibrot set */
+                if (p->formula != FORMULA_MULTIBROT)
+                {
+                    fprintf(stderr, "%s: --degree: Option must be used in conjunction with --formula=multibrot\n",
+                            programName);
+                    argError = PARSE_ERANGE;
+                    break;
+                }
+
+                argError = uLongArg(&tempUL, optarg, DEGREE_MIN, DEGREE_MAX);
+                p->degree = (unsigned int) tempUL;
+                break;
             case 'o': /* Output image filename */
                 strncpy(p->plotFilepath, optarg, sizeof(p->plotFilepath));
                 p->plotFilepath[sizeof(p->plotFilepath) - 1] = '\0';
@@ -484,6 +1018,9 @@ static int parseDiscreteOptions(PlotCTX *p, int argc, char **argv)
                 argError = uIntMaxArg(&tempUIntMax, optarg, HEIGHT_MIN, HEIGHT_MAX);
                 p->height = (size_t) tempUIntMax;
                 break;
+            case '3': /* Output a Deep Zoom tile pyramid */
+                argError = parseTileSize(p, optarg);
+                break;
             default:
                 break;
         }
@@ -530,6 +1067,9 @@ static int parseContinuousOptions(PlotCTX *p, int argc, char **argv)
                     case EXT_PRECISION:
                         argError = complexArgExt(&(p->c.lc), optarg, C_MIN_EXT, C_MAX_EXT);
                         break;
+                    case DD_PRECISION:
+                        argError = complexArgDD(&(p->c.dd), optarg, C_MIN_EXT, C_MAX_EXT);
+                        break;
                     
                     #ifdef MP_PREC
                     case MUL_PRECISION:
@@ -552,6 +1092,9 @@ static int parseContinuousOptions(PlotCTX *p, int argc, char **argv)
                     case EXT_PRECISION:
                         argError = complexArgExt(&(p->minimum.lc), optarg, COMPLEX_MIN_EXT, COMPLEX_MAX_EXT);
                         break;
+                    case DD_PRECISION:
+                        argError = complexArgDD(&(p->minimum.dd), optarg, COMPLEX_MIN_EXT, COMPLEX_MAX_EXT);
+                        break;
 
                     #ifdef MP_PREC
                     case MUL_PRECISION:
@@ -574,6 +1117,9 @@ static int parseContinuousOptions(PlotCTX *p, int argc, char **argv)
                     case EXT_PRECISION:
                         argError = complexArgExt(&(p->maximum.lc), optarg, COMPLEX_MIN_EXT, COMPLEX_MAX_EXT);
                         break;
+                    case DD_PRECISION:
+                        argError = complexArgDD(&(p->maximum.dd), optarg, COMPLEX_MIN_EXT, COMPLEX_MAX_EXT);
+                        break;
                     
                     #ifdef MP_PREC
                     case MUL_PRECISION:
@@ -638,11 +1184,42 @@ static PlotType parsePlotType(int argc, char **argv)
 }
 
 
+/* Do one getopt pass to get the formula iterated (default is Mandelbrot) */
+static int parseFormula(Formula *formula, int argc, char **argv)
+{
+    *formula = FORMULA_MANDELBROT;
+
+    optind = 0;
+    while ((opt = getopt_long(argc, argv, GETOPT_STRING, LONG_OPTIONS, NULL)) != -1)
+    {
+        if (opt != 'Z')
+            continue;
+
+        if (!strcmp(optarg, "mandelbrot"))
+            *formula = FORMULA_MANDELBROT;
+        else if (!strcmp(optarg, "multibrot"))
+            *formula = FORMULA_MULTIBROT;
+        else if (!strcmp(optarg, "burning-ship"))
+            *formula = FORMULA_BURNING_SHIP;
+        else if (!strcmp(optarg, "tricorn"))
+            *formula = FORMULA_TRICORN;
+        else
+        {
+            fprintf(stderr, "%s: --formula: Unknown formula \'%s\'\n", programName, optarg);
+            getoptErrorMessage(OPT_NONE, NULL);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
 /* Do one getopt pass to get the plot type (default is Mandelbrot) */
 static OutputType parseOutputType(int argc, char **argv)
 {
     OutputType output = OUTPUT_PNM;
-    bool oFlag = false, tFlag = false;
+    bool oFlag = false, tFlag = false, WFlag = false, NFlag = false, tilesFlag = false;
 
     optind = 0;
     while ((opt = getopt_long(argc, argv, GETOPT_STRING, LONG_OPTIONS, NULL)) != -1)
@@ -660,9 +1237,14 @@ static OutputType parseOutputType(int argc, char **argv)
         }
         else if (opt == 't') /* Output plot to stdout */
         {
-            if (oFlag)
+            if (oFlag || WFlag || NFlag || tilesFlag)
             {
-                fprintf(stderr, "%s: -%c: Option mutually exclusive with -%c\n", programName, opt, 'o');
+                if (oFlag)
+                    fprintf(stderr, "%s: -%c: Option mutually exclusive with -%c\n", programName, opt, 'o');
+                else
+                    fprintf(stderr, "%s: -%c: Option mutually exclusive with --%s\n", programName, opt,
+                            (WFlag) ? "raw" : (NFlag) ? "png" : "tiles");
+
                 getoptErrorMessage(OPT_NONE, NULL);
                 return OUTPUT_NONE;
             }
@@ -670,6 +1252,57 @@ static OutputType parseOutputType(int argc, char **argv)
             tFlag = true;
             output = OUTPUT_TERMINAL;
         }
+        else if (opt == 'W') /* Output smoothed iteration values, to be coloured later */
+        {
+            if (tFlag || NFlag || tilesFlag)
+            {
+                if (tFlag)
+                    fprintf(stderr, "%s: --raw: Option mutually exclusive with -%c\n", programName, 't');
+                else
+                    fprintf(stderr, "%s: --raw: Option mutually exclusive with --%s\n", programName,
+                            (NFlag) ? "png" : "tiles");
+
+                getoptErrorMessage(OPT_NONE, NULL);
+                return OUTPUT_NONE;
+            }
+
+            WFlag = true;
+            output = OUTPUT_RAW;
+        }
+        else if (opt == 'N') /* Output a PNG image */
+        {
+            if (tFlag || WFlag || tilesFlag)
+            {
+                if (tFlag)
+                    fprintf(stderr, "%s: --png: Option mutually exclusive with -%c\n", programName, 't');
+                else
+                    fprintf(stderr, "%s: --png: Option mutually exclusive with --%s\n", programName,
+                            (WFlag) ? "raw" : "tiles");
+
+                getoptErrorMessage(OPT_NONE, NULL);
+                return OUTPUT_NONE;
+            }
+
+            NFlag = true;
+            output = OUTPUT_PNG;
+        }
+        else if (opt == '3') /* Output a Deep Zoom tile pyramid */
+        {
+            if (tFlag || WFlag || NFlag)
+            {
+                if (tFlag)
+                    fprintf(stderr, "%s: --tiles: Option mutually exclusive with -%c\n", programName, 't');
+                else
+                    fprintf(stderr, "%s: --tiles: Option mutually exclusive with --%s\n", programName,
+                            (WFlag) ? "raw" : "png");
+
+                getoptErrorMessage(OPT_NONE, NULL);
+                return OUTPUT_NONE;
+            }
+
+            tilesFlag = true;
+            output = OUTPUT_TILES;
+        }
     }
 
     return output;
@@ -694,6 +1327,10 @@ static int parseMagnification(PlotCTX *p, int argc, char **argv)
             {
                 argError = magArgExt(p, optarg, COMPLEX_MIN_EXT, COMPLEX_MAX_EXT, MAGNIFICATION_MIN, MAGNIFICATION_MAX);
             }
+            else if (p->precision == DD_PRECISION)
+            {
+                argError = magArgDD(p, optarg, COMPLEX_MIN_EXT, COMPLEX_MAX_EXT, MAGNIFICATION_MIN, MAGNIFICATION_MAX);
+            }
 
             #ifdef MP_PREC
             else if (p->precision == MUL_PRECISION)
@@ -716,4 +1353,118 @@ static int parseMagnification(PlotCTX *p, int argc, char **argv)
     }
 
     return 0;
+}
+
+
+/* Get the options of the image a raw image is coloured into */
+static int parseRecolourOptions(PlotCTX *p, int argc, char **argv)
+{
+    bool oFlag = false;
+
+    optind = 0;
+    while ((opt = getopt_long(argc, argv, GETOPT_STRING, LONG_OPTIONS, NULL)) != -1)
+    {
+        ParseErr argError = PARSE_SUCCESS;
+        unsigned long tempUL = 0;
+
+        switch (opt)
+        {
+            case 'c': /* Colour scheme of PPM image */
+                argError = uLongArg(&tempUL, optarg, 0UL, ULONG_MAX);
+
+                if (initialiseColourScheme(&p->colour, (ColourSchemeType) tempUL))
+                {
+                    fprintf(stderr, "%s: -%c: Invalid colour scheme\n", programName, opt);
+                    argError = PARSE_ERANGE;
+                }
+
+                break;
+            case 'o': /* Output image filename */
+                strncpy(p->plotFilepath, optarg, sizeof(p->plotFilepath));
+                p->plotFilepath[sizeof(p->plotFilepath) - 1] = '\0';
+                oFlag = true;
+                break;
+            case 'N': /* Output a PNG image */
+                p->output = OUTPUT_PNG;
+                break;
+            case '3': /* Output a Deep Zoom tile pyramid */
+                p->output = OUTPUT_TILES;
+                argError = parseTileSize(p, optarg);
+                break;
+            case 'g': case 'G': case 'i': case 'j': case 'm': case 'M': case 'r': case 's': case 't': case 'x':
+            case 'W':
+                fprintf(stderr, "%s: Plot options cannot be used with --recolour\n", programName);
+                argError = PARSE_ERANGE;
+                break;
+            default:
+                break;
+        }
+
+        if (argError == PARSE_ERANGE) /* Error message already outputted */
+        {
+            getoptErrorMessage(OPT_NONE, NULL);
+            return -1;
+        }
+        else if (argError != PARSE_SUCCESS) /* Error but no error message, yet */
+        {
+            getoptErrorMessage(OPT_EARG, NULL);
+            return -1;
+        }
+    }
+
+    if (p->output == OUTPUT_PNG && !oFlag)
+    {
+        strncpy(p->plotFilepath, PNG_FILEPATH_DEFAULT, sizeof(p->plotFilepath));
+        p->plotFilepath[sizeof(p->plotFilepath) - 1] = '\0';
+    }
+    else if (p->output == OUTPUT_TILES && !oFlag)
+    {
+        strncpy(p->plotFilepath, TILES_FILEPATH_DEFAULT, sizeof(p->plotFilepath));
+        p->plotFilepath[sizeof(p->plotFilepath) - 1] = '\0';
+    }
+
+    /* Rows of the raw image cannot be widened to fill whole bytes */
+    if (p->colour.depth == BIT_DEPTH_ASCII || (p->colour.depth < CHAR_BIT && p->width % CHAR_BIT != 0))
+    {
+        fprintf(stderr, "%s: Invalid colour scheme for raw image\n", programName);
+        getoptErrorMessage(OPT_NONE, NULL);
+        return -1;
+    }
+
+    /* Tiles are scaled down a byte at a time */
+    if (p->output == OUTPUT_TILES && p->colour.depth < CHAR_BIT)
+    {
+        fprintf(stderr, "%s: Invalid colour scheme for tiles\n", programName);
+        getoptErrorMessage(OPT_NONE, NULL);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Tile size of a tile pyramid, if given. Tiles halve into the level below, so
+ * the size must be even
+ */
+static ParseErr parseTileSize(PlotCTX *p, char *arg)
+{
+    ParseErr argError;
+    unsigned long tempUL = 0;
+
+    p->tileSize = PYRAMID_TILE_SIZE_DEFAULT;
+
+    if (!arg)
+        return PARSE_SUCCESS;
+
+    argError = uLongArg(&tempUL, arg, PYRAMID_TILE_SIZE_MIN, PYRAMID_TILE_SIZE_MAX);
+
+    if (argError == PARSE_SUCCESS && tempUL % 2 != 0)
+    {
+        fprintf(stderr, "%s: --tiles: Tile size must be even\n", programName);
+        return PARSE_ERANGE;
+    }
+
+    p->tileSize = (size_t) tempUL;
+
+    return argError;
 }
\ No newline at end of file
@@ -24,6 +24,55 @@ int initialiseProgramCTX(ProgramCTX *ctx)
     ctx->mem = 0;
     ctx->threads = 0;
 
+    /* Pixels are only plotted on a GPU when asked */
+    ctx->gpu = false;
+    ctx->gpuDevice = 0;
+
+    /* Default unit of work depends on whether tiles are subdivided */
+    ctx->tileWidth = 0;
+    ctx->tileHeight = 0;
+
+    ctx->subdivide = true;
+    ctx->symmetry = true;
+    ctx->perturbation = false;
+
+    /* Edges are only supersampled when asked (0 for none) */
+    ctx->antiAlias = 0;
+
+    /* Progress is only recorded, and a plot resumed, when asked */
+    ctx->checkpoint = false;
+    ctx->resume = false;
+
+    /* Images are written through a file stream unless mapped */
+    ctx->map = false;
+
+    /* A raw image is only recoloured when given */
+    ctx->recolour = false;
+    ctx->recolourFilepath[0] = '\0';
+
+    /* Statistics are only reported when asked, and then only at the end
+     * unless given an interval
+     */
+    ctx->stats = false;
+    ctx->statsFilepath[0] = '\0';
+    ctx->statsInterval = 0.0;
+
+    /* Threads run where the scheduler puts them, and pages are placed by
+     * whichever thread first writes them, unless asked otherwise
+     */
+    ctx->affinity = AFFINITY_NONE;
+    ctx->firstTouch = false;
+    ctx->hugePages = false;
+
+    /* A single image is plotted unless a sequence of frames is asked for */
+    ctx->frames = 1;
+    ctx->zoomTo = 0.0L;
+    ctx->centre = NULL;
+
+    /* A single plot is made unless asked to serve render jobs */
+    ctx->serve = false;
+    ctx->serveFilepath[0] = '\0';
+
     return 0;
 }
 
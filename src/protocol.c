@@ -0,0 +1,266 @@
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "protocol.h"
+
+
+static void putUInt(WireBuffer *w, uint64_t x, size_t n);
+static uint64_t getUInt(WireBuffer *w, size_t n);
+static void encodeUInt(unsigned char *dest, uint64_t x, size_t n);
+static uint64_t decodeUInt(const unsigned char *src, size_t n);
+
+
+/* Create the header of a message with a body of `length` bytes */
+MessageHeader createMessageHeader(MessageType type, uint64_t job, uint64_t row, size_t length)
+{
+    MessageHeader h =
+    {
+        .version = PROTOCOL_VERSION,
+        .type = (uint8_t) type,
+        .flags = 0,
+        .length = (uint32_t) length,
+        .job = job,
+        .row = row
+    };
+
+    return h;
+}
+
+
+/* Write the header to `dest`, which must have MESSAGE_HEADER_SIZE bytes */
+void encodeMessageHeader(unsigned char *dest, const MessageHeader *h)
+{
+    encodeUInt(dest, h->version, 1);
+    encodeUInt(dest + 1, h->type, 1);
+    encodeUInt(dest + 2, h->flags, 2);
+    encodeUInt(dest + 4, h->length, 4);
+    encodeUInt(dest + 8, h->job, 8);
+    encodeUInt(dest + 16, h->row, 8);
+}
+
+
+/* Read a header from MESSAGE_HEADER_SIZE bytes at `src`. Returns 1 if the
+ * message is of another protocol version or of an unknown type
+ */
+int decodeMessageHeader(MessageHeader *h, const unsigned char *src)
+{
+    h->version = (uint8_t) decodeUInt(src, 1);
+    h->type = (uint8_t) decodeUInt(src + 1, 1);
+    h->flags = (uint16_t) decodeUInt(src + 2, 2);
+    h->length = (uint32_t) decodeUInt(src + 4, 4);
+    h->job = decodeUInt(src + 8, 8);
+    h->row = decodeUInt(src + 16, 8);
+
+    if (h->version != PROTOCOL_VERSION)
+        return 1;
+
+    if (h->type < MESSAGE_PARAMETERS || h->type > MESSAGE_NEXT)
+        return 1;
+
+    return 0;
+}
+
+
+WireBuffer createWireBuffer(unsigned char *data, size_t size)
+{
+    WireBuffer w =
+    {
+        .data = data,
+        .size = size,
+        .pos = 0,
+        .error = false
+    };
+
+    return w;
+}
+
+
+void putU8(WireBuffer *w, uint8_t x)
+{
+    putUInt(w, x, 1);
+}
+
+
+void putU32(WireBuffer *w, uint32_t x)
+{
+    putUInt(w, x, 4);
+}
+
+
+void putU64(WireBuffer *w, uint64_t x)
+{
+    putUInt(w, x, 8);
+}
+
+
+/* Doubles are sent as their IEEE 754 bit pattern */
+void putDouble(WireBuffer *w, double x)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &x, sizeof(bits));
+    putU64(w, bits);
+}
+
+
+/* The width and layout of long double vary between platforms, so it is sent as
+ * a sign, a binary exponent, and a 128-bit significand, which holds any
+ * long double format exactly
+ */
+void putLongDouble(WireBuffer *w, long double x)
+{
+    int exponent;
+    long double significand;
+    uint64_t hi, lo;
+
+    if (!isfinite(x))
+    {
+        w->error = true;
+        return;
+    }
+
+    significand = ldexpl(frexpl(fabsl(x), &exponent), 64);
+    hi = (uint64_t) significand;
+    lo = (uint64_t) ldexpl(significand - (long double) hi, 64);
+
+    putU8(w, (signbit(x)) ? 1 : 0);
+    putU32(w, (uint32_t) (int32_t) exponent);
+    putU64(w, hi);
+    putU64(w, lo);
+}
+
+
+void putBytes(WireBuffer *w, const void *src, size_t n)
+{
+    if (w->error || w->size - w->pos < n)
+    {
+        w->error = true;
+        return;
+    }
+
+    memcpy(w->data + w->pos, src, n);
+    w->pos += n;
+}
+
+
+uint8_t getU8(WireBuffer *w)
+{
+    return (uint8_t) getUInt(w, 1);
+}
+
+
+uint32_t getU32(WireBuffer *w)
+{
+    return (uint32_t) getUInt(w, 4);
+}
+
+
+uint64_t getU64(WireBuffer *w)
+{
+    return getUInt(w, 8);
+}
+
+
+double getDouble(WireBuffer *w)
+{
+    double x;
+    uint64_t bits = getU64(w);
+
+    memcpy(&x, &bits, sizeof(x));
+
+    return x;
+}
+
+
+long double getLongDouble(WireBuffer *w)
+{
+    uint8_t sign = getU8(w);
+    uint32_t exponentBits = getU32(w);
+    uint64_t hi = getU64(w);
+    uint64_t lo = getU64(w);
+
+    /* Exponent is two's complement */
+    long exponent = (exponentBits > INT32_MAX) ? -(long) (~exponentBits) - 1 : (long) exponentBits;
+    long double x;
+
+    if (w->error || sign > 1 || exponent < LDBL_MIN_EXP - LDBL_MANT_DIG || exponent > LDBL_MAX_EXP)
+    {
+        w->error = true;
+        return 0.0L;
+    }
+
+    x = ldexpl((long double) hi + ldexpl((long double) lo, -64), (int) exponent - 64);
+
+    return (sign) ? -x : x;
+}
+
+
+/* Returns a pointer to the next `n` bytes of the body (in place) */
+const unsigned char * getBytes(WireBuffer *w, size_t n)
+{
+    const unsigned char *ptr;
+
+    if (w->error || w->size - w->pos < n)
+    {
+        w->error = true;
+        return NULL;
+    }
+
+    ptr = w->data + w->pos;
+    w->pos += n;
+
+    return ptr;
+}
+
+
+static void putUInt(WireBuffer *w, uint64_t x, size_t n)
+{
+    if (w->error || w->size - w->pos < n)
+    {
+        w->error = true;
+        return;
+    }
+
+    encodeUInt(w->data + w->pos, x, n);
+    w->pos += n;
+}
+
+
+static uint64_t getUInt(WireBuffer *w, size_t n)
+{
+    uint64_t x;
+
+    if (w->error || w->size - w->pos < n)
+    {
+        w->error = true;
+        return 0;
+    }
+
+    x = decodeUInt(w->data + w->pos, n);
+    w->pos += n;
+
+    return x;
+}
+
+
+/* Write the low `n` bytes of `x`, least significant first */
+static void encodeUInt(unsigned char *dest, uint64_t x, size_t n)
+{
+    for (size_t i = 0; i < n; ++i, x >>= 8)
+        dest[i] = (unsigned char) (x & 0xFF);
+}
+
+
+static uint64_t decodeUInt(const unsigned char *src, size_t n)
+{
+    uint64_t x = 0;
+
+    for (size_t i = n; i > 0; --i)
+        x = (x << 8) | src[i - 1];
+
+    return x;
+}
@@ -0,0 +1,496 @@
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libgroot/include/log.h"
+
+#include "pyramid.h"
+
+#include "colour.h"
+#include "parameters.h"
+#include "png.h"
+
+
+/* Longest path of a tile within the directory ("/LEVEL/COLUMN_ROW.png") */
+#define PYRAMID_TILE_NAME_LEN_MAX 96
+
+#define PYRAMID_PATH_LEN_MAX (PLOT_FILEPATH_LEN_MAX + PYRAMID_TILE_NAME_LEN_MAX)
+
+
+const size_t PYRAMID_TILE_SIZE_MIN = 64;
+const size_t PYRAMID_TILE_SIZE_MAX = 1024;
+const size_t PYRAMID_TILE_SIZE_DEFAULT = 256;
+
+
+static int flushLevels(Pyramid *pyramid, size_t level);
+static int writeTileRow(Pyramid *pyramid, size_t level);
+static void * tileThread(void *workerInfo);
+static int writeTile(PyramidWorker *worker, size_t level, size_t column);
+static void scaleDown(PyramidLevel *dest, const PyramidLevel *src, size_t pixelSize);
+static size_t getLevelCount(size_t width, size_t height);
+static int getDirectory(char *dest, const char *path, size_t n);
+static int makeDirectory(const char *path);
+static unsigned int getTileThreads(unsigned int threads);
+
+
+/* Fill the Deep Zoom descriptor of the pyramid of the plot - the header of its
+ * file - in up to `n` bytes. Returns 0 if it does not fit
+ */
+size_t getPyramidHeader(char *dest, const PlotCTX *p, size_t n)
+{
+    int len = snprintf(dest, n,
+                       "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                       "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"png\" Overlap=\"0\" "
+                       "TileSize=\"%zu\">\n"
+                       "  <Size Width=\"%zu\" Height=\"%zu\"/>\n"
+                       "</Image>\n",
+                       p->tileSize, p->width, p->height);
+
+    return (len < 0 || (size_t) len >= n) ? 0 : (size_t) len;
+}
+
+
+Pyramid * createPyramid(void)
+{
+    Pyramid *pyramid = malloc(sizeof(*pyramid));
+
+    if (!pyramid)
+        return NULL;
+
+    if (pthread_mutex_init(&(pyramid->mutex), NULL))
+    {
+        free(pyramid);
+        return NULL;
+    }
+
+    pyramid->levels = NULL;
+    pyramid->levelCount = 0;
+    pyramid->workers = NULL;
+    pyramid->threads = 0;
+
+    return pyramid;
+}
+
+
+/* Set up the levels of the pyramid of the plot and create the directory of
+ * each. With `threads` as 0, there is a thread writing tiles for each
+ * processor
+ */
+int initialisePyramid(Pyramid *pyramid, const PlotCTX *p, unsigned int threads)
+{
+    PlotCTX tile;
+    char path[PYRAMID_PATH_LEN_MAX];
+    size_t count, width, height;
+
+    if (!pyramid)
+        return 1;
+
+    if (p->colour.depth != BIT_DEPTH_8 && p->colour.depth != BIT_DEPTH_24)
+    {
+        logMessage(ERROR, "Tiles can only be 8 or 24-bit");
+        return 1;
+    }
+
+    pyramid->tileSize = p->tileSize;
+    pyramid->pixelSize = p->colour.depth / CHAR_BIT;
+
+    if (getDirectory(pyramid->directory, p->plotFilepath, sizeof(pyramid->directory)) ||
+        makeDirectory(pyramid->directory))
+    {
+        return 1;
+    }
+
+    count = getLevelCount(p->width, p->height);
+    pyramid->levels = calloc(count, sizeof(PyramidLevel));
+
+    if (!pyramid->levels)
+    {
+        logMessage(ERROR, "Memory allocation failed");
+        return 1;
+    }
+
+    pyramid->levelCount = count;
+
+    /* Levels below the plot are half the size of the level above, rounded up */
+    width = p->width;
+    height = p->height;
+
+    for (size_t i = count; i-- > 0; width = (width + 1) / 2, height = (height + 1) / 2)
+    {
+        PyramidLevel *level = &(pyramid->levels[i]);
+
+        level->width = width;
+        level->height = height;
+        level->rowSize = width * pyramid->pixelSize;
+        level->rows = malloc(level->rowSize * ((height < pyramid->tileSize) ? height : pyramid->tileSize));
+
+        if (!level->rows)
+        {
+            logMessage(ERROR, "Memory allocation failed");
+            return 1;
+        }
+
+        snprintf(path, sizeof(path), "%s/%zu", pyramid->directory, i);
+
+        if (makeDirectory(path))
+            return 1;
+    }
+
+    /* Each tile is compressed on the one thread writing it */
+    tile = *p;
+    tile.width = (p->width < pyramid->tileSize) ? p->width : pyramid->tileSize;
+
+    threads = getTileThreads(threads);
+    pyramid->workers = calloc(threads, sizeof(PyramidWorker));
+
+    if (!pyramid->workers)
+    {
+        logMessage(ERROR, "Memory allocation failed");
+        return 1;
+    }
+
+    for (pyramid->threads = 0; pyramid->threads < threads; ++(pyramid->threads))
+    {
+        PyramidWorker *worker = &(pyramid->workers[pyramid->threads]);
+
+        worker->pyramid = pyramid;
+        worker->png = createPNGEncoder();
+        worker->tile = malloc(tile.width * pyramid->pixelSize * pyramid->tileSize);
+        worker->path = malloc(PYRAMID_PATH_LEN_MAX);
+
+        if (!worker->png || initialisePNGEncoder(worker->png, &tile, 1) || !worker->tile || !worker->path)
+        {
+            logMessage(ERROR, "Could not create tile encoder");
+            freePNGEncoder(worker->png);
+            free(worker->tile);
+            free(worker->path);
+            return 1;
+        }
+    }
+
+    logMessage(DEBUG, "Pyramid of %zu levels of %zu pixel tiles, written on %u threads", count,
+               pyramid->tileSize, threads);
+
+    return 0;
+}
+
+
+/* Memory the pyramid of the plot would take on `threads` threads (0 for a
+ * thread for each processor), so it can be left aside when planning blocks
+ */
+size_t getPyramidSize(const PlotCTX *p, unsigned int threads)
+{
+    PlotCTX tile = *p;
+    size_t pixelSize = p->colour.depth / CHAR_BIT;
+    size_t size = 0;
+
+    tile.width = (p->width < p->tileSize) ? p->width : p->tileSize;
+
+    for (size_t i = getLevelCount(p->width, p->height), width = p->width, height = p->height; i > 0;
+         --i, width = (width + 1) / 2, height = (height + 1) / 2)
+    {
+        size += width * pixelSize * ((height < p->tileSize) ? height : p->tileSize);
+    }
+
+    threads = getTileThreads(threads);
+
+    return size + (size_t) threads * (getPNGEncoderSize(&tile, 1) + tile.width * pixelSize * p->tileSize +
+                                      PYRAMID_PATH_LEN_MAX);
+}
+
+
+/* Add the next `n` rows of the plot to its level. Each row of tiles is written
+ * once filled, along with any rows of the levels below it fills in turn
+ */
+int writePyramidRows(Pyramid *pyramid, const char *rows, size_t n)
+{
+    PyramidLevel *top = &(pyramid->levels[pyramid->levelCount - 1]);
+
+    if (n > top->height - top->received)
+    {
+        logMessage(ERROR, "Rows given beyond the end of the image");
+        return 1;
+    }
+
+    while (n)
+    {
+        size_t count = (n < pyramid->tileSize - top->filled) ? n : pyramid->tileSize - top->filled;
+
+        memcpy(top->rows + top->filled * top->rowSize, rows, count * top->rowSize);
+
+        top->filled += count;
+        top->received += count;
+        rows += count * top->rowSize;
+        n -= count;
+
+        if (flushLevels(pyramid, pyramid->levelCount - 1))
+            return 1;
+    }
+
+    return 0;
+}
+
+
+void freePyramid(Pyramid *pyramid)
+{
+    if (!pyramid)
+        return;
+
+    for (unsigned int i = 0; i < pyramid->threads; ++i)
+    {
+        freePNGEncoder(pyramid->workers[i].png);
+        free(pyramid->workers[i].tile);
+        free(pyramid->workers[i].path);
+    }
+
+    for (size_t i = 0; i < pyramid->levelCount; ++i)
+        free(pyramid->levels[i].rows);
+
+    free(pyramid->workers);
+    free(pyramid->levels);
+    pthread_mutex_destroy(&(pyramid->mutex));
+    free(pyramid);
+}
+
+
+/* Write the tile row of each level from `level` down that is complete - every
+ * row filled, or the last rows of the level - and scale it into the level
+ * below, which may complete a tile row of its own
+ */
+static int flushLevels(Pyramid *pyramid, size_t level)
+{
+    for (size_t i = level + 1; i-- > 0; )
+    {
+        PyramidLevel *current = &(pyramid->levels[i]);
+
+        if (!current->filled || (current->filled < pyramid->tileSize && current->received < current->height))
+            break;
+
+        if (writeTileRow(pyramid, i))
+            return 1;
+
+        if (i > 0)
+            scaleDown(&(pyramid->levels[i - 1]), current, pyramid->pixelSize);
+
+        current->filled = 0;
+        ++(current->tileRow);
+    }
+
+    return 0;
+}
+
+
+/* Write the tiles of the filled tile row of a level. The tiles are claimed by
+ * the threads as they become free, each compressing its own
+ */
+static int writeTileRow(Pyramid *pyramid, size_t level)
+{
+    const PyramidLevel *current = &(pyramid->levels[level]);
+    pthread_t *pids = NULL;
+    unsigned int created = 0;
+    int ret = 0;
+
+    pyramid->level = level;
+    pyramid->next = 0;
+    pyramid->columns = (current->width + pyramid->tileSize - 1) / pyramid->tileSize;
+
+    logMessage(INFO, "Writing row %zu of tiles of level %zu", current->tileRow, level);
+
+    /* This thread writes tiles alongside the rest */
+    if (pyramid->threads > 1 && pyramid->columns > 1)
+        pids = malloc((pyramid->threads - 1) * sizeof(pthread_t));
+
+    if (pids)
+    {
+        for (; created < pyramid->threads - 1 && created + 1 < pyramid->columns; ++created)
+        {
+            if (pthread_create(&(pids[created]), NULL, tileThread, &(pyramid->workers[created + 1])))
+            {
+                logMessage(WARNING, "Tile thread could not be created");
+                break;
+            }
+        }
+    }
+
+    tileThread(&(pyramid->workers[0]));
+
+    for (unsigned int i = 0; i < created; ++i)
+    {
+        if (pthread_join(pids[i], NULL))
+            logMessage(WARNING, "Tile thread could not be harvested");
+    }
+
+    free(pids);
+
+    for (unsigned int i = 0; i <= created; ++i)
+    {
+        if (pyramid->workers[i].error)
+            ret = 1;
+    }
+
+    return ret;
+}
+
+
+/* Claim and write tiles of the row until there are none left */
+static void * tileThread(void *workerInfo)
+{
+    PyramidWorker *worker = workerInfo;
+    Pyramid *pyramid = worker->pyramid;
+
+    worker->error = 0;
+
+    while (1)
+    {
+        size_t column;
+
+        pthread_mutex_lock(&(pyramid->mutex));
+        column = (pyramid->next)++;
+        pthread_mutex_unlock(&(pyramid->mutex));
+
+        if (column >= pyramid->columns)
+            break;
+
+        if (writeTile(worker, pyramid->level, column))
+            worker->error = 1;
+    }
+
+    return NULL;
+}
+
+
+/* Copy a tile out of the tile row of a level, and write it as a PNG image */
+static int writeTile(PyramidWorker *worker, size_t level, size_t column)
+{
+    const Pyramid *pyramid = worker->pyramid;
+    const PyramidLevel *current = &(pyramid->levels[level]);
+    size_t x = column * pyramid->tileSize;
+    size_t width = (current->width - x < pyramid->tileSize) ? current->width - x : pyramid->tileSize;
+    size_t rowSize = width * pyramid->pixelSize;
+    FILE *f;
+    int ret;
+
+    for (size_t i = 0; i < current->filled; ++i)
+        memcpy(worker->tile + i * rowSize, current->rows + i * current->rowSize + x * pyramid->pixelSize, rowSize);
+
+    snprintf(worker->path, PYRAMID_PATH_LEN_MAX, "%s/%zu/%zu_%zu.png", pyramid->directory, level, column,
+             current->tileRow);
+
+    f = fopen(worker->path, "wb");
+
+    if (!f)
+    {
+        logMessage(ERROR, "File \'%s\' could not be opened", worker->path);
+        return 1;
+    }
+
+    ret = (startPNGImage(worker->png, f, width, current->filled) ||
+           writePNGRows(worker->png, worker->tile, current->filled) || finishPNG(worker->png));
+
+    if (fclose(f))
+        ret = 1;
+
+    if (ret)
+        logMessage(ERROR, "Tile \'%s\' could not be written", worker->path);
+
+    return ret;
+}
+
+
+/* Scale the filled rows of a level down by half into the rows of the level
+ * below. Each pixel is the mean of the 2x2 pixels it covers, rounded, with the
+ * last row and column of an odd level standing in for their missing pair
+ */
+static void scaleDown(PyramidLevel *dest, const PyramidLevel *src, size_t pixelSize)
+{
+    size_t rows = (src->filled + 1) / 2;
+
+    for (size_t y = 0; y < rows; ++y)
+    {
+        const unsigned char *a = (const unsigned char *) src->rows + 2 * y * src->rowSize;
+        const unsigned char *b = (2 * y + 1 < src->filled) ? a + src->rowSize : a;
+        unsigned char *out = (unsigned char *) dest->rows + (dest->filled + y) * dest->rowSize;
+
+        for (size_t x = 0; x < dest->width; ++x, out += pixelSize)
+        {
+            size_t left = 2 * x * pixelSize;
+            size_t right = (2 * x + 1 < src->width) ? left + pixelSize : left;
+
+            for (size_t k = 0; k < pixelSize; ++k)
+                out[k] = (unsigned char) ((a[left + k] + a[right + k] + b[left + k] + b[right + k] + 2) / 4);
+        }
+    }
+
+    dest->filled += rows;
+    dest->received += rows;
+}
+
+
+/* Levels down to a single pixel - the ceiling of log2 of the longest side,
+ * plus the plot's own
+ */
+static size_t getLevelCount(size_t width, size_t height)
+{
+    size_t count = 1;
+
+    for (; width > 1 || height > 1; width = (width + 1) / 2, height = (height + 1) / 2)
+        ++count;
+
+    return count;
+}
+
+
+/* Directory of the tiles of the descriptor at `path` - the path less its
+ * extension, with PYRAMID_DIRECTORY_SUFFIX
+ */
+static int getDirectory(char *dest, const char *path, size_t n)
+{
+    const char *slash = strrchr(path, '/');
+    const char *name = (slash) ? slash + 1 : path;
+    const char *dot = strrchr(name, '.');
+    size_t len = (dot && dot > name) ? (size_t) (dot - path) : strlen(path);
+
+    if (len + sizeof(PYRAMID_DIRECTORY_SUFFIX) > n)
+    {
+        logMessage(ERROR, "Path of tile directory is too long");
+        return 1;
+    }
+
+    memcpy(dest, path, len);
+    memcpy(dest + len, PYRAMID_DIRECTORY_SUFFIX, sizeof(PYRAMID_DIRECTORY_SUFFIX));
+
+    return 0;
+}
+
+
+/* Create a directory, unless it is already there */
+static int makeDirectory(const char *path)
+{
+    if (mkdir(path, 0777) && errno != EEXIST)
+    {
+        logMessage(ERROR, "Directory \'%s\' could not be created", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static unsigned int getTileThreads(unsigned int threads)
+{
+    long procs;
+
+    if (threads)
+        return threads;
+
+    procs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (procs < 1) ? 1 : (procs > UINT_MAX) ? UINT_MAX : (unsigned int) procs;
+}
\ No newline at end of file
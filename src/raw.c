@@ -0,0 +1,88 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libgroot/include/log.h"
+
+#include "raw.h"
+
+#include "parameters.h"
+#include "protocol.h"
+#include "serialise.h"
+
+
+#define RAW_VERSION 2
+
+
+/* Fill the RAW_HEADER_LEN bytes of the header of a raw image of the plot */
+int getRawHeader(unsigned char *dest, const PlotCTX *p)
+{
+    WireBuffer w = createWireBuffer(dest, RAW_HEADER_LEN);
+    WireBuffer length;
+    size_t start;
+
+    memset(dest, 0, RAW_HEADER_LEN);
+
+    putBytes(&w, RAW_MAGIC, RAW_MAGIC_LEN);
+    putU32(&w, RAW_VERSION);
+
+    /* The length is filled in once the parameters are written */
+    length = createWireBuffer(dest + w.pos, sizeof(uint32_t));
+    putU32(&w, 0);
+    start = w.pos;
+
+    if (w.error || serialisePlot(&w, p))
+    {
+        logMessage(ERROR, "Plot parameters do not fit in raw image header");
+        return 1;
+    }
+
+    putU32(&length, (uint32_t) (w.pos - start));
+
+    return 0;
+}
+
+
+/* Read the header of a raw image into a new plot parameters object, leaving
+ * the file at the first row. Returns NULL if the file is not a raw image
+ */
+PlotCTX * readRawHeader(FILE *f)
+{
+    unsigned char header[RAW_HEADER_LEN];
+    WireBuffer w = createWireBuffer(header, sizeof(header));
+    WireBuffer parameters;
+    PlotCTX *p;
+    uint32_t version, length;
+
+    if (fread(header, sizeof(header), 1, f) != 1)
+    {
+        logMessage(ERROR, "Could not read raw image header");
+        return NULL;
+    }
+
+    if (memcmp(getBytes(&w, RAW_MAGIC_LEN), RAW_MAGIC, RAW_MAGIC_LEN))
+    {
+        logMessage(ERROR, "File is not a raw image");
+        return NULL;
+    }
+
+    version = getU32(&w);
+    length = getU32(&w);
+
+    if (version != RAW_VERSION || length > w.size - w.pos)
+    {
+        logMessage(ERROR, "Raw image header is of an unknown version");
+        return NULL;
+    }
+
+    parameters = createWireBuffer(header + w.pos, length);
+
+    if (deserialisePlot(&p, &parameters))
+    {
+        logMessage(ERROR, "Could not read plot parameters from raw image header");
+        return NULL;
+    }
+
+    return p;
+}
\ No newline at end of file
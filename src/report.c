@@ -0,0 +1,231 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "libgroot/include/log.h"
+
+#include "report.h"
+
+#include "array.h"
+#include "connection.h"
+#include "network_ctx.h"
+#include "stats.h"
+
+
+/* Minimum/maximum seconds between interim reports */
+const double REPORT_INTERVAL_MIN = 0.0;
+const double REPORT_INTERVAL_MAX = 86400.0;
+
+
+static void writeThreadStats(FILE *f, const ThreadStats *s);
+static void writeThreads(FILE *f, const Thread *threads);
+static void writeWorkers(FILE *f, const NetworkCTX *network, double now);
+
+
+RunReport * createRunReport(void)
+{
+    return malloc(sizeof(RunReport));
+}
+
+
+/* Open the report file, and start the clock of the run */
+int initialiseRunReport(RunReport *r, const char *filepath, double interval)
+{
+    if (!r)
+        return 1;
+
+    if (!strcmp(filepath, "-"))
+    {
+        r->file = stdout;
+    }
+    else
+    {
+        r->file = fopen(filepath, "w");
+
+        if (!r->file)
+        {
+            logMessage(ERROR, "Could not open statistics file '%s'", filepath);
+            return 1;
+        }
+    }
+
+    r->start = getMonotonicTime();
+    r->interval = interval;
+    r->last = r->start;
+    r->blocks = 0;
+    r->blockTime = 0.0;
+    r->blockTimeMax = 0.0;
+    r->writeWait = 0.0;
+
+    return 0;
+}
+
+
+void addBlockTime(RunReport *r, double seconds)
+{
+    if (!r)
+        return;
+
+    ++(r->blocks);
+    r->blockTime += seconds;
+
+    if (seconds > r->blockTimeMax)
+        r->blockTimeMax = seconds;
+}
+
+
+void addWriteWait(RunReport *r, double seconds)
+{
+    if (r)
+        r->writeWait += seconds;
+}
+
+
+/* Whether an interim report is due */
+bool isReportDue(const RunReport *r)
+{
+    return r && r->interval > 0.0 && getMonotonicTime() - r->last >= r->interval;
+}
+
+
+/* Write the statistics of the run so far as a line of JSON. Thread statistics
+ * must only be given while the threads are idle, and the connections of a
+ * master only while they cannot change
+ */
+int writeRunReport(RunReport *r, const Thread *threads, const NetworkCTX *network, bool final)
+{
+    double now = getMonotonicTime();
+
+    if (!r)
+        return 0;
+
+    r->last = now;
+
+    fprintf(r->file, "{\"elapsed_s\":%.6f,\"final\":%s", now - r->start, (final) ? "true" : "false");
+
+    if (r->blocks)
+    {
+        fprintf(r->file, ",\"blocks\":{\"count\":%zu,\"plot_s\":%.6f,\"max_s\":%.6f,\"write_wait_s\":%.6f}",
+                r->blocks, r->blockTime, r->blockTimeMax, r->writeWait);
+    }
+
+    if (threads)
+        writeThreads(r->file, threads);
+
+    if (network && network->mode == LAN_MASTER)
+        writeWorkers(r->file, network, now);
+
+    fputs("}\n", r->file);
+
+    if (fflush(r->file) || ferror(r->file))
+    {
+        logMessage(ERROR, "Could not write statistics");
+        return 1;
+    }
+
+    return 0;
+}
+
+
+void freeRunReport(RunReport *r)
+{
+    if (!r)
+        return;
+
+    if (r->file && r->file != stdout)
+        fclose(r->file);
+
+    free(r);
+}
+
+
+static void writeThreadStats(FILE *f, const ThreadStats *s)
+{
+    fprintf(f, "\"pixels\":%" PRIuMAX ",\"iterations\":%" PRIuMAX ",\"escaped\":%" PRIuMAX
+            ",\"interior\":%" PRIuMAX ",\"filled\":%" PRIuMAX ",\"reused\":%" PRIuMAX ",\"samples\":%" PRIuMAX
+            ",\"tiles\":%" PRIuMAX ",\"busy_s\":%.6f", s->pixels, s->iterations, s->escaped, s->pixels - s->escaped,
+            s->filled, s->reused, s->samples, s->tiles, s->busy);
+}
+
+
+/* Write each thread's counts and their total. Imbalance is the busiest
+ * thread's time against the mean - 1 when the work was spread evenly
+ */
+static void writeThreads(FILE *f, const Thread *threads)
+{
+    ThreadStats total = createThreadStats();
+    double busiest = 0.0;
+    unsigned int n = threads[0].tCount;
+
+    fputs(",\"threads\":[", f);
+
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        const ThreadStats *s = &(threads[i].stats);
+
+        fputs((i) ? ",{" : "{", f);
+        writeThreadStats(f, s);
+        fputc('}', f);
+
+        total.pixels += s->pixels;
+        total.iterations += s->iterations;
+        total.escaped += s->escaped;
+        total.filled += s->filled;
+        total.reused += s->reused;
+        total.samples += s->samples;
+        total.tiles += s->tiles;
+        total.busy += s->busy;
+
+        if (s->busy > busiest)
+            busiest = s->busy;
+    }
+
+    fputs("],\"total\":{", f);
+    writeThreadStats(f, &total);
+    fprintf(f, ",\"imbalance\":%.4f}", (total.busy > 0.0) ? busiest * n / total.busy : 1.0);
+}
+
+
+/* Write the traffic of each connected worker, then of those that left. The
+ * turnaround is the mean time from sending a unit to receiving its last row
+ */
+static void writeWorkers(FILE *f, const NetworkCTX *network, double now)
+{
+    bool first = true;
+
+    fputs(",\"workers\":[", f);
+
+    for (int i = 1; i < network->max; ++i)
+    {
+        const Connection *c = &(network->connections[i]);
+        ConnectionStats s = createConnectionStats();
+        char address[INET_ADDRSTRLEN];
+
+        if (network->fds[i].fd < 0)
+            continue;
+
+        addConnectionStats(&s, &(c->stats), now);
+
+        if (!inet_ntop(AF_INET, &(c->addr.sin_addr), address, sizeof(address)))
+            strcpy(address, "?");
+
+        fprintf(f, "%s{\"address\":\"%s:%u\",\"rows\":%" PRIuMAX ",\"bytes\":%" PRIuMAX ",\"units\":%" PRIuMAX
+                ",\"turnaround_s\":%.6f,\"idle_s\":%.6f}",
+                (first) ? "" : ",", address, (unsigned int) ntohs(c->addr.sin_port), s.rows, s.bytes, s.units,
+                (s.units) ? s.turnaround / (double) s.units : 0.0, s.idle);
+
+        first = false;
+    }
+
+    fprintf(f, "],\"departed\":{\"count\":%u,\"rows\":%" PRIuMAX ",\"bytes\":%" PRIuMAX ",\"units\":%" PRIuMAX
+            ",\"idle_s\":%.6f}",
+            network->pastCount, network->past.rows, network->past.bytes, network->past.units,
+            network->past.idle);
+}
\ No newline at end of file
@@ -1,36 +1,69 @@
 #include <errno.h>
-#include <limits.h>
+#include <inttypes.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
-#include <sys/ioctl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "libgroot/include/log.h"
-#include "percy/include/parser.h"
 
 #include "request_handler.h"
 
+#include "arg_ranges.h"
 #include "array.h"
+#include "colour.h"
+#include "connection.h"
 #include "ext_precision.h"
 #include "network_ctx.h"
 #include "parameters.h"
+#include "protocol.h"
+#include "run_length.h"
 #include "serialise.h"
 
 
-ssize_t writeSocket(const void *src, int s, size_t n)
+static int takeParameters(NetworkCTX *network, const MessageHeader *h, unsigned char *body, PlotCTX **p);
+static int sendEmptyMessage(const NetworkCTX *network, int i, MessageType type);
+static int waitWritable(int s);
+
+
+/* Send a message - the header and body are given to the kernel together, so
+ * each message is a single call to sendmsg() unless the socket is full. A full
+ * nonblocking socket is waited on until the message is sent. The body is not
+ * const, as struct iovec does not allow it. Returns 1 if the peer has closed
+ * the connection
+ */
+int sendMessage(int s, const MessageHeader *h, void *body)
 {
+    unsigned char header[MESSAGE_HEADER_SIZE];
+    struct iovec iov[2];
+    struct msghdr msg;
+
+    size_t n = MESSAGE_HEADER_SIZE + h->length;
     size_t sentBytes = 0;
 
-    do
+    encodeMessageHeader(header, h);
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = body;
+    iov[1].iov_len = h->length;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (h->length) ? 2 : 1;
+
+    while (sentBytes < n)
     {
         ssize_t ret;
-        const char *srctmp = src;
 
         errno = 0;
-        ret = send(s, srctmp + sentBytes, n - sentBytes, 0);
+        ret = sendmsg(s, &msg, 0);
 
         if (ret < 0)
         {
@@ -39,47 +72,75 @@ ssize_t writeSocket(const void *src, int s, size_t n)
                 /* Write call interrupted - try again */
                 continue;
             }
-            else if (errno == ECONNRESET) /* Connection closed */
+            else if (errno == EAGAIN)
+            {
+                /* Nonblocking socket is full - wait for room */
+                if (waitWritable(s))
+                    return 2;
+
+                continue;
+            }
+            else if (errno == EWOULDBLOCK)
+            {
+                if (waitWritable(s))
+                    return 2;
+
+                continue;
+            }
+            else if (errno == ECONNRESET || errno == EPIPE) /* Connection closed */
             {
                 logMessage(INFO, "Connection with peer closed");
-                return 0;
+                return 1;
             }
             else
             {
                 logMessage(ERROR, "Could not write to connection");
-                return -1;
+                return 2;
             }
         }
 
         sentBytes += (size_t) ret;
+
+        /* Skip what has been sent of a partial write */
+        while (msg.msg_iovlen && (size_t) ret >= msg.msg_iov->iov_len)
+        {
+            ret -= (ssize_t) msg.msg_iov->iov_len;
+            ++(msg.msg_iov);
+            --(msg.msg_iovlen);
+        }
+
+        if (msg.msg_iovlen)
+        {
+            msg.msg_iov->iov_base = (unsigned char *) msg.msg_iov->iov_base + ret;
+            msg.msg_iov->iov_len -= (size_t) ret;
+        }
     }
-    while (sentBytes < n);
 
-    return (sentBytes > SSIZE_MAX) ? SSIZE_MAX : (ssize_t) sentBytes;
+    return 0;
 }
 
 
-int blockingRead(NetworkCTX *network, int i, size_t n)
+/* Block until a whole message has been received from connection `i`. The body
+ * is left in the receive buffer, and is valid until the next read into it. A
+ * worker's socket times out if the master is silent for too long, which is
+ * an error
+ */
+int readMessage(NetworkCTX *network, int i, MessageHeader *h, unsigned char **body)
 {
-    size_t freeSpace = network->connections[i].n - network->connections[i].read;
-    size_t totalReadBytes = 0;
+    Connection *c = &(network->connections[i]);
 
-    if (freeSpace < n)
-    {
-        logMessage(WARNING, "Cannot read %zu bytes into buffer with %zu free bytes", n, freeSpace);
-        return 2;
-    }
-
-    while (totalReadBytes < n)
+    while (1)
     {
         ssize_t readBytes;
+        int ret = takeMessage(c, h, body);
+
+        if (ret != 1)
+            return ret;
+
+        compactClientReceiveBuffer(c);
+
         errno = 0;
-        readBytes = recv(
-            network->fds[i].fd,
-            network->connections[i].buffer + network->connections[i].read,
-            n - totalReadBytes,
-            0
-        );
+        readBytes = recv(network->fds[i].fd, c->buffer + c->read, c->n - c->read, 0);
 
         if (readBytes == 0)
         {
@@ -90,253 +151,482 @@ int blockingRead(NetworkCTX *network, int i, size_t n)
         {
             if (errno == EINTR)
                 continue;
-            
-            logMessage(WARNING, "Could not read data from peer");
+            else if (errno == EAGAIN)
+                logMessage(WARNING, "Timed out waiting for peer");
+            else if (errno == EWOULDBLOCK)
+                logMessage(WARNING, "Timed out waiting for peer");
+            else
+                logMessage(WARNING, "Could not read data from peer");
+
             return 2;
         }
 
-        network->connections[i].read += (size_t) readBytes;
-        totalReadBytes += (size_t) readBytes;
+        c->read += (size_t) readBytes;
     }
-
-    return 0;
 }
 
 
-int getRowNumber(Block *block, NetworkCTX *network, const PlotCTX *p)
+/* Look through what can be received from connection `i` without waiting for
+ * the master's word that the plot is finished. A connection that fails as the
+ * master closes it may still hold it. Returns 1 if the plot is finished, and 2
+ * if the frame is finished and the next of a sequence follows. A master serving
+ * render jobs that kept the connection has moved on to its next plot, so its
+ * word is looked for under that plot's job
+ */
+int takePlotDone(NetworkCTX *network, int i)
 {
-    int ret;
-    char *endptr;
-    uintmax_t tempRow = 0;
+    Connection *c = &(network->connections[i]);
+    uint64_t job = network->job;
 
-    clearClientReceiveBuffer(&(network->connections[0]));
-    ret = blockingRead(network, 0, network->connections[0].n);
+    while (1)
+    {
+        MessageHeader h;
+        unsigned char *body;
+        ssize_t readBytes;
+        int ret = takeMessage(c, &h, &body);
 
-    if (ret)
-        return ret;
+        if (ret == 0)
+        {
+            if (h.type == MESSAGE_DONE && h.job == job)
+                return 1;
+            else if (h.type == MESSAGE_NEXT && h.job == job && (h.flags & MESSAGE_FLAG_KEEP))
+                ++job;
+            else if (h.type == MESSAGE_NEXT && h.job == job)
+                return 2;
+
+            continue;
+        }
+        else if (ret != 1)
+        {
+            return 0;
+        }
 
-    network->connections[0].buffer[sizeof(network->connections[0].n) - 1] = '\0';
+        compactClientReceiveBuffer(c);
 
-    if (stringToUIntMax(&tempRow, network->connections[0].buffer, 0, p->height - 1, &endptr, BASE_DEC) != PARSE_SUCCESS)
-        return 2;
+        errno = 0;
+        readBytes = recv(network->fds[i].fd, c->buffer + c->read, c->n - c->read, MSG_DONTWAIT);
 
-    block->id = tempRow;
-    return 0;
+        if (readBytes < 0 && errno == EINTR)
+            continue;
+        else if (readBytes <= 0)
+            return 0;
+
+        c->read += (size_t) readBytes;
+    }
 }
 
 
-int nonblockingRead(NetworkCTX *network, int i)
+/* Receive what is available from connection `i` (of a master, where sockets
+ * are nonblocking) with a single call. Data goes first to the rest of the body
+ * being received, if any, then to the header of the next message - so bodies
+ * are received straight to where they belong, not through a buffer. A body to
+ * be thrown away is read over the start of the receive buffer, a buffer's
+ * worth at a time. Returns -1 if there is nothing to receive
+ */
+int receiveMessageData(NetworkCTX *network, int i)
 {
-    while (network->connections[i].read < network->connections[i].n)
+    Connection *c = &(network->connections[i]);
+    struct iovec iov[2];
+    int iovCount = 0;
+    size_t bodyBytes = 0;
+    ssize_t readBytes;
+
+    if (c->body)
     {
-        ssize_t readBytes;
+        bodyBytes = c->message.length - c->bodyRead;
 
-        errno = 0;
-        readBytes = recv(
-            network->fds[i].fd,
-            network->connections[i].buffer + network->connections[i].read,
-            network->connections[i].n - network->connections[i].read,
-            0
-        );
+        if (c->discard && bodyBytes > c->n)
+            bodyBytes = c->n;
 
-        if (readBytes == 0)
-        {
-            logMessage(INFO, "Connection with peer closed");
-            return 1;
-        }
-        else if (readBytes < 0)
-        {
-            if (errno == EAGAIN)
-                break;
-            else if (errno == EWOULDBLOCK)
-                break;
+        iov[iovCount].iov_base = (c->discard) ? c->body : c->body + c->bodyRead;
+        iov[iovCount++].iov_len = bodyBytes;
+    }
 
-            logMessage(WARNING, "Could not read data from peer");
-            return 2;
-        }
+    /* The next header follows only the end of the body */
+    if (!c->body || c->bodyRead + bodyBytes == c->message.length)
+    {
+        iov[iovCount].iov_base = c->header + c->headerRead;
+        iov[iovCount++].iov_len = MESSAGE_HEADER_SIZE - c->headerRead;
+    }
+
+    errno = 0;
+    readBytes = readv(network->fds[i].fd, iov, iovCount);
+
+    if (readBytes == 0)
+    {
+        logMessage(INFO, "Connection with peer closed");
+        return 1;
+    }
+    else if (readBytes < 0)
+    {
+        if (errno == EAGAIN)
+            return -1;
+        else if (errno == EWOULDBLOCK)
+            return -1;
+        else if (errno == EINTR)
+            return 0;
+
+        logMessage(WARNING, "Could not read data from peer");
+        return 2;
+    }
+
+    if (c->body)
+    {
+        if ((size_t) readBytes < bodyBytes)
+            bodyBytes = (size_t) readBytes;
 
-        network->connections[i].read += (size_t) readBytes;
+        c->bodyRead += bodyBytes;
+        readBytes -= (ssize_t) bodyBytes;
     }
 
+    c->headerRead += (size_t) readBytes;
+
     return 0;
 }
 
 
-int readParameters(NetworkCTX *network, PlotCTX **p)
+/* Take the header received by receiveMessageData(), once whole, into
+ * `c->message`, for the body to be received next. Returns 1 if the header is
+ * not yet whole, and 2 if the message is of an unknown version or type
+ */
+int takeMessageHeader(Connection *c)
 {
-    int ret;
-    PrecisionMode precision;
-
-    clearClientReceiveBuffer(&(network->connections[0]));
-
-    logMessage(DEBUG, "Reading precision mode");
-    if (blockingRead(network, 0, network->connections[0].n))
+    if (c->headerRead < MESSAGE_HEADER_SIZE)
         return 1;
 
-    logMessage(DEBUG, "Deserialising precision mode");
+    c->headerRead = 0;
+    c->bodyRead = 0;
 
-    #ifndef MP_PREC
-    if (deserialisePrecision(&precision, network->connections[0].buffer))
-    #else
-    if (deserialisePrecision(&precision, &mpSignificandSize, network->connections[0].buffer))
-    #endif
+    if (decodeMessageHeader(&(c->message), c->header))
     {
-        logMessage(ERROR, "Could not deserialise precision mode");
+        logMessage(WARNING, "Received message of unknown protocol version or type");
+        return 2;
+    }
+
+    return 0;
+}
+
+
+/* Take the next message from the receive buffer. Returns 1 if no whole message
+ * has been received yet, and 2 if the message is malformed or could never fit
+ * in the buffer
+ */
+int takeMessage(Connection *c, MessageHeader *h, unsigned char **body)
+{
+    size_t available = c->read - c->head;
+
+    if (available < MESSAGE_HEADER_SIZE)
         return 1;
+
+    if (decodeMessageHeader(h, c->buffer + c->head))
+    {
+        logMessage(WARNING, "Received message of unknown protocol version or type");
+        return 2;
     }
 
-    clearClientReceiveBuffer(&(network->connections[0]));
+    if (h->length > c->n - MESSAGE_HEADER_SIZE)
+    {
+        logMessage(WARNING, "Received message of %" PRIu32 " bytes, larger than the receive buffer", h->length);
+        return 2;
+    }
 
-    logMessage(DEBUG, "Reading plot parameters");
-    if (blockingRead(network, 0, network->connections[0].n))
+    if (available - MESSAGE_HEADER_SIZE < h->length)
         return 1;
 
-    logMessage(DEBUG, "Creating plot parameters structure");
-    *p = createPlotCTX(precision);
+    *body = c->buffer + c->head + MESSAGE_HEADER_SIZE;
+    c->head += MESSAGE_HEADER_SIZE + h->length;
+
+    return 0;
+}
 
-    if (!*p)
+
+/* Read the next unit of work from the master: the first row and the number of
+ * rows. Units the master has queued are held by the socket until read, and
+ * heartbeats between them are passed over. Returns 1 if the plot is finished,
+ * 2 if the connection is lost or the master sends something else, 3 if the
+ * frame is finished and the next of a sequence follows, and 4 if the plot is
+ * finished and the next follows on the same connection
+ */
+int getWorkUnit(size_t *row, size_t *rows, NetworkCTX *network, const PlotCTX *p)
+{
+    MessageHeader h;
+    WireBuffer w;
+    unsigned char *body;
+    uint32_t tempRows;
+
+    do
     {
-        logMessage(ERROR, "Could not create plot parameters structure");
+        if (readMessage(network, 0, &h, &body))
+            return 2;
+
+        if (h.job != network->job)
+        {
+            logMessage(WARNING, "Received message of another plot from the master");
+            return 2;
+        }
+    }
+    while (h.type == MESSAGE_HEARTBEAT);
+
+    if (h.type == MESSAGE_DONE)
         return 1;
+    else if (h.type == MESSAGE_NEXT)
+        return (h.flags & MESSAGE_FLAG_KEEP) ? 4 : 3;
+
+    if (h.type != MESSAGE_UNIT)
+    {
+        logMessage(WARNING, "Expected a unit of work from the master");
+        return 2;
     }
 
-    logMessage(DEBUG, "Deserialising plot parameters");
-    switch((*p)->precision)
+    w = createWireBuffer(body, h.length);
+    tempRows = getU32(&w);
+
+    if (w.error || w.pos != w.size || h.row >= p->height || !tempRows || tempRows > p->height - h.row)
+        return 2;
+
+    *row = (size_t) h.row;
+    *rows = tempRows;
+    return 0;
+}
+
+
+/* Give a unit of work to worker `i` */
+int sendWorkUnit(const NetworkCTX *network, int i, size_t row, size_t rows)
+{
+    unsigned char body[4];
+    WireBuffer w = createWireBuffer(body, sizeof(body));
+    MessageHeader h;
+
+    putU32(&w, (uint32_t) rows);
+    h = createMessageHeader(MESSAGE_UNIT, network->job, row, w.pos);
+
+    return sendMessage(network->fds[i].fd, &h, body);
+}
+
+
+/* Let connection `i` know this end is still there. A worker's callers hold
+ * the send lock
+ */
+int sendHeartbeat(const NetworkCTX *network, int i)
+{
+    return sendEmptyMessage(network, i, MESSAGE_HEARTBEAT);
+}
+
+
+/* Tell worker `i` the plot is finished, so that it does not try to rejoin */
+int sendPlotDone(const NetworkCTX *network, int i)
+{
+    return sendEmptyMessage(network, i, MESSAGE_DONE);
+}
+
+
+/* Tell worker `i` the frame is finished, so that it joins the next. With
+ * `keep`, the worker instead waits on the connection for the next plot
+ */
+int sendPlotNext(const NetworkCTX *network, int i, bool keep)
+{
+    MessageHeader h = createMessageHeader(MESSAGE_NEXT, network->job, 0, 0);
+
+    if (keep)
+        h.flags |= MESSAGE_FLAG_KEEP;
+
+    return sendMessage(network->fds[i].fd, &h, NULL);
+}
+
+
+/* Read the parameters of the plot from the master. A master between render
+ * jobs sends heartbeats until it has a plot, which are passed over
+ */
+int readParameters(NetworkCTX *network, PlotCTX **p)
+{
+    MessageHeader h;
+    unsigned char *body;
+
+    logMessage(DEBUG, "Reading plot parameters");
+
+    do
     {
-        case STD_PRECISION:
-            ret = deserialisePlotCTX(*p, network->connections[0].buffer);
-            break;
-        case EXT_PRECISION:
-            ret = deserialisePlotCTXExt(*p, network->connections[0].buffer);
-            break;
-
-        #ifdef MP_PREC
-        case MUL_PRECISION:
-            ret = deserialisePlotCTXMP(*p, network->connections[0].buffer);
-            break;
-        #endif
-
-        default:
-            logMessage(ERROR, "Unknown precision mode");
-            freePlotCTX(*p);
+        if (readMessage(network, 0, &h, &body))
             return 1;
     }
+    while (h.type == MESSAGE_HEARTBEAT);
+
+    return takeParameters(network, &h, body, p);
+}
+
+
+/* Wait on a kept connection for the parameters of the master's next plot.
+ * Heartbeats of either plot are passed over, and the send lock is only taken
+ * once the parameters have come, so the heartbeat thread carries on in the
+ * meantime. Returns 1 if the master has finished, and 2 if the connection is
+ * lost or the parameters could not be read
+ */
+int readNextParameters(NetworkCTX *network, PlotCTX **p)
+{
+    MessageHeader h;
+    unsigned char *body;
+    int ret;
+
+    logMessage(DEBUG, "Waiting for the next plot");
 
-    if (ret)
+    do
     {
-        logMessage(ERROR, "Could not deserialise plot parameters");
-        freePlotCTX(*p);
-        return 1;
+        if (readMessage(network, 0, &h, &body))
+            return 2;
     }
+    while (h.type == MESSAGE_HEARTBEAT);
 
-    return 0;
+    if (h.type == MESSAGE_DONE)
+        return 1;
+
+    pthread_mutex_lock(&(network->send));
+    ret = takeParameters(network, &h, body, p);
+    pthread_mutex_unlock(&(network->send));
+
+    return (ret) ? 2 : 0;
 }
 
 
+/* Send the precision mode and plot parameters to worker `i` in one message */
 int sendParameters(NetworkCTX *network, int i, const PlotCTX *p)
 {
+    MessageHeader h;
+    WireBuffer w = createWireBuffer(network->connections[0].buffer, network->connections[0].n);
+
+    putU32(&w, network->heartbeat);
+
+    logMessage(DEBUG, "Serialising plot parameters");
+
+    if (serialisePlot(&w, p))
+    {
+        logMessage(ERROR, "Could not serialise plot parameters");
+        return 2;
+    }
+
+    logMessage(DEBUG, "Sending plot parameters");
+    h = createMessageHeader(MESSAGE_PARAMETERS, network->job, 0, w.pos);
+
+    if (network->compress)
+        h.flags |= MESSAGE_FLAG_RUN_LENGTH;
+
+    if (network->iterations)
+        h.flags |= MESSAGE_FLAG_ITERATIONS;
+
+    return sendMessage(network->fds[i].fd, &h, network->connections[0].buffer);
+}
+
+
+/* Send the row of the block to the master. If `packed` (of `rowSize` bytes) is
+ * given, the row is run-length encoded into it and sent encoded, unless that
+ * would not make it smaller. Heartbeats are sent from another thread, so the
+ * message is sent under the send lock
+ */
+int sendRowData(NetworkCTX *network, Block *block, unsigned char *packed)
+{
+    MessageHeader h = createMessageHeader(MESSAGE_ROWS, network->job, block->id, block->rowSize);
+    void *body = block->array;
     int ret;
-    ssize_t bytes;
-
-    logMessage(DEBUG, "Serialising precision mode");
-    clearClientReceiveBuffer(&(network->connections[0]));
-
-    #ifndef MP_PREC
-    ret = serialisePrecision(
-        network->connections[0].buffer,
-        network->connections[0].n,
-        p->precision
-    );
-    #else
-    ret = serialisePrecision(
-        network->connections[0].buffer,
-        network->connections[0].n,
-        p->precision,
-        mpSignificandSize
-    );
-    #endif
-
-    /* If truncated or error */
-    if (ret < 0 || (size_t) ret >= network->connections[0].n)
+
+    if (packed)
     {
-        logMessage(ERROR, "Could not serialise precision mode");
-        return 1;
+        size_t n = encodeRunLength(packed, block->rowSize - 1, (const unsigned char *) block->array, block->rowSize,
+                                   getRunLengthUnit(block->parameters->colour.depth));
+
+        if (n)
+        {
+            h.length = (uint32_t) n;
+            h.flags |= MESSAGE_FLAG_RUN_LENGTH;
+            body = packed;
+        }
     }
 
-    logMessage(DEBUG, "Sending precision mode");
-    bytes = writeSocket(network->connections[0].buffer, network->fds[i].fd, network->connections[0].n);
+    pthread_mutex_lock(&(network->send));
+    ret = sendMessage(network->fds[0].fd, &h, body);
+    pthread_mutex_unlock(&(network->send));
 
-    if (bytes == 0)
+    if (ret == 1)
     {
-        /* Safe shutdown */
-        return 1;
+        return -2;
     }
-    else if (bytes < 0)
+    else if (ret)
     {
-        /* Failure to write to the connection */
-        return 2;
+        logMessage(ERROR, "Could not write to socket connection");
+        return -1;
     }
 
-    logMessage(DEBUG, "Serialising plot parameters");
-    clearClientReceiveBuffer(&(network->connections[0]));
+    return 0;
+}
 
-    switch(p->precision)
-    {
-        case STD_PRECISION:
-            ret = serialisePlotCTX(network->connections[0].buffer, network->connections[0].n, p);
-            break;
-        case EXT_PRECISION:
-            ret = serialisePlotCTXExt(network->connections[0].buffer, network->connections[0].n, p);
-            break;
-
-        #ifdef MP_PREC
-        case MUL_PRECISION:
-            ret = serialisePlotCTXMP(network->connections[0].buffer, network->connections[0].n, p);
-            break;
-        #endif
-
-        default:
-            logMessage(ERROR, "Invalid precision mode");
-            return 2;
-    }
 
-    if (ret < 0 || (size_t) ret >= network->connections[0].n)
+/* The master's settings for the network come before the precision mode: the
+ * seconds between heartbeats
+ */
+static int takeParameters(NetworkCTX *network, const MessageHeader *h, unsigned char *body, PlotCTX **p)
+{
+    WireBuffer w;
+    uint32_t tempHeartbeat;
+
+    if (h->type != MESSAGE_PARAMETERS)
     {
-        logMessage(ERROR, "Could not serialise plot context structure");
-        return 2;
+        logMessage(ERROR, "Expected plot parameters from the master");
+        return 1;
     }
 
-    logMessage(DEBUG, "Sending plot parameters");
-    bytes = writeSocket(network->connections[0].buffer, network->fds[i].fd, network->connections[0].n);
-    
-    if (bytes == 0)
+    /* Every later message must be of this plot */
+    network->job = h->job;
+    network->compress = h->flags & MESSAGE_FLAG_RUN_LENGTH;
+    network->iterations = h->flags & MESSAGE_FLAG_ITERATIONS;
+    w = createWireBuffer(body, h->length);
+    tempHeartbeat = getU32(&w);
+
+    if (w.error || tempHeartbeat < HEARTBEAT_MIN || tempHeartbeat > HEARTBEAT_MAX)
     {
-        /* Safe shutdown */
+        logMessage(ERROR, "Could not deserialise network settings");
         return 1;
     }
-    else if (bytes < 0)
+
+    network->heartbeat = tempHeartbeat;
+
+    logMessage(DEBUG, "Deserialising plot parameters");
+
+    if (deserialisePlot(p, &w))
     {
-        /* Failure to write to the connection */
-        return 2;
+        logMessage(ERROR, "Could not deserialise plot parameters");
+        return 1;
     }
-    
+
+    /* Rows are then plotted as iteration values, in the master's place */
+    if (network->iterations)
+        (*p)->colour.depth = BIT_DEPTH_ITERATIONS;
+
     return 0;
 }
 
 
-int sendRowData(const NetworkCTX *network, Block *block)
+static int sendEmptyMessage(const NetworkCTX *network, int i, MessageType type)
 {
-    ssize_t bytes = writeSocket(block->array, network->fds[0].fd, block->rowSize);
+    MessageHeader h = createMessageHeader(type, network->job, 0, 0);
+
+    return sendMessage(network->fds[i].fd, &h, NULL);
+}
+
 
-    if (bytes == 0)
+static int waitWritable(int s)
+{
+    struct pollfd fd =
     {
-        return -2;
-    }
-    else if (bytes < 0 || (size_t) bytes != block->rowSize)
+        .fd = s,
+        .events = POLLOUT,
+        .revents = 0
+    };
+
+    errno = 0;
+
+    if (poll(&fd, 1, -1) < 0 && errno != EINTR)
     {
-        logMessage(ERROR, "Could not write to socket connection");
-        return -1;
+        logMessage(ERROR, "Could not wait to write to connection");
+        return 1;
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,140 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "run_length.h"
+
+#include "colour.h"
+
+
+/* Data is coded in units of a whole pixel, each preceded by a control byte
+ * (as in PackBits): a control byte below RUN_CONTROL_MIN is followed by that
+ * many plus one literal units, and one of at least RUN_CONTROL_MIN by a single
+ * unit repeated (control - RUN_CONTROL_MIN + RUN_MIN) times
+ */
+#define RUN_CONTROL_MIN 128
+#define LITERAL_MAX 128
+#define RUN_MIN 2
+#define RUN_MAX (255 - RUN_CONTROL_MIN + RUN_MIN)
+
+
+static bool isRun(const unsigned char *src, size_t i, size_t count, size_t unit);
+
+
+/* Size of the units runs are counted in - a whole pixel, or a byte for
+ * bit-packed, 8-bit and ASCII rows
+ */
+size_t getRunLengthUnit(BitDepth depth)
+{
+    return (depth > CHAR_BIT) ? (size_t) depth / CHAR_BIT : 1;
+}
+
+
+/* Run-length encode `length` bytes of `src` into `dest` of `n` bytes. Returns
+ * the size of the encoded data, or 0 if it would not fit (so the data is not
+ * worth encoding if `n` is `length`)
+ */
+size_t encodeRunLength(unsigned char *dest, size_t n, const unsigned char *src, size_t length, size_t unit)
+{
+    size_t count = length / unit;
+    size_t in = 0;
+    size_t out = 0;
+
+    if (length % unit)
+        return 0;
+
+    while (in < count)
+    {
+        size_t units = 1;
+
+        if (isRun(src, in, count, unit))
+        {
+            while (in + units < count && units < RUN_MAX
+                   && !memcmp(src + (in + units) * unit, src + in * unit, unit))
+            {
+                ++units;
+            }
+
+            if (n - out < 1 + unit)
+                return 0;
+
+            dest[out++] = (unsigned char) (RUN_CONTROL_MIN + units - RUN_MIN);
+            memcpy(dest + out, src + in * unit, unit);
+            out += unit;
+        }
+        else
+        {
+            /* Literals end where a run starts */
+            while (in + units < count && units < LITERAL_MAX && !isRun(src, in + units, count, unit))
+                ++units;
+
+            if (n - out < 1 + units * unit)
+                return 0;
+
+            dest[out++] = (unsigned char) (units - 1);
+            memcpy(dest + out, src + in * unit, units * unit);
+            out += units * unit;
+        }
+
+        in += units;
+    }
+
+    return out;
+}
+
+
+/* Decode `n` bytes of run-length encoded `src` into exactly `length` bytes of
+ * `dest`. Returns 1 if the data is malformed or decodes to any other length
+ */
+int decodeRunLength(unsigned char *dest, size_t length, const unsigned char *src, size_t n, size_t unit)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < n)
+    {
+        unsigned char control = src[in++];
+
+        if (control < RUN_CONTROL_MIN)
+        {
+            size_t bytes = ((size_t) control + 1) * unit;
+
+            if (n - in < bytes || length - out < bytes)
+                return 1;
+
+            memcpy(dest + out, src + in, bytes);
+            in += bytes;
+            out += bytes;
+        }
+        else
+        {
+            size_t units = (size_t) control - RUN_CONTROL_MIN + RUN_MIN;
+
+            if (n - in < unit || length - out < units * unit)
+                return 1;
+
+            if (unit == 1)
+            {
+                memset(dest + out, src[in], units);
+                out += units;
+            }
+            else
+            {
+                for (size_t i = 0; i < units; ++i, out += unit)
+                    memcpy(dest + out, src + in, unit);
+            }
+
+            in += unit;
+        }
+    }
+
+    return (out == length) ? 0 : 1;
+}
+
+
+/* Whether the unit at `i` starts a run */
+static bool isRun(const unsigned char *src, size_t i, size_t count, size_t unit)
+{
+    return i + 1 < count && !memcmp(src + i * unit, src + (i + 1) * unit, unit);
+}
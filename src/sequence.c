@@ -0,0 +1,228 @@
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libgroot/include/log.h"
+#include "percy/include/parser.h"
+
+#include "sequence.h"
+
+#include "arg_ranges.h"
+#include "ext_precision.h"
+#include "parameters.h"
+#include "process_args.h"
+#include "program_ctx.h"
+
+
+/* Minimum/maximum number of frames (frame numbers in filenames are 5 digits) */
+const size_t FRAME_COUNT_MIN = 1;
+const size_t FRAME_COUNT_MAX = 99999;
+
+/* Relative difference from a 2x zoom that a step between frames may have and
+ * still have its pixels reused. The pixels of the two frames are then a tiny
+ * fraction of a pixel apart, for any image that fits in memory
+ */
+static const long double DOUBLING_TOLERANCE = 1.0e-9L;
+
+/* Space for the magnification in a `-x` argument */
+#define MAGNIFICATION_STR_LEN_MAX 64
+
+
+static long double getStartMagnification(const char *centre);
+static char * createStepArgument(const char *centre, long double magnification);
+static int magnifyPlot(PlotCTX *p, char *arg);
+static int setFrameFilepath(Sequence *s, PlotCTX *p);
+
+
+Sequence * createSequence(void)
+{
+    Sequence *s = malloc(sizeof(*s));
+
+    if (s)
+        s->step = NULL;
+
+    return s;
+}
+
+
+/* Work out the step between frames from the centre and magnification of the
+ * first frame (the plot as given) and that of the last. Magnifications are
+ * spaced evenly, so each frame is the same zoom of the last. The plot is
+ * pointed at the image file of the first frame
+ */
+int initialiseSequence(Sequence *s, const ProgramCTX *ctx, PlotCTX *p)
+{
+    long double step;
+
+    if (!s || !ctx->centre || ctx->frames < 2)
+        return 1;
+
+    s->frames = ctx->frames;
+    s->frame = 0;
+
+    step = (ctx->zoomTo - getStartMagnification(ctx->centre)) / (long double) (s->frames - 1);
+
+    /* Each magnification is a zoom by 0.9 */
+    s->doubling = (fabsl(powl(0.9L, step) - 0.5L) < 0.5L * DOUBLING_TOLERANCE);
+
+    /* The argument magnifies the current frame, not the plot's initial range */
+    s->step = createStepArgument(ctx->centre, 1.0L + step);
+
+    if (!s->step)
+    {
+        logMessage(ERROR, "Could not allocate memory for the step between frames");
+        return 1;
+    }
+
+    strncpy(s->filepath, p->plotFilepath, sizeof(s->filepath));
+    s->filepath[sizeof(s->filepath) - 1] = '\0';
+
+    logMessage(INFO, "Plotting %zu frames, magnified by %Lg each%s", s->frames, step,
+               (s->doubling) ? " (a 2x zoom)" : "");
+
+    return setFrameFilepath(s, p);
+}
+
+
+/* Magnify the plot into the next frame. Returns 1 if there is none, or the
+ * plot could not be magnified
+ */
+int nextFrame(Sequence *s, PlotCTX *p)
+{
+    if (isLastFrame(s))
+        return 1;
+
+    ++(s->frame);
+
+    if (magnifyPlot(p, s->step))
+    {
+        logMessage(ERROR, "Could not magnify the plot into frame %zu", s->frame);
+        return 1;
+    }
+
+    return setFrameFilepath(s, p);
+}
+
+
+bool isLastFrame(const Sequence *s)
+{
+    return (s->frame + 1 >= s->frames);
+}
+
+
+/* Magnify the plot (the first frame) into the last frame of the sequence, if
+ * it is deeper, so the precision can be chosen for the deepest frame
+ */
+int magnifyToLastFrame(PlotCTX *p, const ProgramCTX *ctx)
+{
+    long double magnification;
+    char *arg;
+    int ret;
+
+    if (!ctx->centre)
+        return 1;
+
+    magnification = ctx->zoomTo - getStartMagnification(ctx->centre);
+
+    if (magnification <= 0.0L)
+        return 0;
+
+    arg = createStepArgument(ctx->centre, 1.0L + magnification);
+
+    if (!arg)
+        return 1;
+
+    ret = magnifyPlot(p, arg);
+    free(arg);
+
+    return ret;
+}
+
+
+void freeSequence(Sequence *s)
+{
+    if (s)
+        free(s->step);
+
+    free(s);
+}
+
+
+/* Magnification of a `-x` argument (1 if not given) */
+static long double getStartMagnification(const char *centre)
+{
+    const char *separator = strchr(centre, ',');
+
+    return (separator) ? strtold(separator + 1, NULL) : 1.0L;
+}
+
+
+/* Create a `-x` argument of the centre of `centre` (which may have its own
+ * magnification) and `magnification`
+ */
+static char * createStepArgument(const char *centre, long double magnification)
+{
+    size_t len = strcspn(centre, ",");
+    size_t size = len + MAGNIFICATION_STR_LEN_MAX;
+    char *arg = malloc(size);
+
+    if (arg)
+        snprintf(arg, size, "%.*s,%.*Lg", (int) len, centre, LDBL_DIG + 3, magnification);
+
+    return arg;
+}
+
+
+/* Magnify the plot by a `-x` argument, at the plot's precision */
+static int magnifyPlot(PlotCTX *p, char *arg)
+{
+    ParseErr argError = PARSE_EERR;
+
+    switch (p->precision)
+    {
+        case STD_PRECISION:
+            argError = magArg(p, arg, COMPLEX_MIN, COMPLEX_MAX, MAGNIFICATION_MIN, MAGNIFICATION_MAX);
+            break;
+        case EXT_PRECISION:
+            argError = magArgExt(p, arg, COMPLEX_MIN_EXT, COMPLEX_MAX_EXT, MAGNIFICATION_MIN, MAGNIFICATION_MAX);
+            break;
+        case DD_PRECISION:
+            argError = magArgDD(p, arg, COMPLEX_MIN_EXT, COMPLEX_MAX_EXT, MAGNIFICATION_MIN, MAGNIFICATION_MAX);
+            break;
+
+        #ifdef MP_PREC
+        case MUL_PRECISION:
+            argError = magArgMP(p, arg, NULL, NULL, MAGNIFICATION_MIN_EXT, MAGNIFICATION_MAX_EXT);
+            break;
+        #endif
+
+        default:
+            break;
+    }
+
+    return (argError == PARSE_SUCCESS) ? 0 : 1;
+}
+
+
+/* Point the plot at the image file of the current frame: the sequence's
+ * filepath with the frame number before its extension
+ */
+static int setFrameFilepath(Sequence *s, PlotCTX *p)
+{
+    const char *name = strrchr(s->filepath, '/');
+    const char *extension = strrchr((name) ? name : s->filepath, '.');
+    int len = (extension) ? (int) (extension - s->filepath) : (int) strlen(s->filepath);
+
+    if (snprintf(p->plotFilepath, sizeof(p->plotFilepath), "%.*s-%05zu%s", len, s->filepath, s->frame,
+                 (extension) ? extension : "") >= (int) sizeof(p->plotFilepath))
+    {
+        logMessage(ERROR, "Filepath of frame %zu is too long", s->frame);
+        return 1;
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -1,11 +1,9 @@
 #include <complex.h>
-#include <float.h>
-#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
-#include <stdio.h>
-
-#include "percy/include/parser.h"
+#include <string.h>
 
 #include "serialise.h"
 
@@ -13,6 +11,7 @@
 #include "colour.h"
 #include "ext_precision.h"
 #include "parameters.h"
+#include "protocol.h"
 
 #ifdef MP_PREC
 #include <mpfr.h>
@@ -20,218 +19,336 @@
 #endif
 
 
-#ifdef DBL_DECIMAL_DIG
-    #define SERIALISE_FLT_DIG (DBL_DECIMAL_DIG)
-#else
-    #ifdef DECIMAL_DIG
-        #define SERIALISE_FLT_DIG (DECIMAL_DIG)
-        #define SERIALISE_FLT_DIG_EXT (DECIMAL_DIG)
-    #else
-        #define SERIALISE_FLT_DIG (DBL_DIG + 3)
-        #define SERIALISE_FLT_DIG_EXT (LDBL_DIG + 3)
-    #endif
+/* Plot parameters are sent as the plot type, the minimum, maximum and constant
+ * values (in the precision of the plot), then the settings common to every
+ * precision
+ */
+static void serialisePlotSettings(WireBuffer *w, const PlotCTX *p);
+static int deserialisePlotSettings(PlotCTX *p, WireBuffer *w, uint8_t type);
+
+static void serialiseComplexDD(WireBuffer *w, ComplexDD z);
+static ComplexDD deserialiseComplexDD(WireBuffer *w);
+
+#ifdef MP_PREC
+static void serialiseComplexMP(WireBuffer *w, mpc_srcptr z);
+static void deserialiseComplexMP(mpc_ptr z, WireBuffer *w);
 #endif
 
 
 #ifndef MP_PREC
-int serialisePrecision(char *dest, size_t n, PrecisionMode prec)
+int serialisePrecision(WireBuffer *w, PrecisionMode prec)
 {
-    return snprintf(dest, n, "%u", prec);
+    putU8(w, (uint8_t) prec);
+
+    return (w->error) ? 1 : 0;
 }
 #else
-int serialisePrecision(char *dest, size_t n, PrecisionMode prec, mpfr_prec_t bits)
+int serialisePrecision(WireBuffer *w, PrecisionMode prec, mpfr_prec_t bits)
 {
-    return mpfr_snprintf(dest, n, "%u %Pu", prec, bits);
+    putU8(w, (uint8_t) prec);
+    putU64(w, (uint64_t) bits);
+
+    return (w->error) ? 1 : 0;
 }
 #endif
 
 
 #ifndef MP_PREC
-int deserialisePrecision(PrecisionMode *prec, char *src)
+int deserialisePrecision(PrecisionMode *prec, WireBuffer *w)
 {
-    char *endptr = src;
-    unsigned long tempUL = 0;
-    ParseErr ret = stringToULong(&tempUL, endptr, PREC_MODE_MIN, PREC_MODE_MAX, &endptr, BASE_DEC);
-    
-    *prec = tempUL;
+    uint8_t tempPrec = getU8(w);
+
+    if (w->error || tempPrec < PREC_MODE_MIN || tempPrec > PREC_MODE_MAX)
+        return 1;
+
+    *prec = tempPrec;
 
-    return (ret == PARSE_SUCCESS) ? 0 : 1;
+    return 0;
 }
 #else
-int deserialisePrecision(PrecisionMode *prec, mpfr_prec_t *bits, char *src)
+int deserialisePrecision(PrecisionMode *prec, mpfr_prec_t *bits, WireBuffer *w)
 {
-    char *endptr = src;
-    unsigned long tempUL = 0;
-    ParseErr ret = stringToULong(&tempUL, endptr, PREC_MODE_MIN, PREC_MODE_MAX, &endptr, BASE_DEC);
-    
-    if (ret != PARSE_EEND)
+    uint8_t tempPrec = getU8(w);
+    uint64_t tempBits = getU64(w);
+
+    if (w->error || tempPrec < PREC_MODE_MIN || tempPrec > PREC_MODE_MAX)
+        return 1;
+
+    if (tempBits < (uint64_t) MP_BITS_MIN || tempBits > (uint64_t) MP_BITS_MAX
+        || tempBits < MPFR_PREC_MIN || tempBits > MPFR_PREC_MAX)
+    {
+        return 1;
+    }
+
+    *prec = tempPrec;
+    *bits = (mpfr_prec_t) tempBits;
+
+    return 0;
+}
+#endif
+
+
+/* Precision mode and plot parameters, in the precision of the plot */
+int serialisePlot(WireBuffer *w, const PlotCTX *p)
+{
+    #ifndef MP_PREC
+    if (serialisePrecision(w, p->precision))
+        return 1;
+    #else
+    if (serialisePrecision(w, p->precision, mpSignificandSize))
         return 1;
+    #endif
+
+    switch (p->precision)
+    {
+        case STD_PRECISION:
+            return serialisePlotCTX(w, p);
+        case EXT_PRECISION:
+            return serialisePlotCTXExt(w, p);
+        case DD_PRECISION:
+            return serialisePlotCTXDD(w, p);
+
+        #ifdef MP_PREC
+        case MUL_PRECISION:
+            return serialisePlotCTXMP(w, p);
+        #endif
+
+        default:
+            return 1;
+    }
+}
 
-    *prec = tempUL;
 
-    ret = stringToULong(&tempUL, endptr, (unsigned long) MP_BITS_MIN, (unsigned long) MP_BITS_MAX, &endptr, BASE_DEC);
+/* Create a plot parameters object from its precision mode and parameters, as
+ * serialised by serialisePlot(). Returns 1 if they could not be read
+ */
+int deserialisePlot(PlotCTX **p, WireBuffer *w)
+{
+    int ret;
+    PrecisionMode precision;
 
-    if (tempUL < MPFR_PREC_MIN || tempUL > MPFR_PREC_MAX || ret != PARSE_SUCCESS)
+    #ifndef MP_PREC
+    if (deserialisePrecision(&precision, w))
         return 1;
+    #else
+    if (deserialisePrecision(&precision, &mpSignificandSize, w))
+        return 1;
+    #endif
 
-    *bits = (mpfr_prec_t) tempUL;
+    *p = createPlotCTX(precision);
+
+    if (!*p)
+        return 1;
+
+    switch (precision)
+    {
+        case STD_PRECISION:
+            ret = deserialisePlotCTX(*p, w);
+            break;
+        case EXT_PRECISION:
+            ret = deserialisePlotCTXExt(*p, w);
+            break;
+        case DD_PRECISION:
+            ret = deserialisePlotCTXDD(*p, w);
+            break;
+
+        #ifdef MP_PREC
+        case MUL_PRECISION:
+            ret = deserialisePlotCTXMP(*p, w);
+            break;
+        #endif
+
+        default:
+            ret = 1;
+            break;
+    }
+
+    if (ret)
+    {
+        freePlotCTX(*p);
+        *p = NULL;
+        return 1;
+    }
 
     return 0;
 }
-#endif
 
 
-int serialisePlotCTX(char *dest, size_t n, const PlotCTX *p)
+int serialisePlotCTX(WireBuffer *w, const PlotCTX *p)
 {
-    int ret = snprintf(dest, n,
-                       "%u"
-                       " %.*e+%.*ei"
-                       " %.*e+%.*ei"
-                       " %.*e+%.*ei"
-                       " %lu"
-                       " %zu %zu"
-                       " %u",
-                       p->type,
-                       SERIALISE_FLT_DIG, creal(p->minimum.c), SERIALISE_FLT_DIG, cimag(p->minimum.c),
-                       SERIALISE_FLT_DIG, creal(p->maximum.c), SERIALISE_FLT_DIG, cimag(p->maximum.c),
-                       SERIALISE_FLT_DIG, creal(p->c.c), SERIALISE_FLT_DIG, cimag(p->c.c),
-                       p->iterations,
-                       p->width, p->height,
-                       p->colour.scheme);
-    
-    return ret;
+    putU8(w, (uint8_t) p->type);
+    putDouble(w, creal(p->minimum.c));
+    putDouble(w, cimag(p->minimum.c));
+    putDouble(w, creal(p->maximum.c));
+    putDouble(w, cimag(p->maximum.c));
+    putDouble(w, creal(p->c.c));
+    putDouble(w, cimag(p->c.c));
+    serialisePlotSettings(w, p);
+
+    return (w->error) ? 1 : 0;
 }
 
 
-int serialisePlotCTXExt(char *dest, size_t n, const PlotCTX *p)
+int serialisePlotCTXExt(WireBuffer *w, const PlotCTX *p)
 {
-    int ret = snprintf(dest, n,
-                       "%u"
-                       " %.*Le+%.*Lei"
-                       " %.*Le+%.*Lei"
-                       " %.*Le+%.*Lei"
-                       " %lu"
-                       " %zu %zu"
-                       " %u",
-                       p->type,
-                       SERIALISE_FLT_DIG_EXT, creall(p->minimum.lc), SERIALISE_FLT_DIG_EXT, cimagl(p->minimum.lc),
-                       SERIALISE_FLT_DIG_EXT, creall(p->maximum.lc), SERIALISE_FLT_DIG_EXT, cimagl(p->maximum.lc),
-                       SERIALISE_FLT_DIG_EXT, creall(p->c.lc), SERIALISE_FLT_DIG_EXT, cimagl(p->c.lc),
-                       p->iterations,
-                       p->width, p->height,
-                       p->colour.scheme);
-    
-    return ret;
+    putU8(w, (uint8_t) p->type);
+    putLongDouble(w, creall(p->minimum.lc));
+    putLongDouble(w, cimagl(p->minimum.lc));
+    putLongDouble(w, creall(p->maximum.lc));
+    putLongDouble(w, cimagl(p->maximum.lc));
+    putLongDouble(w, creall(p->c.lc));
+    putLongDouble(w, cimagl(p->c.lc));
+    serialisePlotSettings(w, p);
+
+    return (w->error) ? 1 : 0;
 }
 
 
-#ifdef MP_PREC
-int serialisePlotCTXMP(char *dest, size_t n, const PlotCTX *p)
+/* Both parts of each double-double value are sent, so it arrives unrounded */
+int serialisePlotCTXDD(WireBuffer *w, const PlotCTX *p)
 {
-    int ret;
+    putU8(w, (uint8_t) p->type);
+    serialiseComplexDD(w, p->minimum.dd);
+    serialiseComplexDD(w, p->maximum.dd);
+    serialiseComplexDD(w, p->c.dd);
+    serialisePlotSettings(w, p);
 
-    char *min = mpc_get_str(10, 0, p->minimum.mpc, MP_COMPLEX_RND);
-    char *max = mpc_get_str(10, 0, p->maximum.mpc, MP_COMPLEX_RND);
-    char *c = mpc_get_str(10, 0, p->c.mpc, MP_COMPLEX_RND);
+    return (w->error) ? 1 : 0;
+}
 
-    if (!min || !max || !c)
-    {
-        mpc_free_str(min);
-        mpc_free_str(max);
-        mpc_free_str(c);
-        return -1;
-    }
 
-    ret = snprintf(dest, n,
-                   "%u"
-                   " %s"
-                   " %s"
-                   " %s"
-                   " %lu"
-                   " %zu %zu"
-                   " %u",
-                   p->type,
-                   min,
-                   max,
-                   c,
-                   p->iterations,
-                   p->width, p->height,
-                   p->colour.scheme);
-
-    mpc_free_str(min);
-    mpc_free_str(max);
-    mpc_free_str(c);
-    
-    return ret;
+#ifdef MP_PREC
+int serialisePlotCTXMP(WireBuffer *w, const PlotCTX *p)
+{
+    putU8(w, (uint8_t) p->type);
+    serialiseComplexMP(w, p->minimum.mpc);
+    serialiseComplexMP(w, p->maximum.mpc);
+    serialiseComplexMP(w, p->c.mpc);
+    serialisePlotSettings(w, p);
+
+    return (w->error) ? 1 : 0;
 }
 #endif
 
 
-int deserialisePlotCTX(PlotCTX *p, char *src)
+int deserialisePlotCTX(PlotCTX *p, WireBuffer *w)
 {
-    char *endptr = src;
-
-    unsigned long int tempPlotType = 0UL;
-    uintmax_t tempWidth = 0;
-    uintmax_t tempHeight = 0;
-    unsigned long int tempColourScheme = 0UL;
-
-    if (stringToULong(&tempPlotType, endptr, 0, ULONG_MAX, &endptr, BASE_DEC) != PARSE_EEND
-        || stringToComplex(&(p->minimum.c), endptr, CMPLX_MIN, CMPLX_MAX, &endptr) != PARSE_EEND
-        || stringToComplex(&(p->maximum.c), endptr, CMPLX_MIN, CMPLX_MAX, &endptr) != PARSE_EEND
-        || stringToComplex(&(p->c.c), endptr, CMPLX_MIN, CMPLX_MAX, &endptr) != PARSE_EEND
-        || stringToULong(&(p->iterations), endptr, 0, ULONG_MAX, &endptr, BASE_DEC) != PARSE_EEND
-        || stringToUIntMax(&tempWidth, endptr, WIDTH_MIN, WIDTH_MAX, &endptr, BASE_DEC) != PARSE_EEND
-        || stringToUIntMax(&tempHeight, endptr, HEIGHT_MIN, HEIGHT_MAX, &endptr, BASE_DEC) != PARSE_EEND
-        || stringToULong(&tempColourScheme, endptr, 0UL, ULONG_MAX, &endptr, BASE_DEC) != PARSE_SUCCESS)
+    uint8_t type = getU8(w);
+    double minRe = getDouble(w);
+    double minIm = getDouble(w);
+    double maxRe = getDouble(w);
+    double maxIm = getDouble(w);
+    double cRe = getDouble(w);
+    double cIm = getDouble(w);
+
+    if (!isfinite(minRe) || !isfinite(minIm) || !isfinite(maxRe) || !isfinite(maxIm)
+        || !isfinite(cRe) || !isfinite(cIm))
     {
         return 1;
     }
 
-    if (tempPlotType != PLOT_JULIA && tempPlotType != PLOT_MANDELBROT)
-        return 1;
+    p->minimum.c = minRe + minIm * I;
+    p->maximum.c = maxRe + maxIm * I;
+    p->c.c = cRe + cIm * I;
 
-    p->type = tempPlotType;
-    p->width = tempWidth;
-    p->height = tempHeight;
+    return deserialisePlotSettings(p, w, type);
+}
 
-    p->output = OUTPUT_NONE;
-    p->file = NULL;
 
-    if (initialiseColourScheme(&p->colour, tempColourScheme))
-        return 1;
+/* Long doubles are always finite on the wire */
+int deserialisePlotCTXExt(PlotCTX *p, WireBuffer *w)
+{
+    uint8_t type = getU8(w);
+    long double minRe = getLongDouble(w);
+    long double minIm = getLongDouble(w);
+    long double maxRe = getLongDouble(w);
+    long double maxIm = getLongDouble(w);
+    long double cRe = getLongDouble(w);
+    long double cIm = getLongDouble(w);
+
+    p->minimum.lc = minRe + minIm * I;
+    p->maximum.lc = maxRe + maxIm * I;
+    p->c.lc = cRe + cIm * I;
+
+    return deserialisePlotSettings(p, w, type);
+}
 
-    return 0;
+
+int deserialisePlotCTXDD(PlotCTX *p, WireBuffer *w)
+{
+    uint8_t type = getU8(w);
+
+    p->minimum.dd = deserialiseComplexDD(w);
+    p->maximum.dd = deserialiseComplexDD(w);
+    p->c.dd = deserialiseComplexDD(w);
+
+    return deserialisePlotSettings(p, w, type);
 }
 
 
-int deserialisePlotCTXExt(PlotCTX *p, char *src)
+#ifdef MP_PREC
+int deserialisePlotCTXMP(PlotCTX *p, WireBuffer *w)
 {
-    char *endptr = src;
-
-    unsigned long int tempPlotType = 0UL;
-    uintmax_t tempWidth = 0;
-    uintmax_t tempHeight = 0;
-    unsigned long int tempColourScheme = 0UL;
-
-    if (stringToULong(&tempPlotType, endptr, 0, ULONG_MAX, &endptr, BASE_DEC) != PARSE_EEND
-        || stringToComplexL(&(p->minimum.lc), endptr, LCMPLX_MIN, LCMPLX_MAX, &endptr) != PARSE_EEND
-        || stringToComplexL(&(p->maximum.lc), endptr, LCMPLX_MIN, LCMPLX_MAX, &endptr) != PARSE_EEND
-        || stringToComplexL(&(p->c.lc), endptr, LCMPLX_MIN, LCMPLX_MAX, &endptr) != PARSE_EEND
-        || stringToULong(&(p->iterations), endptr, ITERATIONS_MIN, ITERATIONS_MAX, &endptr, BASE_DEC) != PARSE_EEND
-        || stringToUIntMax(&tempWidth, endptr, WIDTH_MIN, WIDTH_MAX, &endptr, BASE_DEC) != PARSE_EEND
-        || stringToUIntMax(&tempHeight, endptr, HEIGHT_MIN, HEIGHT_MAX, &endptr, BASE_DEC) != PARSE_EEND
-        || stringToULong(&tempColourScheme, endptr, 0UL, ULONG_MAX, &endptr, BASE_DEC) != PARSE_SUCCESS)
+    uint8_t type = getU8(w);
+
+    deserialiseComplexMP(p->minimum.mpc, w);
+    deserialiseComplexMP(p->maximum.mpc, w);
+    deserialiseComplexMP(p->c.mpc, w);
+
+    return deserialisePlotSettings(p, w, type);
+}
+#endif
+
+
+static void serialisePlotSettings(WireBuffer *w, const PlotCTX *p)
+{
+    putU8(w, (uint8_t) p->formula);
+    putU8(w, (uint8_t) p->degree);
+    putU64(w, (uint64_t) p->iterations);
+    putU64(w, (uint64_t) p->width);
+    putU64(w, (uint64_t) p->height);
+    putU32(w, (uint32_t) p->colour.scheme);
+}
+
+
+/* Read the settings after the plot values, and check that the whole body has
+ * been read
+ */
+static int deserialisePlotSettings(PlotCTX *p, WireBuffer *w, uint8_t type)
+{
+    uint8_t formula = getU8(w);
+    uint8_t degree = getU8(w);
+    uint64_t tempIterations = getU64(w);
+    uint64_t tempWidth = getU64(w);
+    uint64_t tempHeight = getU64(w);
+    uint32_t tempColourScheme = getU32(w);
+
+    if (w->error || w->pos != w->size)
+        return 1;
+
+    if (type != PLOT_JULIA && type != PLOT_MANDELBROT)
+        return 1;
+
+    /* Only a Multibrot set has a degree other than 2 */
+    if (formula > FORMULA_TRICORN || degree < DEGREE_MIN || degree > DEGREE_MAX
+        || (formula != FORMULA_MULTIBROT && degree != 2))
     {
         return 1;
     }
 
-    if (tempPlotType != PLOT_JULIA && tempPlotType != PLOT_MANDELBROT)
+    if (tempIterations < ITERATIONS_MIN || tempIterations > ITERATIONS_MAX
+        || tempWidth < WIDTH_MIN || tempWidth > WIDTH_MAX
+        || tempHeight < HEIGHT_MIN || tempHeight > HEIGHT_MAX)
+    {
         return 1;
-    
-    p->type = tempPlotType;
-    p->width = tempWidth;
-    p->height = tempHeight;
+    }
+
+    p->type = type;
+    p->formula = (Formula) formula;
+    p->degree = degree;
+    p->iterations = (unsigned long) tempIterations;
+    p->width = (size_t) tempWidth;
+    p->height = (size_t) tempHeight;
 
     p->output = OUTPUT_NONE;
     p->file = NULL;
@@ -239,45 +356,76 @@ int deserialisePlotCTXExt(PlotCTX *p, char *src)
     if (initialiseColourScheme(&p->colour, tempColourScheme))
         return 1;
 
+    setColourDegree(&p->colour, p->degree);
+
     return 0;
 }
 
 
+static void serialiseComplexDD(WireBuffer *w, ComplexDD z)
+{
+    putDouble(w, z.re.hi);
+    putDouble(w, z.re.lo);
+    putDouble(w, z.im.hi);
+    putDouble(w, z.im.lo);
+}
+
+
+/* Non-finite parts flag an error in the buffer */
+static ComplexDD deserialiseComplexDD(WireBuffer *w)
+{
+    ComplexDD z;
+
+    z.re.hi = getDouble(w);
+    z.re.lo = getDouble(w);
+    z.im.hi = getDouble(w);
+    z.im.lo = getDouble(w);
+
+    if (!isfinite(z.re.hi) || !isfinite(z.re.lo) || !isfinite(z.im.hi) || !isfinite(z.im.lo))
+        w->error = true;
+
+    return z;
+}
+
+
 #ifdef MP_PREC
-int deserialisePlotCTXMP(PlotCTX *p, char *src)
+/* MPFR has no portable binary format, so multiple-precision values are sent as
+ * length-prefixed strings (including the terminator) in base 10, at enough
+ * digits to be read back exactly
+ */
+static void serialiseComplexMP(WireBuffer *w, mpc_srcptr z)
 {
-    char *endptr = src;
-
-    unsigned long int tempPlotType = 0UL;
-    uintmax_t tempWidth = 0;
-    uintmax_t tempHeight = 0;
-    unsigned long int tempColourScheme = 0UL;
-
-    if (stringToULong(&tempPlotType, endptr, 0, ULONG_MAX, &endptr, BASE_DEC) != PARSE_EEND
-        || mpc_strtoc(p->minimum.mpc, endptr, &endptr, 10, MP_COMPLEX_RND) == -1
-        || mpc_strtoc(p->maximum.mpc, endptr, &endptr, 10, MP_COMPLEX_RND) == -1
-        || mpc_strtoc(p->c.mpc, endptr, &endptr, 10, MP_COMPLEX_RND) == -1
-        || stringToULong(&(p->iterations), endptr, 0, ULONG_MAX, &endptr, BASE_DEC) != PARSE_EEND
-        || stringToUIntMax(&tempWidth, endptr, WIDTH_MIN, WIDTH_MAX, &endptr, BASE_DEC) != PARSE_EEND
-        || stringToUIntMax(&tempHeight, endptr, HEIGHT_MIN, HEIGHT_MAX, &endptr, BASE_DEC) != PARSE_EEND
-        || stringToULong(&tempColourScheme, endptr, 0UL, ULONG_MAX, &endptr, BASE_DEC) != PARSE_SUCCESS)
+    char *str = mpc_get_str(10, 0, z, MP_COMPLEX_RND);
+    size_t n;
+
+    if (!str)
     {
-        return 1;
+        w->error = true;
+        return;
     }
 
-    if (tempPlotType != PLOT_JULIA && tempPlotType != PLOT_MANDELBROT)
-        return 1;
+    n = strlen(str) + 1;
 
-    p->type = tempPlotType;
-    p->width = tempWidth;
-    p->height = tempHeight;
+    putU32(w, (uint32_t) n);
+    putBytes(w, str, n);
 
-    p->output = OUTPUT_NONE;
-    p->file = NULL;
+    mpc_free_str(str);
+}
 
-    if (initialiseColourScheme(&p->colour, tempColourScheme))
-        return 1;
 
-    return 0;
+static void deserialiseComplexMP(mpc_ptr z, WireBuffer *w)
+{
+    uint32_t n = getU32(w);
+    const unsigned char *str = getBytes(w, n);
+    char *endptr;
+
+    if (!str || !n || str[n - 1] != '\0')
+    {
+        w->error = true;
+        return;
+    }
+
+    if (mpc_strtoc(z, (const char *) str, &endptr, 10, MP_COMPLEX_RND) == -1 || *endptr != '\0')
+        w->error = true;
 }
 #endif
@@ -0,0 +1,643 @@
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "libgroot/include/log.h"
+
+#include "server.h"
+
+#include "getopt_error.h"
+
+
+static void * controlThread(void *serverInfo);
+static int openControlSocket(Server *s, const char *path);
+static void acceptClient(Server *s);
+static void readClient(Server *s, int i);
+static void takeRequest(Server *s, int i, char *line);
+static void queueJob(Server *s, int i, const char *options);
+static int splitOptions(ServerJob *job);
+static void dropClient(Server *s, int i);
+static void reply(const Server *s, int i, const char *format, ...);
+
+
+/* Create a server. The socket is opened and the control thread started by
+ * initialiseServer(). Waits for jobs are timed on the monotonic clock, so are
+ * not thrown by changes to the time of day
+ */
+Server * createServer(void)
+{
+    pthread_condattr_t attr;
+    Server *s = malloc(sizeof(*s));
+
+    if (!s)
+        return NULL;
+
+    if (pthread_mutex_init(&(s->mutex), NULL))
+    {
+        free(s);
+        return NULL;
+    }
+
+    if (pthread_condattr_init(&attr))
+    {
+        pthread_mutex_destroy(&(s->mutex));
+        free(s);
+        return NULL;
+    }
+
+    if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) || pthread_cond_init(&(s->queued), &attr))
+    {
+        pthread_condattr_destroy(&attr);
+        pthread_mutex_destroy(&(s->mutex));
+        free(s);
+        return NULL;
+    }
+
+    pthread_condattr_destroy(&attr);
+
+    s->fd = -1;
+    s->wake = -1;
+    s->path[0] = '\0';
+    s->current = NULL;
+    s->turn = 0;
+    s->next = 1;
+    s->running = false;
+    s->shutdown = false;
+
+    for (int i = 0; i < SERVER_CLIENTS_MAX; ++i)
+    {
+        s->clients[i].fd = -1;
+        s->clients[i].read = 0;
+        s->clients[i].head = NULL;
+        s->clients[i].tail = NULL;
+        s->clients[i].jobs = 0;
+    }
+
+    return s;
+}
+
+
+/* Listen for clients on the Unix domain socket at `path`, and start the
+ * control thread
+ */
+int initialiseServer(Server *s, const char *path)
+{
+    if (!s)
+        return 1;
+
+    if (openControlSocket(s, path))
+        return 1;
+
+    s->wake = eventfd(0, EFD_NONBLOCK);
+
+    if (s->wake < 0)
+    {
+        logMessage(ERROR, "Could not create wake event of control thread");
+        return 1;
+    }
+
+    if (pthread_create(&(s->pid), NULL, controlThread, s))
+    {
+        logMessage(ERROR, "Control thread could not be created");
+        return 1;
+    }
+
+    s->running = true;
+
+    logMessage(INFO, "Serving render jobs on \'%s\'", s->path);
+
+    return 0;
+}
+
+
+/* Wait up to `timeout` seconds for the next job, taken from each client with
+ * jobs queued in turn. Returns 1 if shutdown has been asked for and every job
+ * queued has been taken, and 2 if the wait timed out
+ */
+int waitServerJob(Server *s, ServerJob **job, unsigned int timeout)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += (time_t) timeout;
+
+    pthread_mutex_lock(&(s->mutex));
+
+    while (1)
+    {
+        for (int n = 0; n < SERVER_CLIENTS_MAX; ++n)
+        {
+            int i = (s->turn + n) % SERVER_CLIENTS_MAX;
+            ServerClient *c = &(s->clients[i]);
+
+            if (!c->head)
+                continue;
+
+            *job = c->head;
+            c->head = (*job)->next;
+            --(c->jobs);
+
+            if (!c->head)
+                c->tail = NULL;
+
+            s->turn = (i + 1) % SERVER_CLIENTS_MAX;
+            s->current = *job;
+
+            pthread_mutex_unlock(&(s->mutex));
+
+            return 0;
+        }
+
+        if (s->shutdown)
+        {
+            pthread_mutex_unlock(&(s->mutex));
+            return 1;
+        }
+
+        if (pthread_cond_timedwait(&(s->queued), &(s->mutex), &deadline) == ETIMEDOUT)
+        {
+            pthread_mutex_unlock(&(s->mutex));
+            return 2;
+        }
+    }
+}
+
+
+/* Tell the client of a job taken by waitServerJob() (if still connected)
+ * whether it was rendered, and free it
+ */
+void finishServerJob(Server *s, ServerJob *job, int ret)
+{
+    pthread_mutex_lock(&(s->mutex));
+
+    if (job->client >= 0)
+        reply(s, job->client, "%s %" PRIu64, (ret) ? "failed" : "done", job->id);
+
+    s->current = NULL;
+
+    pthread_mutex_unlock(&(s->mutex));
+
+    free(job);
+}
+
+
+/* Stop the control thread, close the socket and every client, and free the
+ * server with any jobs still queued
+ */
+void freeServer(Server *s)
+{
+    if (s)
+    {
+        if (s->running)
+        {
+            uint64_t event = 1;
+
+            if (write(s->wake, &event, sizeof(event)) < 0 || pthread_join(s->pid, NULL))
+                logMessage(WARNING, "Control thread could not be harvested");
+        }
+
+        for (int i = 0; i < SERVER_CLIENTS_MAX; ++i)
+        {
+            dropClient(s, i);
+
+            while (s->clients[i].head)
+            {
+                ServerJob *job = s->clients[i].head;
+
+                s->clients[i].head = job->next;
+                free(job);
+            }
+        }
+
+        if (s->fd >= 0)
+        {
+            close(s->fd);
+            unlink(s->path);
+        }
+
+        if (s->wake >= 0)
+            close(s->wake);
+
+        pthread_cond_destroy(&(s->queued));
+        pthread_mutex_destroy(&(s->mutex));
+    }
+
+    free(s);
+}
+
+
+/* Body of the control thread - accept clients and read their requests until
+ * woken to exit. Clients are only connected or dropped by this thread, so it
+ * reads their sockets without the lock
+ */
+static void * controlThread(void *serverInfo)
+{
+    Server *s = serverInfo;
+
+    while (1)
+    {
+        struct pollfd fds[SERVER_CLIENTS_MAX + 2];
+        int slots[SERVER_CLIENTS_MAX];
+        int n = 0;
+
+        fds[0].fd = s->wake;
+        fds[0].events = POLLIN;
+        fds[1].fd = s->fd;
+        fds[1].events = POLLIN;
+
+        for (int i = 0; i < SERVER_CLIENTS_MAX; ++i)
+        {
+            if (s->clients[i].fd < 0)
+                continue;
+
+            fds[n + 2].fd = s->clients[i].fd;
+            fds[n + 2].events = POLLIN;
+            slots[n++] = i;
+        }
+
+        if (poll(fds, (nfds_t) n + 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            logMessage(ERROR, "Could not wait on control socket");
+            break;
+        }
+
+        if (fds[0].revents)
+            break;
+
+        if (fds[1].revents & POLLIN)
+            acceptClient(s);
+
+        for (int j = 0; j < n; ++j)
+        {
+            if (fds[j + 2].revents)
+                readClient(s, slots[j]);
+        }
+    }
+
+    /* No more jobs can come, so the jobs queued are the last */
+    pthread_mutex_lock(&(s->mutex));
+    s->shutdown = true;
+    pthread_cond_broadcast(&(s->queued));
+    pthread_mutex_unlock(&(s->mutex));
+
+    return NULL;
+}
+
+
+/* Bind and listen on the socket. A socket left at the path by a server that
+ * did not close it is replaced, but not one still being served on, nor a file
+ * of any other kind
+ */
+static int openControlSocket(Server *s, const char *path)
+{
+    struct sockaddr_un addr =
+    {
+        .sun_family = AF_UNIX
+    };
+
+    struct stat st;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        logMessage(ERROR, "Socket path \'%s\' is too long", path);
+        return 1;
+    }
+
+    strcpy(addr.sun_path, path);
+
+    s->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (s->fd < 0)
+    {
+        logMessage(ERROR, "Control socket could not be created");
+        return 1;
+    }
+
+    if (!lstat(path, &st) && S_ISSOCK(st.st_mode))
+    {
+        if (!connect(s->fd, (struct sockaddr *) &addr, sizeof(addr)))
+        {
+            logMessage(ERROR, "Socket \'%s\' is already being served on", path);
+            close(s->fd);
+            s->fd = -1;
+            return 1;
+        }
+
+        logMessage(WARNING, "Replacing stale socket \'%s\'", path);
+        unlink(path);
+    }
+
+    if (bind(s->fd, (struct sockaddr *) &addr, sizeof(addr)))
+    {
+        logMessage(ERROR, "Control socket could not be bound to \'%s\' - %s", path, strerror(errno));
+        close(s->fd);
+        s->fd = -1;
+        return 1;
+    }
+
+    /* The socket is only unlinked once bound, as it is then the server's own */
+    strcpy(s->path, path);
+
+    if (listen(s->fd, SERVER_CLIENTS_MAX))
+    {
+        logMessage(ERROR, "Could not listen on control socket");
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static void acceptClient(Server *s)
+{
+    int fd = accept(s->fd, NULL, NULL);
+
+    if (fd < 0)
+    {
+        logMessage(WARNING, "Could not accept client of control socket");
+        return;
+    }
+
+    pthread_mutex_lock(&(s->mutex));
+
+    for (int i = 0; i < SERVER_CLIENTS_MAX; ++i)
+    {
+        if (s->clients[i].fd >= 0)
+            continue;
+
+        s->clients[i].fd = fd;
+        s->clients[i].read = 0;
+
+        logMessage(INFO, "Client %d connected to control socket", i);
+        pthread_mutex_unlock(&(s->mutex));
+
+        return;
+    }
+
+    pthread_mutex_unlock(&(s->mutex));
+
+    logMessage(WARNING, "Control socket has %d clients already - refusing client", SERVER_CLIENTS_MAX);
+    close(fd);
+}
+
+
+/* Read what client `i` has sent, and take each request completed, one per
+ * line. A client sending a line too long to be a request is dropped
+ */
+static void readClient(Server *s, int i)
+{
+    ServerClient *c = &(s->clients[i]);
+    ssize_t readBytes = recv(c->fd, c->line + c->read, sizeof(c->line) - c->read, 0);
+    char *start, *end;
+
+    if (readBytes <= 0)
+    {
+        if (readBytes < 0 && errno == EINTR)
+            return;
+
+        pthread_mutex_lock(&(s->mutex));
+        dropClient(s, i);
+        pthread_mutex_unlock(&(s->mutex));
+        return;
+    }
+
+    c->read += (size_t) readBytes;
+    start = c->line;
+
+    pthread_mutex_lock(&(s->mutex));
+
+    while ((end = memchr(start, '\n', c->read - (size_t) (start - c->line))))
+    {
+        *end = '\0';
+        takeRequest(s, i, start);
+        start = end + 1;
+    }
+
+    c->read -= (size_t) (start - c->line);
+    memmove(c->line, start, c->read);
+
+    if (c->read == sizeof(c->line))
+    {
+        reply(s, i, "error request too long");
+        dropClient(s, i);
+    }
+
+    pthread_mutex_unlock(&(s->mutex));
+}
+
+
+/* Carry out a request of client `i`: `render OPTIONS...` queues a job,
+ * replied to once queued and again once rendered, and `shutdown` has the
+ * server exit once every job queued is rendered
+ */
+static void takeRequest(Server *s, int i, char *line)
+{
+    size_t len = strlen(line);
+    char *command, *options;
+
+    if (len && line[len - 1] == '\r')
+        line[len - 1] = '\0';
+
+    command = line + strspn(line, " \t");
+    options = command + strcspn(command, " \t");
+
+    if (*options)
+        *(options++) = '\0';
+
+    if (!(*command))
+        return;
+
+    if (!strcmp(command, "render"))
+    {
+        queueJob(s, i, options);
+    }
+    else if (!strcmp(command, "shutdown"))
+    {
+        logMessage(INFO, "Client %d asked for shutdown", i);
+        s->shutdown = true;
+        pthread_cond_broadcast(&(s->queued));
+        reply(s, i, "ok");
+    }
+    else
+    {
+        reply(s, i, "error unknown request \'%s\'", command);
+    }
+}
+
+
+static void queueJob(Server *s, int i, const char *options)
+{
+    ServerClient *c = &(s->clients[i]);
+    ServerJob *job;
+
+    if (s->shutdown)
+    {
+        reply(s, i, "error shutting down");
+        return;
+    }
+
+    if (c->jobs >= SERVER_CLIENT_JOBS_MAX)
+    {
+        reply(s, i, "error %d jobs queued already", SERVER_CLIENT_JOBS_MAX);
+        return;
+    }
+
+    job = malloc(sizeof(*job));
+
+    if (!job)
+    {
+        logMessage(ERROR, "Memory allocation failed");
+        reply(s, i, "error out of memory");
+        return;
+    }
+
+    strcpy(job->line, options);
+
+    if (splitOptions(job))
+    {
+        reply(s, i, "error options could not be split");
+        free(job);
+        return;
+    }
+
+    job->id = (s->next)++;
+    job->client = i;
+    job->next = NULL;
+
+    if (c->tail)
+        c->tail->next = job;
+    else
+        c->head = job;
+
+    c->tail = job;
+    ++(c->jobs);
+
+    logMessage(INFO, "Client %d queued job %" PRIu64, i, job->id);
+    reply(s, i, "queued %" PRIu64, job->id);
+
+    pthread_cond_signal(&(s->queued));
+}
+
+
+/* Split the options of a job at whitespace, in place, as a shell would words
+ * in single or double quotes. Returns 1 if a quote is left open or there are
+ * too many options
+ */
+static int splitOptions(ServerJob *job)
+{
+    char *src = job->line;
+
+    job->argc = 0;
+    job->argv[(job->argc)++] = programName;
+
+    while (1)
+    {
+        char *dest;
+        char quote = '\0';
+
+        while (isspace((unsigned char) *src))
+            ++src;
+
+        if (!(*src))
+            break;
+
+        if (job->argc > SERVER_ARGS_MAX)
+            return 1;
+
+        dest = src;
+        job->argv[(job->argc)++] = dest;
+
+        for (; *src && (quote || !isspace((unsigned char) *src)); ++src)
+        {
+            if (*src == quote)
+                quote = '\0';
+            else if (!quote && (*src == '\'' || *src == '\"'))
+                quote = *src;
+            else
+                *(dest++) = *src;
+        }
+
+        if (quote)
+            return 1;
+
+        if (*src)
+            ++src;
+
+        *dest = '\0';
+    }
+
+    job->argv[job->argc] = NULL;
+
+    return 0;
+}
+
+
+/* Close client `i`. Its jobs are still rendered, with no one to tell, so a
+ * client need not wait for them. They stay in its slot's queue, which a client
+ * taking the slot shares
+ */
+static void dropClient(Server *s, int i)
+{
+    ServerClient *c = &(s->clients[i]);
+
+    if (c->fd < 0)
+        return;
+
+    for (ServerJob *job = c->head; job; job = job->next)
+        job->client = -1;
+
+    if (s->current && s->current->client == i)
+        s->current->client = -1;
+
+    close(c->fd);
+
+    c->fd = -1;
+    c->read = 0;
+
+    logMessage(INFO, "Client %d disconnected from control socket", i);
+}
+
+
+/* Send client `i` a line, without waiting on a client not reading its
+ * replies. A client gone is noticed by the control thread
+ */
+static void reply(const Server *s, int i, const char *format, ...)
+{
+    char line[SERVER_LINE_LEN_MAX];
+    va_list args;
+    int len;
+
+    va_start(args, format);
+    len = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+
+    if (len < 0)
+        return;
+
+    if ((size_t) len > sizeof(line) - 2)
+        len = (int) sizeof(line) - 2;
+
+    line[len++] = '\n';
+
+    if (send(s->clients[i].fd, line, (size_t) len, MSG_DONTWAIT | MSG_NOSIGNAL) != len)
+        logMessage(DEBUG, "Could not reply to client %d", i);
+}
\ No newline at end of file
@@ -0,0 +1,300 @@
+#include <complex.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libgroot/include/log.h"
+
+#include "simd.h"
+
+#include "mandelbrot_parameters.h"
+
+
+/* Runtime dispatch is only needed where the instruction set varies by machine */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define SIMD_X86_DISPATCH
+#endif
+
+/* Native vector width, in doubles, of the generic kernel */
+#if defined(__AVX512F__)
+    #define SIMD_GENERIC_LANES 8
+#elif defined(__AVX__)
+    #define SIMD_GENERIC_LANES 4
+#else
+    #define SIMD_GENERIC_LANES 2
+#endif
+
+
+/* State of every lane and of the batch of pixels being fed through them. Lane
+ * values are kept in arrays and only held in vector registers by the kernels,
+ * so the code shared between kernels is independent of the instruction set
+ */
+typedef struct Lanes
+{
+    double zr[SIMD_LANES], zi[SIMD_LANES];  /* Current function value */
+    double cr[SIMD_LANES], ci[SIMD_LANES];  /* Constant added each iteration */
+    double nv[SIMD_LANES];                  /* Iteration count (past the maximum once found periodic) */
+    double sr[SIMD_LANES], si[SIMD_LANES];  /* Value saved for periodicity checking */
+    double checks[SIMD_LANES];              /* Checks since the value was saved */
+    double limit[SIMD_LANES];               /* Checks before the value is next saved */
+    size_t lane[SIMD_LANES];                /* Pixel index held by each lane */
+    unsigned int width;                     /* Number of lanes in use */
+    unsigned int active;                    /* Number of lanes holding a pixel */
+    unsigned long *n;                       /* Output iteration counts */
+    complex *z;                             /* Output final function values */
+    const complex *c;                       /* Values of the pixels in the batch */
+    size_t count;                           /* Number of pixels in the batch */
+    size_t next;                            /* Next pixel to be loaded into a lane */
+    complex constant;                       /* Julia set constant */
+    bool julia;                             /* Whether a Julia set (else Mandelbrot set) */
+    Formula formula;                        /* Function iterated */
+    unsigned int degree;                    /* Degree of a Multibrot set */
+    unsigned long max;                      /* Maximum iteration count */
+    uintmax_t iterations;                   /* Iterations run on the batch */
+} Lanes;
+
+typedef void (*SIMDKernel)(Lanes *s);
+
+
+/* Number of iterations between checks for retired lanes */
+static const int LANE_CHECK_INTERVAL = 8;
+
+/* Iteration count of a lane holding no pixel (never reaches the maximum) */
+static const double LANE_EMPTY_COUNT = -1.0e300;
+
+static const size_t LANE_EMPTY = SIZE_MAX;
+
+
+static SIMDKernel kernel = NULL;
+static SIMDExtension extension = SIMD_GENERIC;
+
+
+static uintmax_t iterateBatch(unsigned long *n, complex *z, const complex *c, size_t count, complex constant,
+                              bool julia, Formula formula, unsigned int degree, unsigned long max);
+
+static void fillLane(Lanes *s, unsigned int l);
+static void retireLane(Lanes *s, unsigned int l);
+
+
+/* Kernels for each instruction set */
+#define SIMD_KERNEL iterateGeneric
+#define SIMD_KERNEL_FORMULA iterateGenericFormula
+#define SIMD_KERNEL_LANES SIMD_GENERIC_LANES
+#include "simd_kernel.h"
+
+#ifdef SIMD_X86_DISPATCH
+#pragma GCC push_options
+#pragma GCC target ("avx2,fma")
+#define SIMD_KERNEL iterateAVX2
+#define SIMD_KERNEL_FORMULA iterateAVX2Formula
+#define SIMD_KERNEL_LANES 4
+#include "simd_kernel.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target ("avx512f,avx512dq")
+#define SIMD_KERNEL iterateAVX512
+#define SIMD_KERNEL_FORMULA iterateAVX512Formula
+#define SIMD_KERNEL_LANES 8
+#include "simd_kernel.h"
+#pragma GCC pop_options
+#endif
+
+/* Select the widest vector extension supported by the processor. Must be
+ * called before any threads use the kernels
+ */
+SIMDExtension initialiseSIMD(void)
+{
+    char extStr[16];
+
+    kernel = iterateGeneric;
+    extension = SIMD_GENERIC;
+
+    #ifdef SIMD_X86_DISPATCH
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+    {
+        kernel = iterateAVX512;
+        extension = SIMD_AVX512;
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        kernel = iterateAVX2;
+        extension = SIMD_AVX2;
+    }
+    #endif
+
+    if (!getSIMDString(extStr, extension, sizeof(extStr)))
+        logMessage(DEBUG, "Using %s escape-time kernel", extStr);
+
+    return extension;
+}
+
+
+/* Run the Mandelbrot set function of the formula on `count` pixels, adding
+ * the iterations run to `iterations`
+ */
+void mandelbrotSIMD(unsigned long *n, complex *z, const complex *c, size_t count, Formula formula,
+                    unsigned int degree, unsigned long max, uintmax_t *iterations)
+{
+    *iterations += iterateBatch(n, z, c, count, 0.0, false, formula, degree, max);
+}
+
+
+/* Run the Julia set function of the formula on `count` pixels, adding the
+ * iterations run to `iterations`
+ */
+void juliaSIMD(unsigned long *n, complex *z, const complex *c, size_t count, complex constant, Formula formula,
+               unsigned int degree, unsigned long max, uintmax_t *iterations)
+{
+    *iterations += iterateBatch(n, z, c, count, constant, true, formula, degree, max);
+}
+
+
+int getSIMDString(char *dest, SIMDExtension ext, size_t n)
+{
+    const char *extStr;
+
+    switch (ext)
+    {
+        case SIMD_GENERIC:
+            extStr = "generic";
+            break;
+        case SIMD_AVX2:
+            extStr = "AVX2";
+            break;
+        case SIMD_AVX512:
+            extStr = "AVX-512";
+            break;
+        default:
+            return 1;
+    }
+
+    strncpy(dest, extStr, n);
+    dest[n - 1] = '\0';
+
+    return 0;
+}
+
+
+/* Iterate the batch, returning the iterations run. Pixels in the main or
+ * secondary bulb, or found to be periodic, are given the maximum count but
+ * only count the iterations they actually ran
+ */
+static uintmax_t iterateBatch(unsigned long *n, complex *z, const complex *c, size_t count, complex constant,
+                              bool julia, Formula formula, unsigned int degree, unsigned long max)
+{
+    Lanes s =
+    {
+        .active = 0,
+        .n = n,
+        .z = z,
+        .c = c,
+        .count = count,
+        .next = 0,
+        .constant = constant,
+        .julia = julia,
+        .formula = formula,
+        .degree = degree,
+        .max = max,
+        .iterations = 0
+    };
+
+    if (!kernel)
+        kernel = iterateGeneric;
+
+    kernel(&s);
+
+    return s.iterations;
+}
+
+
+/* Load the next pixel that needs iterating into a lane. Pixels that need no
+ * iterations are written straight to the output
+ */
+static void fillLane(Lanes *s, unsigned int l)
+{
+    s->lane[l] = LANE_EMPTY;
+    s->nv[l] = LANE_EMPTY_COUNT;
+    s->zr[l] = s->zi[l] = s->cr[l] = s->ci[l] = 0.0;
+    s->sr[l] = s->si[l] = s->checks[l] = 0.0;
+    s->limit[l] = 1.0;
+
+    while (s->next < s->count)
+    {
+        size_t i = (s->next)++;
+
+        double re = creal(s->c[i]);
+        double im = cimag(s->c[i]);
+        double cdot = re * re + im * im;
+
+        if (s->julia)
+        {
+            if (cdot >= ESCAPE_RADIUS_SQR || s->max == 0)
+            {
+                s->n[i] = 0;
+                s->z[i] = re + im * I;
+                continue;
+            }
+
+            s->zr[l] = re;
+            s->zi[l] = im;
+            s->cr[l] = creal(s->constant);
+            s->ci[l] = cimag(s->constant);
+        }
+        else
+        {
+            /* Ignore main and secondary bulb of z^2 + c */
+            if (s->formula == FORMULA_MANDELBROT
+                && (256.0 * cdot * cdot - 96.0 * cdot + 32.0 * re - 3.0 < 0.0
+                    || 16.0 * (cdot + 2.0 * re + 1.0) - 1.0 < 0.0))
+            {
+                s->n[i] = s->max;
+                s->z[i] = 0.0;
+                continue;
+            }
+
+            s->cr[l] = re;
+            s->ci[l] = im;
+        }
+
+        s->sr[l] = s->zr[l];
+        s->si[l] = s->zi[l];
+        s->checks[l] = 0.0;
+        s->limit[l] = 1.0;
+
+        s->nv[l] = 0.0;
+        s->lane[l] = i;
+        ++(s->active);
+
+        return;
+    }
+}
+
+
+/* Write out the pixel held by a finished lane and refill it. A lane found to
+ * be periodic holds the iterations it ran past the maximum count
+ */
+static void retireLane(Lanes *s, unsigned int l)
+{
+    size_t i = s->lane[l];
+    double maxCount = (double) s->max;
+
+    if (s->nv[l] > maxCount)
+    {
+        s->n[i] = s->max;
+        s->iterations += (uintmax_t) (s->nv[l] - maxCount - 1.0);
+    }
+    else
+    {
+        s->n[i] = (unsigned long) s->nv[l];
+        s->iterations += s->n[i];
+    }
+
+    s->z[i] = s->zr[l] + s->zi[l] * I;
+    --(s->active);
+
+    fillLane(s, l);
+}
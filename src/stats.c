@@ -0,0 +1,61 @@
+#include <time.h>
+
+#include "stats.h"
+
+
+ThreadStats createThreadStats(void)
+{
+    ThreadStats s =
+    {
+        .pixels = 0,
+        .iterations = 0,
+        .escaped = 0,
+        .filled = 0,
+        .reused = 0,
+        .samples = 0,
+        .tiles = 0,
+        .busy = 0.0
+    };
+
+    return s;
+}
+
+
+ConnectionStats createConnectionStats(void)
+{
+    ConnectionStats s =
+    {
+        .rows = 0,
+        .bytes = 0,
+        .units = 0,
+        .turnaround = 0.0,
+        .idle = 0.0,
+        .idleSince = -1.0
+    };
+
+    return s;
+}
+
+
+/* Add a connection's statistics to a total, counting any time it has been
+ * idle up to `now`
+ */
+void addConnectionStats(ConnectionStats *total, const ConnectionStats *s, double now)
+{
+    total->rows += s->rows;
+    total->bytes += s->bytes;
+    total->units += s->units;
+    total->turnaround += s->turnaround;
+    total->idle += s->idle + ((s->idleSince >= 0.0 && now > s->idleSince) ? now - s->idleSince : 0.0);
+}
+
+
+/* Seconds since an arbitrary point, unaffected by changes to the clock */
+double getMonotonicTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
\ No newline at end of file
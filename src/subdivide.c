@@ -0,0 +1,186 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "subdivide.h"
+
+
+/* Rectangles with fewer interior pixels than this are computed in full */
+static const size_t SUBDIVISION_AREA_MIN = 64;
+
+
+static int plotRectangle(Subdivision *s, size_t x, size_t y, size_t width, size_t height);
+static int fillRectangle(Subdivision *s, size_t x, size_t y, size_t width, size_t height);
+static int subdivideRectangle(Subdivision *s, size_t x, size_t y, size_t width, size_t height);
+static bool isBorderUnescaped(const Subdivision *s, size_t x, size_t y, size_t width, size_t height);
+
+
+/* Create a Subdivision object able to hold tiles of up to width * height px */
+Subdivision * createSubdivision(size_t width, size_t height)
+{
+    Subdivision *s;
+
+    if (width == 0 || height == 0 || width > SIZE_MAX / height)
+        return NULL;
+
+    s = malloc(sizeof(*s));
+
+    if (!s)
+        return NULL;
+
+    s->capacity = width * height;
+    s->status = malloc(s->capacity * sizeof(*(s->status)));
+
+    if (!s->status)
+    {
+        free(s);
+        return NULL;
+    }
+
+    s->plot = NULL;
+    s->fill = NULL;
+    s->data = NULL;
+
+    return s;
+}
+
+
+void initialiseSubdivision(Subdivision *s, PlotRectangle plot, FillRectangle fill, void *data)
+{
+    s->plot = plot;
+    s->fill = fill;
+    s->data = data;
+}
+
+
+/* Plot the tile [xStart, xEnd) * [yStart, yEnd) by Mariani-Silver subdivision.
+ * The border of the tile is computed, then the tile is recursively split in
+ * two along its longer side. Any rectangle whose border is entirely unescaped
+ * must be unescaped inside, as the sets are connected, so it is filled
+ * without computing its interior
+ */
+int subdivideTile(Subdivision *s, size_t xStart, size_t xEnd, size_t yStart, size_t yEnd)
+{
+    size_t width = xEnd - xStart;
+    size_t height = yEnd - yStart;
+
+    if (width * height > s->capacity)
+        return 1;
+
+    s->xStart = xStart;
+    s->yStart = yStart;
+    s->width = width;
+
+    /* Too small to have an interior */
+    if (width < 3 || height < 3)
+        return plotRectangle(s, 0, 0, width, height);
+
+    /* Top and bottom rows, then the left and right columns between them */
+    if (plotRectangle(s, 0, 0, width, 1) || plotRectangle(s, 0, height - 1, width, 1)
+        || plotRectangle(s, 0, 1, 1, height - 2) || plotRectangle(s, width - 1, 1, 1, height - 2))
+    {
+        return 1;
+    }
+
+    return subdivideRectangle(s, 0, 0, width, height);
+}
+
+
+void freeSubdivision(Subdivision *s)
+{
+    if (s)
+        free(s->status);
+
+    free(s);
+}
+
+
+/* Plot every pixel of a rectangle (relative to the tile) */
+static int plotRectangle(Subdivision *s, size_t x, size_t y, size_t width, size_t height)
+{
+    if (width == 0 || height == 0)
+        return 0;
+
+    return s->plot(s->data, s->xStart + x, s->yStart + y, width, height, &s->status[y * s->width + x], s->width);
+}
+
+
+/* Fill every pixel of a rectangle (relative to the tile) as unescaped, so the
+ * status of every pixel of the tile is known once it is plotted
+ */
+static int fillRectangle(Subdivision *s, size_t x, size_t y, size_t width, size_t height)
+{
+    for (size_t row = y; row < y + height; ++row)
+        memset(&s->status[row * s->width + x], SUBDIVISION_UNESCAPED, width);
+
+    return s->fill(s->data, s->xStart + x, s->yStart + y, width, height);
+}
+
+
+/* Complete a rectangle (relative to the tile) whose border is already plotted */
+static int subdivideRectangle(Subdivision *s, size_t x, size_t y, size_t width, size_t height)
+{
+    size_t split;
+
+    if (width < 3 || height < 3)
+        return 0;
+
+    /* Fill the interior of a wholly unescaped rectangle */
+    if (isBorderUnescaped(s, x, y, width, height))
+        return fillRectangle(s, x + 1, y + 1, width - 2, height - 2);
+
+    if ((width - 2) * (height - 2) < SUBDIVISION_AREA_MIN)
+        return plotRectangle(s, x + 1, y + 1, width - 2, height - 2);
+
+    /* Plot the line dividing the rectangle in two, then complete each half */
+    if (width >= height)
+    {
+        split = width / 2;
+
+        if (plotRectangle(s, x + split, y + 1, 1, height - 2)
+            || subdivideRectangle(s, x, y, split + 1, height)
+            || subdivideRectangle(s, x + split, y, width - split, height))
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        split = height / 2;
+
+        if (plotRectangle(s, x + 1, y + split, width - 2, 1)
+            || subdivideRectangle(s, x, y, width, split + 1)
+            || subdivideRectangle(s, x, y + split, width, height - split))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+static bool isBorderUnescaped(const Subdivision *s, size_t x, size_t y, size_t width, size_t height)
+{
+    const unsigned char *top = &s->status[y * s->width + x];
+    const unsigned char *bottom = &s->status[(y + height - 1) * s->width + x];
+
+    for (size_t i = 0; i < width; ++i)
+    {
+        if (top[i] != SUBDIVISION_UNESCAPED || bottom[i] != SUBDIVISION_UNESCAPED)
+            return false;
+    }
+
+    for (size_t row = y + 1; row < y + height - 1; ++row)
+    {
+        if (s->status[row * s->width + x] != SUBDIVISION_UNESCAPED
+            || s->status[row * s->width + x + width - 1] != SUBDIVISION_UNESCAPED)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,253 @@
+#include <complex.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "libgroot/include/log.h"
+
+#include "symmetry.h"
+
+#include "array.h"
+#include "colour.h"
+#include "ext_precision.h"
+#include "parameters.h"
+
+
+/* Distance (in pixels) the grid may be from symmetric and still be mirrored */
+#define SYMMETRY_TOLERANCE 1e-6L
+
+/* Largest pixel swapped when reversing a row */
+#define PIXEL_SIZE_MAX 8
+
+
+static int getBounds(long double *reMin, long double *reMax, long double *imMin, long double *imMax,
+                     const PlotCTX *p);
+static int getAxis(size_t *axis, long double max, long double min, size_t n);
+static void reverseRow(char *row, const Block *block);
+static unsigned char reverseBits(unsigned char x);
+
+
+/* Find the rows of the plot that are the image of earlier rows. Returns 1 if
+ * the plot has no symmetry the pixels lie on
+ */
+int getSymmetry(Symmetry *s, const PlotCTX *p)
+{
+    long double reMin, reMax, imMin, imMax;
+
+    if (getBounds(&reMin, &reMax, &imMin, &imMax, p) || getAxis(&(s->axis), imMax, imMin, p->height))
+        return 1;
+
+    s->rotate = (p->type == PLOT_JULIA);
+
+    /* The Burning Ship folds z into one quadrant, so its Mandelbrot set is not
+     * mirrored. A Julia set of z^d + c only survives a half turn for even d
+     */
+    if ((!s->rotate && p->formula == FORMULA_BURNING_SHIP) || (s->rotate && p->degree % 2))
+        return 1;
+
+    /* A half turn takes each column to another only if they are centred */
+    if (s->rotate)
+    {
+        size_t columnAxis;
+
+        if (getAxis(&columnAxis, reMax, reMin, p->width) || columnAxis != p->width - 1)
+            return 1;
+    }
+
+    s->first = s->axis / 2 + 1;
+    s->last = (s->axis < p->height - 1) ? s->axis : p->height - 1;
+
+    if (s->first > s->last)
+        return 1;
+
+    logMessage(INFO, "Rows %zu to %zu are %s of rows %zu to %zu", s->first, s->last,
+               (s->rotate) ? "rotations" : "reflections", s->axis - s->last, s->axis - s->first);
+
+    return 0;
+}
+
+
+/* Set the rows of the block to be copied from their image rather than
+ * plotted. Without `readable`, rows written before the block cannot be read
+ * back, so only rows mirrored within the block are copied
+ */
+void setBlockMirror(Block *block, const Symmetry *s, bool readable)
+{
+    size_t start = block->id * block->rows;
+    size_t rows = (block->remainder) ? block->remainderRows : block->rows;
+    size_t first = (s->first > start) ? s->first : start;
+    size_t last = (s->last < start + rows - 1) ? s->last : start + rows - 1;
+
+    if (!readable)
+        last = (s->axis < start) ? 0 : (last < s->axis - start) ? last : s->axis - start;
+
+    if (first > last)
+    {
+        block->mirrorStart = 0;
+        block->mirrorEnd = 0;
+        return;
+    }
+
+    block->mirrorStart = first - start;
+    block->mirrorEnd = last - start + 1;
+}
+
+
+/* Whether image row `y` is copied from its image in the block of `rows` rows it
+ * falls in, as setBlockMirror() sets that block's rows
+ */
+bool isMirroredImageRow(const Symmetry *s, size_t y, size_t rows, bool readable)
+{
+    size_t start = y / rows * rows;
+
+    if (y < s->first || y > s->last)
+        return false;
+
+    return (readable || (s->axis >= start && y <= s->axis - start));
+}
+
+
+/* Copy the mirrored rows of a plotted block from their image. Rows before the
+ * block are read from the image file, where the first row is at `offset` -
+ * every earlier block must be written and flushed
+ */
+int mirrorBlock(Block *block, const Symmetry *s, FILE *f, off_t offset)
+{
+    size_t start = block->id * block->rows;
+
+    for (size_t y = block->mirrorStart; y < block->mirrorEnd; ++y)
+    {
+        char *row = block->array + y * block->rowSize;
+        size_t src = s->axis - (start + y);
+
+        if (src >= start)
+        {
+            memcpy(row, block->array + (src - start) * block->rowSize, block->rowSize);
+        }
+        else if (pread(fileno(f), row, block->rowSize, offset + (off_t) (src * block->rowSize))
+                 != (ssize_t) block->rowSize)
+        {
+            logMessage(ERROR, "Row %zu could not be read back from image file", src);
+            return 1;
+        }
+
+        if (s->rotate)
+            reverseRow(row, block);
+    }
+
+    return 0;
+}
+
+
+/* Get the corners of the plot, at the highest precision pixels can be placed
+ * by mirroring. Multiple-precision plots are not mirrored
+ */
+static int getBounds(long double *reMin, long double *reMax, long double *imMin, long double *imMax,
+                     const PlotCTX *p)
+{
+    switch (p->precision)
+    {
+        case STD_PRECISION:
+            *reMin = creal(p->minimum.c);
+            *reMax = creal(p->maximum.c);
+            *imMin = cimag(p->minimum.c);
+            *imMax = cimag(p->maximum.c);
+            break;
+        case EXT_PRECISION:
+            *reMin = creall(p->minimum.lc);
+            *reMax = creall(p->maximum.lc);
+            *imMin = cimagl(p->minimum.lc);
+            *imMax = cimagl(p->maximum.lc);
+            break;
+        case DD_PRECISION:
+            *reMin = (long double) p->minimum.dd.re.hi + p->minimum.dd.re.lo;
+            *reMax = (long double) p->maximum.dd.re.hi + p->maximum.dd.re.lo;
+            *imMin = (long double) p->minimum.dd.im.hi + p->minimum.dd.im.lo;
+            *imMax = (long double) p->maximum.dd.im.hi + p->maximum.dd.im.lo;
+            break;
+        default:
+            return 1;
+    }
+
+    return 0;
+}
+
+
+/* Get the sum of the indices of two of `n` pixels from `max` down to `min`
+ * that lie either side of 0. Returns 1 if pixels are not placed evenly about 0
+ */
+static int getAxis(size_t *axis, long double max, long double min, size_t n)
+{
+    long double px, sum;
+
+    if (n < 2 || !(max > min))
+        return 1;
+
+    px = (max - min) / (n - 1);
+    sum = 2 * max / px;
+
+    if (!(sum >= 1) || sum > 2 * (long double) (n - 1) || fabsl(sum - roundl(sum)) > SYMMETRY_TOLERANCE)
+        return 1;
+
+    *axis = (size_t) roundl(sum);
+
+    return 0;
+}
+
+
+/* Reverse the order of the pixels of a row, in any bit depth */
+static void reverseRow(char *row, const Block *block)
+{
+    unsigned char *px = (unsigned char *) row;
+    size_t width = block->parameters->width;
+
+    if (block->parameters->colour.depth < CHAR_BIT && block->parameters->colour.depth != BIT_DEPTH_ASCII)
+    {
+        /* Whole bytes of pixels - the width is a multiple of CHAR_BIT */
+        size_t n = block->rowSize;
+
+        for (size_t i = 0; i < n / 2; ++i)
+        {
+            unsigned char tmp = reverseBits(px[i]);
+
+            px[i] = reverseBits(px[n - 1 - i]);
+            px[n - 1 - i] = tmp;
+        }
+
+        if (n % 2)
+            px[n / 2] = reverseBits(px[n / 2]);
+    }
+    else
+    {
+        size_t size = block->memSize;
+
+        if (size > PIXEL_SIZE_MAX)
+            return;
+
+        for (size_t i = 0, j = width - 1; i < j; ++i, --j)
+        {
+            unsigned char tmp[PIXEL_SIZE_MAX];
+
+            memcpy(tmp, px + i * size, size);
+            memcpy(px + i * size, px + j * size, size);
+            memcpy(px + j * size, tmp, size);
+        }
+    }
+}
+
+
+static unsigned char reverseBits(unsigned char x)
+{
+    unsigned char r = 0;
+
+    for (int i = 0; i < CHAR_BIT; ++i, x >>= 1)
+        r = (unsigned char) ((r << 1) | (x & 1));
+
+    return r;
+}
\ No newline at end of file